@@ -79,11 +79,12 @@ extern longclock_t cib_call_time;
 extern enum cib_errors cib_status;
 
 
-int send_via_callback_channel(xmlNode *msg, const char *token);
+int send_via_callback_channel(
+	xmlNode *msg, const char *token, cib_version_t *snapshot);
 
 enum cib_errors cib_process_command(
-	xmlNode *request, xmlNode **reply,
-	xmlNode **cib_diff, gboolean privileged);
+	xmlNode *request, xmlNode **reply, xmlNode **cib_diff,
+	gboolean privileged, cib_version_t **snapshot);
 
 gboolean cib_common_callback(IPC_Channel *channel, cib_client_t *cib_client,
 			     gboolean force_synchronous, gboolean privileged);
@@ -328,7 +329,7 @@ cib_common_callback(IPC_Channel *channel, cib_client_t *cib_client,
 
 static void
 do_local_notify(xmlNode *notify_src, const char *client_id,
-		gboolean sync_reply, gboolean from_peer) 
+		gboolean sync_reply, gboolean from_peer, cib_version_t *snapshot) 
 {
 	/* send callback to originating child */
 	cib_client_t *client_obj = NULL;
@@ -357,7 +358,7 @@ do_local_notify(xmlNode *notify_src, const char *client_id,
 		if(sync_reply) {
 			client_id = client_obj->id;
 		}
-		local_rc = send_via_callback_channel(notify_src, client_id);
+		local_rc = send_via_callback_channel(notify_src, client_id, snapshot);
 	} 
 	
 	if(local_rc != cib_ok && client_obj != NULL) {
@@ -577,10 +578,12 @@ cib_process_request(
 	gboolean needs_reply = TRUE;
 	gboolean local_notify = FALSE;
 	gboolean needs_forward = FALSE;
+	gboolean broadcast = FALSE;
 	gboolean global_update = crm_is_true(crm_element_value(request, F_CIB_GLOBAL_UPDATE));
 	
 	xmlNode *op_reply = NULL;
 	xmlNode *result_diff = NULL;
+	cib_version_t *snapshot = NULL;
 
 	enum cib_errors rc = cib_ok;
 	const char *op         = crm_element_value(request, F_CIB_OPERATION);
@@ -654,9 +657,18 @@ cib_process_request(
 		int level = LOG_INFO;
 		const char *section = crm_element_value(request, F_CIB_SECTION);
 		
+		/* Only local IPC clients can be sent a cached reply.
+		 * Peers and remote clients get a normal one.
+		 */
+		cib_version_t **reply_from = NULL;
+		if(from_peer == FALSE && cib_client != NULL
+		   && crm_str_eq(cib_client->channel_name, "remote", FALSE) == FALSE) {
+			reply_from = &snapshot;
+		}
+		
 		cib_num_local++;
 		rc = cib_process_command(
-			request, &op_reply, &result_diff, privileged);
+			request, &op_reply, &result_diff, privileged, reply_from);
 
 		if(global_update) {
 		    switch(rc) {
@@ -708,9 +720,9 @@ cib_process_request(
 	if(local_notify) {
 		const char *client_id = crm_element_value(request, F_CIB_CLIENTID);
 		if(process == FALSE) {
-			do_local_notify(request, client_id, call_options & cib_sync_call, from_peer);
+			do_local_notify(request, client_id, call_options & cib_sync_call, from_peer, NULL);
 		} else {
-			do_local_notify(op_reply, client_id, call_options & cib_sync_call, from_peer);
+			do_local_notify(op_reply, client_id, call_options & cib_sync_call, from_peer, snapshot);
 		}
 	}
 
@@ -725,6 +737,7 @@ cib_process_request(
 		  && result_diff != NULL
 		  && !(call_options & cib_inhibit_bcast)) {
 		send_peer_reply(request, result_diff, originator, TRUE);
+		broadcast = TRUE;
 		
 	} else if(call_options & cib_discard_reply) {
 		crm_debug_4("Caller isn't interested in reply");
@@ -745,9 +758,14 @@ cib_process_request(
 
 		send_peer_reply(op_reply, result_diff, originator, FALSE);
 	}
+
+	if(rc == cib_ok && is_update) {
+		cib_diff_history_update(request, result_diff, broadcast);
+	}
 	
 	free_xml(op_reply);
 	free_xml(result_diff);
+	cib_version_unref(snapshot);
 
 	return;	
 }
@@ -786,14 +804,21 @@ cib_construct_reply(xmlNode *request, xmlNode *output, int rc)
 	return reply;
 }
 
+/*
+ * If snapshot is non-NULL and the request is a query for the whole CIB,
+ * the reply is built without F_CIB_CALLDATA and *snapshot is set to a
+ * reference on the version that was read.  The caller sends the version's
+ * cached calldata with the reply and releases the reference.
+ */
 enum cib_errors
-cib_process_command(xmlNode *request, xmlNode **reply,
-		    xmlNode **cib_diff, gboolean privileged)
+cib_process_command(xmlNode *request, xmlNode **reply, xmlNode **cib_diff,
+		    gboolean privileged, cib_version_t **snapshot)
 {
     xmlNode *input       = NULL;
     xmlNode *output      = NULL;
     xmlNode *result_cib  = NULL;
     xmlNode *current_cib = NULL;
+    cib_version_t *version = NULL;
 	
     int call_type    = 0;
     int call_options = 0;
@@ -835,11 +860,30 @@ cib_process_command(xmlNode *request, xmlNode **reply,
 	goto done;
 		
     } else if(cib_op_modifies(call_type) == FALSE) {
+	/* Read from a pinned version: the output stays valid even if
+	 * processing the request causes the CIB to be replaced
+	 */
+	version = cib_version_ref();
+	if(version == NULL) {
+	    crm_err("No CIB to process %s against", op);
+	    rc = cib_NOOBJECT;
+	    goto done;
+	}
+	current_cib = version->cib;
+	
 	rc = cib_perform_op(op, call_options, cib_op_func(call_type), TRUE,
 			    section, request, input, FALSE, &config_changed,
 			    current_cib, &result_cib, NULL, &output);
 
 	CRM_CHECK(result_cib == NULL, free_xml(result_cib));
+
+	if(snapshot != NULL && rc == cib_ok
+	   && output == current_cib && safe_str_eq(op, CIB_OP_QUERY)) {
+	    crm_debug_3("Replying from the cached copy of CIB version %p", version);
+	    *snapshot = version;
+	    version = NULL;
+	    output = NULL;
+	}
 	goto done;
     }	
 
@@ -906,6 +950,11 @@ cib_process_command(xmlNode *request, xmlNode **reply,
     } else {
 	free_xml(result_cib);    
     }
+
+    if(the_cib != NULL) {
+	/* the index went to result_cib, get it back if that was rejected */
+	cib_index_enable(the_cib);
+    }
     
     if((call_options & cib_inhibit_notify) == 0) {
 	const char *call_id = crm_element_value(request, F_CIB_CALLID);
@@ -950,11 +999,13 @@ cib_process_command(xmlNode *request, xmlNode **reply,
     if(call_type >= 0) {
 	cib_op_cleanup(call_type, call_options, &input, &output);
     }
+    cib_version_unref(version);
     return rc;
 }
 
+/* snapshot, if any, supplies the F_CIB_CALLDATA field of msg */
 int
-send_via_callback_channel(xmlNode *msg, const char *token) 
+send_via_callback_channel(xmlNode *msg, const char *token, cib_version_t *snapshot) 
 {
 	cib_client_t *hash_client = NULL;
 	enum cib_errors rc = cib_ok;
@@ -993,9 +1044,14 @@ send_via_callback_channel(xmlNode *msg, const char *token)
 	    crm_debug_3("Delivering reply to client %s (%s)",
 			token, hash_client->channel_name);
 	    if (crm_str_eq(hash_client->channel_name, "remote", FALSE)) {
+		if(snapshot != NULL) {
+		    add_message_xml(msg, F_CIB_CALLDATA, snapshot->cib);
+		}
 		cib_send_remote_msg(hash_client->channel, msg, hash_client->encrypted);
 		
-	    } else if(send_ipc_message(hash_client->channel, msg) == FALSE) {
+	    } else if(send_ipc_message_adv(
+			  hash_client->channel, msg,
+			  snapshot?cib_version_calldata(snapshot):NULL) == FALSE) {
 		crm_warn("Delivery of reply to client %s/%s failed",
 			 hash_client->name, token);
 		rc = cib_reply_failed;
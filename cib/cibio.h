@@ -28,6 +28,7 @@
 #include <fcntl.h>
 
 #include <crm/common/xml.h>
+#include <crm/cib.h>
 
 extern gboolean initialized;
 extern xmlNode *the_cib;
@@ -38,6 +39,30 @@ extern xmlNode *status_search;
     
 extern xmlNode *get_the_CIB(void);
 
+/*
+ * A committed CIB.  Versions are never modified: every write builds a
+ * new one and activateCibXml() publishes it.  Holding a reference keeps
+ * a version (and its cached query reply) alive after it is replaced.
+ */
+typedef struct cib_version_s 
+{
+	xmlNode *cib;
+	int refs;
+	crm_xml_blob_t *calldata;
+} cib_version_t;
+
+extern cib_version_t *cib_version_ref(void);
+extern void cib_version_unref(cib_version_t *version);
+extern const crm_xml_blob_t *cib_version_calldata(cib_version_t *version);
+
+extern gboolean cib_snapshots_enabled;
+extern gboolean write_cib_snapshot(gpointer user_data);
+extern enum cib_errors publish_cib_snapshot(void);
+
+/* See index.c */
+extern void cib_index_init(void);
+extern void cib_index_enable(xmlNode *xml);
+
 extern int initializeCib(xmlNode *cib);
 extern gboolean uninitializeCib(void);
 extern xmlNode *createEmptyCib(void);
@@ -19,6 +19,10 @@
 #define CIB_MESSAGES__H
 
 #include <crm/cib_ops.h>
+
+/* Wraps the diffs sent in reply to a versioned sync request */
+#define CIB_TAG_DIFF_SET "cib_diff_set"
+
 extern xmlNode *createCibRequest(
 	gboolean isLocal, const char *operation, const char *section,
 	const char *verbose, xmlNode *data);
@@ -40,6 +44,10 @@ extern enum cib_errors cib_process_ping(
 	const char *op, int options, const char *section, xmlNode *req, xmlNode *input,
 	xmlNode *existing_cib, xmlNode **result_cib, xmlNode **answer);
 
+extern enum cib_errors cib_process_snapshot(
+	const char *op, int options, const char *section, xmlNode *req, xmlNode *input,
+	xmlNode *existing_cib, xmlNode **result_cib, xmlNode **answer);
+
 extern enum cib_errors cib_process_readwrite(
 	const char *op, int options, const char *section, xmlNode *req, xmlNode *input,
 	xmlNode *existing_cib, xmlNode **result_cib, xmlNode **answer);
@@ -64,4 +72,7 @@ extern enum cib_errors cib_process_delete_absolute(
 	const char *op, int options, const char *section, xmlNode *req, xmlNode *input,
 	xmlNode *existing_cib, xmlNode **result_cib, xmlNode **answer);
 
+extern void cib_diff_history_update(
+	xmlNode *request, xmlNode *result_diff, gboolean broadcast);
+
 #endif
@@ -207,6 +207,7 @@ static cib_operation_t cib_server_ops[] = {
     {"cib_shutdown_req",FALSE, TRUE, FALSE, cib_prepare_sync, cib_cleanup_sync,   cib_process_shutdown_req},
     {CRM_OP_QUIT,      FALSE, TRUE,  FALSE, cib_prepare_none, cib_cleanup_none,   cib_process_quit},
     {CRM_OP_PING,      FALSE, FALSE, FALSE, cib_prepare_none, cib_cleanup_output, cib_process_ping},
+    {CIB_OP_SNAPSHOT,  FALSE, FALSE, FALSE, cib_prepare_none, cib_cleanup_none,   cib_process_snapshot},
 };
 
 enum cib_errors
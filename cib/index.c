@@ -0,0 +1,359 @@
+/*
+ * Copyright (C) 2004 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+#include <crm_internal.h>
+
+#include <sys/param.h>
+#include <stdio.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <libxml/xpathInternals.h>
+
+#include <crm/crm.h>
+#include <crm/msg_xml.h>
+#include <crm/common/xml.h>
+#include <crm/common/util.h>
+#include <cibio.h>
+
+/*
+ * Id index
+ *
+ * (element name, id) -> elements in document order.  Each element is
+ * also filed under ("*", id) for wildcard lookups.
+ *
+ * Only documents passed to cib_index_enable() are indexed and the index
+ * is built the first time it is used.  After that the xml functions
+ * report elements that are added or re-id'd (see
+ * crm_xml_index_functions_t), libxml2 reports the ones it frees, and
+ * cib_perform_op() hands the index on to the copy that becomes the next
+ * version of the CIB, so it is never rebuilt for a new version.
+ *
+ * Each indexed element points at its entry (via node->_private) and the
+ * lists hold entries rather than elements, so moving the index to a copy
+ * only has to repoint the entries.
+ */
+typedef struct cib_index_entry_s
+{
+	xmlNode *node;
+} cib_index_entry_t;
+
+typedef struct cib_index_s
+{
+	GHashTable *ids;	/* NULL until first used */
+	int count;
+} cib_index_t;
+
+/* Returns the index of xml's document if it has been built */
+static cib_index_t *
+cib_index_get(xmlNode *xml)
+{
+	cib_index_t *index = NULL;
+	if(xml != NULL && xml->doc != NULL) {
+	    index = xml->doc->_private;
+	}
+	if(index != NULL && index->ids == NULL) {
+	    return NULL;
+	}
+	return index;
+}
+
+static void
+cib_index_file(
+	GHashTable *ids, const char *name, const char *id,
+	cib_index_entry_t *entry, gboolean in_order)
+{
+	GListPtr iter = NULL;
+	GListPtr matches = NULL;
+	gpointer key = crm_concat(name, id, ' ');
+	gpointer orig_key = NULL;
+
+	if(g_hash_table_lookup_extended(ids, key, &orig_key, (gpointer*)&matches) == FALSE) {
+	    g_hash_table_insert(ids, key, g_list_append(NULL, entry));
+	    return;
+	}
+	crm_free(key);
+
+	iter = g_list_last(matches);
+	if(in_order
+	   || xmlXPathCmpNodes(((cib_index_entry_t*)iter->data)->node, entry->node) > 0) {
+	    /* appending leaves the head (and the table) untouched */
+	    matches = g_list_append(matches, entry);
+	    return;
+	}
+
+	for(iter = matches; iter != NULL; iter = iter->next) {
+	    cib_index_entry_t *existing = iter->data;
+	    if(xmlXPathCmpNodes(entry->node, existing->node) > 0) {
+		break;
+	    }
+	}
+
+	iter = g_list_insert_before(matches, iter, entry);
+	if(iter != matches) {
+	    g_hash_table_steal(ids, orig_key);
+	    g_hash_table_insert(ids, orig_key, iter);
+	}
+}
+
+static void
+cib_index_unfile(GHashTable *ids, const char *name, const char *id, cib_index_entry_t *entry)
+{
+	GListPtr head = NULL;
+	GListPtr matches = NULL;
+	gpointer orig_key = NULL;
+	char *key = crm_concat(name, id, ' ');
+	gboolean found = g_hash_table_lookup_extended(
+	    ids, key, &orig_key, (gpointer*)&matches);
+
+	crm_free(key);
+	CRM_CHECK(found, return);
+
+	head = g_list_remove(matches, entry);
+	if(head != matches) {
+	    g_hash_table_steal(ids, orig_key);
+	    if(head == NULL) {
+		crm_free(orig_key);
+	    } else {
+		g_hash_table_insert(ids, orig_key, head);
+	    }
+	}
+}
+
+static void
+cib_index_add_node(cib_index_t *index, xmlNode *xml, gboolean in_order)
+{
+	const char *id = ID(xml);
+	cib_index_entry_t *entry = NULL;
+
+	if(id == NULL) {
+	    return;
+	}
+
+	crm_malloc0(entry, sizeof(cib_index_entry_t));
+	entry->node = xml;
+	xml->_private = entry;
+	index->count++;
+
+	cib_index_file(index->ids, crm_element_name(xml), id, entry, in_order);
+	cib_index_file(index->ids, "*", id, entry, in_order);
+}
+
+static void
+cib_index_remove_node(cib_index_t *index, xmlNode *xml)
+{
+	cib_index_entry_t *entry = xml->_private;
+
+	if(entry == NULL) {
+	    return;
+	}
+
+	CRM_CHECK(entry->node == xml, return);
+	cib_index_unfile(index->ids, crm_element_name(xml), ID(xml), entry);
+	cib_index_unfile(index->ids, "*", ID(xml), entry);
+
+	xml->_private = NULL;
+	index->count--;
+	crm_free(entry);
+}
+
+static void
+cib_index_add(cib_index_t *index, xmlNode *xml, gboolean in_order)
+{
+	cib_index_add_node(index, xml, in_order);
+	xml_child_iter(xml, child, cib_index_add(index, child, in_order));
+}
+
+static void
+cib_index_added(xmlNode *xml)
+{
+	cib_index_t *index = cib_index_get(xml);
+	if(index != NULL) {
+	    cib_index_add(index, xml, FALSE);
+	}
+}
+
+static void
+cib_index_id_changing(xmlNode *xml)
+{
+	cib_index_t *index = cib_index_get(xml);
+	if(index != NULL) {
+	    cib_index_remove_node(index, xml);
+	}
+}
+
+static void
+cib_index_id_changed(xmlNode *xml)
+{
+	cib_index_t *index = cib_index_get(xml);
+	if(index != NULL) {
+	    cib_index_add_node(index, xml, FALSE);
+	}
+}
+
+static void
+cib_index_free_list(gpointer data)
+{
+	g_list_free((GListPtr)data);
+}
+
+void
+cib_index_enable(xmlNode *xml)
+{
+	cib_index_t *index = NULL;
+	CRM_CHECK(xml != NULL && xml->doc != NULL, return);
+
+	if(xml->doc->_private == NULL) {
+	    crm_malloc0(index, sizeof(cib_index_t));
+	    xml->doc->_private = index;
+	}
+}
+
+static void
+cib_index_release(xmlNode *xml)
+{
+	cib_index_entry_t *entry = xml->_private;
+	if(entry != NULL) {
+	    xml->_private = NULL;
+	    crm_free(entry);
+	}
+	xml_child_iter(xml, child, cib_index_release(child));
+}
+
+static void
+cib_index_drop(xmlDoc *doc)
+{
+	cib_index_t *index = doc->_private;
+	if(index == NULL) {
+	    return;
+	}
+
+	doc->_private = NULL;
+	if(index->ids != NULL) {
+	    cib_index_release(xmlDocGetRootElement(doc));
+	    g_hash_table_destroy(index->ids);
+	}
+	crm_free(index);
+}
+
+/* Registered with xmlDeregisterNodeDefault(), libxml2 calls it for
+ * every node it frees (a document before its children, an element
+ * before its attributes and children)
+ */
+static void
+cib_index_freed(xmlNode *xml)
+{
+	if(xml->type == XML_DOCUMENT_NODE) {
+	    cib_index_drop((xmlDoc*)xml);
+
+	} else if(xml->type == XML_ELEMENT_NODE && xml->_private != NULL) {
+	    cib_index_id_changing(xml);
+	}
+}
+
+static void
+cib_index_move_tree(xmlNode *from, xmlNode *to)
+{
+	xmlNode *from_child = NULL;
+	xmlNode *to_child = NULL;
+	cib_index_entry_t *entry = from->_private;
+
+	if(entry != NULL) {
+	    entry->node = to;
+	    to->_private = entry;
+	    from->_private = NULL;
+	}
+
+	to_child = to->children;
+	for(from_child = from->children; from_child != NULL; from_child = from_child->next) {
+	    CRM_CHECK(to_child != NULL && to_child->type == from_child->type, return);
+	    if(from_child->type == XML_ELEMENT_NODE) {
+		cib_index_move_tree(from_child, to_child);
+	    }
+	    to_child = to_child->next;
+	}
+}
+
+static gboolean
+cib_index_move(xmlNode *from, xmlNode *to)
+{
+	cib_index_t *index = NULL;
+
+	if(from == NULL || from->doc == NULL || from->doc->_private == NULL) {
+	    return FALSE;
+	}
+
+	CRM_CHECK(to != NULL && to->doc != NULL && to->doc->_private == NULL, return FALSE);
+	CRM_CHECK(from == xmlDocGetRootElement(from->doc), return FALSE);
+	CRM_CHECK(to == xmlDocGetRootElement(to->doc), return FALSE);
+
+	index = from->doc->_private;
+	from->doc->_private = NULL;
+	to->doc->_private = index;
+
+	if(index->ids != NULL) {
+	    cib_index_move_tree(from, to);
+	}
+	return TRUE;
+}
+
+static gboolean
+cib_index_lookup(xmlNode *xml, const char *name, const char *id, GListPtr *matches)
+{
+	char *key = NULL;
+	cib_index_t *index = NULL;
+
+	*matches = NULL;
+	if(xml == NULL || xml->doc == NULL || xml->doc->_private == NULL) {
+	    return FALSE;
+	}
+
+	index = xml->doc->_private;
+	if(index->ids == NULL) {
+	    index->ids = g_hash_table_new_full(
+		g_str_hash, g_str_equal, g_hash_destroy_str, cib_index_free_list);
+	    cib_index_add(index, xmlDocGetRootElement(xml->doc), TRUE);
+	    crm_debug_2("Indexed %d elements", index->count);
+	}
+
+	key = crm_concat(name, id, ' ');
+	slist_iter(
+	    entry, cib_index_entry_t, g_hash_table_lookup(index->ids, key), lpc,
+	    *matches = g_list_append(*matches, entry->node);
+	    );
+	crm_free(key);
+	return TRUE;
+}
+
+static crm_xml_index_functions_t cib_index_fns = {
+	cib_index_added,
+	cib_index_id_changing,
+	cib_index_id_changed,
+	cib_index_lookup,
+	cib_index_move,
+};
+
+void
+cib_index_init(void)
+{
+	set_xml_index_functions(&cib_index_fns);
+	xmlDeregisterNodeDefault(cib_index_freed);
+}
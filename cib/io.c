@@ -74,6 +74,7 @@ xmlNode *status_search = NULL;
 
 extern gboolean cib_writes_enabled;
 extern GTRIGSource *cib_writer;
+extern crm_trigger_t *cib_snapshot_writer;
 extern enum cib_errors cib_status;
 
 int set_connected_peers(xmlNode *xml_obj);
@@ -423,19 +424,117 @@ get_the_CIB(void)
 	return the_cib;
 }
 
+static cib_version_t *the_cib_version = NULL;
+
+/* Take a reference on the current version */
+cib_version_t *
+cib_version_ref(void)
+{
+	if(the_cib_version == NULL) {
+		return NULL;
+	}
+	the_cib_version->refs++;
+	return the_cib_version;
+}
+
+void
+cib_version_unref(cib_version_t *version)
+{
+	if(version == NULL) {
+		return;
+	}
+
+	CRM_CHECK(version->refs > 0, return);
+	version->refs--;
+	if(version->refs > 0) {
+		return;
+	}
+
+	crm_debug_3("Freeing CIB version %p", version);
+	free_xml(version->cib);
+	xml_blob_free(version->calldata);
+	crm_free(version);
+}
+
+/*
+ * The F_CIB_CALLDATA field of a whole-CIB query reply, rendered the
+ * first time it is asked for and then shared by every reply for this
+ * version.
+ */
+const crm_xml_blob_t *
+cib_version_calldata(cib_version_t *version)
+{
+	CRM_CHECK(version != NULL, return NULL);
+
+	if(version->calldata == NULL) {
+		xmlNode *holder = create_xml_node(NULL, F_CIB_CALLDATA);
+		add_node_copy(holder, version->cib);
+		version->calldata = xml_blob_new(holder);
+		free_xml(holder);
+	}
+	return version->calldata;
+}
+
+/* Off until a local reader asks for them with CIB_OP_SNAPSHOT */
+gboolean cib_snapshots_enabled = FALSE;
+
+/*
+ * Publish the current version for local read-only clients (see
+ * cib_mmap_new()).  Runs at low priority so that a burst of updates
+ * results in a single snapshot.
+ *
+ * A failed write removes the old snapshot, so that readers go back to
+ * asking us rather than using stale data, and is retried with the next
+ * version.
+ */
+enum cib_errors
+publish_cib_snapshot(void)
+{
+	static unsigned long long sequence = 0;
+	static gboolean write_failed = FALSE;
+	enum cib_errors rc = cib_ok;
+
+	if(the_cib == NULL || cib_snapshots_enabled == FALSE) {
+		return cib_ok;
+	}
+
+	rc = cib_snapshot_write(the_cib, NULL, ++sequence);
+	if(rc != cib_ok) {
+		if(write_failed == FALSE) {
+			crm_warn("Could not publish a CIB snapshot,"
+				 " retrying with the next update");
+		}
+		write_failed = TRUE;
+		cib_snapshot_remove(NULL);
+
+	} else if(write_failed) {
+		crm_info("CIB snapshots are being published again");
+		write_failed = FALSE;
+	}
+	return rc;
+}
+
+gboolean
+write_cib_snapshot(gpointer user_data)
+{
+	publish_cib_snapshot();
+	return TRUE;
+}
+
 gboolean
 uninitializeCib(void)
 {
-	xmlNode *tmp_cib = the_cib;
+	cib_version_t *tmp_version = the_cib_version;
 	
 	
-	if(tmp_cib == NULL) {
+	if(tmp_version == NULL) {
 		crm_debug("The CIB has already been deallocated.");
 		return FALSE;
 	}
 	
 	initialized = FALSE;
 	the_cib = NULL;
+	the_cib_version = NULL;
 	node_search = NULL;
 	resource_search = NULL;
 	constraint_search = NULL;
@@ -443,7 +542,10 @@ uninitializeCib(void)
 
 	crm_debug("Deallocating the CIB.");
 	
-	free_xml(tmp_cib);
+	cib_version_unref(tmp_version);
+	if(cib_snapshots_enabled) {
+		cib_snapshot_remove(NULL);
+	}
 
 	crm_debug("The CIB has been deallocated.");
 	
@@ -454,15 +556,30 @@ uninitializeCib(void)
  * This method will not free the old CIB pointer or the new one.
  * We rely on the caller to have saved a pointer to the old CIB
  *   and to free the old/bad one depending on what is appropriate.
+ *
+ * The new CIB is published as a version holding one reference, which
+ *   is dropped again when it in turn is replaced.
  */
 gboolean
 initializeCib(xmlNode *new_cib)
 {
+	cib_version_t *version = NULL;
+
 	if(new_cib == NULL) {
 		return FALSE;
+
+	} else if(the_cib_version != NULL && new_cib == the_cib_version->cib) {
+		initialized = TRUE;
+		return TRUE;
 	}
+
+	crm_malloc0(version, sizeof(cib_version_t));
+	version->cib = new_cib;
+	version->refs = 1;
 	
+	the_cib_version = version;
 	the_cib = new_cib;
+	cib_index_enable(the_cib);
 	initialized = TRUE;
 	return TRUE;
 }
@@ -500,6 +617,7 @@ int
 activateCibXml(xmlNode *new_cib, gboolean to_disk, const char *op)
 {
 	xmlNode *saved_cib = the_cib;
+	cib_version_t *saved_version = the_cib_version;
 
 	CRM_ASSERT(new_cib != saved_cib);
 	if(initializeCib(new_cib) == FALSE) {
@@ -522,7 +640,11 @@ activateCibXml(xmlNode *new_cib, gboolean to_disk, const char *op)
 		return cib_ACTIVATION;		
 	} 
 
-	free_xml(saved_cib);
+	/* anyone still reading saved_cib keeps it alive */
+	cib_version_unref(saved_version);
+	if(cib_snapshots_enabled && cib_snapshot_writer) {
+	    mainloop_set_trigger(cib_snapshot_writer);
+	}
 	if(cib_writes_enabled && cib_status == cib_ok && to_disk) {
 	    crm_debug("Triggering CIB write for %s op", op);
 	    G_main_set_trigger(cib_writer);
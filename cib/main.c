@@ -83,6 +83,7 @@ gboolean startCib(const char *filename);
 extern int write_cib_contents(gpointer p);
 
 GTRIGSource *cib_writer = NULL;
+crm_trigger_t *cib_snapshot_writer = NULL;
 GHashTable *client_list = NULL;
 
 char *channel1 = NULL;
@@ -140,6 +141,9 @@ main(int argc, char ** argv)
 	cib_writer = G_main_add_tempproc_trigger(			
 		G_PRIORITY_LOW, write_cib_contents, "write_cib_contents",
 		NULL, NULL, NULL, cib_diskwrite_complete);
+	cib_snapshot_writer = mainloop_add_trigger(
+		G_PRIORITY_LOW, write_cib_snapshot, NULL);
+	cib_index_init();
 
 	/* EnableProcLogging(); */
 	set_sigchld_proctrack(G_PRIORITY_HIGH,DEFAULT_MAXDISPATCHTIME);
@@ -404,6 +408,9 @@ int
 cib_init(void)
 {
 	gboolean was_error = FALSE;
+
+	/* Left over from a previous instance, nobody has asked for it yet */
+	cib_snapshot_remove(NULL);
 	
 	if(startCib("cib.xml") == FALSE){
 		crm_crit("Cannot start CIB... terminating");
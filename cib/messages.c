@@ -40,6 +40,7 @@
 #include <callbacks.h>
 
 #define MAX_DIFF_RETRY 5
+#define MAX_DIFF_HISTORY 100
 
 #ifdef CIBPIPE
 gboolean cib_is_master = TRUE;
@@ -193,6 +194,26 @@ cib_process_ping(
 }
 
 
+/* A local reader wants snapshots (see cib_mmap_new()), publish one now */
+enum cib_errors 
+cib_process_snapshot(
+	const char *op, int options, const char *section, xmlNode *req, xmlNode *input,
+	xmlNode *existing_cib, xmlNode **result_cib, xmlNode **answer)
+{
+#ifdef CIBPIPE
+    return cib_invalid_argument;
+#else
+	crm_debug_2("Processing \"%s\" event", op);
+	*answer = NULL;
+
+	if(cib_snapshots_enabled == FALSE) {
+		crm_info("Publishing CIB snapshots for local readers");
+		cib_snapshots_enabled = TRUE;
+	}
+	return publish_cib_snapshot();
+#endif
+}
+
 enum cib_errors 
 cib_process_sync(
 	const char *op, int options, const char *section, xmlNode *req, xmlNode *input,
@@ -219,26 +240,305 @@ cib_process_sync_one(
 
 int sync_in_progress = 0;
 
+/* A bounded history of the diffs that took this instance to its current
+ * version.  Peers that only fell a few updates behind are sent the missing
+ * diffs rather than the whole CIB (see sync_our_cib()).
+ *
+ * The entries always form a single chain, oldest first, and any change
+ * that was not seen by our peers breaks it.
+ */
+typedef struct cib_diff_entry_s 
+{
+	int admin_epoch;
+	int epoch;
+	int updates;
+
+	/* digest of the CIB after the diff was applied, may be NULL */
+	char *digest;
+	xmlNode *diff;
+	
+} cib_diff_entry_t;
+
+static GList *diff_history = NULL;
+static int diff_history_len = 0;
+
+static void
+free_diff_entry(cib_diff_entry_t *entry) 
+{
+	if(entry == NULL) {
+		return;
+	}
+	free_xml(entry->diff);
+	crm_free(entry->digest);
+	crm_free(entry);
+}
+
+static void
+cib_diff_history_flush(const char *reason) 
+{
+	if(diff_history_len > 0) {
+		crm_debug_2("Discarding %d diffs: %s", diff_history_len, reason);
+	}
+	slist_iter(entry, cib_diff_entry_t, diff_history, lpc,
+		   free_diff_entry(entry);
+		);
+	g_list_free(diff_history);
+	diff_history = NULL;
+	diff_history_len = 0;
+}
+
+static void
+cib_diff_history_add(xmlNode *diff) 
+{
+	cib_diff_entry_t *entry = NULL;
+	cib_diff_entry_t *last = NULL;
+	
+	int diff_add_updates = 0;
+	int diff_add_epoch  = 0;
+	int diff_add_admin_epoch = 0;
+	
+	int diff_del_updates = 0;
+	int diff_del_epoch  = 0;
+	int diff_del_admin_epoch = 0;
+
+	cib_diff_version_details(
+		diff,
+		&diff_add_admin_epoch, &diff_add_epoch, &diff_add_updates, 
+		&diff_del_admin_epoch, &diff_del_epoch, &diff_del_updates);
+
+	if(diff_history != NULL) {
+		last = g_list_last(diff_history)->data;
+	}
+	
+	if(last != NULL
+	   && (last->admin_epoch != diff_del_admin_epoch
+	       || last->epoch != diff_del_epoch
+	       || last->updates != diff_del_updates)) {
+		crm_debug("Diff %d.%d.%d -> %d.%d.%d does not follow %d.%d.%d",
+			  diff_del_admin_epoch,diff_del_epoch,diff_del_updates,
+			  diff_add_admin_epoch,diff_add_epoch,diff_add_updates,
+			  last->admin_epoch, last->epoch, last->updates);
+		cib_diff_history_flush("history is not contiguous");
+	}
+
+	crm_malloc0(entry, sizeof(cib_diff_entry_t));
+	entry->admin_epoch = diff_add_admin_epoch;
+	entry->epoch = diff_add_epoch;
+	entry->updates = diff_add_updates;
+	entry->digest = crm_element_value_copy(diff, XML_ATTR_DIGEST);
+	entry->diff = copy_xml(diff);
+	
+	diff_history = g_list_append(diff_history, entry);
+	diff_history_len++;
+
+	while(diff_history_len > MAX_DIFF_HISTORY) {
+		GList *oldest = diff_history;
+		free_diff_entry(oldest->data);
+		diff_history = g_list_delete_link(diff_history, oldest);
+		diff_history_len--;
+	}
+}
+
+void
+cib_diff_history_update(xmlNode *request, xmlNode *result_diff, gboolean broadcast) 
+{
+	const char *op = crm_element_value(request, F_CIB_OPERATION);
+	xmlNode *input = NULL;
+
+	if(result_diff == NULL) {
+		return;
+		
+	} else if(broadcast) {
+		/* send_peer_reply() has already added the digest */
+		cib_diff_history_add(result_diff);
+		return;
+
+	} else if(crm_is_true(crm_element_value(request, F_CIB_GLOBAL_UPDATE)) == FALSE) {
+		cib_diff_history_flush("local update");
+		return;
+
+	} else if(safe_str_neq(op, CIB_OP_APPLY_DIFF)) {
+		/* a full sync, not worth keeping */
+		cib_diff_history_flush(op);
+		return;
+	}
+
+	/* Keep the diff we were sent rather than the one we calculated
+	 * locally, it has the digest of the resulting CIB
+	 */
+	input = get_message_xml(request, F_CIB_UPDATE_DIFF);
+	if(safe_str_eq(crm_element_name(input), CIB_TAG_DIFF_SET)) {
+		xml_child_iter(input, diff, cib_diff_history_add(diff));
+
+	} else if(input != NULL) {
+		cib_diff_history_add(input);
+	}
+}
+
+/* Returns how many diffs at the start of the set existing_cib already
+ * contains, or -1 if the set does not lead on from it.
+ *
+ * A set sent in reply to our own sync request starts at our version,
+ * one broadcast on join holds the master's whole history and we only
+ * need the part after our version.
+ */
+static int
+cib_diff_set_start(xmlNode *input, xmlNode *existing_cib) 
+{
+	int this_updates = -1;
+	int this_epoch  = -1;
+	int this_admin_epoch = -1;
+
+	int lpc = 0;
+	int start = -1;
+	
+	crm_element_value_int(existing_cib, XML_ATTR_GENERATION_ADMIN, &this_admin_epoch);
+	crm_element_value_int(existing_cib, XML_ATTR_GENERATION, &this_epoch);
+	crm_element_value_int(existing_cib, XML_ATTR_NUMUPDATES, &this_updates);
+
+	xml_child_iter(
+		input, diff,
+
+		int diff_add_updates = 0;
+		int diff_add_epoch  = 0;
+		int diff_add_admin_epoch = 0;
+	    
+		int diff_del_updates = 0;
+		int diff_del_epoch  = 0;
+		int diff_del_admin_epoch = 0;
+
+		if(start >= 0) {
+			break;
+		}
+		
+		cib_diff_version_details(
+			diff,
+			&diff_add_admin_epoch, &diff_add_epoch, &diff_add_updates, 
+			&diff_del_admin_epoch, &diff_del_epoch, &diff_del_updates);
+
+		lpc++;
+		if(diff_del_admin_epoch == this_admin_epoch
+		   && diff_del_epoch == this_epoch
+		   && diff_del_updates == this_updates) {
+			/* apply_xml_diff() checks the digest of the result */
+			start = lpc - 1;
+
+		} else if(diff_add_admin_epoch == this_admin_epoch
+			  && diff_add_epoch == this_epoch
+			  && diff_add_updates == this_updates) {
+			/* nothing after this diff will check our copy
+			 * if it is the last one, so compare them here
+			 */
+			const char *digest = crm_element_value(diff, XML_ATTR_DIGEST);
+			char *our_digest = calculate_xml_digest(existing_cib, FALSE, TRUE);
+
+			if(safe_str_eq(digest, our_digest)) {
+				start = lpc;
+				
+			} else {
+				crm_info("Our CIB differs from the master's at %d.%d.%d"
+					 " (%s vs. %s)", this_admin_epoch, this_epoch,
+					 this_updates, our_digest, crm_str(digest));
+				crm_free(our_digest);
+				return -1;
+			}
+			crm_free(our_digest);
+		}
+		);
+
+	if(start < 0) {
+		crm_debug("%d.%d.%d is outside the %d diffs we were sent",
+			  this_admin_epoch, this_epoch, this_updates, lpc);
+	}
+	return start;
+}
+
+static enum cib_errors 
+cib_process_diff_set(
+	const char *op, int options, const char *section, xmlNode *req, xmlNode *input,
+	xmlNode *existing_cib, xmlNode **result_cib, xmlNode **answer)
+{
+	int rc = cib_ok;
+	int lpc = 0;
+	int applied = 0;
+	xmlNode *current = NULL;
+	int start = cib_diff_set_start(input, existing_cib);
+
+	if(start < 0) {
+		return cib_diff_resync;
+	}
+	
+	xml_child_iter(
+		input, diff,
+		
+		xmlNode *next = NULL;
+		if(lpc++ < start) {
+			continue;
+		}
+		
+		if(rc == cib_ok) {
+			rc = cib_process_diff(
+				op, options, section, req, diff,
+				current?current:existing_cib, &next, answer);
+		
+			if(rc == cib_ok) {
+				free_xml(current);
+				current = next;
+				applied++;
+			
+			} else {
+				free_xml(next);
+			}
+		}
+		);
+
+	if(rc != cib_ok) {
+		/* fall back to a full copy */
+		free_xml(current);
+		return cib_diff_resync;
+	}
+
+	if(current != NULL) {
+		free_xml(*result_cib);
+		*result_cib = current;
+	}
+	
+	crm_info("Sync from %s complete: applied %d of %d diffs",
+		 crm_str(crm_element_value(req, F_ORIG)), applied, lpc);
+	sync_in_progress = 0;
+	return rc;
+}
+
 enum cib_errors 
 cib_server_process_diff(
 	const char *op, int options, const char *section, xmlNode *req, xmlNode *input,
 	xmlNode *existing_cib, xmlNode **result_cib, xmlNode **answer)
 {
 	int rc = cib_ok;
+	gboolean is_sync = FALSE;
 
 	if(cib_is_master) {
 		/* the master is never waiting for a resync */
 		sync_in_progress = 0;
 	}
 	
-	if(sync_in_progress > MAX_DIFF_RETRY) {
+	if(safe_str_eq(crm_element_name(input), CIB_TAG_DIFF_SET)) {
+		/* the reply to our resync request */
+		is_sync = TRUE;
+		rc = cib_process_diff_set(
+			op, options, section, req, input, existing_cib, result_cib, answer);
+		
+	} else if(sync_in_progress > MAX_DIFF_RETRY) {
 		/* request another full-sync,
 		 * the last request may have been lost
 		 */
 		sync_in_progress = 0;
 	} 
 
-	if(sync_in_progress) {
+	if(is_sync) {
+		/* already processed */
+		
+	} else if(sync_in_progress) {
 	    int diff_add_updates = 0;
 	    int diff_add_epoch  = 0;
 	    int diff_add_admin_epoch = 0;
@@ -257,10 +557,10 @@ cib_server_process_diff(
 		     diff_del_admin_epoch,diff_del_epoch,diff_del_updates,
 		     diff_add_admin_epoch,diff_add_epoch,diff_add_updates);
 	    return cib_diff_resync;
-	}
 
-    
-	rc = cib_process_diff(op, options, section, req, input, existing_cib, result_cib, answer);
+	} else {
+		rc = cib_process_diff(op, options, section, req, input, existing_cib, result_cib, answer);
+	}
 	
 	if(rc == cib_diff_resync && cib_is_master == FALSE) {
 		xmlNode *sync_me = create_xml_node(NULL, "sync-me");
@@ -273,6 +573,23 @@ cib_server_process_diff(
 		crm_xml_add(sync_me, F_CIB_OPERATION, CIB_OP_SYNC_ONE);
 		crm_xml_add(sync_me, F_CIB_DELEGATED, cib_our_uname);
 
+		if(is_sync == FALSE) {
+			/* Tell the master where we are so that it can send
+			 * only the diffs we missed.
+			 * If those just failed to apply, ask for everything.
+			 */
+			char *digest = calculate_xml_digest(existing_cib, FALSE, TRUE);
+
+			crm_xml_add(sync_me, XML_ATTR_GENERATION_ADMIN,
+				    crm_element_value(existing_cib, XML_ATTR_GENERATION_ADMIN));
+			crm_xml_add(sync_me, XML_ATTR_GENERATION,
+				    crm_element_value(existing_cib, XML_ATTR_GENERATION));
+			crm_xml_add(sync_me, XML_ATTR_NUMUPDATES,
+				    crm_element_value(existing_cib, XML_ATTR_NUMUPDATES));
+			crm_xml_add(sync_me, XML_ATTR_DIGEST, digest);
+			crm_free(digest);
+		}
+
 		if(send_cluster_message(NULL, crm_msg_cib, sync_me, FALSE) == FALSE) {
 			rc = cib_not_connected;
 		}
@@ -421,6 +738,149 @@ check_generation(xmlNode *newCib, xmlNode *oldCib)
 }
 
 #ifndef CIBPIPE
+/* Returns the diffs a peer needs to get from the version advertised in
+ * request to our current one, or NULL if a full copy is required
+ */
+static xmlNode *
+cib_diff_history_since(xmlNode *request, xmlNode *current) 
+{
+	int this_updates = -1;
+	int this_epoch  = -1;
+	int this_admin_epoch = -1;
+
+	int peer_updates = -1;
+	int peer_epoch  = -1;
+	int peer_admin_epoch = -1;
+
+	int count = 0;
+	GList *gIter = NULL;
+	xmlNode *diffs = NULL;
+	cib_diff_entry_t *base = NULL;
+	cib_diff_entry_t *last = NULL;
+	const char *peer = crm_element_value(request, F_ORIG);
+	const char *digest = crm_element_value(request, XML_ATTR_DIGEST);
+
+	if(digest == NULL
+	   || crm_element_value_int(request, XML_ATTR_GENERATION_ADMIN, &peer_admin_epoch) < 0
+	   || crm_element_value_int(request, XML_ATTR_GENERATION, &peer_epoch) < 0
+	   || crm_element_value_int(request, XML_ATTR_NUMUPDATES, &peer_updates) < 0) {
+		return NULL;
+		
+	} else if(diff_history == NULL) {
+		crm_debug("No diff history for %s", peer);
+		return NULL;
+	}
+
+	crm_element_value_int(current, XML_ATTR_GENERATION_ADMIN, &this_admin_epoch);
+	crm_element_value_int(current, XML_ATTR_GENERATION, &this_epoch);
+	crm_element_value_int(current, XML_ATTR_NUMUPDATES, &this_updates);
+
+	last = g_list_last(diff_history)->data;
+	if(last->admin_epoch != this_admin_epoch
+	   || last->epoch != this_epoch
+	   || last->updates != this_updates) {
+		crm_debug("Diff history ends at %d.%d.%d, not %d.%d.%d",
+			  last->admin_epoch, last->epoch, last->updates,
+			  this_admin_epoch, this_epoch, this_updates);
+		return NULL;
+	}
+	
+	for(gIter = diff_history; gIter != NULL; gIter = gIter->next) {
+		cib_diff_entry_t *entry = gIter->data;
+		if(entry->admin_epoch == peer_admin_epoch
+		   && entry->epoch == peer_epoch
+		   && entry->updates == peer_updates) {
+			base = entry;
+			break;
+		}
+	}
+
+	if(base == NULL) {
+		crm_debug("%s is at %d.%d.%d, outside our diff history",
+			  peer, peer_admin_epoch, peer_epoch, peer_updates);
+		return NULL;
+		
+	} else if(safe_str_neq(base->digest, digest)) {
+		crm_info("%s has a different CIB at %d.%d.%d (%s vs. %s)",
+			 peer, peer_admin_epoch, peer_epoch, peer_updates,
+			 digest, crm_str(base->digest));
+		return NULL;
+	}
+
+	diffs = create_xml_node(NULL, CIB_TAG_DIFF_SET);
+	for(gIter = gIter->next; gIter != NULL; gIter = gIter->next) {
+		cib_diff_entry_t *entry = gIter->data;
+		add_node_copy(diffs, entry->diff);
+		count++;
+	}
+
+	crm_info("Syncing CIB to %s: sending %d diffs (%d.%d.%d -> %d.%d.%d)",
+		 peer, count, peer_admin_epoch, peer_epoch, peer_updates,
+		 this_admin_epoch, this_epoch, this_updates);
+	return diffs;
+}
+
+/* Returns our whole diff history for broadcasting on join, or NULL if
+ * sending the CIB itself is no bigger.  Each peer applies the part it
+ * is missing and asks for a full copy if it has none of it.
+ */
+static xmlNode *
+cib_diff_history_all(xmlNode *current) 
+{
+	int this_updates = -1;
+	int this_epoch  = -1;
+	int this_admin_epoch = -1;
+
+	int diff_len = 0;
+	int cib_len = 0;
+	char *buffer = NULL;
+	xmlNode *diffs = NULL;
+	cib_diff_entry_t *last = NULL;
+
+	if(diff_history == NULL) {
+		crm_debug("No diff history");
+		return NULL;
+	}
+
+	crm_element_value_int(current, XML_ATTR_GENERATION_ADMIN, &this_admin_epoch);
+	crm_element_value_int(current, XML_ATTR_GENERATION, &this_epoch);
+	crm_element_value_int(current, XML_ATTR_NUMUPDATES, &this_updates);
+
+	last = g_list_last(diff_history)->data;
+	if(last->admin_epoch != this_admin_epoch
+	   || last->epoch != this_epoch
+	   || last->updates != this_updates) {
+		crm_debug("Diff history ends at %d.%d.%d, not %d.%d.%d",
+			  last->admin_epoch, last->epoch, last->updates,
+			  this_admin_epoch, this_epoch, this_updates);
+		return NULL;
+	}
+
+	diffs = create_xml_node(NULL, CIB_TAG_DIFF_SET);
+	slist_iter(entry, cib_diff_entry_t, diff_history, lpc,
+		   add_node_copy(diffs, entry->diff);
+		);
+
+	buffer = dump_xml_unformatted(diffs);
+	diff_len = buffer?strlen(buffer):0;
+	crm_free(buffer);
+
+	buffer = dump_xml_unformatted(current);
+	cib_len = buffer?strlen(buffer):0;
+	crm_free(buffer);
+
+	if(diff_len >= cib_len) {
+		crm_debug("%d diffs are no smaller than the CIB (%d vs. %d bytes)",
+			  diff_history_len, diff_len, cib_len);
+		free_xml(diffs);
+		return NULL;
+	}
+	
+	crm_info("Syncing CIB to all peers: sending %d diffs ending at %d.%d.%d",
+		 diff_history_len, this_admin_epoch, this_epoch, this_updates);
+	return diffs;
+}
+
 enum cib_errors
 sync_our_cib(xmlNode *request, gboolean all) 
 {
@@ -428,15 +888,40 @@ sync_our_cib(xmlNode *request, gboolean all)
 	const char *host            = crm_element_value(request, F_ORIG);
 	const char *op              = crm_element_value(request, F_CIB_OPERATION);
 
+	xmlNode *diffs = NULL;
 	xmlNode *replace_request = cib_msg_copy(request, FALSE);
 	
 	CRM_CHECK(the_cib != NULL, ;);
 	CRM_CHECK(replace_request != NULL, ;);
 	
-	crm_debug("Syncing CIB to %s", all?"all peers":host);
 	if(all == FALSE && host == NULL) {
 	    crm_log_xml(LOG_ERR, "bad sync", request);
+
+	} else if(all == FALSE) {
+	    diffs = cib_diff_history_since(request, the_cib);
+
+	} else {
+	    diffs = cib_diff_history_all(the_cib);
 	}
+
+	if(diffs != NULL) {
+	    if(host != NULL) {
+		crm_xml_add(replace_request, F_CIB_ISREPLY, host);
+	    }
+	    crm_xml_add(replace_request, F_CIB_OPERATION, CIB_OP_APPLY_DIFF);
+	    crm_xml_add(replace_request, "original_"F_CIB_OPERATION, op);
+	    crm_xml_add(replace_request, F_CIB_GLOBAL_UPDATE, XML_BOOLEAN_TRUE);
+	    add_message_xml(replace_request, F_CIB_UPDATE_DIFF, diffs);
+	    
+	    if(send_cluster_message(all?NULL:host, crm_msg_cib, replace_request, FALSE) == FALSE) {
+		result = cib_not_connected;
+	    }
+	    free_xml(diffs);
+	    free_xml(replace_request);
+	    return result;
+	}
+	
+	crm_debug("Syncing CIB to %s", all?"all peers":host);
 	
 	/* remove the "all == FALSE" condition
 	 *
@@ -97,6 +97,7 @@ crmd_ha_connection_destroy(gpointer user_data)
 	trigger_fsa(fsa_source);
 }
 
+/* Takes ownership of msg */
 void
 crmd_ha_msg_filter(xmlNode *msg)
 {
@@ -118,6 +119,7 @@ crmd_ha_msg_filter(xmlNode *msg)
 		}
 
 		do_crm_log(level, "Another DC detected: %s (op=%s)", from, op);
+		free_xml(msg);
 		goto done;
 	    }
 	}
@@ -125,12 +127,13 @@ crmd_ha_msg_filter(xmlNode *msg)
     } else {
 	const char *sys_to = crm_element_value(msg, F_CRM_SYS_TO);
 	if(safe_str_eq(sys_to, CRM_SYSTEM_DC)) {
+	    free_xml(msg);
 	    return;
 	}
     }
     
     /* crm_log_xml(LOG_MSG, "HA[inbound]", msg); */
-    route_message(C_HA_MESSAGE, msg);
+    route_message_adv(C_HA_MESSAGE, msg, TRUE);
 
   done:
     trigger_fsa(fsa_source);
@@ -179,6 +182,7 @@ crmd_ha_msg_callback(HA_Message *hamsg, void* private_data)
 
 	} else {
 	    crmd_ha_msg_filter(msg);
+	    return;
 	}
 
   bail:
@@ -218,10 +222,11 @@ crmd_ipc_msg_callback(IPC_Channel *client, gpointer user_data)
 		crm_log_xml(LOG_DEBUG_2, "CRMd[inbound]", msg);
 
 		if(crmd_authorize_message(msg, curr_client)) {
-		    route_message(C_IPC_MESSAGE, msg);
-		} 
+		    route_message_adv(C_IPC_MESSAGE, msg, TRUE);
 
-		free_xml(msg);
+		} else {
+		    free_xml(msg);
+		}
 		msg = NULL;
 
 		if(client->ch_status != IPC_CONNECT) {
@@ -625,8 +630,8 @@ crmd_cib_connection_destroy(gpointer user_data)
 gboolean
 crm_fsa_trigger(gpointer user_data) 
 {
-	crm_debug_2("Invoked (queue len: %d)", g_list_length(fsa_message_queue));
+	crm_debug_2("Invoked (queue len: %d)", g_queue_get_length(fsa_message_queue));
 	s_crmd_fsa(C_FSA_INTERNAL);
-	crm_debug_2("Exited  (queue len: %d)", g_list_length(fsa_message_queue));
+	crm_debug_2("Exited  (queue len: %d)", g_queue_get_length(fsa_message_queue));
 	return TRUE;	
 }
@@ -99,6 +99,7 @@ static gboolean crm_ais_dispatch(AIS_Message *wrapper, char *data, int sender)
 	    crm_xml_add(xml, F_ORIG, wrapper->sender.uname);
 	    crm_xml_add_int(xml, F_SEQ, wrapper->id);
 	    crmd_ha_msg_filter(xml);
+	    xml = NULL;
 	    break;
 
 	case crm_class_rmpeer:
@@ -301,14 +302,15 @@ static void free_mem(fsa_data_t *msg_data)
 		fsa_cluster_conn = NULL;
 	}
 #endif	
-	slist_destroy(fsa_data_t, fsa_data, fsa_message_queue, 
-		      crm_info("Dropping %s: [ state=%s cause=%s origin=%s ]",
-			       fsa_input2string(fsa_data->fsa_input),
-			       fsa_state2string(fsa_state),
-			       fsa_cause2string(fsa_data->fsa_cause),
-			       fsa_data->origin);
-		      delete_fsa_input(fsa_data);
-		);
+	while(is_message()) {
+		fsa_data_t *fsa_data = get_message();
+		crm_info("Dropping %s: [ state=%s cause=%s origin=%s ]",
+			 fsa_input2string(fsa_data->fsa_input),
+			 fsa_state2string(fsa_state),
+			 fsa_cause2string(fsa_data->fsa_cause),
+			 fsa_data->origin);
+		delete_fsa_input(fsa_data);
+	}
 	delete_fsa_input(msg_data);
 
 	if(ipc_clients) {
@@ -725,6 +727,7 @@ pe_cluster_option crmd_opts[] = {
 	{ XML_CONFIG_ATTR_FORCE_QUIT, "shutdown_escalation", "time", NULL, "20min", &check_timer, "*** Advanced Use Only ***.", "If need to adjust this value, it probably indicates the presence of a bug." },
 	{ "crmd-integration-timeout", NULL, "time", NULL, "3min", &check_timer, "*** Advanced Use Only ***.", "If need to adjust this value, it probably indicates the presence of a bug." },
 	{ "crmd-finalization-timeout", NULL, "time", NULL, "30min", &check_timer, "*** Advanced Use Only ***.", "If you need to adjust this value, it probably indicates the presence of a bug." },
+	{ "crmd-lrm-update-window", NULL, "time", "Zero sends every result immediately", "200ms", &check_timer, "How long to collect resource operation results before writing them to the CIB.", "Results that arrive within this window are sent to the CIB as a single update.  The update is also sent as soon as no other (non-recurring) actions are executing on the node." },
 	{ XML_ATTR_EXPECTED_VOTES, NULL, "integer", NULL, "2", &check_number, "The number of nodes expected to be in the cluster", "Used to calculate quorum in openais based clusters." },
 };
 
@@ -802,6 +805,9 @@ config_query_callback(xmlNode *msg, int call_id, int rc,
 	value = crmd_pref(config_hash, "crmd-finalization-timeout");
 	finalization_timer->period_ms = crm_get_msec(value);
 
+	value = crmd_pref(config_hash, "crmd-lrm-update-window");
+	lrm_update_window = crm_get_msec(value);
+
 #if SUPPORT_AIS
 	if(is_openais_cluster()) {
 	    value = crmd_pref(config_hash, XML_ATTR_EXPECTED_VOTES);
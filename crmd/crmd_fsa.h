@@ -77,12 +77,16 @@ struct fsa_data_s
 		const char	   *origin;
 		void		   *data;
 		enum fsa_data_type  data_type;
+		unsigned long long  queued; /* see fsa_time_now() */
 };
 
 
 
 extern enum crmd_fsa_state s_crmd_fsa(enum crmd_fsa_cause cause);
 
+extern unsigned long long fsa_time_now(void);
+extern xmlNode *fsa_timing_xml(void);
+
 /* Global FSA stuff */
 extern volatile gboolean do_fsa_stall;
 extern volatile enum crmd_fsa_state fsa_state;
@@ -97,7 +101,7 @@ extern char	  *fsa_our_uuid;
 extern char	  *fsa_pe_ref; /* the last invocation of the PE */
 extern char       *fsa_our_dc;
 extern char	  *fsa_our_dc_version;
-extern GListPtr   fsa_message_queue;
+extern GQueue    *fsa_message_queue;
 
 extern fsa_timer_t *election_trigger;		/*  */
 extern fsa_timer_t *election_timeout;		/*  */
@@ -19,3 +19,6 @@
 extern void free_lrm_op(lrm_op_t *op);
 extern gboolean verify_stopped(enum crmd_fsa_state cur_state, int log_level);
 extern void lrm_connection_destroy(gpointer user_data);
+
+extern int lrm_update_window;
+extern int flush_rsc_updates(const char *reason);
@@ -41,8 +41,15 @@ extern int register_fsa_input_adv(
 	void *data, long long with_actions,
 	gboolean prepend, const char *raised_from);
 
+extern int register_fsa_input_full(
+	enum crmd_fsa_cause cause, enum crmd_fsa_input input,
+	void *data, long long with_actions,
+	gboolean prepend, gboolean copy, const char *raised_from);
+
 extern void fsa_dump_queue(int log_level);
 extern void route_message(enum crmd_fsa_cause cause, xmlNode *input);
+extern void route_message_adv(
+	enum crmd_fsa_cause cause, xmlNode *input, gboolean owned);
 
 #define crmd_fsa_stall(cur_input) if(cur_input != NULL) {		\
 		register_fsa_input_adv(					\
@@ -72,7 +79,7 @@ extern void route_message(enum crmd_fsa_cause cause, xmlNode *input);
 
 void delete_fsa_input(fsa_data_t *fsa_data);
 
-GListPtr put_message(fsa_data_t *new_message);
+void put_message(fsa_data_t *new_message);
 fsa_data_t *get_message(void);
 gboolean is_message(void);
 gboolean have_wait_message(void);
@@ -19,6 +19,7 @@
 #include <crm_internal.h>
 
 #include <sys/param.h>
+#include <sys/time.h>
 #include <stdio.h>
 #include <string.h>
 #include <time.h>
@@ -71,6 +72,20 @@ extern void initialize_join(gboolean before);
 #define DOT_PREFIX "actions:trace: "
 #define do_dot_log(fmt, args...)     do_crm_log_unlikely(LOG_DEBUG_2, fmt, ##args)
 
+#define MAXACTION 64
+
+typedef struct fsa_timing_s 
+{
+	unsigned long      count;
+	unsigned long long total;
+	unsigned long long max;
+} fsa_timing_t;
+
+/* All times are in microseconds */
+static fsa_timing_t input_wait[MAXINPUT];
+static fsa_timing_t input_run[MAXINPUT];
+static fsa_timing_t action_run[MAXACTION];
+
 long long do_state_transition(long long actions,
 			      enum crmd_fsa_state cur_state,
 			      enum crmd_fsa_state next_state,
@@ -130,6 +145,86 @@ init_dotfile(void)
 	do_dot_log(DOT_PREFIX"	\"S_IDLE\" [ fontcolor = \"green\" ]");
 }
 
+unsigned long long
+fsa_time_now(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+	if(clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+		return (ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+	}
+#endif
+	{
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		return (tv.tv_sec * 1000000ULL) + tv.tv_usec;
+	}
+}
+
+static void
+fsa_timing_add(fsa_timing_t *timing, unsigned long long start, unsigned long long end)
+{
+	unsigned long long delta = 0;
+	if(end > start) {
+	    /* only without a monotonic clock can this go backwards */
+	    delta = end - start;
+	}
+	timing->count++;
+	timing->total += delta;
+	if(delta > timing->max) {
+	    timing->max = delta;
+	}
+}
+
+static void
+fsa_timing_xml_add(xmlNode *parent, const char *prefix, fsa_timing_t *timing) 
+{
+	char name[64];
+	char value[64];
+
+	snprintf(name, sizeof(name), "%s_count", prefix);
+	snprintf(value, sizeof(value), "%lu", timing->count);
+	crm_xml_add(parent, name, value);
+	
+	snprintf(name, sizeof(name), "%s_total", prefix);
+	snprintf(value, sizeof(value), "%llu", timing->total);
+	crm_xml_add(parent, name, value);
+
+	snprintf(name, sizeof(name), "%s_max", prefix);
+	snprintf(value, sizeof(value), "%llu", timing->max);
+	crm_xml_add(parent, name, value);
+}
+
+xmlNode *
+fsa_timing_xml(void) 
+{
+	int lpc = 0;
+	xmlNode *stats = create_xml_node(NULL, XML_TAG_FSA_STATS);
+
+	crm_xml_add(stats, XML_ATTR_UNAME, fsa_our_uname);
+	for(lpc = 0; lpc < MAXINPUT; lpc++) {
+	    xmlNode *input = NULL;
+	    if(input_wait[lpc].count == 0) {
+		continue;
+	    }
+	    input = create_xml_node(stats, "fsa_input");
+	    crm_xml_add(input, XML_ATTR_ID, fsa_input2string(lpc));
+	    fsa_timing_xml_add(input, "wait", &input_wait[lpc]);
+	    fsa_timing_xml_add(input, "run", &input_run[lpc]);
+	}
+
+	for(lpc = 0; lpc < MAXACTION; lpc++) {
+	    xmlNode *action = NULL;
+	    if(action_run[lpc].count == 0) {
+		continue;
+	    }
+	    action = create_xml_node(stats, "fsa_action");
+	    crm_xml_add(action, XML_ATTR_ID, fsa_action2string(1LL << lpc));
+	    fsa_timing_xml_add(action, "run", &action_run[lpc]);
+	}
+	return stats;
+}
+
 static void
 do_fsa_action(fsa_data_t *fsa_data, long long an_action,
 	      void (*function)(long long action,
@@ -138,6 +233,8 @@ do_fsa_action(fsa_data_t *fsa_data, long long an_action,
 			       enum crmd_fsa_input cur_input,
 			       fsa_data_t *msg_data)) 
 {
+	int bit = 0;
+	unsigned long long start = 0;
 	int action_log_level = LOG_DEBUG;
 	
 	/* The calls to fsa_action2string() is expensive,
@@ -150,7 +247,14 @@ do_fsa_action(fsa_data_t *fsa_data, long long an_action,
 	
 	fsa_actions &= ~an_action;
 	do_crm_log(action_log_level, DOT_PREFIX"\t// %s", fsa_action2string(an_action));
+
+	start = fsa_time_now();
 	function(an_action, fsa_data->fsa_cause, fsa_state, fsa_data->fsa_input, fsa_data);
+
+	while(bit < MAXACTION - 1 && (1LL << bit) != an_action) {
+	    bit++;
+	}
+	fsa_timing_add(&action_run[bit], start, fsa_time_now());
 }
 
 static long long startup_actions = A_STARTUP|A_CIB_START|A_LRM_CONNECT|A_CCM_CONNECT|A_HA_CONNECT|A_READCONFIG|A_STARTED|A_CL_JOIN_QUERY;
@@ -159,6 +263,7 @@ enum crmd_fsa_state
 s_crmd_fsa(enum crmd_fsa_cause cause)
 {
 	fsa_data_t *fsa_data = NULL;
+	unsigned long long started = 0;
 	long long register_copy = fsa_input_register;
 	long long new_actions = A_NOTHING;
 	enum crmd_fsa_state last_state = fsa_state;
@@ -175,16 +280,19 @@ s_crmd_fsa(enum crmd_fsa_cause cause)
 		fsa_data->fsa_cause = C_FSA_INTERNAL;
 		fsa_data->origin    = __FUNCTION__;
 		fsa_data->data_type = fsa_dt_none;
-		fsa_message_queue = g_list_append(fsa_message_queue, fsa_data);
+		put_message(fsa_data);
 		fsa_data = NULL;
 	}
 	while(is_message() && do_fsa_stall == FALSE) {
 		crm_debug_2("Checking messages (%d remaining)",
-			    g_list_length(fsa_message_queue));
+			    g_queue_get_length(fsa_message_queue));
 		
 		fsa_data = get_message();
 		CRM_CHECK(fsa_data != NULL, continue);
 
+		started = fsa_time_now();
+		fsa_timing_add(&input_wait[fsa_data->fsa_input], fsa_data->queued, started);
+
 		log_fsa_input(fsa_data);
 		
 		/* add any actions back to the queue */
@@ -264,14 +372,15 @@ s_crmd_fsa(enum crmd_fsa_cause cause)
 
 		/* start doing things... */
 		s_crmd_fsa_actions(fsa_data);
+		fsa_timing_add(&input_run[fsa_data->fsa_input], started, fsa_time_now());
 		delete_fsa_input(fsa_data);
 		fsa_data = NULL;
 	}
 
-	if(g_list_length(fsa_message_queue) > 0
+	if(g_queue_is_empty(fsa_message_queue) == FALSE
 	   || fsa_actions != A_NOTHING || do_fsa_stall) {
 		crm_debug("Exiting the FSA: queue=%d, fsa_actions=0x%llx, stalled=%s",
-			  g_list_length(fsa_message_queue), fsa_actions,
+			  g_queue_get_length(fsa_message_queue), fsa_actions,
 			  do_fsa_stall?"true":"false");
 	} else {
 		crm_debug_2("Exiting the FSA");
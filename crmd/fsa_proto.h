@@ -19,7 +19,9 @@
 #ifndef XML_FSA_PROTO__H
 #define XML_FSA_PROTO__H
 
-extern xmlNode *do_lrm_query(gboolean);
+extern xmlNode *do_lrm_query(void);
+extern xmlNode *do_lrm_join_query(const char *base);
+extern const char *lrm_history_id(void);
 
 /*	 A_READCONFIG	*/
 void
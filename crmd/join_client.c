@@ -174,6 +174,9 @@ join_query_callback(xmlNode *msg, int call_id, int rc,
 			CRM_SYSTEM_DC, CRM_SYSTEM_CRMD, NULL);
 
 		crm_xml_add(reply, F_CRM_JOIN_ID, join_id);
+
+		/* lets the DC check if it already has most of our LRM state */
+		crm_xml_add(reply, F_CRM_LRM_HISTORY, lrm_history_id());
 		send_cluster_message(fsa_our_dc, crm_msg_crmd, reply, TRUE);
 		free_xml(reply);
 
@@ -239,7 +242,8 @@ do_cl_join_finalize_respond(long long action,
 	/* send our status section to the DC */
 	crm_debug("Confirming join join-%d: %s",
 		  join_id, crm_element_value(input->msg, F_CRM_TASK));
-	tmp1 = do_lrm_query(TRUE);
+	tmp1 = do_lrm_join_query(
+	    crm_element_value(input->msg, F_CRM_LRM_HISTORY));
 	if(tmp1 != NULL) {
 		xmlNode *reply = create_request(
 			CRM_OP_JOIN_CONFIRM, tmp1, fsa_our_dc,
@@ -31,12 +31,14 @@ GHashTable *welcomed_nodes   = NULL;
 GHashTable *integrated_nodes = NULL;
 GHashTable *finalized_nodes  = NULL;
 GHashTable *confirmed_nodes  = NULL;
+static GHashTable *join_lrm_history = NULL;
 char *max_epoch = NULL;
 char *max_generation_from = NULL;
 xmlNode *max_generation_xml = NULL;
 
 void initialize_join(gboolean before);
 gboolean finalize_join_for(gpointer key, gpointer value, gpointer user_data);
+static void finalize_join_all(void);
 void finalize_sync_callback(xmlNode *msg, int call_id, int rc,
 			    xmlNode *output, void *user_data);
 gboolean check_join_state(enum crmd_fsa_state cur_state, const char *source);
@@ -55,6 +57,9 @@ initialize_join(gboolean before)
 	g_hash_table_destroy(integrated_nodes);
 	g_hash_table_destroy(finalized_nodes);
 	g_hash_table_destroy(confirmed_nodes);
+	if(join_lrm_history != NULL) {
+		g_hash_table_destroy(join_lrm_history);
+	}
 
 	if(before) {
 		if(max_generation_from != NULL) {
@@ -81,6 +86,9 @@ initialize_join(gboolean before)
 	confirmed_nodes = g_hash_table_new_full(
 		g_str_hash, g_str_equal,
 		g_hash_destroy_str, g_hash_destroy_str);
+	join_lrm_history = g_hash_table_new_full(
+		g_str_hash, g_str_equal,
+		g_hash_destroy_str, g_hash_destroy_str);
 }
 
 void
@@ -104,6 +112,9 @@ erase_node_from_join(const char *uname)
 	if(confirmed_nodes != NULL) {
 	    c = g_hash_table_remove(confirmed_nodes, uname);
 	}
+	if(join_lrm_history != NULL) {
+	    g_hash_table_remove(join_lrm_history, uname);
+	}
 
 	if(w || i || f || c) {
 	    crm_info("Removed node %s from join calculations:"
@@ -362,8 +373,15 @@ do_dc_join_filter_offer(long long action,
 		crm_err("join-%d: NACK'ing node %s (ref %s)",
 			join_id, join_from, ref);
 	} else {
+		const char *history = crm_element_value(
+			join_ack->msg, F_CRM_LRM_HISTORY);
+
 		crm_debug("join-%d: Welcoming node %s (ref %s)",
 			  join_id, join_from, ref);
+		if(history != NULL && join_lrm_history != NULL) {
+			g_hash_table_replace(join_lrm_history,
+					     crm_strdup(join_from), crm_strdup(history));
+		}
 	}
 	
 	/* add them to our list of CRMD_STATE_ACTIVE nodes */
@@ -462,10 +480,7 @@ finalize_sync_callback(xmlNode *msg, int call_id, int rc,
 	    
 	    /* make sure dc_uuid is re-set to us */
 	    if(check_join_state(fsa_state, __FUNCTION__) == FALSE) {
-		crm_debug("Notifying %d clients of join-%d results",
-			  g_hash_table_size(integrated_nodes), current_join_id);
-		g_hash_table_foreach_remove(
-		    integrated_nodes, finalize_join_for, NULL);
+		finalize_join_all();
 	    }
 		
 	} else {
@@ -476,6 +491,90 @@ finalize_sync_callback(xmlNode *msg, int call_id, int rc,
 	crm_free(user_data);
 }
 
+static void
+add_held_history(xmlNode *lrm, GHashTable *held) 
+{
+	int len = 0;
+	char *epoch = NULL;
+	const char *sep = NULL;
+	const char *stamp = crm_element_value(lrm, XML_LRM_ATTR_HISTORY);
+
+	if(stamp == NULL || (sep = strrchr(stamp, ':')) == NULL) {
+		return;
+	}
+	
+	len = sep - stamp;
+	crm_malloc0(epoch, len + 1);
+	strncpy(epoch, stamp, len);
+	g_hash_table_replace(held, epoch, crm_strdup(stamp));
+}
+
+static void
+finalize_history_callback(xmlNode *msg, int call_id, int rc,
+			  xmlNode *output, void *user_data) 
+{
+	int join_id = crm_parse_int(user_data, "-1");
+	GHashTable *held = g_hash_table_new_full(
+		g_str_hash, g_str_equal, g_hash_destroy_str, g_hash_destroy_str);
+
+	if(rc == cib_ok && output != NULL) {
+		if(safe_str_eq(crm_element_name(output), XML_CIB_TAG_LRM)) {
+			add_held_history(output, held);
+		} else {
+			xml_child_iter_filter(
+				output, lrm, XML_CIB_TAG_LRM,
+				add_held_history(lrm, held);
+				);
+		}
+		
+	} else if(rc != cib_NOTEXISTS) {
+		crm_warn("join-%d: Could not determin which LRM histories we hold: %s",
+			 join_id, cib_error2string(rc));
+	}
+	
+	if(AM_I_DC && fsa_state == S_FINALIZE_JOIN && join_id == current_join_id) {
+		if(check_join_state(fsa_state, __FUNCTION__) == FALSE) {
+			crm_debug("Notifying %d clients of join-%d results"
+				  " (%d LRM histories held)",
+				  g_hash_table_size(integrated_nodes), current_join_id,
+				  g_hash_table_size(held));
+			g_hash_table_foreach_remove(
+				integrated_nodes, finalize_join_for, held);
+		}
+		
+	} else {
+		crm_debug("No longer the DC in S_FINALIZE_JOIN for join-%d: %s/%s",
+			  join_id, AM_I_DC?"DC":"CRMd", fsa_state2string(fsa_state));
+	}
+
+	g_hash_table_destroy(held);
+	crm_free(user_data);
+}
+
+/* Find the LRM histories we already hold, so that nodes which still
+ * have the same one only need to send us what changed since
+ */
+static void
+finalize_join_all(void) 
+{
+	int call_id = 0;
+
+	if(join_lrm_history == NULL || g_hash_table_size(join_lrm_history) == 0) {
+		crm_debug("Notifying %d clients of join-%d results",
+			  g_hash_table_size(integrated_nodes), current_join_id);
+		g_hash_table_foreach_remove(
+			integrated_nodes, finalize_join_for, NULL);
+		return;
+	}
+
+	call_id = fsa_cib_conn->cmds->query(
+		fsa_cib_conn,
+		"//"XML_CIB_TAG_STATE"/"XML_CIB_TAG_LRM"[@"XML_LRM_ATTR_HISTORY"]",
+		NULL, cib_scope_local|cib_xpath|cib_no_children);
+	add_cib_op_callback(fsa_cib_conn, call_id, FALSE,
+			    crm_itoa(current_join_id), finalize_history_callback);
+}
+
 static void
 join_update_complete_callback(xmlNode *msg, int call_id, int rc,
 			      xmlNode *output, void *user_data)
@@ -493,6 +592,117 @@ join_update_complete_callback(xmlNode *msg, int call_id, int rc,
 	}
 }
 
+static void
+join_confirm_node(const char *join_from, const char *join_id_s, xmlNode *update)
+{
+	int call_id = 0;
+
+	g_hash_table_remove(finalized_nodes, join_from);
+	
+	if(g_hash_table_lookup(confirmed_nodes, join_from) != NULL) {
+		crm_err("join-%s: hash already contains confirmation from %s",
+			join_id_s, join_from);
+	}
+	
+	g_hash_table_insert(
+		confirmed_nodes, crm_strdup(join_from), crm_strdup(join_id_s));
+
+ 	crm_info("join-%s: Updating node state to %s for %s",
+ 		 join_id_s, CRMD_JOINSTATE_MEMBER, join_from);
+
+	fsa_cib_update(XML_CIB_TAG_STATUS, update,
+		       cib_scope_local|cib_quorum_override|cib_can_create, call_id);
+	add_cib_op_callback(
+		fsa_cib_conn, call_id, FALSE, NULL, join_update_complete_callback);
+ 	crm_debug("join-%s: Registered callback for LRM update %d",
+		  join_id_s, call_id);
+}
+
+#define lrm_state_template "//"XML_CIB_TAG_STATE"[@uname='%s']/"XML_CIB_TAG_LRM
+#define lrm_rsc_set_template "//"XML_CIB_TAG_STATE"[@uname='%s']//"XML_LRM_TAG_RESOURCE"[%s]"
+
+/* Replace the resources listed in an LRM delta, dropping those the node no
+ * longer has.  Resources not listed are unchanged since the base history.
+ */
+static void
+join_apply_delta(const char *join_from, xmlNode *lrm) 
+{
+	int ids_len = 0;
+	char *ids = NULL;
+	xmlNode *rsc_list = find_xml_node(lrm, XML_LRM_TAG_RESOURCES, FALSE);
+
+	xml_child_iter_filter(
+		rsc_list, xml_rsc, XML_LRM_TAG_RESOURCE,
+
+		const char *rsc_id = ID(xml_rsc);
+		int len = strlen(" or @"XML_ATTR_ID"=''") + strlen(rsc_id);
+
+		crm_realloc(ids, ids_len + len + 1);
+		ids_len += sprintf(ids + ids_len, "%s@"XML_ATTR_ID"='%s'",
+				   ids_len?" or ":"", rsc_id);
+
+		if(crm_is_true(crm_element_value(xml_rsc, XML_LRM_ATTR_REMOVED))) {
+			free_xml_from_parent(rsc_list, xml_rsc);
+		}
+		);
+
+	if(ids != NULL) {
+		int call_id = 0;
+		int max = strlen(lrm_rsc_set_template) + strlen(join_from) + ids_len + 1;
+		char *xpath = NULL;
+		
+		crm_malloc0(xpath, max);
+		snprintf(xpath, max, lrm_rsc_set_template, join_from, ids);
+		call_id = fsa_cib_conn->cmds->delete(
+			fsa_cib_conn, xpath, NULL,
+			cib_scope_local|cib_quorum_override|cib_xpath|cib_multiple);
+		add_cib_op_callback(fsa_cib_conn, call_id, FALSE,
+				    NULL, join_update_complete_callback);
+		crm_free(xpath);
+		crm_free(ids);
+	}
+
+	xml_remove_prop(lrm, XML_LRM_ATTR_HISTORY_BASE);
+}
+
+static void
+join_delta_callback(xmlNode *msg, int call_id, int rc,
+		    xmlNode *output, void *user_data)
+{
+	int join_id = -1;
+	const char *held = NULL;
+	ha_msg_input_t *join_ack = user_data;
+	const char *join_id_s = crm_element_value(join_ack->msg, F_CRM_JOIN_ID);
+	const char *join_from = crm_element_value(join_ack->msg, F_CRM_HOST_FROM);
+	xmlNode *lrm = get_xpath_object("//"XML_CIB_TAG_LRM, join_ack->xml, LOG_ERR);
+	const char *base = crm_element_value(lrm, XML_LRM_ATTR_HISTORY_BASE);
+
+	crm_element_value_int(join_ack->msg, F_CRM_JOIN_ID, &join_id);
+	if(rc == cib_ok) {
+		held = crm_element_value(output, XML_LRM_ATTR_HISTORY);
+	}
+	
+	if(AM_I_DC == FALSE || join_id != current_join_id
+	   || g_hash_table_lookup(finalized_nodes, join_from) == NULL) {
+		crm_info("join-%d: Discarding LRM delta from %s", join_id, join_from);
+
+	} else if(safe_str_neq(held, base)) {
+		/* Restarting the join gets us their full state */
+		crm_warn("join-%d: LRM delta from %s is against %s but we now hold %s",
+			 join_id, join_from, base, crm_str(held));
+		register_fsa_error_adv(
+			C_FSA_INTERNAL, I_ELECTION_DC, NULL, NULL, __FUNCTION__);
+
+	} else {
+		crm_info("join-%d: Applying LRM delta from %s against %s",
+			 join_id, join_from, base);
+		join_apply_delta(join_from, lrm);
+		join_confirm_node(join_from, join_id_s, join_ack->xml);
+	}
+
+	delete_ha_msg_input(join_ack);
+}
+
 /*	A_DC_JOIN_PROCESS_ACK	*/
 void
 do_dc_join_ack(long long action,
@@ -503,6 +713,7 @@ do_dc_join_ack(long long action,
 {
 	int join_id = -1;
 	int call_id = 0;
+	xmlNode *lrm = NULL;
 	ha_msg_input_t *join_ack = fsa_typed_data(fsa_dt_ha_msg);
 
 	const char *join_id_s  = NULL;
@@ -542,30 +753,31 @@ do_dc_join_ack(long long action,
 		return;
 	}
 
-	g_hash_table_remove(finalized_nodes, join_from);
-	
-	if(g_hash_table_lookup(confirmed_nodes, join_from) != NULL) {
-		crm_err("join-%d: hash already contains confirmation from %s",
-			join_id, join_from);
+	lrm = get_xpath_object("//"XML_CIB_TAG_LRM, join_ack->xml, LOG_DEBUG_2);
+	if(lrm != NULL && crm_element_value(lrm, XML_LRM_ATTR_HISTORY_BASE) != NULL) {
+		/* Only changes since the history we held when we ACK'd them,
+		 * make sure nothing happened to it in the meantime
+		 */
+		int max = strlen(lrm_state_template) + strlen(join_from) + 1;
+		char *xpath = NULL;
+
+		crm_malloc0(xpath, max);
+		snprintf(xpath, max, lrm_state_template, join_from);
+		call_id = fsa_cib_conn->cmds->query(
+			fsa_cib_conn, xpath, NULL,
+			cib_scope_local|cib_xpath|cib_no_children);
+		add_cib_op_callback(fsa_cib_conn, call_id, FALSE,
+				    copy_ha_msg_input(join_ack), join_delta_callback);
+		crm_free(xpath);
+		return;
 	}
-	
-	g_hash_table_insert(
-		confirmed_nodes, crm_strdup(join_from), crm_strdup(join_id_s));
-
- 	crm_info("join-%d: Updating node state to %s for %s",
- 		 join_id, CRMD_JOINSTATE_MEMBER, join_from);
 
 	/* update CIB with the current LRM status from the node
 	 * We dont need to notify the TE of these updates, a transition will
 	 *   be started in due time
 	 */
 	erase_status_tag(join_from, XML_CIB_TAG_LRM, cib_scope_local);
-	fsa_cib_update(XML_CIB_TAG_STATUS, join_ack->xml,
-		       cib_scope_local|cib_quorum_override|cib_can_create, call_id);
-	add_cib_op_callback(
-		fsa_cib_conn, call_id, FALSE, NULL, join_update_complete_callback);
- 	crm_debug("join-%d: Registered callback for LRM update %d",
-		  join_id, call_id);
+	join_confirm_node(join_from, join_id_s, join_ack->xml);
 }
 
 gboolean
@@ -608,9 +820,21 @@ finalize_join_for(gpointer key, gpointer value, gpointer user_data)
 	
 	/* set the ack/nack */
 	if(safe_str_eq(join_state, CRMD_JOINSTATE_MEMBER)) {
+		GHashTable *held = user_data;
+
 		crm_debug("join-%d: ACK'ing join request from %s, state %s",
 			  current_join_id, join_to, join_state);
 		crm_xml_add(acknak, CRM_OP_JOIN_ACKNAK, XML_BOOLEAN_TRUE);
+
+		if(held != NULL
+		   && g_hash_table_lookup(join_lrm_history, join_to) != NULL) {
+			/* they need only send what changed since */
+			const char *stamp = g_hash_table_lookup(
+				held, g_hash_table_lookup(join_lrm_history, join_to));
+			crm_debug("join-%d: We hold LRM history %s for %s",
+				  current_join_id, crm_str(stamp), join_to);
+			crm_xml_add(acknak, F_CRM_LRM_HISTORY, stamp);
+		}
 		g_hash_table_insert(
 			finalized_nodes,
 			crm_strdup(join_to), crm_strdup(CRMD_JOINSTATE_MEMBER));
@@ -47,10 +47,22 @@ struct recurring_op_s
 		gboolean cancelled;
 };
 
+struct bulk_deletion_s 
+{
+	int      refs;
+	int      deleted;
+	char    *from_sys;
+	char    *from_host;
+	xmlNode *request;
+	xmlNode *update;
+	xmlNode *resources;
+};
+
 struct pending_deletion_op_s 
 {
 	char           *rsc;
 	ha_msg_input_t *input;
+	struct bulk_deletion_s *bulk;
 };
 
 struct delete_event_s 
@@ -66,9 +78,13 @@ gboolean build_operation_update(
     xmlNode *rsc_list, lrm_rsc_t *rsc, lrm_op_t *op, const char *src, int lpc, int level);
 
 gboolean build_active_RAs(xmlNode *rsc_list);
+static void lrm_history_changed(const char *rsc_id);
+static void lrm_history_callback(
+    xmlNode *msg, int call_id, int rc, xmlNode *output, void *user_data);
 gboolean is_rsc_active(const char *rsc_id);
 
 int do_update_resource(lrm_op_t *op);
+static void check_rsc_updates(void);
 gboolean process_lrm_event(lrm_op_t *op);
 
 void do_lrm_rsc_op(lrm_rsc_t *rsc, const char *operation,
@@ -83,6 +99,10 @@ void send_direct_ack(const char *to_host, const char *to_sys,
 void free_recurring_op(gpointer value);
 void free_deletion_op(gpointer value);
 
+static void bulk_delete_record(
+	struct bulk_deletion_s *bulk, const char *rsc_id, int rc);
+static void bulk_delete_release(struct bulk_deletion_s *bulk, gboolean reply);
+
 GHashTable *resources = NULL;
 GHashTable *pending_ops = NULL;
 GHashTable *deletion_ops = NULL;
@@ -124,6 +144,8 @@ do_lrm_control(long long action,
 		    return;
 		}
 		
+		flush_rsc_updates("disconnecting");
+		
 		if(is_set(fsa_input_register, R_LRM_CONNECTED)) {
 		    clear_bit_inplace(fsa_input_register, R_LRM_CONNECTED);
 		    fsa_lrm_conn->lrm_ops->signoff(fsa_lrm_conn);
@@ -749,13 +771,56 @@ is_rsc_active(const char *rsc_id)
 }
 
 
-gboolean
-build_active_RAs(xmlNode *rsc_list)
+static void
+build_active_RA(xmlNode *rsc_list, lrm_rsc_t *the_rsc)
 {
 	GList *op_list  = NULL;
-	GList *lrm_list = NULL;
+	int max_call_id = -1;
 	gboolean found_op = FALSE;
 	state_flag_t cur_state = 0;
+	xmlNode *xml_rsc = create_xml_node(rsc_list, XML_LRM_TAG_RESOURCE);
+
+	crm_xml_add(xml_rsc, XML_ATTR_ID, the_rsc->id);
+	crm_xml_add(xml_rsc, XML_ATTR_TYPE, the_rsc->type);
+	crm_xml_add(xml_rsc, XML_AGENT_ATTR_CLASS, the_rsc->class);
+	crm_xml_add(xml_rsc, XML_AGENT_ATTR_PROVIDER,the_rsc->provider);
+
+	op_list = the_rsc->ops->get_cur_state(the_rsc, &cur_state);
+
+	slist_iter(
+		op, lrm_op_t, op_list, llpc,
+
+		if(max_call_id < op->call_id) {
+			build_operation_update(
+			    xml_rsc, the_rsc, op, __FUNCTION__, llpc, LOG_DEBUG_2);
+
+		} else if(max_call_id > op->call_id) {
+			crm_err("Bad call_id in list=%d. Previous call_id=%d",
+				op->call_id, max_call_id);
+
+		} else {
+			crm_warn("lrm->get_cur_state() returned"
+				 " duplicate entries for call_id=%d",
+				 op->call_id);
+		}
+		max_call_id = op->call_id;
+		found_op = TRUE;
+		lrm_free_op(op);
+		);
+		
+	if(found_op == FALSE && g_list_length(op_list) != 0) {
+		crm_err("Could not properly determin last op"
+			" for %s from %d entries", the_rsc->id,
+			g_list_length(op_list));
+	}
+
+	g_list_free(op_list);
+}
+
+gboolean
+build_active_RAs(xmlNode *rsc_list)
+{
+	GList *lrm_list = NULL;
 	
 	if(fsa_lrm_conn == NULL) {
 		return FALSE;
@@ -766,8 +831,6 @@ build_active_RAs(xmlNode *rsc_list)
 	slist_iter(
 		rid, char, lrm_list, lpc,
 
-		int max_call_id = -1;
-		xmlNode *xml_rsc = NULL;
 		lrm_rsc_t *the_rsc = fsa_lrm_conn->lrm_ops->get_rsc(fsa_lrm_conn, rid);
 		
 		if(the_rsc == NULL) {
@@ -775,53 +838,169 @@ build_active_RAs(xmlNode *rsc_list)
 		    continue;
 		}
 
-		xml_rsc = create_xml_node(rsc_list, XML_LRM_TAG_RESOURCE);
-		crm_xml_add(xml_rsc, XML_ATTR_ID, the_rsc->id);
-		crm_xml_add(xml_rsc, XML_ATTR_TYPE, the_rsc->type);
-		crm_xml_add(xml_rsc, XML_AGENT_ATTR_CLASS, the_rsc->class);
-		crm_xml_add(xml_rsc, XML_AGENT_ATTR_PROVIDER,the_rsc->provider);
+		build_active_RA(rsc_list, the_rsc);
+		lrm_free_rsc(the_rsc);
+		);
+
+	slist_destroy(char, rid, lrm_list, free(rid));
+
+	return TRUE;
+}
 
-		op_list = the_rsc->ops->get_cur_state(the_rsc, &cur_state);
+/*
+ * Versioned LRM history
+ *
+ * Every change we make to our lrm section bumps lrm_history_version and
+ * records it against the resource.  Updates are stamped with
+ * "<epoch>:<version>", so a CIB holding our stamp holds everything we
+ * changed up to that version.  When we rejoin, the DC tells us which
+ * stamp it holds and we only send the resources changed since then.
+ *
+ * A failed write leaves a hole behind the stamp, so it starts a new
+ * epoch which the CIB can't hold until we next send our full state.
+ * Updates that only reached our local CIB stop us stamping until the
+ * next join update has carried them to the DC.
+ */
+static char *lrm_history_epoch = NULL;
+static int lrm_history_version = 0;
+static gboolean lrm_history_synced = FALSE;
+static GHashTable *lrm_history_changes = NULL;
 
-		slist_iter(
-			op, lrm_op_t, op_list, llpc,
+static void
+lrm_history_reset(const char *reason)
+{
+	static int epochs = 0;
+	int max = strlen(fsa_our_uname?fsa_our_uname:"") + 64;
 
-			if(max_call_id < op->call_id) {
-				build_operation_update(
-				    xml_rsc, the_rsc, op, __FUNCTION__, llpc, LOG_DEBUG_2);
+	crm_free(lrm_history_epoch);
+	crm_malloc0(lrm_history_epoch, max);
+	snprintf(lrm_history_epoch, max, "%s-%lx-%x-%d",
+		 fsa_our_uname?fsa_our_uname:"", (unsigned long)time(NULL),
+		 (unsigned)getpid(), epochs++);
 
-			} else if(max_call_id > op->call_id) {
-				crm_err("Bad call_id in list=%d. Previous call_id=%d",
-					op->call_id, max_call_id);
+	if(lrm_history_changes != NULL) {
+	    g_hash_table_destroy(lrm_history_changes);
+	}
+	lrm_history_changes = g_hash_table_new_full(
+		g_str_hash, g_str_equal, g_hash_destroy_str, NULL);
+	lrm_history_synced = FALSE;
 
-			} else {
-				crm_warn("lrm->get_cur_state() returned"
-					 " duplicate entries for call_id=%d",
-					 op->call_id);
-			}
-			max_call_id = op->call_id;
-			found_op = TRUE;
-			lrm_free_op(op);
-			);
-		
-		if(found_op == FALSE && g_list_length(op_list) != 0) {
-			crm_err("Could not properly determin last op"
-				" for %s from %d entries", the_rsc->id,
-				g_list_length(op_list));
-		}
+	crm_info("Starting LRM history %s: %s", lrm_history_epoch, reason);
+}
 
-		g_list_free(op_list);
-		lrm_free_rsc(the_rsc);
-		);
+static void
+lrm_history_changed(const char *rsc_id)
+{
+	if(lrm_history_changes == NULL) {
+	    lrm_history_reset("first change");
+	}
+	lrm_history_version++;
+	g_hash_table_replace(lrm_history_changes, crm_strdup(rsc_id),
+			     GINT_TO_POINTER(lrm_history_version));
+}
 
-	slist_destroy(char, rid, lrm_list, free(rid));
+static void
+lrm_history_stamp(xmlNode *lrm)
+{
+	int max = strlen(lrm_history_epoch) + 16;
+	char *stamp = NULL;
 
-	return TRUE;
+	crm_malloc0(stamp, max);
+	snprintf(stamp, max, "%s:%d", lrm_history_epoch, lrm_history_version);
+	crm_xml_add(lrm, XML_LRM_ATTR_HISTORY, stamp);
+	crm_free(stamp);
 }
 
-xmlNode*
-do_lrm_query(gboolean is_replace)
+static void
+lrm_history_callback(xmlNode *msg, int call_id, int rc,
+		     xmlNode *output, void *user_data)
+{
+	switch(rc) {
+	    case cib_ok:
+	    case cib_diff_failed:
+	    case cib_diff_resync:
+	    case cib_NOTEXISTS:
+		break;
+	    default:
+		crm_warn("LRM history update %d failed: %s",
+			 call_id, cib_error2string(rc));
+		lrm_history_reset("update failed");
+	}
+}
+
+const char *
+lrm_history_id(void) 
 {
+	if(lrm_history_changes == NULL) {
+	    lrm_history_reset("join");
+	}
+	return lrm_history_epoch;
+}
+
+struct lrm_history_delta_s 
+{
+	int since;
+	int changed;
+	xmlNode *rsc_list;
+};
+
+static void
+lrm_history_add_changed(gpointer key, gpointer value, gpointer user_data)
+{
+	const char *rsc_id = key;
+	lrm_rsc_t *the_rsc = NULL;
+	struct lrm_history_delta_s *delta = user_data;
+
+	if(GPOINTER_TO_INT(value) <= delta->since) {
+	    return;
+	}
+
+	delta->changed++;
+	the_rsc = fsa_lrm_conn->lrm_ops->get_rsc(fsa_lrm_conn, rsc_id);
+	if(the_rsc == NULL) {
+	    xmlNode *xml_rsc = create_xml_node(delta->rsc_list, XML_LRM_TAG_RESOURCE);
+	    crm_xml_add(xml_rsc, XML_ATTR_ID, rsc_id);
+	    crm_xml_add(xml_rsc, XML_LRM_ATTR_REMOVED, XML_BOOLEAN_TRUE);
+	    return;
+	}
+
+	build_active_RA(delta->rsc_list, the_rsc);
+	lrm_free_rsc(the_rsc);
+}
+
+/* The version in base, if it is one of ours */
+static int
+lrm_history_since(const char *base) 
+{
+	const char *sep = NULL;
+	int since = -1;
+
+	if(base == NULL || lrm_history_epoch == NULL) {
+	    return -1;
+	}
+
+	sep = strrchr(base, ':');
+	if(sep == NULL
+	   || strlen(lrm_history_epoch) != (size_t)(sep - base)
+	   || strncmp(base, lrm_history_epoch, sep - base) != 0) {
+	    crm_info("Not sending an LRM delta: %s is not from history %s",
+		     base, lrm_history_epoch);
+	    return -1;
+	}
+
+	since = crm_parse_int(sep+1, "-1");
+	if(since > lrm_history_version) {
+	    crm_warn("Not sending an LRM delta: %s is ahead of us (%d)",
+		     base, lrm_history_version);
+	    return -1;
+	}
+	return since;
+}
+
+static xmlNode*
+build_lrm_state(const char *base, gboolean stamp)
+{
+	int since = -1;
 	gboolean shut_down = FALSE;
 	xmlNode *xml_result= NULL;
 	xmlNode *xml_state = NULL;
@@ -829,6 +1008,9 @@ do_lrm_query(gboolean is_replace)
 	xmlNode *rsc_list  = NULL;
 	const char *exp_state = CRMD_STATE_ACTIVE;
 
+	/* the result shouldn't be older than what we've already sent */
+	flush_rsc_updates("state query");
+
 	if(is_set(fsa_input_register, R_SHUTDOWN)) {
 		exp_state = CRMD_STATE_INACTIVE;
 		shut_down = TRUE;
@@ -843,8 +1025,29 @@ do_lrm_query(gboolean is_replace)
 	crm_xml_add(xml_data, XML_ATTR_ID, fsa_our_uuid);
 	rsc_list  = create_xml_node(xml_data, XML_LRM_TAG_RESOURCES);
 
-	/* Build a list of active (not always running) resources */
-	build_active_RAs(rsc_list);
+	if(fsa_lrm_conn != NULL) {
+	    since = lrm_history_since(base);
+	}
+
+	if(since >= 0) {
+	    struct lrm_history_delta_s delta = { since, 0, rsc_list };
+
+	    g_hash_table_foreach(lrm_history_changes, lrm_history_add_changed, &delta);
+	    crm_xml_add(xml_data, XML_LRM_ATTR_HISTORY_BASE, base);
+	    crm_info("Sending %d LRM changes since %s", delta.changed, base);
+
+	} else {
+	    /* Build a list of active (not always running) resources */
+	    build_active_RAs(rsc_list);
+	}
+
+	if(stamp) {
+	    if(lrm_history_changes == NULL) {
+		lrm_history_reset("full update");
+	    }
+	    lrm_history_stamp(xml_data);
+	    lrm_history_synced = TRUE;
+	}
 
 	xml_result = create_cib_fragment(xml_state, XML_CIB_TAG_STATUS);
 	crm_log_xml_debug_3(xml_state, "Current state of the LRM");
@@ -853,6 +1056,19 @@ do_lrm_query(gboolean is_replace)
 	return xml_result;
 }
 
+/* Our state for the DC, as changes since base if we can */
+xmlNode*
+do_lrm_join_query(const char *base)
+{
+	return build_lrm_state(base, TRUE);
+}
+
+xmlNode*
+do_lrm_query(void)
+{
+	return build_lrm_state(NULL, FALSE);
+}
+
 
 static void notify_deleted(ha_msg_input_t *input, const char *rsc_id, int rc) 
 {
@@ -898,7 +1114,16 @@ static gboolean lrm_remove_deleted_rsc(
     struct pending_deletion_op_s *op = value;
 
     if(safe_str_eq(event->rsc, op->rsc)) {
-	notify_deleted(op->input, event->rsc, event->rc);
+	if(op->bulk != NULL) {
+	    /* part of a bulk deletion - fold it into the single reply */
+	    struct bulk_deletion_s *bulk = op->bulk;
+	    op->bulk = NULL;
+	    bulk_delete_record(bulk, event->rsc, event->rc);
+	    bulk_delete_release(bulk, TRUE);
+
+	} else {
+	    notify_deleted(op->input, event->rsc, event->rc);
+	}
 	return TRUE;
     }
     return FALSE;
@@ -931,16 +1156,23 @@ delete_rsc_entry(ha_msg_input_t *input, const char *rsc_id, int rc)
     CRM_CHECK(rsc_id != NULL, return);
     
     if(rc == HA_OK) {
+	int call_id = 0;
 	char *rsc_xpath = NULL;
 	char *rsc_id_copy = crm_strdup(rsc_id);
 	int max = strlen(rsc_template) + strlen(rsc_id) + strlen(fsa_our_uname) + 1;
+
+	/* don't let a queued update bring it back */
+	flush_rsc_updates("resource deletion");
 	crm_malloc0(rsc_xpath, max);
 	snprintf(rsc_xpath, max, rsc_template, fsa_our_uname, rsc_id);
 	CRM_CHECK(rsc_id != NULL, return);
 	
 	crm_debug("sync: Sending delete op for %s", rsc_id);
-	fsa_cib_conn->cmds->delete(
+	lrm_history_changed(rsc_id);
+	call_id = fsa_cib_conn->cmds->delete(
 	    fsa_cib_conn, rsc_xpath, NULL, cib_quorum_override|cib_xpath);
+	add_cib_op_callback(
+	    fsa_cib_conn, call_id, FALSE, NULL, lrm_history_callback);
 
 	g_hash_table_foreach_remove(pending_ops, lrm_remove_deleted_op, rsc_id_copy);
     
@@ -969,7 +1201,12 @@ delete_rsc_entry(ha_msg_input_t *input, const char *rsc_id, int rc)
 static void
 delete_op_entry(lrm_op_t *op, const char *rsc_id, const char *key, int call_id) 
 {
+	int rc = 0;
 	xmlNode *xml_top = NULL;
+
+	/* don't let a queued update bring it back */
+	flush_rsc_updates("operation deletion");
+
 	if(op != NULL) {
 		xml_top = create_xml_node(NULL, XML_LRM_TAG_RSC_OP);
 		crm_xml_add_int(xml_top, XML_LRM_ATTR_CALLID, op->call_id);
@@ -978,7 +1215,8 @@ delete_op_entry(lrm_op_t *op, const char *rsc_id, const char *key, int call_id)
 		crm_debug("async: Sending delete op for %s_%s_%d (call=%d)",
 			  op->rsc_id, op->op_type, op->interval, op->call_id);
 
-		fsa_cib_conn->cmds->delete(
+		lrm_history_changed(op->rsc_id);
+		rc = fsa_cib_conn->cmds->delete(
 		    fsa_cib_conn, XML_CIB_TAG_STATUS, xml_top, cib_quorum_override);		
 
 	} else if (rsc_id != NULL && key != NULL) {
@@ -996,7 +1234,8 @@ delete_op_entry(lrm_op_t *op, const char *rsc_id, const char *key, int call_id)
 	    }
 	    
 	    crm_debug("sync: Sending delete op for %s (call=%d)", rsc_id, call_id);
-	    fsa_cib_conn->cmds->delete(
+	    lrm_history_changed(rsc_id);
+	    rc = fsa_cib_conn->cmds->delete(
 		fsa_cib_conn, op_xpath, NULL, cib_quorum_override|cib_xpath);
 
 	    crm_free(op_xpath);
@@ -1006,6 +1245,8 @@ delete_op_entry(lrm_op_t *op, const char *rsc_id, const char *key, int call_id)
 		return;
 	}
 
+	add_cib_op_callback(fsa_cib_conn, rc, FALSE, NULL, lrm_history_callback);
+
  	crm_log_xml_debug_2(xml_top, "op:cancel");
  	free_xml(xml_top);
 }
@@ -1168,6 +1409,186 @@ get_lrm_resource(xmlNode *resource, xmlNode *op_msg, gboolean do_create)
 }
 
 
+#define rsc_set_template "//"XML_CIB_TAG_STATE"[@uname='%s']//"XML_LRM_TAG_RESOURCE"[%s]"
+
+static void
+bulk_delete_record(struct bulk_deletion_s *bulk, const char *rsc_id, int rc) 
+{
+	lrm_op_t *op = construct_op(bulk->request, rsc_id, CRMD_ACTION_DELETE);
+	xmlNode *xml_entry = NULL;
+
+	CRM_ASSERT(op != NULL);
+	if(rc == HA_OK) {
+		op->op_status = LRM_OP_DONE;
+		op->rc = EXECRA_OK;
+		bulk->deleted++;
+	} else {
+		op->op_status = LRM_OP_ERROR;
+		op->rc = EXECRA_UNKNOWN_ERROR;
+	}
+
+	xml_entry = create_xml_node(bulk->resources, XML_LRM_TAG_RESOURCE);
+	crm_xml_add(xml_entry, XML_ATTR_ID, rsc_id);
+	build_operation_update(xml_entry, NULL, op, __FUNCTION__, 0, LOG_DEBUG);
+	free_lrm_op(op);
+}
+
+/*
+ * Drop a reference to a bulk deletion
+ *
+ * The reply is only sent once the last resource is accounted for so
+ * that the requester sees exactly one reply per node
+ */
+static void
+bulk_delete_release(struct bulk_deletion_s *bulk, gboolean reply) 
+{
+	xmlNode *msg = NULL;
+	xmlNode *fragment = NULL;
+
+	bulk->refs--;
+	if(bulk->refs > 0) {
+		return;
+	}
+
+	if(reply) {
+		fragment = create_cib_fragment(bulk->update, XML_CIB_TAG_STATUS);
+		msg = create_request(CRM_OP_INVOKE_LRM, fragment, bulk->from_host,
+				     bulk->from_sys, CRM_SYSTEM_LRMD, NULL);
+
+		crm_info("ACK'ing deletion of %d resources for %s on %s",
+			 bulk->deleted, crm_str(bulk->from_sys), crm_str(bulk->from_host));
+		if(relay_message(msg, TRUE) == FALSE) {
+			crm_log_xml(LOG_ERR, "Unable to route reply", msg);
+		}
+
+		if(bulk->deleted > 0 && safe_str_neq(bulk->from_sys, CRM_SYSTEM_TENGINE)) {
+			/* this isn't expected - trigger a new transition */
+			char *now_s = crm_itoa(time(NULL));
+			crm_debug("Triggering a refresh after %s deleted %d resources from the LRM",
+				  bulk->from_sys, bulk->deleted);
+			update_attr(fsa_cib_conn, cib_none, XML_CIB_TAG_CRMCONFIG,
+				    NULL, NULL, NULL, "last-lrm-refresh", now_s, FALSE);
+			crm_free(now_s);
+		}
+		free_xml(fragment);
+		free_xml(msg);
+	}
+
+	crm_free(bulk->from_sys);
+	crm_free(bulk->from_host);
+	free_xml(bulk->request);
+	free_xml(bulk->update);
+	crm_free(bulk);
+}
+
+/*
+ * Remove a set of resources from the LRM in one pass
+ *
+ * Unlike CRM_OP_LRM_DELETE this results in a single reply, rather than
+ * one per resource.  Resources the LRM is still busy with are included
+ * in that reply once their deletion completes.
+ */
+static void
+do_lrm_bulk_delete(ha_msg_input_t *input, const char *from_host, const char *from_sys) 
+{
+	int rc = HA_OK;
+	int ids_len = 0;
+	char *ids = NULL;
+	xmlNode *iter = NULL;
+	struct bulk_deletion_s *bulk = NULL;
+
+	/* don't let a queued update bring any of them back */
+	flush_rsc_updates("bulk resource deletion");
+
+	crm_malloc0(bulk, sizeof(struct bulk_deletion_s));
+	bulk->refs = 1;
+	bulk->from_sys = crm_strdup(from_sys?from_sys:CRM_SYSTEM_TENGINE);
+	if(from_host != NULL) {
+		bulk->from_host = crm_strdup(from_host);
+	}
+	bulk->request = copy_xml(input->xml);
+	bulk->update = create_node_state(
+		fsa_our_uname, NULL, NULL, NULL, NULL, NULL, FALSE, __FUNCTION__);
+	iter = create_xml_node(bulk->update, XML_CIB_TAG_LRM);
+	crm_xml_add(iter, XML_ATTR_ID, fsa_our_uuid);
+	bulk->resources = create_xml_node(iter, XML_LRM_TAG_RESOURCES);
+	
+	xml_child_iter_filter(
+		input->xml, xml_rsc, XML_CIB_TAG_RESOURCE,
+
+		const char *rsc_id = ID(xml_rsc);
+		lrm_rsc_t *rsc = get_lrm_resource(xml_rsc, input->xml, FALSE);
+
+		rc = HA_OK;
+		if(rsc == NULL) {
+		    crm_notice("Not creating resource for a %s event: %s",
+			       CRMD_ACTION_DELETE, rsc_id);
+
+		} else {
+		    crm_info("Removing resource %s from the LRM", rsc->id);
+		    rc = fsa_lrm_conn->lrm_ops->delete_rsc(fsa_lrm_conn, rsc->id);
+		}
+
+		if(rsc == NULL) {
+		    /* nothing to do */
+		    
+		} else if(rc == HA_OK) {
+		    char *rsc_id_copy = crm_strdup(rsc->id);
+		    int len = strlen(" or @"XML_ATTR_ID"=''") + strlen(rsc->id);
+
+		    crm_realloc(ids, ids_len + len + 1);
+		    ids_len += sprintf(ids + ids_len, "%s@"XML_ATTR_ID"='%s'",
+				       ids_len?" or ":"", rsc->id);
+
+		    g_hash_table_foreach_remove(pending_ops, lrm_remove_deleted_op, rsc_id_copy);
+		    lrm_history_changed(rsc_id_copy);
+		    crm_free(rsc_id_copy);
+		    
+#ifdef HAVE_LRM_OP_T_RSC_DELETED
+		} else if(rc == HA_RSCBUSY) {
+		    /* recorded in the reply once the LRM is done with it */
+		    struct pending_deletion_op_s *pending = NULL;
+		    char *ref = crm_element_value_copy(input->msg, XML_ATTR_REFERENCE);
+		    crm_info("Resource deletion for %s scheduled for %s on %s",
+			     rsc->id, from_sys, from_host);
+		    
+		    crm_malloc0(pending, sizeof(struct pending_deletion_op_s));
+		    pending->rsc = crm_strdup(rsc->id);
+		    pending->bulk = bulk;
+		    bulk->refs++;
+		    g_hash_table_insert(deletion_ops, crm_concat(ref, rsc->id, '-'), pending);
+		    crm_free(ref);
+		    lrm_free_rsc(rsc);
+		    continue;
+#endif
+		} else {
+		    crm_err("Deletion of resource '%s' for %s on %s failed: %d",
+			    rsc->id, from_sys, from_host, rc);
+		}
+		lrm_free_rsc(rsc);
+		bulk_delete_record(bulk, rsc_id, rc);
+		);
+
+	if(ids != NULL) {
+		int call_id = 0;
+		int max = strlen(rsc_set_template) + strlen(fsa_our_uname) + strlen(ids) + 1;
+		char *rsc_xpath = NULL;
+		
+		crm_malloc0(rsc_xpath, max);
+		snprintf(rsc_xpath, max, rsc_set_template, fsa_our_uname, ids);
+		
+		crm_debug("sync: Sending delete op for %d resources", bulk->deleted);
+		call_id = fsa_cib_conn->cmds->delete(
+			fsa_cib_conn, rsc_xpath, NULL, cib_quorum_override|cib_xpath|cib_multiple);
+		add_cib_op_callback(
+			fsa_cib_conn, call_id, FALSE, NULL, lrm_history_callback);
+		crm_free(rsc_xpath);
+	}
+
+	crm_free(ids);
+	bulk_delete_release(bulk, TRUE);
+}
+
 /*	 A_LRM_INVOKE	*/
 void
 do_lrm_invoke(long long action,
@@ -1192,7 +1613,11 @@ do_lrm_invoke(long long action,
 	
 	crm_debug_2("LRM command from: %s", from_sys);
 	
-	if(safe_str_eq(crm_op, CRM_OP_LRM_DELETE)) {
+	if(safe_str_eq(crm_op, CRM_OP_LRM_BULK_DELETE)) {
+		do_lrm_bulk_delete(input, from_host, from_sys);
+		return;
+		
+	} else if(safe_str_eq(crm_op, CRM_OP_LRM_DELETE)) {
 		operation = CRMD_ACTION_DELETE;
 
 	} else if(safe_str_eq(operation, CRM_OP_LRM_REFRESH)) {
@@ -1247,7 +1672,7 @@ do_lrm_invoke(long long action,
 
 	if(safe_str_eq(crm_op, CRM_OP_LRM_REFRESH)) {
 		enum cib_errors rc = cib_ok;
-		xmlNode *fragment = do_lrm_query(TRUE);
+		xmlNode *fragment = do_lrm_query();
 		crm_info("Forcing a local LRM refresh");
 
 		fsa_cib_update(XML_CIB_TAG_STATUS, fragment,
@@ -1255,7 +1680,7 @@ do_lrm_invoke(long long action,
 		free_xml(fragment);
 		
 	} else if(safe_str_eq(crm_op, CRM_OP_LRM_QUERY)) {
-		xmlNode *data = do_lrm_query(FALSE);
+		xmlNode *data = do_lrm_query();
 		xmlNode *reply = create_reply(input->msg, data);
 
 		if(relay_message(reply, TRUE) == FALSE) {
@@ -1682,6 +2107,10 @@ void
 free_deletion_op(gpointer value)
 {
 	struct pending_deletion_op_s *op = value;
+	if(op->bulk != NULL) {
+		/* abandoned before the LRM finished with it */
+		bulk_delete_release(op->bulk, FALSE);
+	}
 	crm_free(op->rsc);
 	delete_ha_msg_input(op->input);
 	crm_free(op);
@@ -1788,77 +2217,77 @@ copy_lrm_rsc(const lrm_rsc_t *rsc)
 	return rsc_copy;
 }
 
+/* Resource updates
+ *
+ * Operation results are collected into a single status update for up to
+ * lrm_update_window ms, or until nothing else the TE is waiting for is
+ * still executing here, and then sent to the CIB with one call.
+ */
+#define MAX_BATCHED_UPDATES 100
+
+struct rsc_update_op_s 
+{
+	char *op_key;
+	int   call_id;
+};
+
+int lrm_update_window = 0;
+
+static xmlNode *rsc_update = NULL;
+static xmlNode *rsc_update_list = NULL;
+static GListPtr rsc_update_ops = NULL;
+static int rsc_update_opts = 0;
+static int rsc_update_len = 0;
+static guint rsc_update_timer = 0;
+
 void
 cib_rsc_callback(xmlNode *msg, int call_id, int rc,
 		 xmlNode *output, void *user_data)
 {
+    GListPtr ops = user_data;
+
     switch(rc) {
 	case cib_ok:
 	case cib_diff_failed:
 	case cib_diff_resync:
-	    crm_debug_2("Resource update %d complete: rc=%d", call_id, rc);
 	    break;
 	default:
-	    crm_warn("Resource update %d failed: (rc=%d) %s",
-		     call_id, rc, cib_error2string(rc));	
+	    lrm_history_reset("resource update failed");
     }
-}
 
+    slist_iter(
+	update_op, struct rsc_update_op_s, ops, lpc,
+	
+	switch(rc) {
+	    case cib_ok:
+	    case cib_diff_failed:
+	    case cib_diff_resync:
+		crm_debug_2("Resource update %d for %s (call=%d) complete: rc=%d",
+			    call_id, update_op->op_key, update_op->call_id, rc);
+		break;
+	    default:
+		crm_warn("Resource update %d for %s (call=%d) failed: (rc=%d) %s",
+			 call_id, update_op->op_key, update_op->call_id,
+			 rc, cib_error2string(rc));	
+	}
+	crm_free(update_op->op_key);
+	crm_free(update_op);
+	);
+    g_list_free(ops);
+}
 
 int
-do_update_resource(lrm_op_t* op)
+flush_rsc_updates(const char *reason)
 {
-/*
-  <status>
-    <nodes_status id=uname>
-      <lrm>
-        <lrm_resources>
-          <lrm_resource id=...>
-          </...>
-*/
 	int rc = cib_ok;
-	lrm_rsc_t *rsc = NULL;
-	xmlNode *update, *iter = NULL;
-	int call_opt = cib_quorum_override;
-	
-	CRM_CHECK(op != NULL, return 0);
 
-	if(fsa_state == S_ELECTION || fsa_state == S_PENDING) {
-	    crm_info("Sending update to local CIB in state: %s", fsa_state2string(fsa_state));
-	    call_opt |= cib_scope_local;
+	if(rsc_update_timer != 0) {
+	    g_source_remove(rsc_update_timer);
+	    rsc_update_timer = 0;
 	}
-	
-	iter = create_xml_node(iter, XML_CIB_TAG_STATUS); update = iter;
-	iter = create_xml_node(iter, XML_CIB_TAG_STATE);
-
-	set_uuid(iter, XML_ATTR_UUID, fsa_our_uname);
-	crm_xml_add(iter, XML_ATTR_UNAME, fsa_our_uname);
-	crm_xml_add(iter, XML_ATTR_ORIGIN, __FUNCTION__);
-	
-	iter = create_xml_node(iter, XML_CIB_TAG_LRM);
-	crm_xml_add(iter, XML_ATTR_ID, fsa_our_uuid);
-
-	iter = create_xml_node(iter, XML_LRM_TAG_RESOURCES);
-	iter = create_xml_node(iter, XML_LRM_TAG_RESOURCE);
-	crm_xml_add(iter, XML_ATTR_ID, op->rsc_id);
-		
-	rsc = fsa_lrm_conn->lrm_ops->get_rsc(fsa_lrm_conn, op->rsc_id);
-	build_operation_update(iter, rsc, op, __FUNCTION__, 0, LOG_DEBUG);
 
-	if(rsc) {
-	    crm_xml_add(iter, XML_ATTR_TYPE, rsc->type);
-	    crm_xml_add(iter, XML_AGENT_ATTR_CLASS, rsc->class);
-	    crm_xml_add(iter, XML_AGENT_ATTR_PROVIDER,rsc->provider);	
-
-	    CRM_CHECK(rsc->type != NULL,
-		      crm_err("Resource %s has no value for type", op->rsc_id));
-	    CRM_CHECK(rsc->class != NULL,
-		      crm_err("Resource %s has no value for class", op->rsc_id));
-	    lrm_free_rsc(rsc);
-
-	} else {
-	    crm_warn("Resource %s no longer exists in the lrmd", op->rsc_id);
-	    goto cleanup;
+	if(rsc_update == NULL) {
+	    return 0;
 	}
 
 	/* make it an asyncronous call and be done with it
@@ -1878,15 +2307,161 @@ do_update_resource(lrm_op_t* op)
 	 * the alternative however means blocking here for too long, which
 	 * isnt acceptable
 	 */
-	fsa_cib_update(XML_CIB_TAG_STATUS, update, call_opt, rc);
+	if(lrm_history_synced && (rsc_update_opts & cib_scope_local) == 0) {
+	    lrm_history_stamp(rsc_update_list->parent);
+	}
+
+	fsa_cib_update(XML_CIB_TAG_STATUS, rsc_update, rsc_update_opts, rc);
 			
 	/* the return code is a call number, not an error code */
-	crm_debug_2("Sent resource state update message: %d", rc);
+	crm_debug_2("Sent resource state update message %d for %d operations: %s",
+		    rc, rsc_update_len, reason);
 	fsa_cib_conn->cmds->register_callback(
-	    fsa_cib_conn, rc, 60, FALSE, NULL, "cib_rsc_callback", cib_rsc_callback);
+	    fsa_cib_conn, rc, 60, FALSE, rsc_update_ops, "cib_rsc_callback", cib_rsc_callback);
 	
-  cleanup:
-	free_xml(update);
+	free_xml(rsc_update);
+	rsc_update = NULL;
+	rsc_update_list = NULL;
+	rsc_update_ops = NULL;
+	rsc_update_len = 0;
+	return rc;
+}
+
+static gboolean
+rsc_update_timer_popped(gpointer data)
+{
+	rsc_update_timer = 0;
+	flush_rsc_updates("timer expired");
+	return FALSE;
+}
+
+static void
+ghash_count_active(gpointer key, gpointer value, gpointer user_data) 
+{
+	int *counter = user_data;
+	struct recurring_op_s *pending = value;
+
+	if(pending->interval == 0) {
+	    (*counter)++;
+	}
+}
+
+/* Send whatever we have once the last non-recurring op completes,
+ * there is no point in holding results the TE is waiting for
+ */
+static void
+check_rsc_updates(void)
+{
+	int counter = 0;
+	
+	if(rsc_update == NULL) {
+	    return;
+	}
+	if(pending_ops) {
+	    g_hash_table_foreach(pending_ops, ghash_count_active, &counter);
+	}
+	if(counter == 0) {
+	    flush_rsc_updates("no actions in progress");
+	}
+}
+
+int
+do_update_resource(lrm_op_t* op)
+{
+/*
+  <status>
+    <nodes_status id=uname>
+      <lrm>
+        <lrm_resources>
+          <lrm_resource id=...>
+          </...>
+*/
+	int rc = 0;
+	lrm_rsc_t *rsc = NULL;
+	xmlNode *iter = NULL;
+	xmlNode *xml_rsc = NULL;
+	int call_opt = cib_quorum_override;
+	struct rsc_update_op_s *update_op = NULL;
+	
+	CRM_CHECK(op != NULL, return 0);
+
+	if(fsa_state == S_ELECTION || fsa_state == S_PENDING) {
+	    crm_info("Sending update to local CIB in state: %s", fsa_state2string(fsa_state));
+	    call_opt |= cib_scope_local;
+	    lrm_history_synced = FALSE;
+	}
+
+	if(rsc_update != NULL && call_opt != rsc_update_opts) {
+	    flush_rsc_updates("update options changed");
+	}
+	
+	rsc = fsa_lrm_conn->lrm_ops->get_rsc(fsa_lrm_conn, op->rsc_id);
+	if(rsc == NULL) {
+	    crm_warn("Resource %s no longer exists in the lrmd", op->rsc_id);
+	    return 0;
+	}
+	
+	if(rsc_update == NULL) {
+	    iter = create_xml_node(iter, XML_CIB_TAG_STATUS); rsc_update = iter;
+	    iter = create_xml_node(iter, XML_CIB_TAG_STATE);
+
+	    set_uuid(iter, XML_ATTR_UUID, fsa_our_uname);
+	    crm_xml_add(iter, XML_ATTR_UNAME, fsa_our_uname);
+	    crm_xml_add(iter, XML_ATTR_ORIGIN, __FUNCTION__);
+	
+	    iter = create_xml_node(iter, XML_CIB_TAG_LRM);
+	    crm_xml_add(iter, XML_ATTR_ID, fsa_our_uuid);
+
+	    rsc_update_list = create_xml_node(iter, XML_LRM_TAG_RESOURCES);
+	    rsc_update_opts = call_opt;
+	}
+
+	xml_rsc = find_entity(rsc_update_list, XML_LRM_TAG_RESOURCE, op->rsc_id);
+	if(xml_rsc == NULL) {
+	    xml_rsc = create_xml_node(rsc_update_list, XML_LRM_TAG_RESOURCE);
+	    crm_xml_add(xml_rsc, XML_ATTR_ID, op->rsc_id);
+	}
+
+	/* A later result for the same op replaces the earlier one */
+	iter = create_xml_node(NULL, XML_LRM_TAG_RESOURCE);
+	build_operation_update(iter, rsc, op, __FUNCTION__, 0, LOG_DEBUG);
+	xml_child_iter(
+	    iter, xml_op,
+	    xmlNode *old = find_entity(xml_rsc, XML_LRM_TAG_RSC_OP, ID(xml_op));
+	    if(old != NULL) {
+		free_xml_from_parent(xml_rsc, old);
+	    }
+	    add_node_copy(xml_rsc, xml_op);
+	    );
+	free_xml(iter);
+
+	crm_xml_add(xml_rsc, XML_ATTR_TYPE, rsc->type);
+	crm_xml_add(xml_rsc, XML_AGENT_ATTR_CLASS, rsc->class);
+	crm_xml_add(xml_rsc, XML_AGENT_ATTR_PROVIDER,rsc->provider);	
+	lrm_history_changed(op->rsc_id);
+
+	CRM_CHECK(rsc->type != NULL,
+		  crm_err("Resource %s has no value for type", op->rsc_id));
+	CRM_CHECK(rsc->class != NULL,
+		  crm_err("Resource %s has no value for class", op->rsc_id));
+	lrm_free_rsc(rsc);
+
+	crm_malloc0(update_op, sizeof(struct rsc_update_op_s));
+	update_op->op_key = generate_op_key(op->rsc_id, op->op_type, op->interval);
+	update_op->call_id = op->call_id;
+	rsc_update_ops = g_list_append(rsc_update_ops, update_op);
+	rsc_update_len++;
+
+	if(lrm_update_window <= 0) {
+	    rc = flush_rsc_updates("batching disabled");
+
+	} else if(rsc_update_len >= MAX_BATCHED_UPDATES) {
+	    rc = flush_rsc_updates("batch is full");
+	    
+	} else if(rsc_update_timer == 0) {
+	    rsc_update_timer = g_timeout_add(
+		lrm_update_window, rsc_update_timer_popped, NULL);
+	}
 	return rc;
 }
 
@@ -1981,6 +2556,8 @@ process_lrm_event(lrm_op_t *op)
 	    crm_debug_2("Op %s (call=%d, stop-id=%s): Confirmed", op_key, op->call_id, op_id);
 	}
 
+	check_rsc_updates();
+
   out:
 	if(op->op_status == LRM_OP_DONE) {
 	    do_crm_log(log_level,
@@ -37,10 +37,12 @@
 #include <crmd_lrm.h>
 
 
-GListPtr fsa_message_queue = NULL;
+/* An all-zero GQueue is a valid empty one */
+static GQueue fsa_queue_storage;
+GQueue *fsa_message_queue = &fsa_queue_storage;
 extern void crm_shutdown(int nsig);
 
-void handle_response(xmlNode *stored_msg);
+enum crmd_fsa_input handle_response(xmlNode *stored_msg);
 enum crmd_fsa_input handle_request(xmlNode *stored_msg);
 enum crmd_fsa_input handle_shutdown_request(xmlNode *stored_msg);
 
@@ -83,7 +85,20 @@ register_fsa_input_adv(
 	void *data, long long with_actions,
 	gboolean prepend, const char *raised_from)
 {
-	unsigned  old_len = g_list_length(fsa_message_queue);
+	return register_fsa_input_full(
+		cause, input, data, with_actions, prepend, TRUE, raised_from);
+}
+
+/* If copy is FALSE the queue takes ownership of the xmlNode in the
+ * (caller's) ha_msg_input_t.  LRM events are always copied.
+ */
+int
+register_fsa_input_full(
+	enum crmd_fsa_cause cause, enum crmd_fsa_input input,
+	void *data, long long with_actions,
+	gboolean prepend, gboolean copy, const char *raised_from)
+{
+	unsigned  old_len = g_queue_get_length(fsa_message_queue);
 	fsa_data_t *fsa_data = NULL;
 
 	last_data_id++;
@@ -125,6 +140,7 @@ register_fsa_input_adv(
 	fsa_data->data      = NULL;
 	fsa_data->data_type = fsa_dt_none;
 	fsa_data->actions   = with_actions;
+	fsa_data->queued    = fsa_time_now();
 
 	if(with_actions != A_NOTHING) {
 		crm_debug_3("Adding actions %.16llx to input", with_actions);
@@ -136,19 +152,25 @@ register_fsa_input_adv(
 			case C_CRMD_STATUS_CALLBACK:
 			case C_IPC_MESSAGE:
 			case C_HA_MESSAGE:
-				crm_debug_3("Copying %s data from %s as a HA msg",
-					  fsa_cause2string(cause),
-					  raised_from);
+				crm_debug_3("%s %s data from %s as a HA msg",
+					    copy?"Copying":"Taking",
+					    fsa_cause2string(cause),
+					    raised_from);
 				CRM_CHECK(((ha_msg_input_t*)data)->msg != NULL,
 					  crm_err("Bogus data from %s", raised_from));
-				fsa_data->data = copy_ha_msg_input(data);
+				if(copy) {
+				    fsa_data->data = copy_ha_msg_input(data);
+				} else {
+				    fsa_data->data = new_ha_msg_input(
+					((ha_msg_input_t*)data)->msg);
+				}
 				fsa_data->data_type = fsa_dt_ha_msg;
 				break;
 				
 			case C_LRM_OP_CALLBACK:
 				crm_debug_3("Copying %s data from %s as lrm_op_t",
-					  fsa_cause2string(cause),
-					  raised_from);
+					    fsa_cause2string(cause),
+					    raised_from);
 				fsa_data->data = copy_lrm_op((lrm_op_t*)data);
 				fsa_data->data_type = fsa_dt_lrm;
 				break;
@@ -176,18 +198,14 @@ register_fsa_input_adv(
 	/* make sure to free it properly later */
 	if(prepend) {
 		crm_debug_2("Prepending input");
-		fsa_message_queue = g_list_prepend(fsa_message_queue, fsa_data);
+		g_queue_push_head(fsa_message_queue, fsa_data);
 	} else {
-		fsa_message_queue = g_list_append(fsa_message_queue, fsa_data);
+		g_queue_push_tail(fsa_message_queue, fsa_data);
 	}
 	
-	crm_debug_2("Queue len: %d", g_list_length(fsa_message_queue));
+	crm_debug_2("Queue len: %d", g_queue_get_length(fsa_message_queue));
 
 	fsa_dump_queue(LOG_DEBUG_2);
-	
-	if(old_len == g_list_length(fsa_message_queue)){
-		crm_err("Couldnt add message to the queue");
-	}
 
 	if(fsa_source) {
 		crm_debug_3("Triggering FSA: %s", __FUNCTION__);
@@ -203,7 +221,7 @@ fsa_dump_queue(int log_level)
 		return;
 	}
 	slist_iter(
-		data, fsa_data_t, fsa_message_queue, lpc,
+		data, fsa_data_t, fsa_message_queue->head, lpc,
 		do_crm_log(log_level, 
 			   "queue[%d(%d)]: input %s raised by %s()\t(cause=%s)",
 			   lpc, data->id, fsa_input2string(data->fsa_input),
@@ -277,12 +295,18 @@ delete_fsa_input(fsa_data_t *fsa_data)
 	crm_free(fsa_data);
 }
 
+void
+put_message(fsa_data_t *new_message)
+{
+	new_message->queued = fsa_time_now();
+	g_queue_push_tail(fsa_message_queue, new_message);
+}
+
 /* returns the next message */
 fsa_data_t *
 get_message(void)
 {
-	fsa_data_t* message = g_list_nth_data(fsa_message_queue, 0);
-	fsa_message_queue = g_list_remove(fsa_message_queue, message);
+	fsa_data_t* message = g_queue_pop_head(fsa_message_queue);
 	crm_debug_2("Processing input %d", message->id);
 	return message;
 }
@@ -291,7 +315,7 @@ get_message(void)
 gboolean
 is_message(void)
 {
-	return (g_list_length(fsa_message_queue) > 0);
+	return (g_queue_is_empty(fsa_message_queue) == FALSE);
 }
 
 
@@ -335,16 +359,25 @@ do_msg_route(long long action,
 
 void
 route_message(enum crmd_fsa_cause cause, xmlNode *input)
+{
+	route_message_adv(cause, input, FALSE);
+}
+
+/* If owned is TRUE, input is either queued (without being copied)
+ * or free'd before we return
+ */
+void
+route_message_adv(enum crmd_fsa_cause cause, xmlNode *input, gboolean owned)
 {
 	ha_msg_input_t fsa_input;
 	enum crmd_fsa_input result = I_NULL;
 
 	fsa_input.msg = input;
-	CRM_CHECK(cause == C_IPC_MESSAGE || cause == C_HA_MESSAGE, return);
+	CRM_CHECK(cause == C_IPC_MESSAGE || cause == C_HA_MESSAGE, goto bail);
 
 	/* try passing the buck first */
 	if(relay_message(input, cause==C_IPC_MESSAGE)) {
-		return;
+		goto bail;
 	}
 	
 	/* handle locally */
@@ -361,13 +394,21 @@ route_message(enum crmd_fsa_cause cause, xmlNode *input)
 			break;
 		default:
 		    /* Defering local processing of message */
-		    register_fsa_input_later(cause, result, &fsa_input);			
+		    register_fsa_input_full(
+			cause, result, &fsa_input, A_NOTHING, FALSE, !owned, __FUNCTION__);
 		    return;
 	}
 
 	if(result != I_NULL) {
 		/* add to the front of the queue */
-		register_fsa_input(cause, result, &fsa_input);
+		register_fsa_input_full(
+		    cause, result, &fsa_input, A_NOTHING, FALSE, !owned, __FUNCTION__);
+		return;
+	}
+
+  bail:
+	if(owned) {
+		free_xml(input);
 	}
 }
 
@@ -667,8 +708,7 @@ handle_message(xmlNode *msg)
 	return handle_request(msg);
 	
     } else if(crm_str_eq(type, XML_ATTR_RESPONSE, TRUE)) {
-	handle_response(msg);
-	return I_NULL;
+	return handle_response(msg);
     }
     
     crm_err("Unknown message type: %s", type);
@@ -761,6 +801,7 @@ handle_request(xmlNode *stored_msg)
 	return I_JOIN_RESULT;
 	
     } else if(strcmp(op, CRM_OP_LRM_DELETE) == 0
+	      || strcmp(op, CRM_OP_LRM_BULK_DELETE) == 0
 	      || strcmp(op, CRM_OP_LRM_FAIL) == 0
 	      || strcmp(op, CRM_OP_LRM_REFRESH) == 0
 	      || strcmp(op, CRM_OP_REPROBE) == 0) {
@@ -814,6 +855,15 @@ handle_request(xmlNode *stored_msg)
 	free_xml(ping);
 	free_xml(msg);
 	
+    } else if(strcmp(op, CRM_OP_FSA_STATS) == 0) {
+	xmlNode *stats = fsa_timing_xml();
+
+	msg = create_reply(stored_msg, stats);
+	relay_message(msg, TRUE);
+	
+	free_xml(stats);
+	free_xml(msg);
+	
 	/* probably better to do this via signals on the
 	 * local node
 	 */
@@ -825,6 +875,14 @@ handle_request(xmlNode *stored_msg)
 	alter_debug(DEBUG_DEC);
 	crm_info("Debug set to %d", get_crm_log_level());
 
+    } else if(strcmp(op, CRM_OP_BLACKBOX) == 0) {
+	if(crm_blackbox_enabled) {
+	    crm_blackbox_dump("requested by crmadmin");
+	} else {
+	    crm_notice("No blackbox to write: start the %s with PCMK_blackbox=yes to keep one",
+		       crm_system_name);
+	}
+
     } else {
 	crm_err("Unexpected request (%s) sent to %s", op, AM_I_DC?"the DC":"non-DC node");
 	crm_log_xml(LOG_ERR, "Unexpected", stored_msg);
@@ -833,7 +891,7 @@ handle_request(xmlNode *stored_msg)
     return I_NULL;
 }
 
-void
+enum crmd_fsa_input
 handle_response(xmlNode *stored_msg)
 {
     const char *op = crm_element_value(stored_msg, F_CRM_TASK);
@@ -848,10 +906,9 @@ handle_response(xmlNode *stored_msg)
 	    crm_err("%s - Ignoring calculation with no reference", op);
 
 	} else if(safe_str_eq(msg_ref, fsa_pe_ref)) {
-	    ha_msg_input_t fsa_input;
-	    fsa_input.msg = stored_msg;
-	    register_fsa_input_later(C_IPC_MESSAGE, I_PE_SUCCESS, &fsa_input);			
+	    /* route_message() will queue it */
 	    crm_debug_2("Completed: %s...", fsa_pe_ref);
+	    return I_PE_SUCCESS;
 
 	} else {
 	    crm_info("%s calculation %s is obsolete", op, msg_ref);
@@ -866,6 +923,8 @@ handle_response(xmlNode *stored_msg)
 	crm_err("Unexpected response (op=%s, src=%s) sent to the %s",
 		op, host_from, AM_I_DC?"DC":"CRMd");
     }
+
+    return I_NULL;
 }
 
 enum crmd_fsa_input
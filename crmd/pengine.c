@@ -140,8 +140,7 @@ pe_msg_dispatch(IPC_Channel *client, gpointer user_data)
 
 	msg = xmlfromIPC(client, MAX_IPC_DELAY);
 	if (msg != NULL) {
-	    route_message(C_IPC_MESSAGE, msg);
-	    free_xml(msg);
+	    route_message_adv(C_IPC_MESSAGE, msg, TRUE);
 	}
     }
     
@@ -321,6 +321,9 @@ cib_action_update(crm_action_t *action, int status, int op_rc)
 	rsc = create_xml_node(state, XML_CIB_TAG_LRM);
 	crm_xml_add(rsc, XML_ATTR_ID, target_uuid);
 
+	/* the node didn't write this, so its next join can't be a delta */
+	crm_xml_add(rsc, XML_LRM_ATTR_HISTORY, crm_system_name);
+
 	rsc = create_xml_node(rsc,   XML_LRM_TAG_RESOURCES);
 	rsc = create_xml_node(rsc,   XML_LRM_TAG_RESOURCE);
 	crm_xml_add(rsc, XML_ATTR_ID, rsc_id);
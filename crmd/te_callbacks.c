@@ -38,9 +38,6 @@ gboolean shuttingdown = FALSE;
 crm_graph_t *transition_graph;
 crm_trigger_t *transition_trigger = NULL;
 
-/* #define rsc_op_template "//"XML_TAG_DIFF_ADDED"//"XML_TAG_CIB"//"XML_CIB_TAG_STATE"[@uname='%s']"//"XML_LRM_TAG_RSC_OP"[@id='%s]" */
-#define rsc_op_template "//"XML_TAG_DIFF_ADDED"//"XML_TAG_CIB"//"XML_LRM_TAG_RSC_OP"[@id='%s']"
-
 static const char *get_node_id(xmlNode *rsc_op) 
 {
     xmlNode *node = rsc_op;
@@ -70,6 +67,62 @@ static void process_resource_updates(xmlXPathObject *xpathObj)
     }
 }
 
+/*
+ * Everything te_update_diff() cares about in one diff, collected by a
+ * single walk instead of one document-wide xpath search per question
+ */
+typedef struct te_diff_scan_s 
+{
+	xmlNode *attrs_added;	/* first transient_attributes added/removed */
+	xmlNode *attrs_removed;
+	int lrm_resources;	/* lrm_resource entries added */
+	GListPtr node_states;	/* node_state entries added */
+	GListPtr added_ops;	/* lrm_rsc_op entries added */
+	GListPtr removed_ops;	/* lrm_rsc_op entries removed */
+} te_diff_scan_t;
+
+static void
+scan_status_diff(xmlNode *xml, gboolean added, te_diff_scan_t *scan)
+{
+    xml_child_iter(
+	xml, child,
+	const char *tag = crm_element_name(child);
+
+	if(safe_str_eq(tag, XML_LRM_TAG_RSC_OP)) {
+	    if(added) {
+		scan->added_ops = g_list_prepend(scan->added_ops, child);
+	    } else {
+		scan->removed_ops = g_list_prepend(scan->removed_ops, child);
+	    }
+	    continue;
+	    
+	} else if(safe_str_eq(tag, XML_TAG_TRANSIENT_NODEATTRS)) {
+	    if(added && scan->attrs_added == NULL) {
+		scan->attrs_added = child;
+	    } else if(added == FALSE && scan->attrs_removed == NULL) {
+		scan->attrs_removed = child;
+	    }
+	    continue;
+
+	} else if(added && safe_str_eq(tag, XML_CIB_TAG_STATE)) {
+	    scan->node_states = g_list_prepend(scan->node_states, child);
+
+	} else if(added && safe_str_eq(tag, XML_LRM_TAG_RESOURCE)) {
+	    scan->lrm_resources++;
+	}
+	
+	scan_status_diff(child, added, scan);
+	);
+}
+
+static void
+free_diff_scan(te_diff_scan_t *scan)
+{
+    g_list_free(scan->node_states);
+    g_list_free(scan->added_ops);
+    g_list_free(scan->removed_ops);
+}
+
 void
 te_update_diff(const char *event, xmlNode *msg)
 {
@@ -77,8 +130,11 @@ te_update_diff(const char *event, xmlNode *msg)
 	const char *op = NULL;
 
 	xmlNode *diff = NULL;
-	xmlNode *cib_top = NULL;
-	xmlXPathObject *xpathObj = NULL;
+	xmlNode *added = NULL;
+	xmlNode *removed = NULL;
+	xmlNode *added_status = NULL;
+	xmlNode *removed_status = NULL;
+	te_diff_scan_t scan;
 
 	int diff_add_updates     = 0;
 	int diff_add_epoch       = 0;
@@ -121,88 +177,89 @@ te_update_diff(const char *event, xmlNode *msg)
 		  fsa_state2string(fsa_state));
 	log_cib_diff(LOG_DEBUG_2, diff, op);
 
+	added = find_xml_node(find_xml_node(diff, XML_TAG_DIFF_ADDED, FALSE), XML_TAG_CIB, TRUE);
+	removed = find_xml_node(find_xml_node(diff, XML_TAG_DIFF_REMOVED, FALSE), XML_TAG_CIB, TRUE);
+
 	/* Process crm_config updates */ 
-	cib_top = get_xpath_object("//"F_CIB_UPDATE_RESULT"//"XML_TAG_DIFF_ADDED"//"XML_CIB_TAG_CRMCONFIG, diff, LOG_DEBUG);
-	if(cib_top != NULL) {
+	if(find_xml_node(find_xml_node(added, XML_CIB_TAG_CONFIGURATION, FALSE),
+			 XML_CIB_TAG_CRMCONFIG, FALSE) != NULL) {
 	    mainloop_set_trigger(config_read);	    
 	}
 	
-	/* Process anything that was added */
-	cib_top = get_xpath_object("//"F_CIB_UPDATE_RESULT"//"XML_TAG_DIFF_ADDED"//"XML_TAG_CIB, diff, LOG_ERR);
-	if(need_abort(cib_top)) {
-	    goto bail; /* configuration changed */
+	/* Process anything that was added or removed */
+	if(need_abort(added) || need_abort(removed)) {
+	    return; /* configuration changed */
 	}
 
-	/* Process anything that was removed */
-	cib_top = get_xpath_object("//"F_CIB_UPDATE_RESULT"//"XML_TAG_DIFF_REMOVED"//"XML_TAG_CIB, diff, LOG_ERR);
-	if(need_abort(cib_top)) {
-	    goto bail; /* configuration changed */
+	/* Everything below lives in the status section */
+	added_status = find_xml_node(added, XML_CIB_TAG_STATUS, FALSE);
+	removed_status = find_xml_node(removed, XML_CIB_TAG_STATUS, FALSE);
+	if(added_status == NULL && removed_status == NULL) {
+	    crm_debug_2("No status changes");
+	    return;
 	}
 
+	memset(&scan, 0, sizeof(te_diff_scan_t));
+	scan_status_diff(added_status, TRUE, &scan);
+	scan_status_diff(removed_status, FALSE, &scan);
+	scan.node_states = g_list_reverse(scan.node_states);
+	scan.added_ops = g_list_reverse(scan.added_ops);
+	scan.removed_ops = g_list_reverse(scan.removed_ops);
+
+	crm_debug_2("Diff contains %d node updates, %d new and %d removed operations",
+		    g_list_length(scan.node_states), g_list_length(scan.added_ops),
+		    g_list_length(scan.removed_ops));
+	
 	/* Transient Attributes - Added/Updated */
-	xpathObj = xpath_search(diff,"//"F_CIB_UPDATE_RESULT"//"XML_TAG_DIFF_ADDED"//"XML_TAG_TRANSIENT_NODEATTRS);
-	if(xpathObj && xpathObj->nodesetval->nodeNr > 0) {
-	    xmlNode *aborted = getXpathResult(xpathObj, 0);
-	    abort_transition(INFINITY, tg_restart, "Transient attribute: update", aborted);
+	if(scan.attrs_added != NULL) {
+	    abort_transition(INFINITY, tg_restart, "Transient attribute: update", scan.attrs_added);
 	    goto bail;
-
-	} else if(xpathObj) {
-	    xmlXPathFreeObject(xpathObj);
 	}
 	
 	/* Transient Attributes - Removed */
-	xpathObj = xpath_search(diff,"//"F_CIB_UPDATE_RESULT"//"XML_TAG_DIFF_REMOVED"//"XML_TAG_TRANSIENT_NODEATTRS);
-	if(xpathObj && xpathObj->nodesetval->nodeNr > 0) {
-	    xmlNode *aborted = getXpathResult(xpathObj, 0);
-	    abort_transition(INFINITY, tg_restart, "Transient attribute: removal", aborted);
+	if(scan.attrs_removed != NULL) {
+	    abort_transition(INFINITY, tg_restart, "Transient attribute: removal", scan.attrs_removed);
 	    goto bail;
-
-	} else if(xpathObj) {
-	    xmlXPathFreeObject(xpathObj);
 	}
 
 	/* Check for node state updates... possibly from a shutdown we requested */
-	xpathObj = xpath_search(diff, "//"F_CIB_UPDATE_RESULT"//"XML_TAG_DIFF_ADDED"//"XML_CIB_TAG_STATE);
-	if(xpathObj) {
-	    int lpc = 0, max = xpathObj->nodesetval->nodeNr;
-	    for(lpc = 0; lpc < max; lpc++) {
-		xmlNode *node = getXpathResult(xpathObj, lpc);
-		const char *event_node = crm_element_value(node, XML_ATTR_ID);
-		const char *ccm_state  = crm_element_value(node, XML_CIB_ATTR_INCCM);
-		const char *ha_state   = crm_element_value(node, XML_CIB_ATTR_HASTATE);
-		const char *shutdown_s = crm_element_value(node, XML_CIB_ATTR_SHUTDOWN);
-		const char *crmd_state = crm_element_value(node, XML_CIB_ATTR_CRMDSTATE);
-
-		if(safe_str_eq(ccm_state, XML_BOOLEAN_FALSE)
-		   || safe_str_eq(ha_state, DEADSTATUS)
-		   || safe_str_eq(crmd_state, CRMD_JOINSTATE_DOWN)) {
-		    crm_action_t *shutdown = match_down_event(0, event_node, NULL);
-		    
-		    if(shutdown != NULL) {
-			const char *task = crm_element_value(shutdown->xml, XML_LRM_ATTR_TASK);
-			if(safe_str_neq(task, CRM_OP_FENCE)) {
-			    /* Wait for stonithd to tell us it is complete via tengine_stonith_callback() */
-			    update_graph(transition_graph, shutdown);
-			    trigger_graph();
-			}
-			
-		    } else {
-			crm_info("Stonith/shutdown of %s not matched", event_node);
-			abort_transition(INFINITY, tg_restart, "Node failure", node);
-		    }			
-		    fail_incompletable_actions(transition_graph, event_node);
-		}
-	 
-		if(shutdown_s) {
-		    int shutdown = crm_parse_int(shutdown_s, NULL);
-		    if(shutdown > 0) {
-			crm_info("Aborting on "XML_CIB_ATTR_SHUTDOWN" attribute for %s", event_node);
-			abort_transition(INFINITY, tg_restart, "Shutdown request", node);
+	slist_iter(
+	    node, xmlNode, scan.node_states, lpc,
+	    
+	    const char *event_node = crm_element_value(node, XML_ATTR_ID);
+	    const char *ccm_state  = crm_element_value(node, XML_CIB_ATTR_INCCM);
+	    const char *ha_state   = crm_element_value(node, XML_CIB_ATTR_HASTATE);
+	    const char *shutdown_s = crm_element_value(node, XML_CIB_ATTR_SHUTDOWN);
+	    const char *crmd_state = crm_element_value(node, XML_CIB_ATTR_CRMDSTATE);
+
+	    if(safe_str_eq(ccm_state, XML_BOOLEAN_FALSE)
+	       || safe_str_eq(ha_state, DEADSTATUS)
+	       || safe_str_eq(crmd_state, CRMD_JOINSTATE_DOWN)) {
+		crm_action_t *shutdown = match_down_event(0, event_node, NULL);
+		
+		if(shutdown != NULL) {
+		    const char *task = crm_element_value(shutdown->xml, XML_LRM_ATTR_TASK);
+		    if(safe_str_neq(task, CRM_OP_FENCE)) {
+			/* Wait for stonithd to tell us it is complete via tengine_stonith_callback() */
+			update_graph(transition_graph, shutdown);
+			trigger_graph();
 		    }
+		    
+		} else {
+		    crm_info("Stonith/shutdown of %s not matched", event_node);
+		    abort_transition(INFINITY, tg_restart, "Node failure", node);
+		}			
+		fail_incompletable_actions(transition_graph, event_node);
+	    }
+	    
+	    if(shutdown_s) {
+		int shutdown = crm_parse_int(shutdown_s, NULL);
+		if(shutdown > 0) {
+		    crm_info("Aborting on "XML_CIB_ATTR_SHUTDOWN" attribute for %s", event_node);
+		    abort_transition(INFINITY, tg_restart, "Shutdown request", node);
 		}
 	    }
-	    xmlXPathFreeObject(xpathObj);
-	}
+	    );
 
 	/*
 	 * Check for and fast-track the processing of LRM refreshes
@@ -212,82 +269,66 @@ te_update_diff(const char *event, xmlNode *msg)
 	 * Otherwise we could miss updates we're waiting for and stall 
 	 *
 	 */
-	xpathObj = NULL;
-	if(transition_graph->pending == 0) {
-	    xpathObj = xpath_search(diff, "//"F_CIB_UPDATE_RESULT"//"XML_TAG_DIFF_ADDED"//"XML_LRM_TAG_RESOURCE);
-	}
-	
-	if(xpathObj) {
-	    int updates = xpathObj->nodesetval->nodeNr;
-	    if(updates > 1) {
-		/* Updates by, or in response to, TE actions will never contain updates
-		 * for more than one resource at a time
-		 */
-		crm_info("Detected LRM refresh - %d resources updated: Skipping all resource events", updates);
-		abort_transition(INFINITY, tg_restart, "LRM Refresh", diff);
-		goto bail;
-	    }
-	    xmlXPathFreeObject(xpathObj);
+	if(transition_graph->pending == 0 && scan.lrm_resources > 1) {
+	    /* Updates by, or in response to, TE actions will never contain updates
+	     * for more than one resource at a time
+	     */
+	    crm_info("Detected LRM refresh - %d resources updated: Skipping all resource events",
+		     scan.lrm_resources);
+	    abort_transition(INFINITY, tg_restart, "LRM Refresh", diff);
+	    goto bail;
 	}
 
 	/* Process operation updates */
-	xpathObj = xpath_search(diff, "//"F_CIB_UPDATE_RESULT"//"XML_TAG_DIFF_ADDED"//"XML_LRM_TAG_RSC_OP);
-	if(xpathObj) {
-	    process_resource_updates(xpathObj);
-	    xmlXPathFreeObject(xpathObj);
-	}
+	slist_iter(
+	    rsc_op, xmlNode, scan.added_ops, lpc,
+	    process_graph_event(rsc_op, get_node_id(rsc_op));
+	    );
 	
 	/* Detect deleted (as opposed to replaced or added) actions - eg. crm_resource -C */ 
-	xpathObj = xpath_search(diff, "//"XML_TAG_DIFF_REMOVED"//"XML_LRM_TAG_RSC_OP);
-	if(xpathObj) {
-	    int lpc = 0, max = xpathObj->nodesetval->nodeNr;
+	if(scan.removed_ops != NULL) {
+	    GHashTable *replaced = g_hash_table_new(g_str_hash, g_str_equal);
+
+	    slist_iter(
+		rsc_op, xmlNode, scan.added_ops, lpc,
+		const char *op_id = ID(rsc_op);
+		if(op_id != NULL) {
+		    g_hash_table_insert(replaced, (gpointer)op_id, rsc_op);
+		}
+		);
 	    
-	    for(lpc = 0; lpc < max; lpc++) {
-		int max = 0;
-		const char *op_id = NULL;
-		char *rsc_op_xpath = NULL;
-		xmlXPathObject *op_match = NULL;
-		xmlNode *match = getXpathResult(xpathObj, lpc);
-		CRM_CHECK(match != NULL, continue);
-
-		op_id = ID(match);
-
-		max = strlen(rsc_op_template) + strlen(op_id) + 1;
-		crm_malloc0(rsc_op_xpath, max);
-		snprintf(rsc_op_xpath, max, rsc_op_template, op_id);
-		
-		op_match = xpath_search(diff, rsc_op_xpath);
-		if(op_match == NULL || op_match->nodesetval->nodeNr == 0) {
-		    /* Prevent false positives by matching cancelations too */
-		    const char *node = get_node_id(match);
-		    crm_action_t *cancelled = get_cancel_action(op_id, node);
-
-		    if(cancelled == NULL) {
-			crm_debug("No match for deleted action %s (%s on %s)", rsc_op_xpath, op_id, node);
-			abort_transition(INFINITY, tg_restart, "Resource op removal", match);
-			if(op_match) {
-			    xmlXPathFreeObject(op_match);
-			}
-			crm_free(rsc_op_xpath);
-			goto bail;
+	    slist_iter(
+		match, xmlNode, scan.removed_ops, lpc,
 
-		    } else {
-			crm_debug("Deleted lrm_rsc_op %s on %s was for graph event %d",
-				  op_id, node, cancelled->id);
-		    }
+		const char *node = NULL;
+		const char *op_id = ID(match);
+		crm_action_t *cancelled = NULL;
+		
+		CRM_CHECK(op_id != NULL, continue);
+		if(g_hash_table_lookup(replaced, op_id) != NULL) {
+		    continue;
 		}
-
-		if(op_match) {
-		    xmlXPathFreeObject(op_match);
+		
+		/* Prevent false positives by matching cancelations too */
+		node = get_node_id(match);
+		cancelled = get_cancel_action(op_id, node);
+		
+		if(cancelled == NULL) {
+		    crm_debug("No match for deleted action %s on %s", op_id, node);
+		    abort_transition(INFINITY, tg_restart, "Resource op removal", match);
+		    g_hash_table_destroy(replaced);
+		    goto bail;
+		    
+		} else {
+		    crm_debug("Deleted lrm_rsc_op %s on %s was for graph event %d",
+			      op_id, node, cancelled->id);
 		}
-		crm_free(rsc_op_xpath);
-	    }
+		);
+	    g_hash_table_destroy(replaced);
 	}
 
   bail:
-	if(xpathObj) {
-	    xmlXPathFreeObject(xpathObj);
-	}
+	free_diff_scan(&scan);
 }
 
 gboolean
@@ -58,7 +58,8 @@ need_abort(xmlNode *update)
 		  return TRUE;
 	);
     
-    xml = get_object_root(XML_CIB_TAG_CONFIGURATION, update);
+    /* update is the <cib/> element of one half of a diff */
+    xml = find_xml_node(update, XML_CIB_TAG_CONFIGURATION, FALSE);
     if(xml != NULL) {
 	abort_transition(INFINITY, tg_restart, "Non-status change", xml);
 	return TRUE;
@@ -32,7 +32,8 @@ enum cib_variant {
 	cib_file,
 	cib_remote,
 	cib_database,
-	cib_edir
+	cib_edir,
+	cib_mmap
 };
 
 enum cib_state {
@@ -158,6 +159,7 @@ enum cib_section {
 #define CIB_OP_APPLY_DIFF "cib_apply_diff"
 #define CIB_OP_UPGRADE    "cib_upgrade"
 #define CIB_OP_DELETE_ALT	"cib_delete_alt"
+#define CIB_OP_SNAPSHOT	"cib_snapshot"
 
 #define F_CIB_CLIENTID  "cib_clientid"
 #define F_CIB_CALLOPTS  "cib_callopt"
@@ -294,6 +296,11 @@ extern cib_t *cib_new(void);
 extern cib_t *cib_native_new(void);
 extern cib_t *cib_file_new(const char *filename);
 extern cib_t *cib_remote_new(const char *server, const char *user, const char *passwd, int port, gboolean encrypted);
+extern cib_t *cib_mmap_new(const char *filename);
+
+/* Read-only snapshots published by the cib daemon for cib_mmap_new() */
+extern int cib_snapshot_write(xmlNode *cib, const char *filename, unsigned long long sequence);
+extern void cib_snapshot_remove(const char *filename);
 
 extern cib_t *cib_new_no_shadow(void);
 extern char *get_shadow_file(const char *name);
@@ -34,6 +34,8 @@ typedef struct crmd_client_s
 } crmd_client_t;
 
 extern gboolean send_ipc_message(IPC_Channel *ipc_client, xmlNode *msg);
+extern gboolean send_ipc_message_adv(
+	IPC_Channel *ipc_client, xmlNode *msg, const crm_xml_blob_t *attach);
 
 extern void default_ipc_connection_destroy(gpointer user_data);
 
@@ -43,10 +43,17 @@
 
 #define DEBUG_INC SIGUSR1
 #define DEBUG_DEC SIGUSR2
+#define DEBUG_DUMP SIGTRAP
 
 extern unsigned int crm_log_level;
-extern gboolean crm_config_error;
-extern gboolean crm_config_warning;
+
+/* Per-thread so that PE calculations can run side by side.
+ * Only the accessors are exported, the storage stays in the library.
+ */
+extern gboolean *crm_config_error_location(void);
+extern gboolean *crm_config_warning_location(void);
+#define crm_config_error	(*crm_config_error_location())
+#define crm_config_warning	(*crm_config_warning_location())
 
 #ifdef HAVE_GETOPT_H
 #  include <getopt.h>
@@ -113,6 +120,17 @@ extern char *generateReference(const char *custom1, const char *custom2);
 
 extern void alter_debug(int nsig);
 
+/* cl_log() isn't thread-safe, the crm_* log macros hold this around it */
+extern void crm_log_lock(void);
+extern void crm_log_unlock(void);
+
+extern gboolean crm_blackbox_enabled;
+extern void crm_blackbox_init(void);
+extern void crm_blackbox_log(int level, const char *function, const char *fmt, ...)
+	__attribute__ ((format (printf, 3, 4)));
+extern void crm_blackbox_dump(const char *reason);
+extern void crm_blackbox_signal(int nsig);
+
 extern void g_hash_destroy_str(gpointer data);
 
 extern gboolean crm_is_true(const char * s);
@@ -148,6 +166,25 @@ extern char *generate_transition_key(int action, int transition_id, int target_r
 extern gboolean decode_transition_key(
     const char *key, char **uuid, int *action, int *transition_id, int *target_rc);
 
+/* Interned operation keys
+ *
+ * Each distinct key is parsed once and shared for the life of the table.
+ * Lookups are case-insensitive (like safe_str_eq()) so two interned keys
+ * can be compared by pointer.
+ */
+typedef struct crm_op_key_s
+{
+	char *key;
+	char *rsc_id;	/* NULL if the key could not be parsed */
+	char *task;
+	int   interval;
+} crm_op_key_t;
+
+extern const crm_op_key_t *intern_op_key(const char *key);
+extern const crm_op_key_t *find_op_key(const char *key);
+extern void flush_op_keys(void);
+extern GHashTable *swap_op_keys(GHashTable *table);
+
 extern char *crm_concat(const char *prefix, const char *suffix, char join);
 
 extern gboolean decode_op_key(
@@ -264,9 +301,13 @@ extern gboolean attrd_update(IPC_Channel *cluster, char command, const char *hos
 extern gboolean attrd_lazy_update(char command, const char *host, const char *name, const char *value, const char *section, const char *set, const char *dampen);
 extern gboolean attrd_update_no_mainloop(int *connection, char command, const char *host, const char *name, const char *value, const char *section, const char *set, const char *dampen);
 
-extern int node_score_red;
-extern int node_score_green;
-extern int node_score_yellow;
+/* Per-thread, like crm_config_error */
+extern int *node_score_red_location(void);
+extern int *node_score_green_location(void);
+extern int *node_score_yellow_location(void);
+#define node_score_red		(*node_score_red_location())
+#define node_score_green	(*node_score_green_location())
+#define node_score_yellow	(*node_score_yellow_location())
 extern int node_score_infinity;
 
 #endif
@@ -157,6 +157,10 @@ extern void log_xml_diff(unsigned int log_level, xmlNode *diff, const char *func
 extern gboolean apply_xml_diff(
 	xmlNode *old, xmlNode *diff, xmlNode **new);
 
+/* *new must be an unmodified copy_xml() of old, which is patched in place */
+extern gboolean apply_xml_diff_inplace(
+	xmlNode *old, xmlNode *diff, xmlNode **new);
+
 
 /*
  * Searching & Modifying
@@ -167,6 +171,32 @@ extern xmlNode *find_xml_node(
 extern xmlNode *find_entity(
 	xmlNode *parent, const char *node_name, const char *id);
 
+/*
+ * Lets a process index the elements of its documents by name and id
+ * (only the cib does).  The functions in this file report every subtree
+ * they put into a document and every id they change.  Elements that are
+ * freed have to be caught with xmlDeregisterNodeDefault().
+ *
+ * lookup() returns FALSE if xml's document isn't indexed.  Otherwise
+ * *matches lists every element called name (or anything, for "*") with
+ * that id in document order, free it with g_list_free().
+ *
+ * move() hands the index on to "to", which must be an unmodified
+ * copy_xml() of "from".  Returns FALSE if "from" had none.
+ */
+typedef struct crm_xml_index_functions_s 
+{
+	void (*added)(xmlNode *xml);
+	void (*id_changing)(xmlNode *xml);
+	void (*id_changed)(xmlNode *xml);
+	gboolean (*lookup)(
+		xmlNode *xml, const char *name, const char *id, GListPtr *matches);
+	gboolean (*move)(xmlNode *from, xmlNode *to);
+} crm_xml_index_functions_t;
+
+extern void set_xml_index_functions(crm_xml_index_functions_t *fns);
+extern gboolean xml_index_move(xmlNode *from, xmlNode *to);
+
 extern xmlNode *subtract_xml_object(
 	xmlNode *left, xmlNode *right, const char *marker);
 
@@ -288,8 +318,27 @@ extern xmlNode *convert_ipc_message(IPC_Message *msg, const char *field);
 extern xmlNode *convert_ha_message(xmlNode *parent, HA_Message *msg, const char *field);
 
 extern HA_Message *convert_xml_message(xmlNode *msg);
+
+/*
+ * The wire form of one message field: the text (or, above
+ * CRM_BZ2_THRESHOLD, the compressed text) that convert_xml_message()
+ * produces for a child.  Rendering it once lets the same XML be
+ * attached to any number of messages.
+ */
+typedef struct crm_xml_blob_s 
+{
+	char *name;
+	char *data;
+	unsigned int len;
+	gboolean compressed;
+} crm_xml_blob_t;
+
+extern crm_xml_blob_t *xml_blob_new(xmlNode *xml);
+extern void xml_blob_free(crm_xml_blob_t *blob);
+extern void convert_xml_blob(HA_Message *msg, const crm_xml_blob_t *blob);
 extern xmlNode *sorted_xml(xmlNode *input, xmlNode *parent, gboolean recursive);
 extern xmlXPathObjectPtr xpath_search(xmlNode *xml_top, const char *path);
+extern gboolean xpath_search_id(xmlNode *xml_top, const char *path, GListPtr *matches);
 extern gboolean cli_config_update(xmlNode **xml, int *best_version, gboolean to_logs);
 extern xmlNode *expand_idref(xmlNode *input, xmlNode *top);
 
@@ -123,6 +123,7 @@ extern const char *crm_system_name;
 #define CRM_OP_DIE		"die_no_respawn"
 #define CRM_OP_RETRIVE_CIB	"retrieve_cib"
 #define CRM_OP_PING		"ping"
+#define CRM_OP_FSA_STATS	"fsa_stats"
 #define CRM_OP_VOTE		"vote"
 #define CRM_OP_NOVOTE		"no-vote"
 #define CRM_OP_HELLO		"hello"
@@ -144,10 +145,12 @@ extern const char *crm_system_name;
 #define CRM_OP_REGISTER		"register"
 #define CRM_OP_DEBUG_UP		"debug_inc"
 #define CRM_OP_DEBUG_DOWN	"debug_dec"
+#define CRM_OP_BLACKBOX		"blackbox"
 #define CRM_OP_INVOKE_LRM	"lrm_invoke"
 #define CRM_OP_LRM_REFRESH	"lrm_refresh"
 #define CRM_OP_LRM_QUERY	"lrm_query"
 #define CRM_OP_LRM_DELETE	"lrm_delete"
+#define CRM_OP_LRM_BULK_DELETE	"lrm_bulk_delete"
 #define CRM_OP_LRM_FAIL		"lrm_fail"
 #define CRM_OP_PROBED		"probe_complete"
 #define CRM_OP_REPROBE		"probe_again"
@@ -246,26 +249,31 @@ typedef GList* GListPtr;
 #define do_crm_log(level, fmt, args...) do {				\
 	if(__unlikely(crm_log_level < (level))) {			\
 	    continue;							\
-	} else if(__likely((level) < LOG_DEBUG_2)) {			\
+	}								\
+	crm_log_lock();							\
+	if(__likely((level) < LOG_DEBUG_2)) {				\
 	    cl_log(level, "%s: " fmt, __PRETTY_FUNCTION__ , ##args);	\
 	} else {							\
 	    cl_log(LOG_DEBUG, "debug%d: %s: " fmt,			\
 		   level-LOG_INFO, __PRETTY_FUNCTION__ , ##args);	\
 	}								\
+	crm_log_unlock();						\
     } while(0)
 
+/* Also recorded in the blackbox, if enabled, whatever the current log level */
 #define do_crm_log_unlikely(level, fmt, args...) do {			\
-	if(__likely(crm_log_level < (level))) {				\
+	if(__likely(crm_log_level < (level))				\
+	   && __likely(crm_blackbox_enabled == FALSE)) {		\
 	    continue;							\
-	} else if((level) < LOG_DEBUG_2) {				\
-	    cl_log(level, "%s: " fmt, __PRETTY_FUNCTION__ , ##args);	\
-	} else {							\
-	    cl_log(LOG_DEBUG, "debug%d: %s: " fmt,			\
-		   level-LOG_INFO, __PRETTY_FUNCTION__ , ##args);	\
 	}								\
+	crm_blackbox_log(level, __PRETTY_FUNCTION__, fmt , ##args);	\
     } while(0)
 
-#define do_crm_log_always(level, fmt, args...) cl_log(level, "%s: " fmt, __PRETTY_FUNCTION__ , ##args)
+#define do_crm_log_always(level, fmt, args...) do {			\
+	crm_log_lock();							\
+	cl_log(level, "%s: " fmt, __PRETTY_FUNCTION__ , ##args);	\
+	crm_log_unlock();						\
+    } while(0)
 
 #define crm_crit(fmt, args...)    do_crm_log_always(LOG_CRIT,    fmt , ##args)
 #define crm_err(fmt, args...)     do_crm_log(LOG_ERR,     fmt , ##args)
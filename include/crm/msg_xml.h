@@ -31,6 +31,7 @@
 #define F_CRM_VERSION			XML_ATTR_VERSION
 #define F_CRM_ORIGIN			"origin"
 #define F_CRM_JOIN_ID			"join_id"
+#define F_CRM_LRM_HISTORY		"lrm-history"
 #define F_CRM_ELECTION_ID		"election-id"
 #define F_CRM_ELECTION_OWNER		"election-owner"
 #define F_CRM_TGRAPH			"crm-tgraph"
@@ -97,6 +98,9 @@
 #define XML_PING_ATTR_STATUS		"result"
 #define XML_PING_ATTR_SYSFROM		"crm_subsystem"
 
+#define XML_TAG_FSA_STATS		"fsa_stats"
+#define XML_TAG_PE_PROFILE		"pe_profile"
+
 #define XML_TAG_FRAGMENT		"cib_fragment"
 #define XML_ATTR_RESULT			"result"
 #define XML_ATTR_SECTION		"section"
@@ -170,6 +174,9 @@
 #define XML_AGENT_ATTR_CLASS		"class"
 #define XML_AGENT_ATTR_PROVIDER		"provider"
 #define XML_LRM_TAG_ATTRIBUTES		"attributes"
+#define XML_LRM_ATTR_HISTORY		"lrm-history"
+#define XML_LRM_ATTR_HISTORY_BASE	"lrm-history-base"
+#define XML_LRM_ATTR_REMOVED		"lrm-removed"
 
 #define XML_CIB_ATTR_REPLACE       	"replace"
 #define XML_CIB_ATTR_SOURCE       	"source"
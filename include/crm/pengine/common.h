@@ -19,8 +19,11 @@
 #define PE_COMMON__H
 #include <glib.h>
 
-extern gboolean was_processing_error;
-extern gboolean was_processing_warning;
+/* Per-thread, see crm_config_error */
+extern gboolean *was_processing_error_location(void);
+extern gboolean *was_processing_warning_location(void);
+#define was_processing_error	(*was_processing_error_location())
+#define was_processing_warning	(*was_processing_warning_location())
 
 /* order is significant here
  * items listed in order of accending severeness
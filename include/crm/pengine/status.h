@@ -58,6 +58,10 @@ enum pe_restart {
 #define pe_flag_start_failure_fatal	0x00001000ULL
 #define pe_flag_remove_after_stop	0x00002000ULL
 
+#define pe_flag_unpacking_constraints	0x00010000ULL
+
+
+struct pe_region_s;
 
 typedef struct pe_working_set_s 
 {
@@ -76,6 +80,9 @@ typedef struct pe_working_set_s
 		no_quorum_policy_t no_quorum_policy;
 
 		GHashTable *config_hash;
+
+		/* node attribute -> nodes grouped by value, see node_attr_index() */
+		GHashTable *attr_index;
 		
 		GListPtr nodes;
 		GListPtr resources;
@@ -93,10 +100,14 @@ typedef struct pe_working_set_s
 		int max_valid_nodes;
 		int order_id;
 		int action_id;
+		int action_visits;
 
 		/* final output */
 		xmlNode *graph;
 
+		/* backing store for objects freed by cleanup_calculations() */
+		struct pe_region_s *region;
+
 } pe_working_set_t;
 
 struct node_shared_s { 
@@ -115,6 +126,8 @@ struct node_shared_s {
 		GListPtr allocated_rsc;	/* resource_t* */
 		
 		GHashTable *attrs;	/* char* => char* */
+		GHashTable *failcounts;	      /* rsc id => fail-count/last-failure */
+		GHashTable *clone_failcounts; /* "rsc:", "rsc:0:" => totals over all instances */
 		enum node_type type;
 }; 
 
@@ -200,6 +213,7 @@ struct action_s
 		char *task;
 
 		char *uuid;
+		const struct crm_op_key_s *op_key; /* interned copy of uuid */
 		xmlNode *op_entry;
 		
 		gboolean pseudo;
@@ -216,6 +230,7 @@ struct action_s
 		
 		gboolean dumped;
 		gboolean processed;
+		gboolean queued; /* on the update_action_states() worklist */
 
 		action_t *pre_notify;
 		action_t *pre_notified;
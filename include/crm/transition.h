@@ -32,6 +32,7 @@ typedef struct te_timer_s crm_action_timer_t;
 typedef struct synapse_s {
 		int id;
 		int priority;
+		int depth; /* longest chain of synapses waiting on this one */
 
 		gboolean ready;
 		gboolean executed;
@@ -99,6 +100,8 @@ typedef struct crm_graph_s
 		int num_synapses;
 
 		int batch_limit;
+		int node_limit;		/* in-flight actions per node, 0 = no limit */
+		GHashTable *node_limits; /* uname -> per-node override */
 		int network_delay;
 		int stonith_timeout;
 		int transition_timeout;
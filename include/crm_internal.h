@@ -75,6 +75,15 @@ size_t strlcpy(char * dest, const char *source, size_t len);
 size_t strlcat(char * dest, const char *source, size_t len);
 #endif
 
+/* State the PE keeps per worker thread.  Without compiler support
+ * configure leaves HAVE_GTHREAD unset, so there is only ever one.
+ */
+#ifdef HAVE___THREAD
+#  define CRM_THREAD_LOCAL __thread
+#else
+#  define CRM_THREAD_LOCAL
+#endif
+
 /*
  * Some compilers do not define __FUNCTION__
  */
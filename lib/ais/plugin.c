@@ -72,10 +72,13 @@ uint64_t membership_seq = 0;
 pthread_t pcmk_wait_thread;
 
 gboolean wait_active = TRUE;
+int plugin_batch_window = 0;
 gboolean have_reliable_membership_id = FALSE;
 GHashTable *ipc_client_list = NULL;
 GHashTable *membership_list = NULL;
 GHashTable *membership_notify_list = NULL;
+GHashTable *membership_changes = NULL;
+uint64_t membership_update_seq = 0;
 
 #define MAX_RESPAWN		100
 #define LOOPBACK_ID		16777343
@@ -94,6 +97,18 @@ struct crm_identify_msg_s
 	uint64_t		born_on;
 } __attribute__((packed));
 
+/* Several AIS_Messages packed into one totem message, each padded to 8 bytes */
+struct crm_batch_msg_s
+{
+	coroipc_request_header_t	header __attribute__((aligned(8)));
+	uint32_t		count;
+	uint32_t		padding;
+	char			data[0];
+} __attribute__((packed));
+
+#define BATCH_MAX_SIZE		(64*1024)
+#define BATCH_ALIGN(size)	(((size) + 7) & ~7)
+
 static crm_child_t pcmk_children[] = {
     { 0, crm_proc_none,     crm_flag_none,    0, 0, FALSE, "none",     NULL,       NULL,		   NULL, NULL },
     { 0, crm_proc_ais,      crm_flag_none,    0, 0, FALSE, "ais",      NULL,       NULL,		   NULL, NULL },
@@ -107,7 +122,8 @@ static crm_child_t pcmk_children[] = {
 };
 
 void send_cluster_id(void);
-int send_cluster_msg_raw(const AIS_Message *ais_msg);
+int send_cluster_msg_raw(AIS_Message *ais_msg);
+int flush_cluster_batch(void);
 char *pcmk_generate_membership_data(void);
 gboolean check_message_sanity(const AIS_Message *msg, const char *data);
 
@@ -148,8 +164,58 @@ void pcmk_notify(void *conn, ais_void_ptr *msg);
 void pcmk_remove_member(void *conn, ais_void_ptr *msg);
 void pcmk_quorum(void *conn, ais_void_ptr *msg);
 
+void pcmk_cluster_batch_swab(void *msg)
+{
+    uint32_t lpc = 0;
+    struct crm_batch_msg_s *batch = msg;
+    char *data = batch->data;
+
+    ais_debug_3("Performing endian conversion...");
+    batch->header.size = swab32 (batch->header.size);
+    batch->header.id   = swab32 (batch->header.id);
+    batch->count       = swab32 (batch->count);
+
+    for(lpc = 0; lpc < batch->count; lpc++) {
+	AIS_Message *ais_msg = (AIS_Message *)data;
+	if(data + sizeof(AIS_Message) > (char *)batch + batch->header.size) {
+	    break; /* pcmk_cluster_batch_callback() will complain */
+	}
+	pcmk_cluster_swab(ais_msg);
+	data += BATCH_ALIGN(ais_msg->header.size);
+    }
+}
+
+void pcmk_cluster_batch_callback (
+    ais_void_ptr *message, unsigned int nodeid)
+{
+    uint32_t lpc = 0;
+    const struct crm_batch_msg_s *batch = message;
+    const char *data = batch->data;
+    const char *end = (const char *)batch + batch->header.size;
+
+    ais_debug_2("Batch of %u messages from node %u (%s)", batch->count,
+		nodeid, nodeid==local_nodeid?"local":"remote");
+
+    for(lpc = 0; lpc < batch->count; lpc++) {
+	const AIS_Message *ais_msg = (const AIS_Message *)data;
+
+	AIS_CHECK(data + sizeof(AIS_Message) <= end
+		  && ais_msg->header.size >= sizeof(AIS_Message)
+		  && data + ais_msg->header.size <= end,
+		  ais_err("Batch from node %u is truncated at message %u of %u",
+			  nodeid, lpc, batch->count);
+		  return);
+
+	pcmk_cluster_callback((ais_void_ptr *)data, nodeid);
+	data += BATCH_ALIGN(ais_msg->header.size);
+    }
+}
+
 void pcmk_cluster_id_swab(void *msg);
 void pcmk_cluster_id_callback(ais_void_ptr *message, unsigned int nodeid);
+
+void pcmk_cluster_batch_swab(void *msg);
+void pcmk_cluster_batch_callback(ais_void_ptr *message, unsigned int nodeid);
 void ais_remove_peer(char *node_id);
 
 static uint32_t get_process_list(void) 
@@ -226,6 +292,10 @@ static struct corosync_exec_handler pcmk_exec_service[] =
     { /* 1 */
 	.exec_handler_fn	= pcmk_cluster_id_callback,
 	.exec_endian_convert_fn = pcmk_cluster_id_swab
+    },
+    { /* 2 */
+	.exec_handler_fn	= pcmk_cluster_batch_callback,
+	.exec_endian_convert_fn = pcmk_cluster_batch_swab
     }
 };
 
@@ -431,6 +501,19 @@ static void process_ais_conf(void)
 	    }
 	}
     }
+
+    /* Only enable this once every node understands batched messages */
+    get_config_opt(pcmk_api, local_handle, "batch_window", &value, "0");
+    plugin_batch_window = ais_get_int(value, NULL);
+#ifndef AIS_COROSYNC
+    if(plugin_batch_window > 0) {
+	ais_warn("Message batching is only supported with Corosync");
+	plugin_batch_window = 0;
+    }
+#endif
+    if(plugin_batch_window > 0) {
+	ais_info("Batching cluster messages for up to %dms", plugin_batch_window);
+    }
     
     config_find_done(pcmk_api, local_handle);
 }
@@ -596,6 +679,7 @@ int pcmk_startup(struct corosync_api_v1 *init_with)
     membership_list = g_hash_table_new_full(
 	g_direct_hash, g_direct_equal, NULL, destroy_ais_node);
     membership_notify_list = g_hash_table_new(g_direct_hash, g_direct_equal);
+    membership_changes = g_hash_table_new(g_direct_hash, g_direct_equal);
     ipc_client_list = g_hash_table_new(g_direct_hash, g_direct_equal);
     
     ais_info("CRM: Initialized");
@@ -901,7 +985,8 @@ void pcmk_cluster_swab(void *msg)
 void pcmk_cluster_callback (
     ais_void_ptr *message, unsigned int nodeid)
 {
-    const AIS_Message *ais_msg = message;
+    /* Like the endian conversion, routing updates the delivered copy in place */
+    AIS_Message *ais_msg = (AIS_Message *)message;
 
     ais_debug_2("Message from node %u (%s)",
 		nodeid, nodeid==local_nodeid?"local":"remote");
@@ -1083,6 +1168,7 @@ int pcmk_shutdown (
     }
 
     wait_active = FALSE; /* stop the wait loop */
+    flush_cluster_batch();
 
     for (; phase > 0; phase--) {
 	/* dont stop anything with start_seq < 1 */
@@ -1193,7 +1279,30 @@ void member_loop_fn(gpointer key, gpointer value, gpointer user_data)
     data->string = append_member(data->string, node);
 }
 
-char *pcmk_generate_membership_data(void)
+static void member_change_loop_fn(gpointer key, gpointer value, gpointer user_data)
+{
+    struct member_loop_data *data = user_data;    
+    crm_node_t *node = g_hash_table_lookup(membership_list, key);
+
+    if(node != NULL) {
+	/* removed peers are announced separately with crm_class_rmpeer */
+	ais_debug_2("Dumping changed node %u", node->id);
+	data->string = append_member(data->string, node);
+    }
+}
+
+static gboolean member_change_clear_fn(gpointer key, gpointer value, gpointer user_data)
+{
+    return TRUE;
+}
+
+/*
+ * The full list of nodes, or with delta set, only those that changed
+ * since the last notification.  Either way it is tagged with the
+ * sequence number of the last notification so that clients can detect
+ * a delta they missed.
+ */
+static char *generate_membership_data(gboolean delta)
 {
     int size = 0;
     struct member_loop_data data;
@@ -1210,17 +1319,28 @@ char *pcmk_generate_membership_data(void)
     }
     
     snprintf(data.string, size,
-	     "<nodes id=\""U64T"\" quorate=\"%s\" expected=\"%u\" actual=\"%u\">",
+	     "<nodes id=\""U64T"\" quorate=\"%s\" expected=\"%u\" actual=\"%u\""
+	     " update=\""U64T"\" delta=\"%s\">",
 	     membership_seq, plugin_has_quorum()?"true":"false",
-	     plugin_expected_votes, plugin_has_votes);
+	     plugin_expected_votes, plugin_has_votes,
+	     membership_update_seq, delta?"true":"false");
 
-    g_hash_table_foreach(membership_list, member_loop_fn, &data);
+    if(delta) {
+	g_hash_table_foreach(membership_changes, member_change_loop_fn, &data);
+    } else {
+	g_hash_table_foreach(membership_list, member_loop_fn, &data);
+    }
     size = strlen(data.string);
     data.string = realloc(data.string, size + 9) ;/* 9 = </nodes> + nul */
     sprintf(data.string + size, "</nodes>");
     return data.string;
 }
 
+char *pcmk_generate_membership_data(void)
+{
+    return generate_membership_data(FALSE);
+}
+
 void pcmk_nodes(void *conn, ais_void_ptr *msg)
 {
     char *data = pcmk_generate_membership_data();
@@ -1348,11 +1468,15 @@ ghash_send_update(gpointer key, gpointer value, gpointer data)
 
 void send_member_notification(void)
 {
-    char *update = pcmk_generate_membership_data();
+    char *update = NULL;
 
-    ais_info("Sending membership update "U64T" to %d children",
-	     membership_seq,
-	     g_hash_table_size(membership_notify_list));
+    membership_update_seq++;
+    update = generate_membership_data(TRUE);
+
+    ais_info("Sending membership update "U64T" (%d changes, seq "U64T") to %d children",
+	     membership_seq, g_hash_table_size(membership_changes),
+	     membership_update_seq, g_hash_table_size(membership_notify_list));
+    g_hash_table_foreach_remove(membership_changes, member_change_clear_fn, NULL);
 
     g_hash_table_foreach_remove(membership_notify_list, ghash_send_update, update);
     ais_free(update);
@@ -1450,38 +1574,37 @@ static void deliver_transient_msg(gpointer key, gpointer value, gpointer user_da
     }
 }
 
-gboolean route_ais_message(const AIS_Message *msg, gboolean local_origin) 
+gboolean route_ais_message(AIS_Message *msg, gboolean local_origin) 
 {
     int rc = 0;
     int dest = msg->host.type;
     const char *reason = "unknown";
-    AIS_Message *mutable = ais_msg_copy(msg);
     static int service_id =  SERVICE_ID_MAKE(PCMK_SERVICE_ID, 0);
 
     ais_debug_3("Msg[%d] (dest=%s:%s, from=%s:%s.%d, remote=%s, size=%d)",
-		mutable->id, ais_dest(&(mutable->host)), msg_type2text(dest),
-		ais_dest(&(mutable->sender)), msg_type2text(mutable->sender.type),
-		mutable->sender.pid, local_origin?"false":"true", ais_data_len((mutable)));
+		msg->id, ais_dest(&(msg->host)), msg_type2text(dest),
+		ais_dest(&(msg->sender)), msg_type2text(msg->sender.type),
+		msg->sender.pid, local_origin?"false":"true", ais_data_len((msg)));
 
     if(local_origin == FALSE) {
-       if(mutable->host.size == 0
-	  || ais_str_eq(local_uname, mutable->host.uname)) {
-	   mutable->host.local = TRUE;
+       if(msg->host.size == 0
+	  || ais_str_eq(local_uname, msg->host.uname)) {
+	   msg->host.local = TRUE;
        }
     }
 
-    if(check_message_sanity(mutable, mutable->data) == FALSE) {
+    if(check_message_sanity(msg, msg->data) == FALSE) {
 	/* Dont send this message to anyone */
 	rc = 1;
 	goto bail;
     }
     
-    if(mutable->host.local) {
+    if(msg->host.local) {
 	void *conn = NULL;
 	const char *lookup = NULL;
 
 	if(dest == crm_msg_ais) {
-	    process_ais_message(mutable);
+	    process_ais_message(msg);
 	    goto bail;
 
 	} else if(dest == crm_msg_lrmd) {
@@ -1496,7 +1619,7 @@ gboolean route_ais_message(const AIS_Message *msg, gboolean local_origin)
 	    /* Transient client */	    
 
 	    delivered_transient = 0;
-	    g_hash_table_foreach(ipc_client_list, deliver_transient_msg, mutable);
+	    g_hash_table_foreach(ipc_client_list, deliver_transient_msg, msg);
 	    if(delivered_transient) {
 		ais_debug_2("Sent message to %d transient clients: %d", delivered_transient, dest);
 		goto bail;
@@ -1509,8 +1632,8 @@ gboolean route_ais_message(const AIS_Message *msg, gboolean local_origin)
 	    
 	} else if(dest == 0) {
 	    ais_err("Invalid destination: %d", dest);
-	    log_ais_message(LOG_ERR, mutable);
-	    log_printf(LOG_ERR, "%s", get_ais_data(mutable));
+	    log_ais_message(LOG_ERR, msg);
+	    log_printf(LOG_ERR, "%s", get_ais_data(msg));
 	    rc = 1;
 	    goto bail;
 	}
@@ -1521,76 +1644,167 @@ gboolean route_ais_message(const AIS_Message *msg, gboolean local_origin)
 	/* the cluster fails in weird and wonderfully obscure ways when this is not true */
 	AIS_ASSERT(ais_str_eq(lookup, pcmk_children[dest].name));
 
-	if(mutable->header.id == service_id) {
-	    mutable->header.id = 0; /* reset this back to zero for IPC messages */
+	if(msg->header.id == service_id) {
+	    msg->header.id = 0; /* reset this back to zero for IPC messages */
 
-	} else if(mutable->header.id != 0) {
-	    ais_err("reset header id back to zero from %d", mutable->header.id);
-	    mutable->header.id = 0; /* reset this back to zero for IPC messages */
+	} else if(msg->header.id != 0) {
+	    ais_err("reset header id back to zero from %d", msg->header.id);
+	    msg->header.id = 0; /* reset this back to zero for IPC messages */
 	}
 	
-	rc = send_client_ipc(conn, mutable);
+	rc = send_client_ipc(conn, msg);
 
     } else if(local_origin) {
 	/* forward to other hosts */
 	ais_debug_3("Forwarding to cluster");
 	reason = "cluster delivery failed";
-	rc = send_cluster_msg_raw(mutable);    
+	rc = send_cluster_msg_raw(msg);    
     }
     
     if(rc != 0) {
 	ais_warn("Sending message to %s.%s failed: %s (rc=%d)",
-		 ais_dest(&(mutable->host)), msg_type2text(dest), reason, rc);
-	log_ais_message(LOG_DEBUG, mutable);
+		 ais_dest(&(msg->host)), msg_type2text(dest), reason, rc);
+	log_ais_message(LOG_DEBUG, msg);
     }
     
   bail:
-    ais_free(mutable);
     return rc==0?TRUE:FALSE;
 }
 
-int send_cluster_msg_raw(const AIS_Message *ais_msg) 
+static int send_cluster_mcast(void *msg, int size)
 {
-    int rc = 0;
     struct iovec iovec;
+
+    iovec.iov_base = msg;
+    iovec.iov_len = size;
+
+    ais_debug_3("Sending message (size=%u)", (unsigned int)iovec.iov_len);
+#if AIS_COROSYNC
+    return pcmk_api->totem_mcast(&iovec, 1, TOTEMPG_SAFE);
+#else
+    return totempg_groups_mcast_joined(openais_group_handle, &iovec, 1, TOTEMPG_SAFE);
+#endif
+}
+
+/*
+ * With a batch_window set, small messages are held for up to that many
+ * milliseconds (or until the buffer fills) and multicast together.
+ * There is one buffer for all destinations so that totem's ordering
+ * between them is preserved.
+ */
+static struct crm_batch_msg_s *batch_msg = NULL;
+#ifdef AIS_COROSYNC
+static corosync_timer_handle_t batch_timer;
+static gboolean batch_timer_active = FALSE;
+
+static void batch_timer_fn(void *data)
+{
+    batch_timer_active = FALSE;
+    flush_cluster_batch();
+}
+#endif
+
+int flush_cluster_batch(void)
+{
+    int rc = 0;
+    
+    if(batch_msg == NULL || batch_msg->count == 0) {
+	return 0;
+    }
+
+#ifdef AIS_COROSYNC
+    if(batch_timer_active) {
+	pcmk_api->timer_delete(batch_timer);
+	batch_timer_active = FALSE;
+    }
+#endif
+
+    if(batch_msg->count == 1) {
+	/* Not worth the wrapper */
+	AIS_Message *ais_msg = (AIS_Message *)batch_msg->data;
+	rc = send_cluster_mcast(ais_msg, ais_msg->header.size);
+
+    } else {
+	ais_debug_2("Sending %u batched messages (size=%d)",
+		    batch_msg->count, batch_msg->header.size);
+	rc = send_cluster_mcast(batch_msg, batch_msg->header.size);
+    }
+
+    AIS_CHECK(rc == 0, ais_err("Batch of %u messages not sent (%d)", batch_msg->count, rc));
+
+    batch_msg->count = 0;
+    batch_msg->header.size = sizeof(struct crm_batch_msg_s);
+    return rc;
+}
+
+static int batch_cluster_msg(const AIS_Message *ais_msg)
+{
+    char *slot = NULL;
+    int size = BATCH_ALIGN(ais_msg->header.size);
+
+    if(batch_msg == NULL) {
+	ais_malloc0(batch_msg, sizeof(struct crm_batch_msg_s) + BATCH_MAX_SIZE);
+	batch_msg->header.id = SERVICE_ID_MAKE(PCMK_SERVICE_ID, 2);
+	batch_msg->header.size = sizeof(struct crm_batch_msg_s);
+    }
+
+    if(batch_msg->header.size + size > sizeof(struct crm_batch_msg_s) + BATCH_MAX_SIZE) {
+	flush_cluster_batch();
+    }
+
+    slot = (char *)batch_msg + batch_msg->header.size;
+    memcpy(slot, ais_msg, ais_msg->header.size);
+    memset(slot + ais_msg->header.size, 0, size - ais_msg->header.size);
+
+    batch_msg->header.size += size;
+    batch_msg->count++;
+
+#ifdef AIS_COROSYNC
+    if(batch_timer_active == FALSE) {
+	pcmk_api->timer_add_duration(
+	    plugin_batch_window * 1000000ULL, NULL, batch_timer_fn, &batch_timer);
+	batch_timer_active = TRUE;
+    }
+#endif
+    return 0;
+}
+
+int send_cluster_msg_raw(AIS_Message *ais_msg) 
+{
+    int rc = 0;
     static uint32_t msg_id = 0;
-    AIS_Message *mutable = ais_msg_copy(ais_msg);
 
     AIS_ASSERT(local_nodeid != 0);
     AIS_ASSERT(ais_msg->header.size == (sizeof(AIS_Message) + ais_data_len(ais_msg)));
 
-    if(mutable->id == 0) {
+    if(ais_msg->id == 0) {
 	msg_id++;
 	AIS_CHECK(msg_id != 0 /* detect wrap-around */,
 		  msg_id++; ais_err("Message ID wrapped around"));
-	mutable->id = msg_id;
+	ais_msg->id = msg_id;
     }
     
-    mutable->header.error = CS_OK;
-    mutable->header.id = SERVICE_ID_MAKE(PCMK_SERVICE_ID, 0);	
+    ais_msg->header.error = CS_OK;
+    ais_msg->header.id = SERVICE_ID_MAKE(PCMK_SERVICE_ID, 0);	
 
-    mutable->sender.id = local_nodeid;
-    mutable->sender.size = local_uname_len;
-    memset(mutable->sender.uname, 0, MAX_NAME);
-    memcpy(mutable->sender.uname, local_uname, mutable->sender.size);
+    ais_msg->sender.id = local_nodeid;
+    ais_msg->sender.size = local_uname_len;
+    memset(ais_msg->sender.uname, 0, MAX_NAME);
+    memcpy(ais_msg->sender.uname, local_uname, ais_msg->sender.size);
 
-    iovec.iov_base = (char *)mutable;
-    iovec.iov_len = mutable->header.size;
+    if(plugin_batch_window > 0 && ais_msg->header.size <= BATCH_MAX_SIZE / 4) {
+	return batch_cluster_msg(ais_msg);
+    }
 
-    ais_debug_3("Sending message (size=%u)", (unsigned int)iovec.iov_len);
-#if AIS_COROSYNC
-    rc = pcmk_api->totem_mcast(&iovec, 1, TOTEMPG_SAFE);
-#else
-    rc = totempg_groups_mcast_joined(openais_group_handle, &iovec, 1, TOTEMPG_SAFE);
-#endif
+    /* Anything already queued must go first */
+    flush_cluster_batch();
+    rc = send_cluster_mcast(ais_msg, ais_msg->header.size);
 
-    if(rc == 0 && mutable->is_compressed == FALSE) {
-	ais_debug_2("Message sent: %.80s", mutable->data);
+    if(rc == 0 && ais_msg->is_compressed == FALSE) {
+	ais_debug_2("Message sent: %.80s", ais_msg->data);
     }
     
-    AIS_CHECK(rc == 0, ais_err("Message not sent (%d): %.120s", rc, mutable->data));
-
-    ais_free(mutable);
+    AIS_CHECK(rc == 0, ais_err("Message not sent (%d): %.120s", rc, ais_msg->data));
     return rc;	
 }
 
@@ -1601,7 +1815,6 @@ void send_cluster_id(void)
     int rc = 0;
     int lpc = 0;
     int len = 0;
-    struct iovec iovec;
     struct crm_identify_msg_s *msg = NULL;
     
     AIS_ASSERT(local_nodeid != 0);
@@ -1635,14 +1848,8 @@ void send_cluster_id(void)
     update_member(
 	local_nodeid, local_born_on, membership_seq, msg->votes, msg->processes, NULL, NULL, VERSION);
 
-    iovec.iov_base = (char *)msg;
-    iovec.iov_len = msg->header.size;
-    
-#if AIS_COROSYNC
-    rc = pcmk_api->totem_mcast(&iovec, 1, TOTEMPG_SAFE);
-#else
-    rc = totempg_groups_mcast_joined(openais_group_handle, &iovec, 1, TOTEMPG_SAFE);
-#endif
+    flush_cluster_batch();
+    rc = send_cluster_mcast(msg, msg->header.size);
 
     AIS_CHECK(rc == 0, ais_err("Message not sent (%d)", rc));
 
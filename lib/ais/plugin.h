@@ -20,6 +20,8 @@
 #define AIS_CRM_PLUGIN__H
 
 extern GHashTable *membership_notify_list;
-extern int send_cluster_msg_raw(const AIS_Message *ais_msg);
+extern GHashTable *membership_changes;
+extern int send_cluster_msg_raw(AIS_Message *ais_msg);
+extern int flush_cluster_batch(void);
 
 #endif
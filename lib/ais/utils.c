@@ -295,6 +295,11 @@ int update_member(unsigned int id, uint64_t born, uint64_t seq, int32_t votes,
 	}
     }
     
+    if(changed) {
+	/* included in the next membership delta */
+	g_hash_table_replace(membership_changes, GUINT_TO_POINTER(id), NULL);
+    }
+
     AIS_ASSERT(node != NULL);
     return changed;
 }
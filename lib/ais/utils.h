@@ -95,7 +95,7 @@ extern gboolean spawn_child(crm_child_t *child);
 extern void swap_sender(AIS_Message *msg);
 extern char *get_ais_data(const AIS_Message *msg);
 
-extern gboolean route_ais_message(const AIS_Message *msg, gboolean local);
+extern gboolean route_ais_message(AIS_Message *msg, gboolean local);
 extern gboolean process_ais_message(const AIS_Message *msg);
 
 extern int send_cluster_msg(
@@ -268,6 +268,18 @@ cib_new(void)
 	return cib_file_new(value);
     }
 
+    value = getenv("CIB_snapshot");
+    if(value) {
+	int enabled = TRUE;
+	if(crm_str_to_boolean(value, &enabled) < 0) {
+	    /* a path rather than yes/no */
+	    return cib_mmap_new(value);
+
+	} else if(enabled) {
+	    return cib_mmap_new(NULL);
+	}
+    }
+
     value = getenv("CIB_port");
     if(value) {
 	gboolean encrypted = TRUE;
@@ -0,0 +1,486 @@
+/*
+ * Copyright (c) 2010 Andrew Beekhof
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ *
+ */
+#include <crm_internal.h>
+#include <unistd.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <glib.h>
+
+#include <clplumbing/md5.h>
+
+#include <crm/crm.h>
+#include <crm/cib.h>
+#include <crm/msg_xml.h>
+#include <crm/common/xml.h>
+#include <cib_private.h>
+
+/*
+ * Snapshot format
+ *
+ * A single header line followed by the unformatted CIB and a trailing
+ * NUL (so the mapping can be handed straight to the XML parser):
+ *
+ *   pcmk-cib-snapshot <sequence> <length> <md5 of the CIB text>\n
+ *   <cib ...>...</cib>\0
+ *
+ * The cib daemon writes each version to a temporary file and renames it
+ * into place, so a mapping never changes underneath a reader.  Readers
+ * notice a new version by the file's inode changing.
+ *
+ * Nothing is published until the first reader asks the daemon for
+ * snapshots with CIB_OP_SNAPSHOT.
+ */
+#define CIB_SNAPSHOT_MAGIC	"pcmk-cib-snapshot"
+#define CIB_SNAPSHOT_HEADER_MAX	128
+#define CIB_SNAPSHOT_DIGEST_LEN	16
+
+typedef struct cib_mmap_opaque_s
+{
+	char *filename;
+
+	char  *map;
+	size_t map_len;
+	ino_t  inode;
+
+	unsigned long long sequence;
+	const char *data;
+	unsigned int data_len;
+	char digest[2 * CIB_SNAPSHOT_DIGEST_LEN + 1];
+
+	xmlNode *cib;	/* parsed on first use */
+
+} cib_mmap_opaque_t;
+
+int cib_mmap_perform_op(
+    cib_t *cib, const char *op, const char *host, const char *section,
+    xmlNode *data, xmlNode **output_data, int call_options);
+
+int cib_mmap_signon(cib_t* cib, const char *name, enum cib_conn_type type);
+int cib_mmap_signoff(cib_t* cib);
+int cib_mmap_free(cib_t* cib);
+
+static int cib_mmap_inputfd(cib_t* cib) { return cib_NOTSUPPORTED; }
+
+static int cib_mmap_set_connection_dnotify(
+    cib_t *cib, void (*dnotify)(gpointer user_data))
+{
+    return cib_NOTSUPPORTED;
+}
+
+static int cib_mmap_register_notification(cib_t* cib, const char *callback, int enabled)
+{
+    return cib_NOTSUPPORTED;
+}
+
+static char *
+cib_snapshot_digest(const char *buffer, unsigned int len)
+{
+    int lpc = 0;
+    char *digest = NULL;
+    unsigned char raw_digest[CIB_SNAPSHOT_DIGEST_LEN];
+
+    MD5((const unsigned char *)buffer, len, raw_digest);
+
+    crm_malloc0(digest, 2 * CIB_SNAPSHOT_DIGEST_LEN + 1);
+    for(lpc = 0; lpc < CIB_SNAPSHOT_DIGEST_LEN; lpc++) {
+	sprintf(digest+(2*lpc), "%02x", raw_digest[lpc]);
+    }
+    return digest;
+}
+
+static const char *
+cib_snapshot_filename(const char *filename)
+{
+    if(filename == NULL) {
+	filename = getenv("CIB_snapshot");
+    }
+    if(filename == NULL || crm_is_true(filename)) {
+	filename = CRM_STATE_DIR"/cib.snapshot";
+    }
+    return filename;
+}
+
+/*
+ * Publish a serialized copy of the CIB for local read-only clients.
+ * Called by the cib daemon after a new version has been activated.
+ */
+int
+cib_snapshot_write(xmlNode *cib, const char *filename, unsigned long long sequence)
+{
+    int fd = -1;
+    int rc = cib_ok;
+    FILE *snapshot = NULL;
+    char *tmpfile = NULL;
+    char *buffer = NULL;
+    char *digest = NULL;
+    unsigned int len = 0;
+
+    CRM_CHECK(cib != NULL, return cib_missing_data);
+
+    filename = cib_snapshot_filename(filename);
+    buffer = dump_xml_unformatted(cib);
+    CRM_CHECK(buffer != NULL, return cib_output_data);
+
+    len = strlen(buffer);
+    digest = cib_snapshot_digest(buffer, len);
+
+    tmpfile = crm_concat(filename, "XXXXXX", '.');
+    fd = mkstemp(tmpfile);
+    if(fd < 0) {
+	crm_perror(LOG_ERR, "Could not create %s", tmpfile);
+	rc = cib_output_data;
+	goto bail;
+    }
+
+    /* Same audience as the IPC channels */
+    fchmod(fd, S_IRUSR|S_IWUSR|S_IRGRP);
+
+    snapshot = fdopen(fd, "w");
+    if(snapshot == NULL) {
+	crm_perror(LOG_ERR, "Could not open %s", tmpfile);
+	close(fd);
+	rc = cib_output_data;
+
+    } else {
+	if(fprintf(snapshot, "%s %llu %u %s\n",
+		   CIB_SNAPSHOT_MAGIC, sequence, len, digest) < 0
+	   || fwrite(buffer, 1, len + 1, snapshot) != len + 1) {
+	    crm_perror(LOG_ERR, "Could not write %s", tmpfile);
+	    rc = cib_output_data;
+	}
+
+	if(fclose(snapshot) != 0) {
+	    crm_perror(LOG_ERR, "Could not close %s", tmpfile);
+	    rc = cib_output_data;
+	}
+    }
+
+    if(rc == cib_ok && rename(tmpfile, filename) < 0) {
+	crm_perror(LOG_ERR, "Could not rename %s to %s", tmpfile, filename);
+	rc = cib_output_data;
+    }
+
+    if(rc != cib_ok) {
+	unlink(tmpfile);
+
+    } else {
+	crm_debug_2("Published snapshot %llu (%u bytes, digest: %s) to %s",
+		    sequence, len, digest, filename);
+    }
+
+  bail:
+    crm_free(tmpfile);
+    crm_free(digest);
+    crm_free(buffer);
+    return rc;
+}
+
+void
+cib_snapshot_remove(const char *filename)
+{
+    filename = cib_snapshot_filename(filename);
+    if(unlink(filename) < 0 && errno != ENOENT) {
+	crm_perror(LOG_WARNING, "Could not remove %s", filename);
+    }
+}
+
+cib_t*
+cib_mmap_new (const char *filename)
+{
+    cib_mmap_opaque_t *private = NULL;
+    cib_t *cib = cib_new_variant();
+
+    crm_malloc0(private, sizeof(cib_mmap_opaque_t));
+
+    cib->variant = cib_mmap;
+    cib->variant_opaque = private;
+
+    private->filename = crm_strdup(cib_snapshot_filename(filename));
+
+    /* assign variant specific ops*/
+    cib->cmds->variant_op = cib_mmap_perform_op;
+    cib->cmds->signon     = cib_mmap_signon;
+    cib->cmds->signoff    = cib_mmap_signoff;
+    cib->cmds->free       = cib_mmap_free;
+    cib->cmds->inputfd    = cib_mmap_inputfd;
+
+    cib->cmds->register_notification = cib_mmap_register_notification;
+    cib->cmds->set_connection_dnotify = cib_mmap_set_connection_dnotify;
+
+    return cib;
+}
+
+static void
+cib_mmap_unmap(cib_mmap_opaque_t *private)
+{
+    free_xml(private->cib);
+    private->cib = NULL;
+
+    if(private->map != NULL) {
+	munmap(private->map, private->map_len);
+    }
+    private->map = NULL;
+    private->map_len = 0;
+    private->data = NULL;
+    private->data_len = 0;
+    private->inode = 0;
+}
+
+/* Map the current snapshot, unless we already have it */
+static int
+cib_mmap_load(cib_mmap_opaque_t *private)
+{
+    int fd = -1;
+    struct stat buf;
+    char header[CIB_SNAPSHOT_HEADER_MAX];
+    char magic[CIB_SNAPSHOT_HEADER_MAX];
+    const char *eol = NULL;
+    int header_len = 0;
+
+    if(stat(private->filename, &buf) < 0) {
+	crm_perror(LOG_DEBUG, "Could not stat %s", private->filename);
+	cib_mmap_unmap(private);
+	return cib_connection;
+
+    } else if(private->map != NULL && buf.st_ino == private->inode) {
+	return cib_ok;
+    }
+
+    cib_mmap_unmap(private);
+
+    fd = open(private->filename, O_RDONLY);
+    if(fd < 0) {
+	crm_perror(LOG_ERR, "Could not open %s", private->filename);
+	return cib_connection;
+    }
+
+    if(fstat(fd, &buf) < 0 || buf.st_size <= 0) {
+	crm_err("%s is empty", private->filename);
+	close(fd);
+	return CIBRES_CORRUPT;
+    }
+
+    private->map_len = buf.st_size;
+    private->map = mmap(NULL, private->map_len, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(private->map == MAP_FAILED) {
+	crm_perror(LOG_ERR, "Could not map %s", private->filename);
+	private->map = NULL;
+	return cib_connection;
+    }
+    private->inode = buf.st_ino;
+
+    header_len = CIB_SNAPSHOT_HEADER_MAX - 1;
+    if(private->map_len < header_len) {
+	header_len = private->map_len;
+    }
+
+    eol = memchr(private->map, '\n', header_len);
+    if(eol == NULL) {
+	goto corrupt;
+    }
+
+    header_len = eol - private->map;
+    memcpy(header, private->map, header_len);
+    header[header_len] = 0;
+
+    if(sscanf(header, "%127s %llu %u %32s", magic, &(private->sequence),
+	      &(private->data_len), private->digest) != 4
+       || safe_str_neq(magic, CIB_SNAPSHOT_MAGIC)) {
+	goto corrupt;
+    }
+
+    private->data = eol + 1;
+    if(header_len + 1 + private->data_len + 1 > private->map_len
+       || private->data[private->data_len] != 0) {
+	goto corrupt;
+    }
+
+    crm_debug_2("Mapped snapshot %llu from %s", private->sequence, private->filename);
+    return cib_ok;
+
+  corrupt:
+    crm_err("%s is not a valid CIB snapshot", private->filename);
+    cib_mmap_unmap(private);
+    return CIBRES_CORRUPT;
+}
+
+/* Check and parse the mapped snapshot the first time it is queried */
+static int
+cib_mmap_parse(cib_mmap_opaque_t *private)
+{
+    char *digest = NULL;
+    int rc = cib_ok;
+
+    if(private->cib != NULL) {
+	return cib_ok;
+    }
+
+    digest = cib_snapshot_digest(private->data, private->data_len);
+    if(safe_str_neq(digest, private->digest)) {
+	crm_err("Digest mismatch for snapshot %llu: expected %s, calculated %s",
+		private->sequence, private->digest, digest);
+	rc = CIBRES_CORRUPT;
+
+    } else {
+	private->cib = string2xml(private->data);
+	if(private->cib == NULL) {
+	    rc = CIBRES_CORRUPT;
+	}
+    }
+
+    crm_free(digest);
+    return rc;
+}
+
+/* Ask the local cib daemon to start publishing snapshots */
+static int
+cib_mmap_request_snapshots(const char *name)
+{
+    int rc = cib_ok;
+    cib_t *native = cib_native_new();
+
+    rc = native->cmds->signon(native, name, cib_query);
+    if(rc == cib_ok) {
+	rc = native->cmds->variant_op(
+	    native, CIB_OP_SNAPSHOT, NULL, NULL, NULL, NULL,
+	    cib_scope_local|cib_sync_call);
+	native->cmds->signoff(native);
+    }
+
+    cib_delete(native);
+    return rc;
+}
+
+int
+cib_mmap_signon(cib_t* cib, const char *name, enum cib_conn_type type)
+{
+    int rc = cib_ok;
+    cib_mmap_opaque_t *private = cib->variant_opaque;
+
+    rc = cib_mmap_load(private);
+    if(rc == cib_connection) {
+	crm_debug("%s: No CIB snapshot at '%s', requesting one", name, private->filename);
+	rc = cib_mmap_request_snapshots(name);
+	if(rc == cib_ok) {
+	    rc = cib_mmap_load(private);
+	}
+    }
+
+    if(rc == cib_ok) {
+	crm_debug("%s: Mapped CIB snapshot '%s'", name, private->filename);
+	cib->state = cib_connected_query;
+	cib->type  = cib_query;
+
+    } else {
+	fprintf(stderr, "%s: Connection to CIB snapshot '%s' failed: %s\n",
+		name, private->filename, cib_error2string(rc));
+    }
+
+    return rc;
+}
+
+int
+cib_mmap_signoff(cib_t* cib)
+{
+    cib_mmap_opaque_t *private = cib->variant_opaque;
+
+    crm_debug("Unmapping the CIB snapshot");
+    cib_mmap_unmap(private);
+
+    cib->state = cib_disconnected;
+    cib->type  = cib_none;
+
+    return cib_ok;
+}
+
+int
+cib_mmap_free (cib_t* cib)
+{
+    cib_mmap_opaque_t *private = cib->variant_opaque;
+
+    if(cib->state != cib_disconnected) {
+	cib_mmap_signoff(cib);
+    }
+
+    crm_free(private->filename);
+    crm_free(private);
+    crm_free(cib->cmds);
+    crm_free(cib);
+    return cib_ok;
+}
+
+int
+cib_mmap_perform_op(
+    cib_t *cib, const char *op, const char *host, const char *section,
+    xmlNode *data, xmlNode **output_data, int call_options)
+{
+    int rc = cib_ok;
+    gboolean changed = FALSE;
+    xmlNode *output = NULL;
+    xmlNode *result_cib = NULL;
+    cib_op_t fn = cib_process_query;
+    cib_mmap_opaque_t *private = cib->variant_opaque;
+
+    crm_debug_2("%s on %s", op, section);
+
+    if(cib->state == cib_disconnected) {
+	return cib_not_connected;
+    }
+
+    if(output_data != NULL) {
+	*output_data = NULL;
+    }
+
+    if(op == NULL) {
+	return cib_operation;
+
+    } else if(safe_str_neq(op, CIB_OP_QUERY)) {
+	/* Snapshots are read-only */
+	return cib_NOTSUPPORTED;
+    }
+
+    rc = cib_mmap_load(private);
+    if(rc == cib_ok) {
+	rc = cib_mmap_parse(private);
+    }
+
+    cib->call_id++;
+    if(rc == cib_ok) {
+	rc = cib_perform_op(op, call_options, &fn, TRUE, section, NULL, data,
+			    FALSE, &changed, private->cib, &result_cib, NULL, &output);
+    }
+
+    if(cib->op_callback != NULL) {
+	cib->op_callback(NULL, cib->call_id, rc, output);
+    }
+
+    if(output_data && output) {
+	*output_data = copy_xml(output);
+    }
+
+    return rc;
+}
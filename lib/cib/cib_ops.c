@@ -639,9 +639,8 @@ cib_process_diff(
 	}
 
 	if(apply_diff) {
-		free_xml(*result_cib);
-		*result_cib = NULL;
-		if(apply_xml_diff(existing_cib, input, result_cib) == FALSE) {
+		/* *result_cib is still an unmodified copy of existing_cib */
+		if(apply_xml_diff_inplace(existing_cib, input, result_cib) == FALSE) {
 		    log_level = LOG_NOTICE;
 		    reason = "Failed application of an update diff";
 		    
@@ -888,11 +887,23 @@ cib_process_xpath(
     int max = 0;
     int rc = cib_ok;
     gboolean is_query = safe_str_eq(op, CIB_OP_QUERY);
+    gboolean by_id = FALSE;
+    GListPtr id_matches = NULL;
+    GListPtr id_iter = NULL;
     
     xmlXPathObjectPtr xpathObj = NULL;
     crm_debug_2("Processing \"%s\" event", op);
 
-    if(is_query) {
+    /* Only the server indexes the CIB, and cib_perform_op() has moved
+     * the index to *result_cib for updates
+     */
+    by_id = xpath_search_id(is_query?existing_cib:*result_cib, section, &id_matches);
+
+    if(by_id) {
+	max = g_list_length(id_matches);
+	id_iter = id_matches;
+
+    } else if(is_query) {
 	xpathObj = xpath_search(existing_cib, section);
     } else {
 	xpathObj = xpath_search(*result_cib, section);
@@ -917,7 +928,15 @@ cib_process_xpath(
 
     for(lpc = 0; lpc < max; lpc++) {
 	xmlChar *path = NULL;
-	xmlNode *match = getXpathResult(xpathObj, lpc);
+	xmlNode *match = NULL;
+
+	if(by_id) {
+	    match = id_iter->data;
+	    id_iter = id_iter->next;
+	} else {
+	    match = getXpathResult(xpathObj, lpc);
+	}
+
 	if(match == NULL) {
 	    continue;
 	}
@@ -977,6 +996,7 @@ cib_process_xpath(
     if(xpathObj) {
 	xmlXPathFreeObject(xpathObj);
     }
+    g_list_free(id_matches);
 	    
     return rc;
 }
@@ -548,6 +548,11 @@ cib_perform_op(const char *op, int call_options, cib_op_t *fn, gboolean is_query
     }
     
     scratch = copy_xml(current_cib);
+
+    /* The index follows the version being built.  If the update fails
+     * the caller re-enables it for current_cib.
+     */
+    xml_index_move(current_cib, scratch);
     rc = (*fn)(op, call_options, section, req, input, current_cib, &scratch, output);    
 
     CRM_CHECK(current_cib != scratch, return cib_unknown);
@@ -527,7 +527,11 @@ gboolean ais_dispatch(int sender, gpointer user_data)
 	    crm_info("Membership %s: quorum %s", value, quorate?"retained":"still lost");
 	}
 	
-	xml_child_iter(xml, node, crm_update_ais_node(node, crm_peer_seq));
+	if(crm_update_ais_membership(xml, crm_peer_seq) == FALSE) {
+	    /* we missed a delta, wait for the full list instead */
+	    send_ais_text(crm_class_members, __FUNCTION__, TRUE, NULL, crm_msg_ais);
+	    goto done;
+	}
     }
 
     if(dispatch != NULL) {
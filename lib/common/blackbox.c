@@ -0,0 +1,689 @@
+/*
+ * Copyright (C) 2004 Andrew Beekhof <andrew@beekhof.net>
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * The blackbox is a per-process ring of the most recent
+ * do_crm_log_unlikely() calls, recorded whether or not the message
+ * passes the current log level.
+ *
+ * Recording is kept cheap: a slot is claimed with an atomic increment
+ * and only the format pointer, a timestamp and the raw arguments are
+ * stored.  The format is walked once to find out what type each
+ * argument has, strings are copied (they rarely outlive the call) and
+ * nothing is formatted until the ring is dumped.
+ *
+ * Only daemons started with PCMK_blackbox=yes keep one.  Otherwise
+ * do_crm_log_unlikely() costs what it always did: a level check.
+ */
+
+#include <crm_internal.h>
+
+#include <sys/param.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <string.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <errno.h>
+
+#include <crm/crm.h>
+#include <crm/common/util.h>
+#include <crm/common/mainloop.h>
+
+#define BLACKBOX_SLOTS		4096
+#define BLACKBOX_ARG_SPACE	200
+#define BLACKBOX_LINE		1024
+#define BLACKBOX_NULL_STR	USHRT_MAX
+
+typedef struct blackbox_slot_s
+{
+	/* zero while the slot is being (re)written */
+	unsigned long seq;
+	int level;
+	int errno_saved;
+	struct timeval when;
+	const char *function;
+	const char *fmt;
+	unsigned short len;
+	char args[BLACKBOX_ARG_SPACE];
+} blackbox_slot_t;
+
+enum blackbox_length
+{
+	bb_len_none,
+	bb_len_hh,
+	bb_len_h,
+	bb_len_l,
+	bb_len_ll,
+	bb_len_j,
+	bb_len_z,
+	bb_len_t,
+	bb_len_L,
+};
+
+typedef struct blackbox_spec_s
+{
+	const char *flags;
+	int flags_len;
+
+	gboolean width_star;
+	const char *width;
+	int width_len;
+
+	gboolean has_precision;
+	gboolean precision_star;
+	const char *precision;
+	int precision_len;
+
+	enum blackbox_length length;
+	char conversion;
+} blackbox_spec_t;
+
+static blackbox_slot_t *blackbox = NULL;
+static volatile unsigned long blackbox_next = 0;
+static volatile sig_atomic_t blackbox_paused = FALSE;
+
+gboolean crm_blackbox_enabled = FALSE;
+static int blackbox_dumps = 0;
+
+/* Parses the conversion following the '%' at 'fmt'
+ * Returns a pointer to the first character after it
+ */
+static const char *
+blackbox_parse_spec(const char *fmt, blackbox_spec_t *spec)
+{
+	const char *p = fmt + 1;
+
+	memset(spec, 0, sizeof(blackbox_spec_t));
+
+	spec->flags = p;
+	while(*p != 0 && strchr("-+ #0'I", *p) != NULL) {
+		p++;
+	}
+	spec->flags_len = p - spec->flags;
+
+	if(*p == '*') {
+		spec->width_star = TRUE;
+		p++;
+	} else {
+		spec->width = p;
+		while(*p >= '0' && *p <= '9') {
+			p++;
+		}
+		spec->width_len = p - spec->width;
+	}
+
+	if(*p == '.') {
+		p++;
+		spec->has_precision = TRUE;
+		if(*p == '*') {
+			spec->precision_star = TRUE;
+			p++;
+		} else {
+			spec->precision = p;
+			while(*p >= '0' && *p <= '9') {
+				p++;
+			}
+			spec->precision_len = p - spec->precision;
+		}
+	}
+
+	switch(*p) {
+		case 'h':
+			spec->length = bb_len_h;
+			if(*(++p) == 'h') {
+				spec->length = bb_len_hh;
+				p++;
+			}
+			break;
+		case 'l':
+			spec->length = bb_len_l;
+			if(*(++p) == 'l') {
+				spec->length = bb_len_ll;
+				p++;
+			}
+			break;
+		case 'q':
+			spec->length = bb_len_ll;
+			p++;
+			break;
+		case 'j':
+			spec->length = bb_len_j;
+			p++;
+			break;
+		case 'z':
+		case 'Z':
+			spec->length = bb_len_z;
+			p++;
+			break;
+		case 't':
+			spec->length = bb_len_t;
+			p++;
+			break;
+		case 'L':
+			spec->length = bb_len_L;
+			p++;
+			break;
+	}
+
+	spec->conversion = *p;
+	if(*p != 0) {
+		p++;
+	}
+	return p;
+}
+
+#define blackbox_put(type, value) do {					\
+		type __bb_value = (value);				\
+		if(len + sizeof(type) > BLACKBOX_ARG_SPACE) {		\
+			goto full;					\
+		}							\
+		memcpy(buffer + len, &__bb_value, sizeof(type));	\
+		len += sizeof(type);					\
+	} while(0)
+
+static unsigned short
+blackbox_pack(char *buffer, const char *fmt, va_list ap)
+{
+	unsigned int len = 0;
+	blackbox_spec_t spec;
+	const char *p = fmt;
+
+	while(*p != 0) {
+		if(*p != '%') {
+			p++;
+			continue;
+		}
+
+		p = blackbox_parse_spec(p, &spec);
+		if(spec.width_star) {
+			blackbox_put(int, va_arg(ap, int));
+		}
+		if(spec.precision_star) {
+			blackbox_put(int, va_arg(ap, int));
+		}
+
+		switch(spec.conversion) {
+			case 'd':
+			case 'i':
+				switch(spec.length) {
+					case bb_len_l:
+						blackbox_put(long long, va_arg(ap, long));
+						break;
+					case bb_len_ll:
+						blackbox_put(long long, va_arg(ap, long long));
+						break;
+					case bb_len_j:
+						blackbox_put(long long, va_arg(ap, intmax_t));
+						break;
+					case bb_len_z:
+						blackbox_put(long long, va_arg(ap, ssize_t));
+						break;
+					case bb_len_t:
+						blackbox_put(long long, va_arg(ap, ptrdiff_t));
+						break;
+					default:
+						blackbox_put(long long, va_arg(ap, int));
+						break;
+				}
+				break;
+
+			case 'o':
+			case 'u':
+			case 'x':
+			case 'X':
+				switch(spec.length) {
+					case bb_len_l:
+						blackbox_put(unsigned long long, va_arg(ap, unsigned long));
+						break;
+					case bb_len_ll:
+						blackbox_put(unsigned long long, va_arg(ap, unsigned long long));
+						break;
+					case bb_len_j:
+						blackbox_put(unsigned long long, va_arg(ap, uintmax_t));
+						break;
+					case bb_len_z:
+						blackbox_put(unsigned long long, va_arg(ap, size_t));
+						break;
+					case bb_len_t:
+						blackbox_put(unsigned long long, va_arg(ap, ptrdiff_t));
+						break;
+					default:
+						blackbox_put(unsigned long long, va_arg(ap, unsigned int));
+						break;
+				}
+				break;
+
+			case 'c':
+				blackbox_put(int, va_arg(ap, int));
+				break;
+
+			case 'e':
+			case 'E':
+			case 'f':
+			case 'F':
+			case 'g':
+			case 'G':
+			case 'a':
+			case 'A':
+				if(spec.length == bb_len_L) {
+					blackbox_put(double, va_arg(ap, long double));
+				} else {
+					blackbox_put(double, va_arg(ap, double));
+				}
+				break;
+
+			case 'p':
+				blackbox_put(void*, va_arg(ap, void*));
+				break;
+
+			case 'n':
+				(void)va_arg(ap, void*);
+				break;
+
+			case 's':
+				if(spec.length != bb_len_none) {
+					/* wide strings are never logged */
+					goto full;
+
+				} else {
+					const char *value = va_arg(ap, const char*);
+					unsigned short value_len = BLACKBOX_NULL_STR;
+
+					if(value != NULL) {
+						size_t max = 0;
+						if(len + sizeof(unsigned short) >= BLACKBOX_ARG_SPACE) {
+							goto full;
+						}
+						max = BLACKBOX_ARG_SPACE - len - sizeof(unsigned short);
+						value_len = strnlen(value, max);
+					}
+
+					blackbox_put(unsigned short, value_len);
+					if(value != NULL) {
+						memcpy(buffer + len, value, value_len);
+						len += value_len;
+					}
+				}
+				break;
+
+			case '%':
+			case 'm':
+				break;
+
+			default:
+				/* positional or unknown conversions */
+				goto full;
+		}
+	}
+
+  full:
+	return len;
+}
+
+static int blackbox_vformat(char *buffer, size_t max, const char *spec, va_list ap)
+	__attribute__((format(printf, 3, 0)));
+
+static int
+blackbox_vformat(char *buffer, size_t max, const char *spec, va_list ap)
+{
+	return vsnprintf(buffer, max, spec, ap);
+}
+
+/* Appends to 'line' using a format assembled at dump time */
+static void
+blackbox_append(char *line, int *offset, const char *spec, ...)
+{
+	int rc = 0;
+	va_list ap;
+
+	if(*offset >= BLACKBOX_LINE - 1) {
+		return;
+	}
+
+	va_start(ap, spec);
+	rc = blackbox_vformat(line + *offset, BLACKBOX_LINE - *offset, spec, ap);
+	va_end(ap);
+
+	if(rc > 0) {
+		*offset += rc;
+	}
+	if(*offset > BLACKBOX_LINE - 1) {
+		*offset = BLACKBOX_LINE - 1;
+	}
+}
+
+#define blackbox_get(type, target) do {					\
+		if(len + sizeof(type) > slot->len) {			\
+			goto truncated;					\
+		}							\
+		memcpy(&target, slot->args + len, sizeof(type));	\
+		len += sizeof(type);					\
+	} while(0)
+
+/* Rebuilds the message for 'slot' in the same order it was packed */
+static void
+blackbox_unpack(blackbox_slot_t *slot, char *line, int *offset)
+{
+	unsigned int len = 0;
+	blackbox_spec_t spec;
+	const char *p = slot->fmt;
+
+	while(*p != 0) {
+		char rebuilt[64];
+		int r_offset = 0;
+		int star = 0;
+		const char *start = p;
+
+		while(*p != 0 && *p != '%') {
+			p++;
+		}
+		if(p != start) {
+			blackbox_append(line, offset, "%.*s", (int)(p - start), start);
+			continue;
+		}
+
+		p = blackbox_parse_spec(p, &spec);
+		if(spec.conversion == '%') {
+			blackbox_append(line, offset, "%%");
+			continue;
+		}
+
+		r_offset = snprintf(rebuilt, sizeof(rebuilt), "%%%.*s", spec.flags_len, spec.flags);
+		if(spec.width_star) {
+			blackbox_get(int, star);
+			r_offset += snprintf(rebuilt + r_offset, sizeof(rebuilt) - r_offset, "%d", star);
+		} else {
+			r_offset += snprintf(rebuilt + r_offset, sizeof(rebuilt) - r_offset,
+					     "%.*s", spec.width_len, spec.width);
+		}
+		if(spec.precision_star) {
+			blackbox_get(int, star);
+			r_offset += snprintf(rebuilt + r_offset, sizeof(rebuilt) - r_offset, ".%d", star);
+		} else if(spec.has_precision) {
+			r_offset += snprintf(rebuilt + r_offset, sizeof(rebuilt) - r_offset,
+					     ".%.*s", spec.precision_len, spec.precision);
+		}
+		if(r_offset >= (int)sizeof(rebuilt) - 4) {
+			goto truncated;
+		}
+
+		switch(spec.conversion) {
+			case 'd':
+			case 'i':
+				{
+					long long value = 0;
+					blackbox_get(long long, value);
+					sprintf(rebuilt + r_offset, "ll%c", spec.conversion);
+					blackbox_append(line, offset, rebuilt, value);
+				}
+				break;
+
+			case 'o':
+			case 'u':
+			case 'x':
+			case 'X':
+				{
+					unsigned long long value = 0;
+					blackbox_get(unsigned long long, value);
+					sprintf(rebuilt + r_offset, "ll%c", spec.conversion);
+					blackbox_append(line, offset, rebuilt, value);
+				}
+				break;
+
+			case 'c':
+				{
+					int value = 0;
+					blackbox_get(int, value);
+					sprintf(rebuilt + r_offset, "c");
+					blackbox_append(line, offset, rebuilt, value);
+				}
+				break;
+
+			case 'e':
+			case 'E':
+			case 'f':
+			case 'F':
+			case 'g':
+			case 'G':
+			case 'a':
+			case 'A':
+				{
+					double value = 0;
+					blackbox_get(double, value);
+					sprintf(rebuilt + r_offset, "%c", spec.conversion);
+					blackbox_append(line, offset, rebuilt, value);
+				}
+				break;
+
+			case 'p':
+				{
+					void *value = NULL;
+					blackbox_get(void*, value);
+					sprintf(rebuilt + r_offset, "p");
+					blackbox_append(line, offset, rebuilt, value);
+				}
+				break;
+
+			case 's':
+				{
+					unsigned short value_len = 0;
+					blackbox_get(unsigned short, value_len);
+					if(value_len == BLACKBOX_NULL_STR) {
+						sprintf(rebuilt + r_offset, "s");
+						blackbox_append(line, offset, rebuilt, "<null>");
+
+					} else if(len + value_len > slot->len) {
+						goto truncated;
+
+					} else {
+						/* the copy isn't terminated, so bound it */
+						char value[BLACKBOX_ARG_SPACE];
+						memcpy(value, slot->args + len, value_len);
+						value[value_len] = 0;
+						len += value_len;
+
+						sprintf(rebuilt + r_offset, "s");
+						blackbox_append(line, offset, rebuilt, value);
+					}
+				}
+				break;
+
+			case 'm':
+				sprintf(rebuilt + r_offset, "s");
+				blackbox_append(line, offset, rebuilt, strerror(slot->errno_saved));
+				break;
+
+			case 'n':
+				break;
+
+			default:
+				goto truncated;
+		}
+	}
+	return;
+
+  truncated:
+	blackbox_append(line, offset, " <truncated>");
+}
+
+void
+crm_blackbox_init(void)
+{
+	const char *value = getenv("PCMK_blackbox");
+
+	if(blackbox != NULL) {
+		return;
+
+	} else if(value == NULL || crm_is_true(value) == FALSE) {
+		return;
+	}
+
+	crm_malloc0(blackbox, BLACKBOX_SLOTS * sizeof(blackbox_slot_t));
+	crm_blackbox_enabled = TRUE;
+
+	/* Dumping isn't async-signal-safe, so do it from the mainloop */
+	mainloop_add_signal(DEBUG_DUMP, crm_blackbox_signal);
+	crm_info("Recording debug messages in the blackbox, send signal %d to dump it",
+		 DEBUG_DUMP);
+}
+
+/* Backs do_crm_log_unlikely()
+ *
+ * The arguments are only evaluated once, so recording and logging both
+ * happen here rather than in the macro.
+ */
+void
+crm_blackbox_log(int level, const char *function, const char *fmt, ...)
+{
+	va_list ap;
+	unsigned long seq = 0;
+	blackbox_slot_t *slot = NULL;
+	int errno_saved = errno;
+
+	if(crm_log_level >= level) {
+		char *message = NULL;
+
+		va_start(ap, fmt);
+		message = g_strdup_vprintf(fmt, ap);
+		va_end(ap);
+
+		crm_log_lock();
+		if(level < LOG_DEBUG_2) {
+			cl_log(level, "%s: %s", function, message);
+		} else {
+			cl_log(LOG_DEBUG, "debug%d: %s: %s", level-LOG_INFO, function, message);
+		}
+		crm_log_unlock();
+		g_free(message);
+		errno = errno_saved;
+	}
+
+	if(blackbox == NULL || blackbox_paused) {
+		return;
+	}
+
+	seq = __sync_add_and_fetch(&blackbox_next, 1);
+	slot = &blackbox[seq % BLACKBOX_SLOTS];
+
+	slot->seq = 0;
+	__sync_synchronize();
+
+	gettimeofday(&slot->when, NULL);
+	slot->level = level;
+	slot->function = function;
+	slot->fmt = fmt;
+	slot->errno_saved = errno_saved;
+
+	va_start(ap, fmt);
+	slot->len = blackbox_pack(slot->args, fmt, ap);
+	va_end(ap);
+
+	__sync_synchronize();
+	slot->seq = seq;
+	errno = errno_saved;
+}
+
+void
+crm_blackbox_dump(const char *reason)
+{
+	int fd = 0;
+	int lpc = 0;
+	int offset = 0;
+	int written = 0;
+	unsigned long last = 0;
+	char line[BLACKBOX_LINE];
+	char filename[PATH_MAX];
+	static const char *level_names[] = {
+		"emerg", "alert", "crit", "error", "warning", "notice", "info", "debug"
+	};
+
+	if(blackbox == NULL || blackbox_paused) {
+		return;
+	}
+
+	/* Anything logged from here on would only overwrite what we want */
+	blackbox_paused = TRUE;
+	__sync_synchronize();
+	last = blackbox_next;
+
+	snprintf(filename, sizeof(filename), CRM_STATE_DIR"/blackbox-%s-%d.%d",
+		 crm_system_name?crm_system_name:"unknown", (int)getpid(), blackbox_dumps++);
+
+	fd = open(filename, O_WRONLY|O_CREAT|O_TRUNC, S_IRUSR|S_IWUSR);
+	if(fd < 0) {
+		blackbox_paused = FALSE;
+		crm_perror(LOG_ERR, "Could not write blackbox to %s", filename);
+		return;
+	}
+
+	offset = snprintf(line, sizeof(line), "Blackbox of %s[%d] (%s): %lu messages recorded\n",
+			  crm_system_name?crm_system_name:"unknown", (int)getpid(),
+			  reason?reason:"unknown", last);
+	if(write(fd, line, offset) < 0) {
+		goto bail;
+	}
+
+	/* Oldest first */
+	for(lpc = 1; lpc <= BLACKBOX_SLOTS; lpc++) {
+		blackbox_slot_t *slot = &blackbox[(last + lpc) % BLACKBOX_SLOTS];
+
+		if(slot->seq == 0 || slot->seq > last) {
+			continue;
+		}
+
+		offset = 0;
+		if(slot->level <= LOG_DEBUG) {
+			blackbox_append(line, &offset, "%ld.%06ld %-7s %s: ",
+					(long)slot->when.tv_sec, (long)slot->when.tv_usec,
+					level_names[slot->level], slot->function);
+		} else {
+			blackbox_append(line, &offset, "%ld.%06ld debug%-2d %s: ",
+					(long)slot->when.tv_sec, (long)slot->when.tv_usec,
+					slot->level - LOG_INFO, slot->function);
+		}
+		blackbox_unpack(slot, line, &offset);
+		line[offset++] = '\n';
+
+		if(write(fd, line, offset) < 0) {
+			goto bail;
+		}
+		written++;
+	}
+
+  bail:
+	if(lpc <= BLACKBOX_SLOTS) {
+		crm_perror(LOG_ERR, "Could not write blackbox to %s", filename);
+	}
+	close(fd);
+	blackbox_paused = FALSE;
+	crm_notice("Blackbox written to %s (%d entries): %s",
+		   filename, written, reason?reason:"unknown");
+}
+
+void
+crm_blackbox_signal(int nsig)
+{
+	crm_blackbox_dump(strsignal(nsig));
+}
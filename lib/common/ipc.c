@@ -80,7 +80,7 @@ xmlNode *xmlfromIPC(IPC_Channel *ch, int timeout)
     return xml;
 }
 
-static int xml2ipcchan(xmlNode *m, IPC_Channel *ch)
+static int xml2ipcchan(xmlNode *m, const crm_xml_blob_t *attach, IPC_Channel *ch)
 {
 	HA_Message  *msg = NULL;
 	IPC_Message *imsg = NULL;
@@ -92,6 +92,9 @@ static int xml2ipcchan(xmlNode *m, IPC_Channel *ch)
 	}
 
 	msg = convert_xml_message(m);
+	if(attach != NULL) {
+		convert_xml_blob(msg, attach);
+	}
 	if ((imsg = hamsg2ipcmsg(msg, ch)) == NULL) {
 		cl_log(LOG_ERR, "hamsg2ipcmsg() failure");
 		crm_msg_del(msg);
@@ -115,6 +118,14 @@ static int xml2ipcchan(xmlNode *m, IPC_Channel *ch)
 /* frees msg */
 gboolean 
 send_ipc_message(IPC_Channel *ipc_client, xmlNode *msg)
+{
+	return send_ipc_message_adv(ipc_client, msg, NULL);
+}
+
+/* attach, if any, is sent as an extra child of msg */
+gboolean 
+send_ipc_message_adv(
+	IPC_Channel *ipc_client, xmlNode *msg, const crm_xml_blob_t *attach)
 {
 	gboolean all_is_good = TRUE;
 	int fail_level = LOG_WARNING;
@@ -137,7 +148,7 @@ send_ipc_message(IPC_Channel *ipc_client, xmlNode *msg)
 		all_is_good = FALSE;
 	}
 
-	if(all_is_good && xml2ipcchan(msg, ipc_client) != HA_OK) {
+	if(all_is_good && xml2ipcchan(msg, attach, ipc_client) != HA_OK) {
 		do_crm_log(fail_level, "Could not send IPC message to %d",
 			(int)ipc_client->farside_pid);
 		all_is_good = FALSE;
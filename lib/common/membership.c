@@ -373,6 +373,39 @@ crm_node_t *crm_update_ais_node(xmlNode *member, long long seq)
     return crm_update_peer(id, born, seen, votes, procs, uname, uname, addr, state);
 }
 
+/*
+ * Apply a <nodes/> update from the plugin.  Deltas only list the peers
+ * that changed, so one that doesn't directly follow the last update we
+ * applied is refused and the caller must ask for the full list.
+ */
+gboolean crm_update_ais_membership(xmlNode *xml, long long seq)
+{
+    static unsigned long long last_update = 0;
+
+    unsigned long long update = 0;
+    const char *update_s = crm_element_value(xml, "update");
+    gboolean delta = crm_is_true(crm_element_value(xml, "delta"));
+
+    if(update_s == NULL) {
+	/* the plugin predates deltas, this is always the full list */
+	xml_child_iter(xml, node, crm_update_ais_node(node, seq));
+	return TRUE;
+    }
+
+    update = crm_int_helper(update_s, NULL);
+    if(delta && update != last_update + 1) {
+	crm_notice("Membership update %llu does not follow %llu: resyncing",
+		   update, last_update);
+	return FALSE;
+    }
+
+    crm_debug_2("Applying %s membership update %llu",
+		delta?"incremental":"full", update);
+    last_update = update;
+    xml_child_iter(xml, node, crm_update_ais_node(node, seq));
+    return TRUE;
+}
+
 #if SUPPORT_HEARTBEAT
 crm_node_t *crm_update_ccm_node(
     const oc_ev_membership_t *oc, int offset, const char *state, uint64_t seq)
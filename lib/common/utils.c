@@ -63,15 +63,77 @@
 
 static uint ref_counter = 0;
 unsigned int crm_log_level = LOG_INFO;
-gboolean crm_config_error = FALSE;
-gboolean crm_config_warning = FALSE;
 const char *crm_system_name = "unknown";
 
-int node_score_red = 0;
-int node_score_green = 0;
-int node_score_yellow = 0;
+/* cl_log() keeps its logd connection and message queue in globals, so
+ * the PE's worker threads (ptest --batch, pe-alloc-threads) must take
+ * turns.  Recursive, since the arguments of a log call can log too.
+ */
+#if GLIB_CHECK_VERSION(2,32,0)
+static GRecMutex crm_log_mutex;
+#else
+static GStaticRecMutex crm_log_mutex = G_STATIC_REC_MUTEX_INIT;
+#endif
+
+/* Per-thread, like the PE state that sets them */
+static CRM_THREAD_LOCAL gboolean config_error = FALSE;
+static CRM_THREAD_LOCAL gboolean config_warning = FALSE;
+
+static CRM_THREAD_LOCAL int score_red = 0;
+static CRM_THREAD_LOCAL int score_green = 0;
+static CRM_THREAD_LOCAL int score_yellow = 0;
 int node_score_infinity = INFINITY;
 
+void
+crm_log_lock(void)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+	g_rec_mutex_lock(&crm_log_mutex);
+#else
+	g_static_rec_mutex_lock(&crm_log_mutex);
+#endif
+}
+
+void
+crm_log_unlock(void)
+{
+#if GLIB_CHECK_VERSION(2,32,0)
+	g_rec_mutex_unlock(&crm_log_mutex);
+#else
+	g_static_rec_mutex_unlock(&crm_log_mutex);
+#endif
+}
+
+gboolean *
+crm_config_error_location(void)
+{
+	return &config_error;
+}
+
+gboolean *
+crm_config_warning_location(void)
+{
+	return &config_warning;
+}
+
+int *
+node_score_red_location(void)
+{
+	return &score_red;
+}
+
+int *
+node_score_green_location(void)
+{
+	return &score_green;
+}
+
+int *
+node_score_yellow_location(void)
+{
+	return &score_yellow;
+}
+
 void crm_set_env_options(void);
 
 gboolean
@@ -527,6 +589,10 @@ crm_log_init(
 
 	crm_signal(DEBUG_INC, alter_debug);
 	crm_signal(DEBUG_DEC, alter_debug);
+	if(coredir) {
+		/* only daemons, and only if asked for */
+		crm_blackbox_init();
+	}
 
 	return TRUE;
 }
@@ -969,8 +1035,17 @@ parse_op_key(const char *key, char **rsc_id, char **op_type, int *interval)
 	char *mutable_key = NULL;
 	char *mutable_key_ptr = NULL;
 	int len = 0, offset = 0, ch = 0;
+	const crm_op_key_t *op_key = NULL;
 
 	CRM_CHECK(key != NULL, return FALSE);
+
+	op_key = find_op_key(key);
+	if(op_key != NULL && op_key->rsc_id != NULL && strcmp(op_key->key, key) == 0) {
+		*rsc_id = crm_strdup(op_key->rsc_id);
+		*op_type = crm_strdup(op_key->task);
+		*interval = op_key->interval;
+		return TRUE;
+	}
 	
 	*interval = 0;
 	len = strlen(key);
@@ -1197,6 +1272,133 @@ decode_transition_key(
 	return done;
 }
 
+/* Per-thread so that concurrent calculations can't flush each other's keys */
+static CRM_THREAD_LOCAL GHashTable *op_key_table = NULL;
+
+static guint
+crm_strcase_hash(gconstpointer v)
+{
+	const char *p = v;
+	guint h = 0;
+
+	for(; *p != EOS; p++) {
+		h = (h << 5) - h + tolower((unsigned char)*p);
+	}
+	return h;
+}
+
+static gboolean
+crm_strcase_equal(gconstpointer a, gconstpointer b)
+{
+	return strcasecmp(a, b) == 0;
+}
+
+static void
+free_op_key(gpointer data)
+{
+	crm_op_key_t *op_key = data;
+	crm_free(op_key->rsc_id);
+	crm_free(op_key->task);
+	crm_free(op_key->key);
+	crm_free(op_key);
+}
+
+/* Same rules as parse_op_key() but silent, pseudo-actions such as
+ * "all_stopped" are interned too and simply have no rsc_id/task
+ */
+static gboolean
+split_op_key(crm_op_key_t *op_key)
+{
+	const char *key = op_key->key;
+	int len = strlen(key);
+	int offset = len - 1;
+	int task_end = 0;
+
+	while(offset > 0 && isdigit((unsigned char)key[offset])) {
+		offset--;
+	}
+	if(offset <= 0 || key[offset] != '_') {
+		return FALSE;
+	}
+
+	op_key->interval = crm_parse_int(key+offset+1, "0");
+	task_end = offset;
+	offset--;
+
+	while(offset > 0 && key[offset] != '_') {
+		offset--;
+	}
+	if(key[offset] != '_') {
+		return FALSE;
+	}
+
+	crm_malloc0(op_key->task, task_end - offset);
+	strncpy(op_key->task, key+offset+1, task_end - offset - 1);
+
+	crm_malloc0(op_key->rsc_id, offset + 1);
+	strncpy(op_key->rsc_id, key, offset);
+	return TRUE;
+}
+
+const crm_op_key_t *
+find_op_key(const char *key)
+{
+	if(key == NULL || op_key_table == NULL) {
+		return NULL;
+	}
+	return g_hash_table_lookup(op_key_table, key);
+}
+
+const crm_op_key_t *
+intern_op_key(const char *key)
+{
+	crm_op_key_t *op_key = NULL;
+
+	CRM_CHECK(key != NULL, return NULL);
+
+	if(op_key_table == NULL) {
+		op_key_table = g_hash_table_new_full(
+			crm_strcase_hash, crm_strcase_equal, NULL, free_op_key);
+	}
+
+	op_key = g_hash_table_lookup(op_key_table, key);
+	if(op_key != NULL) {
+		return op_key;
+	}
+
+	crm_malloc0(op_key, sizeof(crm_op_key_t));
+	op_key->key = crm_strdup(key);
+	if(split_op_key(op_key) == FALSE) {
+		crm_debug_4("Interned unparsable key: %s", key);
+	}
+
+	g_hash_table_insert(op_key_table, op_key->key, op_key);
+	return op_key;
+}
+
+/* Invalidates every pointer previously returned by intern_op_key() */
+void
+flush_op_keys(void)
+{
+	if(op_key_table != NULL) {
+		crm_debug_2("Flushing %d interned operation keys",
+			    g_hash_table_size(op_key_table));
+		g_hash_table_destroy(op_key_table);
+		op_key_table = NULL;
+	}
+}
+
+/* Lends the keys interned by one thread to another working on the same
+ * calculation.  Only one of them may use the table at a time.
+ */
+GHashTable *
+swap_op_keys(GHashTable *table)
+{
+	GHashTable *previous = op_key_table;
+	op_key_table = table;
+	return previous;
+}
+
 void
 filter_action_parameters(xmlNode *param_set, const char *version) 
 {
@@ -1379,6 +1581,7 @@ crm_abort(const char *file, const char *function, int line,
 			return;
 
 		case 0:	/* Child */
+			crm_blackbox_dump(assert_condition);
 			abort();
 			break;
 	}
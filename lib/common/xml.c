@@ -137,10 +137,82 @@ find_xml_node(xmlNode *root, const char * search_path, gboolean must_find)
 	return NULL;
 }
 
+/*
+ * Id index hooks
+ *
+ * Only set by processes that index their documents (see
+ * crm_xml_index_functions_t), so everyone else pays nothing more than
+ * a NULL check in the functions that add elements or change ids.
+ */
+static crm_xml_index_functions_t *index_fns = NULL;
+
+void
+set_xml_index_functions(crm_xml_index_functions_t *fns)
+{
+	index_fns = fns;
+}
+
+gboolean
+xml_index_move(xmlNode *from, xmlNode *to) 
+{
+	if(index_fns == NULL) {
+	    return FALSE;
+	}
+	return index_fns->move(from, to);
+}
+
+/* For everything that puts a subtree into a document */
+static void
+xml_index_added(xmlNode *xml) 
+{
+	if(index_fns != NULL) {
+	    index_fns->added(xml);
+	}
+}
+
+/* Called before the id of xml is changed or removed
+ * Returns TRUE if xml_index_id_changed() needs to be called afterwards
+ */
+static gboolean
+xml_index_id_changing(xmlNode *xml, const char *name) 
+{
+	if(index_fns == NULL || safe_str_neq(name, XML_ATTR_ID)) {
+	    return FALSE;
+	}
+	index_fns->id_changing(xml);
+	return TRUE;
+}
+
+static void
+xml_index_id_changed(xmlNode *xml) 
+{
+	index_fns->id_changed(xml);
+}
+
 xmlNode*
 find_entity(xmlNode *parent, const char *node_name, const char *id)
 {
+	GListPtr matches = NULL;
+
 	crm_validate_data(parent);
+	if(id != NULL && node_name != NULL && index_fns != NULL
+	   && index_fns->lookup(parent, node_name, id, &matches)) {
+		xmlNode *found = NULL;
+		slist_iter(
+			match, xmlNode, matches, lpc,
+			if(match->parent == parent) {
+				found = match;
+				break;
+			}
+			);
+		g_list_free(matches);
+		if(found == NULL) {
+			crm_debug_3("node <%s id=%s> not found in %s.",
+				    node_name, id, crm_element_name(parent));
+		}
+		return found;
+	}
+	
 	xml_child_iter_filter(
 		parent, a_child, node_name,
 		if(id == NULL || crm_str_eq(id, ID(a_child), TRUE)) {
@@ -268,6 +340,7 @@ add_node_copy(xmlNode *parent, xmlNode *src_node)
 
 	child = xmlDocCopyNode(src_node, doc, 1);
 	xmlAddChild(parent, child);
+	xml_index_added(child);
 	return child;
 }
 
@@ -284,6 +357,7 @@ const char *
 crm_xml_add(xmlNode* node, const char *name, const char *value)
 {
     xmlAttr *attr = NULL;
+    gboolean id_change = FALSE;
     CRM_CHECK_AND_STORE(node != NULL, return NULL);
     CRM_CHECK_AND_STORE(name != NULL, return NULL);
 
@@ -304,7 +378,11 @@ crm_xml_add(xmlNode* node, const char *name, const char *value)
     }
 #endif
     
+    id_change = xml_index_id_changing(node, name);
     attr = xmlSetProp(node, (const xmlChar*)name, (const xmlChar*)value);
+    if(id_change) {
+	xml_index_id_changed(node);
+    }
     CRM_CHECK(attr && attr->children && attr->children->content, return NULL);
     return (char *)attr->children->content;
 }
@@ -313,6 +391,7 @@ const char *
 crm_xml_replace(xmlNode* node, const char *name, const char *value)
 {
     xmlAttr *attr = NULL;
+    gboolean id_change = FALSE;
     const char *old_value = NULL;
     CRM_CHECK(node != NULL, return NULL);
     CRM_CHECK(name != NULL && name[0] != 0, return NULL);
@@ -330,7 +409,11 @@ crm_xml_replace(xmlNode* node, const char *name, const char *value)
 	return NULL;
     }
     
+    id_change = xml_index_id_changing(node, name);
     attr = xmlSetProp(node, (const xmlChar*)name, (const xmlChar*)value);
+    if(id_change) {
+	xml_index_id_changed(node);
+    }
     CRM_CHECK(attr && attr->children && attr->children->content, return NULL);
     return (char *)attr->children->content;
 }
@@ -433,8 +516,8 @@ static void crm_xml_err(void * ctx, const char * msg, ...)
     int len = 0;
     va_list args;
     char *buf = NULL;
-    static int buffer_len = 0;
-    static char *buffer = NULL;
+    static CRM_THREAD_LOCAL int buffer_len = 0;
+    static CRM_THREAD_LOCAL char *buffer = NULL;
     
     va_start(args, msg);
     len = vasprintf(&buf, msg, args);
@@ -825,8 +908,8 @@ convert_xml_message_struct(HA_Message *parent, xmlNode *src_node, const char *fi
     return result;
 }
 
-static void
-convert_xml_child(HA_Message *msg, xmlNode *xml) 
+crm_xml_blob_t *
+xml_blob_new(xmlNode *xml) 
 {
     int orig = 0;
     int rc = BZ_OK;
@@ -834,14 +917,20 @@ convert_xml_child(HA_Message *msg, xmlNode *xml)
     
     char *buffer = NULL;
     char *compressed = NULL;
-    const char *name = NULL;
+    crm_xml_blob_t *blob = NULL;
 
-    name = (const char *)xml->name;
+    CRM_CHECK(xml != NULL, return NULL);
     buffer = dump_xml_unformatted(xml);
-    orig = strlen(buffer);
+    CRM_CHECK(buffer != NULL, return NULL);
+
+    crm_malloc0(blob, sizeof(crm_xml_blob_t));
+    blob->name = crm_strdup((const char *)xml->name);
+    blob->data = buffer;
+    blob->len = strlen(buffer);
+
+    orig = blob->len;
     if(orig < CRM_BZ2_THRESHOLD) {
-	ha_msg_add(msg, name, buffer);
-	goto done;
+	return blob;
     }
     
     len = (orig * 1.1) + 600; /* recomended size */
@@ -850,39 +939,49 @@ convert_xml_child(HA_Message *msg, xmlNode *xml)
     rc = BZ2_bzBuffToBuffCompress(compressed, &len, buffer, orig, CRM_BZ2_BLOCKS, 0, CRM_BZ2_WORK);
     
     if(rc != BZ_OK) {
+	/* send it uncompressed, convert_ha_field() accepts either */
 	crm_err("Compression failed: %d", rc);
 	crm_free(compressed);
-	convert_xml_message_struct(msg, xml, name);
-	goto done;
+	return blob;
     }
     
-    crm_free(buffer);
-    buffer = compressed;
     crm_debug_2("Compression details: %d -> %d", orig, len);
-    ha_msg_addbin(msg, name, buffer, len);
-  done:
     crm_free(buffer);
+    blob->data = compressed;
+    blob->len = len;
+    blob->compressed = TRUE;
+    return blob;
+}
 
+void
+xml_blob_free(crm_xml_blob_t *blob) 
+{
+    if(blob == NULL) {
+	return;
+    }
+    crm_free(blob->name);
+    crm_free(blob->data);
+    crm_free(blob);
+}
 
-#  if 0
-    {
-	unsigned int used = orig;
-	char *uncompressed = NULL;
-	
-	crm_debug("Trying to decompress %d bytes", len);
-	crm_malloc0(uncompressed, orig);
-	rc = BZ2_bzBuffToBuffDecompress(
-	    uncompressed, &used, compressed, len, 1, 0);
-	CRM_CHECK(rc == BZ_OK, ;);
-	CRM_CHECK(used == orig, ;);
-	crm_debug("rc=%d, used=%d", rc, used);
-	if(rc != BZ_OK) {
-	    exit(100);
-	}
-	crm_debug("Original %s, decompressed %s", buffer, uncompressed);
-	crm_free(uncompressed);
+void
+convert_xml_blob(HA_Message *msg, const crm_xml_blob_t *blob) 
+{
+    if(blob->compressed) {
+	ha_msg_addbin(msg, blob->name, blob->data, blob->len);
+    } else {
+	ha_msg_add(msg, blob->name, blob->data);
+    }
+}
+
+static void
+convert_xml_child(HA_Message *msg, xmlNode *xml) 
+{
+    crm_xml_blob_t *blob = xml_blob_new(xml);
+    if(blob != NULL) {
+	convert_xml_blob(msg, blob);
+	xml_blob_free(blob);
     }
-#  endif 
 }
 
 HA_Message*
@@ -1269,6 +1368,11 @@ crm_element_value_copy(xmlNode *data, const char *name)
 void
 xml_remove_prop(xmlNode *obj, const char *name)
 {
+    if(xml_index_id_changing(obj, name)) {
+	xmlUnsetProp(obj, (const xmlChar*)name);
+	xml_index_id_changed(obj);
+	return;
+    }
     xmlUnsetProp(obj, (const xmlChar*)name);
 }
 
@@ -1317,8 +1421,85 @@ purge_diff_markers(xmlNode *a_node)
 		);
 }
 
-gboolean
-apply_xml_diff(xmlNode *old, xmlNode *diff, xmlNode **new)
+/* Removes what the diff-removed section right lists from left, leaving
+ * what subtract_xml_object() would have built, but without copying the
+ * rest of the document (and so keeping anything attached to it, such
+ * as the cib's id index).
+ *
+ * Returns FALSE if nothing is left of left itself.
+ */
+static gboolean
+subtract_xml_inplace(xmlNode *left, xmlNode *right) 
+{
+	int lpc = 0;
+	gboolean skip = FALSE;
+	gboolean differences = FALSE;
+	xmlAttrPtr prop = NULL;
+	xmlAttrPtr next_prop = NULL;
+	const char *value = NULL;
+	static int filter_len = DIMOF(filter);
+
+	for(prop = left->properties; prop != NULL; prop = next_prop) {
+		const char *prop_name = (const char *)prop->name;
+		next_prop = prop->next;
+
+		if(crm_str_eq(prop_name, XML_ATTR_ID, TRUE)) {
+			continue;
+		}
+
+		skip = FALSE;
+		for(lpc = 0; skip == FALSE && lpc < filter_len; lpc++){
+			if(crm_str_eq(prop_name, filter[lpc], TRUE)) {
+				skip = TRUE;
+			}
+		}
+
+		if(skip == FALSE) {
+			value = crm_element_value(right, prop_name);
+			if(value == NULL
+			   || safe_str_neq(crm_element_value(left, prop_name), value)) {
+				/* new or changed */
+				differences = TRUE;
+				continue;
+			}
+		}
+		
+		xml_remove_prop(left, prop_name);
+	}
+
+	xml_child_iter(
+		left, left_child,  
+		xmlNode *right_child = find_entity(
+			right, crm_element_name(left_child), ID(left_child));
+
+		if(right_child == NULL
+		   || subtract_xml_inplace(left_child, right_child)) {
+			differences = TRUE;
+
+		} else {
+			free_xml_from_parent(left, left_child);
+		}
+		);
+
+	if(differences == FALSE) {
+		/* check for XML_DIFF_MARKER in a child */ 
+		xml_child_iter(
+			right, right_child,  
+			value = crm_element_value(right_child, XML_DIFF_MARKER);
+			if(value != NULL && safe_str_eq(value, "removed:top")) {
+				crm_debug_3("Found the root of the deletion: %s",
+					    crm_element_name(left));
+				differences = TRUE;
+				break;
+			}
+			);
+	}
+
+	return differences;
+}
+
+static gboolean
+apply_xml_diff_adv(xmlNode *old, xmlNode *diff, xmlNode **new, gboolean in_place)
 {
 	gboolean result = TRUE;
 	const char *digest = crm_element_value(diff, XML_ATTR_DIGEST);
@@ -1328,16 +1509,23 @@ apply_xml_diff(xmlNode *old, xmlNode *diff, xmlNode **new)
 	int root_nodes_seen = 0;
 
 	CRM_CHECK(new != NULL, return FALSE);
+	CRM_CHECK(in_place == FALSE || *new != NULL, return FALSE);
 
 	crm_debug_2("Substraction Phase");
 	xml_child_iter(removed, child_diff, 
 		       CRM_CHECK(root_nodes_seen == 0, result = FALSE);
-		       if(root_nodes_seen == 0) {
+		       if(root_nodes_seen == 0 && in_place == FALSE) {
 			       *new = subtract_xml_object(old, child_diff, NULL);
+
+		       } else if(root_nodes_seen == 0
+				 && subtract_xml_inplace(*new, child_diff) == FALSE) {
+			       /* nothing was left of the old version */
+			       free_xml(*new);
+			       *new = NULL;
 		       }
 		       root_nodes_seen++;
 		);
-	if(root_nodes_seen == 0) {
+	if(root_nodes_seen == 0 && in_place == FALSE) {
 		*new = copy_xml(old);
 		
 	} else if(root_nodes_seen > 1) {
@@ -1427,6 +1615,18 @@ apply_xml_diff(xmlNode *old, xmlNode *diff, xmlNode **new)
 	return result;
 }
 
+gboolean
+apply_xml_diff(xmlNode *old, xmlNode *diff, xmlNode **new)
+{
+	return apply_xml_diff_adv(old, diff, new, FALSE);
+}
+
+gboolean
+apply_xml_diff_inplace(xmlNode *old, xmlNode *diff, xmlNode **new)
+{
+	return apply_xml_diff_adv(old, diff, new, TRUE);
+}
+
 
 xmlNode *
 diff_xml_object(xmlNode *old, xmlNode *new, gboolean suppress)
@@ -1831,6 +2031,7 @@ replace_xml_child(xmlNode *parent, xmlNode *child, xmlNode *update, gboolean del
 		    xmlDoc *doc = tmp->doc;
 		    xmlNode *old = xmlReplaceNode(child, tmp);
 		    free_xml_from_parent(NULL, old);
+		    xml_index_added(tmp);
 		    xmlDocSetRootElement(doc, NULL);
 		    xmlFreeDoc(doc);
 		}
@@ -2247,7 +2448,6 @@ validate_with_relaxng(
   cleanup:
     if(parser_ctx != NULL) {
 	xmlRelaxNGFreeParserCtxt(parser_ctx);
-	xmlCleanupParser();
     }
 
     if(valid_ctx != NULL) {
@@ -2399,9 +2599,10 @@ static xmlNode *apply_transformation(xmlNode *xml, const char *transform)
 	xsltFreeStylesheet(xslt);
     }
 
-    xsltCleanupGlobals();
-    xmlCleanupParser();
-    
+    /* No xsltCleanupGlobals()/xmlCleanupParser() here, they would pull
+     * the parser out from under any other thread using it.  Daemons
+     * call xmlCleanupParser() on exit.
+     */
     return out;
 }
 
@@ -2591,6 +2792,228 @@ xpath_search(xmlNode *xml_top, const char *path)
     return xpathObj;
 }
 
+/*
+ * Answering simple XPath expressions from the id index
+ *
+ * Recognizes a series of /name or //name steps (name may be '*'), each
+ * with an optional [@attr='value' and ...] predicate, where the last
+ * step includes @id.
+ */
+#define XPATH_ID_MAX_STEPS 16
+#define XPATH_ID_MAX_ATTRS 4
+
+typedef struct xpath_id_step_s 
+{
+	gboolean descendant;
+	char *name;
+	const char *id;
+	int nattrs;
+	char *attr[XPATH_ID_MAX_ATTRS];
+	char *value[XPATH_ID_MAX_ATTRS];
+} xpath_id_step_t;
+
+static gboolean
+xpath_id_namechar(char c) 
+{
+	return isalnum((int)c) || c == '_' || c == '-' || c == '.' || c == ':';
+}
+
+static void
+xpath_id_free_steps(xpath_id_step_t *steps, int max) 
+{
+	int lpc = 0;
+	for(lpc = 0; lpc < max; lpc++) {
+	    int attr = 0;
+	    g_free(steps[lpc].name);
+	    for(attr = 0; attr < steps[lpc].nattrs; attr++) {
+		g_free(steps[lpc].attr[attr]);
+		g_free(steps[lpc].value[attr]);
+	    }
+	}
+}
+
+/* Returns the number of steps, or -1 if path isn't of the supported form */
+static int
+xpath_id_parse(const char *path, xpath_id_step_t *steps) 
+{
+	int num_steps = 0;
+	const char *p = path;
+
+	memset(steps, 0, XPATH_ID_MAX_STEPS * sizeof(xpath_id_step_t));
+	while(*p != 0) {
+	    const char *start = NULL;
+	    xpath_id_step_t *step = NULL;
+
+	    if(*p != '/' || num_steps == XPATH_ID_MAX_STEPS) {
+		goto bail;
+	    }
+	    
+	    step = &steps[num_steps++];
+	    p++;
+	    if(*p == '/') {
+		step->descendant = TRUE;
+		p++;
+	    }
+
+	    start = p;
+	    if(*p == '*') {
+		p++;
+	    } else {
+		while(xpath_id_namechar(*p)) {
+		    p++;
+		}
+	    }
+	    if(p == start) {
+		goto bail;
+	    }
+	    step->name = g_strndup(start, p - start);
+
+	    if(*p == '[') {
+		p++;
+		while(TRUE) {
+		    char quote = 0;
+		    int attr = step->nattrs;
+		    
+		    if(*p != '@' || attr == XPATH_ID_MAX_ATTRS) {
+			goto bail;
+		    }
+
+		    start = ++p;
+		    while(xpath_id_namechar(*p)) {
+			p++;
+		    }
+		    if(p == start || *p != '=') {
+			goto bail;
+		    }
+		    step->attr[attr] = g_strndup(start, p - start);
+
+		    quote = *(++p);
+		    if(quote != '\'' && quote != '"') {
+			g_free(step->attr[attr]);
+			goto bail;
+		    }
+
+		    start = ++p;
+		    p = strchr(start, quote);
+		    if(p == NULL) {
+			g_free(step->attr[attr]);
+			goto bail;
+		    }
+		    step->value[attr] = g_strndup(start, p - start);
+		    step->nattrs++;
+		    p++;
+
+		    if(safe_str_eq(step->attr[attr], XML_ATTR_ID)) {
+			step->id = step->value[attr];
+		    }
+		    
+		    if(*p == ']') {
+			p++;
+			break;
+
+		    } else if(strncmp(p, " and ", 5) != 0) {
+			goto bail;
+		    }
+		    p += 5;
+		}
+	    }
+	}
+
+	if(num_steps > 0 && steps[num_steps-1].id != NULL) {
+	    return num_steps;
+	}
+
+  bail:
+	xpath_id_free_steps(steps, num_steps);
+	return -1;
+}
+
+static gboolean
+xpath_id_step_match(xmlNode *xml, xpath_id_step_t *step) 
+{
+	int lpc = 0;
+	if(xml == NULL || xml->type != XML_ELEMENT_NODE) {
+	    return FALSE;
+
+	} else if(safe_str_neq(step->name, "*")
+		  && crm_str_eq(step->name, crm_element_name(xml), TRUE) == FALSE) {
+	    return FALSE;
+	}
+
+	for(lpc = 0; lpc < step->nattrs; lpc++) {
+	    const char *value = crm_element_value(xml, step->attr[lpc]);
+	    if(crm_str_eq(step->value[lpc], value, TRUE) == FALSE) {
+		return FALSE;
+	    }
+	}
+	return TRUE;
+}
+
+static gboolean
+xpath_id_match(xmlNode *xml, xpath_id_step_t *steps, int step) 
+{
+	xmlNode *parent = NULL;
+	if(xpath_id_step_match(xml, &steps[step]) == FALSE) {
+	    return FALSE;
+	}
+
+	parent = xml->parent;
+	if(step == 0) {
+	    /* /name only matches the document element */
+	    return steps[0].descendant || parent == NULL || parent->type == XML_DOCUMENT_NODE;
+
+	} else if(steps[step].descendant == FALSE) {
+	    return xpath_id_match(parent, steps, step - 1);
+	}
+
+	for(; parent != NULL && parent->type == XML_ELEMENT_NODE; parent = parent->parent) {
+	    if(xpath_id_match(parent, steps, step - 1)) {
+		return TRUE;
+	    }
+	}
+	return FALSE;
+}
+
+/* Returns TRUE if path could be answered from the id index of xml_top's
+ * document, in which case *matches holds the selected elements in
+ * document order (free with g_list_free())
+ */
+gboolean
+xpath_search_id(xmlNode *xml_top, const char *path, GListPtr *matches)
+{
+	int num_steps = 0;
+	GListPtr candidates = NULL;
+	xpath_id_step_t steps[XPATH_ID_MAX_STEPS];
+
+	*matches = NULL;
+	if(index_fns == NULL || xml_top == NULL || path == NULL) {
+	    return FALSE;
+	}
+
+	num_steps = xpath_id_parse(path, steps);
+	if(num_steps < 1) {
+	    return FALSE;
+	}
+	
+	if(index_fns->lookup(xml_top, steps[num_steps-1].name,
+			     steps[num_steps-1].id, &candidates) == FALSE) {
+	    xpath_id_free_steps(steps, num_steps);
+	    return FALSE;
+	}
+
+	slist_iter(
+	    candidate, xmlNode, candidates, lpc,
+	    if(xpath_id_match(candidate, steps, num_steps - 1)) {
+		*matches = g_list_append(*matches, candidate);
+	    }
+	    );
+	g_list_free(candidates);
+
+	crm_debug_2("%s: %d match(es) from the id index", path, g_list_length(*matches));
+	xpath_id_free_steps(steps, num_steps);
+	return TRUE;
+}
+
 gboolean
 cli_config_update(xmlNode **xml, int *best_version, gboolean to_logs) 
 {
@@ -26,8 +26,23 @@
 #include <crm/pengine/status.h>
 #include <crm/pengine/common.h>
 
-gboolean was_processing_error = FALSE;
-gboolean was_processing_warning = FALSE;
+/* A calculation runs start to finish on one thread, so per-thread state
+ * is per-working-set state and calculations can run side by side
+ */
+static CRM_THREAD_LOCAL gboolean processing_error = FALSE;
+static CRM_THREAD_LOCAL gboolean processing_warning = FALSE;
+
+gboolean *
+was_processing_error_location(void)
+{
+	return &processing_error;
+}
+
+gboolean *
+was_processing_warning_location(void)
+{
+	return &processing_warning;
+}
 
 static gboolean
 check_quorum(const char *value) 
@@ -101,6 +116,9 @@ pe_cluster_option pe_opts[] = {
 	  "Action to send to STONITH device", NULL },
 	{ "stonith-timeout", NULL, "time", NULL, "60s", &check_timer,
 	  "How long to wait for the STONITH action to complete", NULL },
+	{ "stonith-concurrency", NULL, "integer", NULL, "1", &check_number,
+	  "How many nodes may be fenced at the same time",
+	  "Fencing operations beyond this limit are queued behind the earlier ones.  0 means no limit.  Only raise this if your STONITH devices can handle parallel requests." },
 	{ "startup-fencing", "startup_fencing", "boolean", NULL, "true", &check_boolean,
 	  "STONITH unseen nodes", "Advanced Use Only!  Not using the default is very unsafe!" },
 
@@ -111,6 +129,9 @@ pe_cluster_option pe_opts[] = {
 	{ "batch-limit", NULL, "integer", NULL, "30", &check_number,
 	  "The number of jobs that the TE is allowed to execute in parallel",
 	  "The \"correct\" value will depend on the speed and load of your network and cluster nodes." },
+	{ "node-action-limit", NULL, "integer", NULL, "0", &check_number,
+	  "The number of jobs that the TE may execute in parallel on any one node",
+	  "Individual nodes can override this with a node-action-limit node attribute.  0 means no limit." },
 	{ "default-action-timeout", "default_action_timeout", "time", NULL, "20s", &check_time,
 	  "How long to wait for actions to complete", NULL },
 
@@ -133,6 +154,9 @@ pe_cluster_option pe_opts[] = {
 	  "The number of PE inputs resulting in WARNINGs to save", "Zero to disable, -1 to store unlimited." },
 	{ "pe-input-series-max", NULL, "integer", NULL, "-1", &check_number,
 	  "The number of other PE inputs to save", "Zero to disable, -1 to store unlimited." },
+	{ "pe-alloc-threads", NULL, "integer", NULL, "1", &check_number,
+	  "The number of threads the PE may use to allocate resources",
+	  "Only resources that aren't colocated with each other are allocated in parallel.  1 disables threading." },
 
 	/* Node health */
 	{ "node-health-strategy", NULL, "enum", "none, migrate-on-red, only-green, progressive, custom", "none", &check_health,
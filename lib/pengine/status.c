@@ -106,6 +106,7 @@ cluster_status(pe_working_set_t *data_set)
  	unpack_nodes(cib_nodes, data_set);
  	unpack_resources(cib_resources, data_set);
  	unpack_status(cib_status, data_set);
+	unpack_failcounts(data_set);
 	
 	return TRUE;
 }
@@ -156,6 +157,12 @@ pe_free_nodes(GListPtr nodes)
 			if(details->attrs != NULL) {
 				g_hash_table_destroy(details->attrs);
 			}
+			if(details->failcounts != NULL) {
+				g_hash_table_destroy(details->failcounts);
+			}
+			if(details->clone_failcounts != NULL) {
+				g_hash_table_destroy(details->clone_failcounts);
+			}
 			pe_free_shallow_adv(details->running_rsc, FALSE);
 			pe_free_shallow_adv(details->allocated_rsc, FALSE);
 			crm_free(details);
@@ -178,6 +185,10 @@ cleanup_calculations(pe_working_set_t *data_set)
 	if(data_set->config_hash != NULL) {
 		g_hash_table_destroy(data_set->config_hash);
 	}
+	if(data_set->attr_index != NULL) {
+		g_hash_table_destroy(data_set->attr_index);
+		data_set->attr_index = NULL;
+	}
 	
 	crm_free(data_set->dc_uuid);
 	
@@ -186,6 +197,7 @@ cleanup_calculations(pe_working_set_t *data_set)
 	
 	crm_debug_3("deleting actions");
 	pe_free_actions(data_set->actions);
+	flush_op_keys();
 
 	crm_debug_3("deleting nodes");
 	pe_free_nodes(data_set->nodes);
@@ -198,7 +210,7 @@ cleanup_calculations(pe_working_set_t *data_set)
 
 	CRM_CHECK(data_set->ordering_constraints == NULL, ;);
 	CRM_CHECK(data_set->placement_constraints == NULL, ;);
-	xmlCleanupParser();
+	pe_region_destroy(data_set);
 }
 
 
@@ -218,14 +230,17 @@ set_working_set_defaults(pe_working_set_t *data_set)
 	data_set->actions		  = NULL;	
 	data_set->resources		  = NULL;
 	data_set->config_hash		  = NULL;
+	data_set->attr_index		  = NULL;
 	data_set->stonith_action	  = NULL;
 	data_set->ordering_constraints    = NULL;
 	data_set->placement_constraints   = NULL;
 	data_set->colocation_constraints  = NULL;
+	data_set->region		  = NULL;
 
 	data_set->order_id		  = 1;
 	data_set->action_id		  = 1;
 	data_set->num_synapse		  = 0;
+	data_set->action_visits		  = 0;
 	data_set->max_valid_nodes	  = 0;
 	data_set->no_quorum_policy	  = no_quorum_freeze;
 
@@ -26,7 +26,9 @@
 #include <crm/pengine/rules.h>
 #include <utils.h>
 
-pe_working_set_t *pe_dataset = NULL;
+CRM_THREAD_LOCAL pe_working_set_t *pe_dataset = NULL;
+CRM_THREAD_LOCAL void (*pe_serialize_fn)(void) = NULL;
+CRM_THREAD_LOCAL GString *pe_score_buffer = NULL;
 
 extern xmlNode *get_object_root(const char *object_type,xmlNode *the_root);
 void print_str_str(gpointer key, gpointer value, gpointer user_data);
@@ -66,6 +68,115 @@ pe_free_shallow_adv(GListPtr alist, gboolean with_data)
 	}
 }
 
+/*
+ * Objects that live exactly as long as the working set (actions,
+ * action wrappers and constraints) are carved out of large blocks
+ * which cleanup_calculations() releases in one go.
+ */
+#define PE_REGION_ALIGN		16
+#define PE_REGION_BLOCK_SIZE	(64 * 1024)
+#define PE_REGION_ROUND(size)	(((size) + PE_REGION_ALIGN - 1) & ~(PE_REGION_ALIGN - 1))
+
+typedef struct pe_region_block_s 
+{
+		struct pe_region_block_s *next;
+		size_t size;
+		size_t used;
+} pe_region_block_t;
+
+#define PE_REGION_HEADER	PE_REGION_ROUND(sizeof(pe_region_block_t))
+
+struct pe_region_s 
+{
+		pe_region_block_t *blocks;
+		unsigned long num_blocks;
+		unsigned long num_objects;
+		unsigned long num_bytes;
+};
+
+void *
+pe_region_alloc(pe_working_set_t *data_set, size_t size)
+{
+	char *mem = NULL;
+	struct pe_region_s *region = NULL;
+	pe_region_block_t *block = NULL;
+
+	CRM_ASSERT(data_set != NULL);
+	pe_serialize();
+	
+	if(data_set->region == NULL) {
+		crm_malloc0(data_set->region, sizeof(struct pe_region_s));
+	}
+	
+	region = data_set->region;
+	size = PE_REGION_ROUND(size);
+	block = region->blocks;
+	
+	if(block == NULL || block->size - block->used < size) {
+		size_t block_size = PE_REGION_BLOCK_SIZE;
+		if(size > PE_REGION_BLOCK_SIZE / 4) {
+			/* give large objects their own block */
+			block_size = size;
+		}
+
+		crm_malloc(block, PE_REGION_HEADER + block_size);
+		block->size = block_size;
+		block->used = 0;
+		region->num_blocks++;
+		
+		if(block_size != PE_REGION_BLOCK_SIZE && region->blocks != NULL) {
+			/* keep filling the current block */
+			block->next = region->blocks->next;
+			region->blocks->next = block;
+			
+		} else {
+			block->next = region->blocks;
+			region->blocks = block;
+		}
+	}
+
+	mem = ((char*)block) + PE_REGION_HEADER + block->used;
+	block->used += size;
+	memset(mem, 0, size);
+
+	region->num_objects++;
+	region->num_bytes += size;
+	return mem;
+}
+
+void
+pe_region_stats(
+	pe_working_set_t *data_set, unsigned long *objects, unsigned long *bytes)
+{
+	struct pe_region_s *region = data_set->region;
+
+	*objects = region?region->num_objects:0;
+	*bytes = region?region->num_bytes:0;
+}
+
+void
+pe_region_destroy(pe_working_set_t *data_set)
+{
+	pe_region_block_t *block = NULL;
+	struct pe_region_s *region = data_set->region;
+
+	if(region == NULL) {
+		return;
+	}
+
+	crm_debug_2("Releasing %lu objects (%lu bytes) in %lu blocks",
+		    region->num_objects, region->num_bytes, region->num_blocks);
+	
+	block = region->blocks;
+	while(block != NULL) {
+		pe_region_block_t *next = block->next;
+		crm_free(block);
+		block = next;
+	}
+	
+	crm_free(data_set->region);
+}
+
 
 node_t *
 node_copy(node_t *this_node) 
@@ -141,15 +252,28 @@ node_list_eq(GListPtr list1, GListPtr list2, gboolean filter)
 GListPtr
 node_list_exclude(GListPtr list1, GListPtr list2, gboolean merge_scores)
 {
-    node_t *other_node = NULL;
     GListPtr result = NULL;
+    GHashTable *in_list2 = g_hash_table_new(g_direct_hash, g_direct_equal);
+    GHashTable *in_result = g_hash_table_new(g_direct_hash, g_direct_equal);
     
     result = node_list_dup(list1, FALSE, FALSE);
+
+    /* the first entry for a node wins, as with pe_find_node_id() */
+    slist_iter(
+	node, node_t, list2, lpc,
+	if(g_hash_table_lookup(in_list2, node->details) == NULL) {
+	    g_hash_table_insert(in_list2, node->details, node);
+	}
+	);
     
     slist_iter(
 	node, node_t, result, lpc,
 	
-	other_node = pe_find_node_id(list2, node->details->id);
+	node_t *other_node = g_hash_table_lookup(in_list2, node->details);
+
+	if(g_hash_table_lookup(in_result, node->details) == NULL) {
+	    g_hash_table_insert(in_result, node->details, node);
+	}
 	
 	if(other_node == NULL) {
 	    node->weight = -INFINITY;
@@ -161,15 +285,16 @@ node_list_exclude(GListPtr list1, GListPtr list2, gboolean merge_scores)
     slist_iter(
 	node, node_t, list2, lpc,
 	
-	other_node = pe_find_node_id(result, node->details->id);
-	
-	if(other_node == NULL) {
+	if(g_hash_table_lookup(in_result, node->details) == NULL) {
 	    node_t *new_node = node_copy(node);
 	    new_node->weight = -INFINITY;
 	    result = g_list_append(result, new_node);
+	    g_hash_table_insert(in_result, node->details, new_node);
 	}
 	);
 
+    g_hash_table_destroy(in_list2);
+    g_hash_table_destroy(in_result);
     return result;
 }
 
@@ -350,6 +475,23 @@ node_list_dup(GListPtr list1, gboolean reset, gboolean filter)
 }
 
 
+void
+pe_score_printf(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    if(pe_score_buffer != NULL) {
+	char *text = g_strdup_vprintf(fmt, ap);
+	g_string_append(pe_score_buffer, text);
+	g_free(text);
+
+    } else {
+	vfprintf(stdout, fmt, ap);
+    }
+    va_end(ap);
+}
+
 void dump_node_scores(int level, resource_t *rsc, const char *comment, GListPtr nodes) 
 {
     GListPtr list = nodes;
@@ -367,10 +509,10 @@ void dump_node_scores(int level, resource_t *rsc, const char *comment, GListPtr
 	char *score = crm_itoa(node->weight); 
 	if(level == 0) {
 	    if(rsc) {
-		fprintf(stdout, "%s: %s allocation score on %s: %s\n",
-			   comment, rsc->id, node->details->uname, score);
+		pe_score_printf("%s: %s allocation score on %s: %s\n",
+				comment, rsc->id, node->details->uname, score);
 	    } else {
-		fprintf(stdout, "%s: %s = %s\n", comment, node->details->uname, score);
+		pe_score_printf("%s: %s = %s\n", comment, node->details->uname, score);
 	    }
 	    
 	} else {
@@ -441,6 +583,7 @@ custom_action(resource_t *rsc, char *key, const char *task,
 	GListPtr possible_matches = NULL;
 	CRM_CHECK(key != NULL, return NULL);
 	CRM_CHECK(task != NULL, return NULL);
+	pe_serialize();
 
 	if(save_action && rsc != NULL) {
 		possible_matches = find_actions(rsc->actions, key, on_node);
@@ -470,7 +613,7 @@ custom_action(resource_t *rsc, char *key, const char *task,
 				    on_node?on_node->details->uname:"<NULL>");
 		}
 		
-		crm_malloc0(action, sizeof(action_t));
+		action = pe_region_alloc(data_set, sizeof(action_t));
 		if(save_action) {
 			action->id   = data_set->action_id++;
 		} else {
@@ -481,6 +624,7 @@ custom_action(resource_t *rsc, char *key, const char *task,
 		action->task = crm_strdup(task);
 		action->node = on_node;
 		action->uuid = key;
+		action->op_key = intern_op_key(key);
 		
 		action->actions_before   = NULL;
 		action->actions_after    = NULL;
@@ -490,6 +634,7 @@ custom_action(resource_t *rsc, char *key, const char *task,
 		action->dumped     = FALSE;
 		action->runnable   = TRUE;
 		action->processed  = FALSE;
+		action->queued     = FALSE;
 		action->optional   = optional;
 		action->seen_count = 0;
 		
@@ -992,8 +1137,9 @@ pe_free_action(action_t *action)
 	if(action == NULL) {
 		return;
 	}
-	pe_free_shallow(action->actions_before);/* action_warpper_t* */
-	pe_free_shallow(action->actions_after); /* action_warpper_t* */	
+	/* The action and its wrappers belong to the working set's region */
+	pe_free_shallow_adv(action->actions_before, FALSE);/* action_warpper_t* */
+	pe_free_shallow_adv(action->actions_after, FALSE); /* action_warpper_t* */	
 	if(action->extra) {
 	    g_hash_table_destroy(action->extra);
 	}
@@ -1002,7 +1148,6 @@ pe_free_action(action_t *action)
 	}
 	crm_free(action->task);
 	crm_free(action->uuid);
-	crm_free(action);
 }
 
 GListPtr
@@ -1039,11 +1184,20 @@ find_recurring_actions(GListPtr input, node_t *not_on_node)
 action_t *
 find_first_action(GListPtr input, const char *uuid, const char *task, node_t *on_node)
 {
+	const crm_op_key_t *op_key = NULL;
 	CRM_CHECK(uuid || task, return NULL);
+
+	if(uuid != NULL) {
+		/* every action's key is interned, so an unknown key can't match */
+		op_key = find_op_key(uuid);
+		if(op_key == NULL) {
+			return NULL;
+		}
+	}
 	
 	slist_iter(
 		action, action_t, input, lpc,
-		if(uuid != NULL && safe_str_neq(uuid, action->uuid)) {
+		if(op_key != NULL && op_key != action->op_key) {
 			continue;
 			
 		} else if(task != NULL && safe_str_neq(task, action->task)) {
@@ -1067,12 +1221,19 @@ GListPtr
 find_actions(GListPtr input, const char *key, node_t *on_node)
 {
 	GListPtr result = NULL;
+	const crm_op_key_t *op_key = NULL;
 	CRM_CHECK(key != NULL, return NULL);
+
+	pe_serialize();
+	op_key = find_op_key(key);
+	if(op_key == NULL) {
+		return NULL;
+	}
 	
 	slist_iter(
 		action, action_t, input, lpc,
 		crm_debug_5("Matching %s against %s", key, action->uuid);
-		if(safe_str_neq(key, action->uuid)) {
+		if(op_key != action->op_key) {
 			continue;
 			
 		} else if(on_node == NULL) {
@@ -1101,12 +1262,19 @@ GListPtr
 find_actions_exact(GListPtr input, const char *key, node_t *on_node)
 {
 	GListPtr result = NULL;
+	const crm_op_key_t *op_key = NULL;
 	CRM_CHECK(key != NULL, return NULL);
+
+	pe_serialize();
+	op_key = find_op_key(key);
+	if(op_key == NULL) {
+		return NULL;
+	}
 	
 	slist_iter(
 		action, action_t, input, lpc,
 		crm_debug_5("Matching %s against %s", key, action->uuid);
-		if(safe_str_neq(key, action->uuid)) {
+		if(op_key != action->op_key) {
 			crm_debug_3("Key mismatch: %s vs. %s",
 				    key, action->uuid);
 			continue;
@@ -1397,41 +1565,148 @@ static void get_failcount_by_prefix(gpointer key_p, gpointer value, gpointer use
     }
 }
 
+typedef struct pe_failcount_s 
+{
+	int count;
+	long long last;
+} pe_failcount_t;
+
+static pe_failcount_t *
+find_failcount_entry(GHashTable *table, const char *rsc_id, long long last, int len)
+{
+    pe_failcount_t *entry = NULL;
+    char *key = NULL;
+
+    crm_malloc0(key, len + 1);
+    strncpy(key, rsc_id, len);
+
+    entry = g_hash_table_lookup(table, key);
+    if(entry == NULL) {
+	crm_malloc0(entry, sizeof(pe_failcount_t));
+	entry->last = last;
+	g_hash_table_insert(table, key, entry);
+
+    } else {
+	crm_free(key);
+    }
+    return entry;
+}
+
+static void
+index_failcount(gpointer key_p, gpointer value, gpointer user_data)
+{
+    node_t *node = user_data;
+    const char *key = key_p;
+    const char *rsc_id = NULL;
+    const char *instance = NULL;
+    pe_failcount_t *entry = NULL;
+    gboolean is_count = FALSE;
+    long long last = 0;
+    int score = 0;
+
+    if(strncmp(key, "fail-count-", 11) == 0) {
+	rsc_id = key+11;
+	is_count = TRUE;
+	score = char2score(value);
+
+    } else if(strncmp(key, "last-failure-", 13) == 0) {
+	rsc_id = key+13;
+	last = crm_int_helper(value, NULL);
+	
+    } else {
+	return;
+    }
+
+    /* A missing last-failure reads as -1, just like crm_int_helper(NULL) */
+    entry = find_failcount_entry(
+	node->details->failcounts, rsc_id, -1, strlen(rsc_id));
+    if(is_count) {
+	entry->count = score;
+    } else {
+	entry->last = last;
+    }
+
+    /* Anonymous clone instances are also totalled under every
+     * clone-stripped prefix, so that "rsc:0:1" counts towards both
+     * "rsc:0:" and "rsc:", just as the old prefix scan matched them
+     */
+    if(rsc_id[0] == 0) {
+	return;
+    }
+    for(instance = strchr(rsc_id + 1, ':');
+	instance != NULL; instance = strchr(instance + 1, ':')) {
+	entry = find_failcount_entry(
+	    node->details->clone_failcounts, rsc_id, 0, 1 + instance - rsc_id);
+	if(is_count) {
+	    entry->count += score;
+	} else if(last > entry->last) {
+	    entry->last = last;
+	}
+    }
+}
+
+static void
+index_failcounts(node_t *node)
+{
+    node->details->failcounts = g_hash_table_new_full(
+	g_str_hash, g_str_equal, g_hash_destroy_str, g_hash_destroy_str);
+    node->details->clone_failcounts = g_hash_table_new_full(
+	g_str_hash, g_str_equal, g_hash_destroy_str, g_hash_destroy_str);
+
+    g_hash_table_foreach(node->details->attrs, index_failcount, node);
+}
+
+void
+unpack_failcounts(pe_working_set_t *data_set)
+{
+    slist_iter(
+	node, node_t, data_set->nodes, lpc,
+	if(node->details->failcounts == NULL) {
+	    index_failcounts(node);
+	}
+	);
+}
+
 int get_failcount(node_t *node, resource_t *rsc, int *last_failure, pe_working_set_t *data_set) 
 {
     struct fail_search search = {rsc, 0, 0, NULL};    
+    const pe_failcount_t *entry = NULL;
 
-    search.key = crm_strdup(rsc->id);
-
+    if(node->details->failcounts == NULL) {
+	index_failcounts(node);
+    }
+    
     if(is_not_set(rsc->flags, pe_rsc_unique)) {
-	int lpc = 0;
+	const char *instance = strrchr(rsc->id, ':');
 
 	search.rsc = uber_parent(rsc);
 
-	/* Strip the clone incarnation */
-	for(lpc = strlen(search.key); lpc > 0; lpc--) {
-	    if(search.key[lpc] == ':') {
-		search.key[lpc+1] = 0;
-		break;
+	if(instance != NULL && instance != rsc->id) {
+	    /* Strip the clone incarnation */
+	    search.key = crm_strdup(rsc->id);
+	    search.key[1 + instance - rsc->id] = 0;
+	    
+	    entry = g_hash_table_lookup(node->details->clone_failcounts, search.key);
+	    if(entry != NULL) {
+		search.count = entry->count;
+		search.last = entry->last;
 	    }
-	}
 
-	g_hash_table_foreach(node->details->attrs, get_failcount_by_prefix, &search);
+	} else {
+	    search.key = crm_strdup(rsc->id);
+	    g_hash_table_foreach(node->details->attrs, get_failcount_by_prefix, &search);
+	}
 
     } else {
 	/* Optimize the "normal" case */
-	char *key = NULL;
-	const char *value = NULL;
-
-	key = crm_concat("fail-count", rsc->id, '-');
-	value = g_hash_table_lookup(node->details->attrs, key);
-	search.count = char2score(value);
-	crm_free(key);
+	entry = g_hash_table_lookup(node->details->failcounts, rsc->id);
+	if(entry != NULL) {
+	    search.count = entry->count;
+	    search.last = entry->last;
 
-	key = crm_concat("last-failure", rsc->id, '-');
-	value = g_hash_table_lookup(node->details->attrs, key);
-	search.last = crm_int_helper(value, NULL);
-	crm_free(key);
+	} else {
+	    search.last = -1;
+	}
     }    
     
     if(search.count != 0 && search.last != 0 && rsc->failure_timeout) {
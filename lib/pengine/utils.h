@@ -20,11 +20,28 @@
 #include <crm/pengine/common.h>
 #include <crm/pengine/status.h>
 
-extern pe_working_set_t *pe_dataset;
+extern CRM_THREAD_LOCAL pe_working_set_t *pe_dataset;
+
+/* Set while resources are being allocated on several threads (see
+ * allocate_resources()).  Called before anything that other resources
+ * may also be using is touched, it returns once the caller is the only
+ * thread allowed to do so.
+ */
+extern CRM_THREAD_LOCAL void (*pe_serialize_fn)(void);
+#define pe_serialize() do {			\
+	if(pe_serialize_fn != NULL) {		\
+	    pe_serialize_fn();			\
+	}					\
+    } while(0)
+
+/* Allocation scores for "ptest -s", buffered in pe_score_buffer if set */
+extern CRM_THREAD_LOCAL GString *pe_score_buffer;
+extern void pe_score_printf(const char *fmt, ...) G_GNUC_PRINTF(1,2);
 
 extern node_t *node_copy(node_t *this_node) ;
 extern time_t get_timet_now(pe_working_set_t *data_set);
 extern int get_failcount(node_t *node, resource_t *rsc, int *last_failure, pe_working_set_t *data_set);
+extern void unpack_failcounts(pe_working_set_t *data_set);
 
 /* Binary like operators for lists of nodes */
 extern GListPtr node_list_exclude(GListPtr list1, GListPtr list2, gboolean merge_scores);
@@ -43,6 +60,12 @@ extern GListPtr node_list_or(GListPtr list1, GListPtr list2, gboolean filter);
 extern void pe_free_shallow(GListPtr alist);
 extern void pe_free_shallow_adv(GListPtr alist, gboolean with_data);
 
+/* Working set region: zero-filled memory that must never be crm_free()'d */
+extern void *pe_region_alloc(pe_working_set_t *data_set, size_t size);
+extern void pe_region_destroy(pe_working_set_t *data_set);
+extern void pe_region_stats(
+	pe_working_set_t *data_set, unsigned long *objects, unsigned long *bytes);
+
 /* For creating the transition graph */
 extern xmlNode *action2xml(action_t *action, gboolean as_input);
 
@@ -223,6 +223,50 @@ fire_synapse(crm_graph_t *graph, synapse_t *synapse)
 	return TRUE;
 }
 
+/* The node that will run the synapse's resource action, if any */
+static const char *
+synapse_node(synapse_t *synapse)
+{
+	slist_iter(
+		action, crm_action_t, synapse->actions, lpc,
+		if(action->type == action_type_rsc) {
+			return crm_element_value(action->xml, XML_LRM_ATTR_TARGET);
+		}
+		);
+	return NULL;
+}
+
+static int
+node_action_limit(crm_graph_t *graph, const char *node)
+{
+	if(node == NULL) {
+		return 0;
+
+	} else if(graph->node_limits != NULL) {
+		gpointer limit = g_hash_table_lookup(graph->node_limits, node);
+		if(limit != NULL) {
+			return GPOINTER_TO_INT(limit);
+		}
+	}
+	return graph->node_limit;
+}
+
+/* Higher priority first, then the longest chain, otherwise graph order */
+static gint
+sort_synapse_fire_order(gconstpointer a, gconstpointer b)
+{
+	const synapse_t *synapse_a = a;
+	const synapse_t *synapse_b = b;
+
+	if(synapse_a->priority != synapse_b->priority) {
+		return synapse_a->priority > synapse_b->priority ? -1 : 1;
+	}
+	if(synapse_a->depth != synapse_b->depth) {
+		return synapse_a->depth > synapse_b->depth ? -1 : 1;
+	}
+	return 0;
+}
+
 int
 run_graph(crm_graph_t *graph) 
 {
@@ -230,6 +274,8 @@ run_graph(crm_graph_t *graph)
 	int pass_result = transition_active;
 
 	const char *status = "In-progress";
+	GListPtr ready = NULL;
+	GHashTable *in_flight = NULL;
 	
 	if(graph_fns == NULL) {
 		set_default_graph_functions();
@@ -245,6 +291,9 @@ run_graph(crm_graph_t *graph)
 	graph->incomplete = 0;
 	crm_debug_2("Entering graph %d callback", graph->id);
 
+	/* resource actions still running on each node */
+	in_flight = g_hash_table_new(g_str_hash, g_str_equal);
+
 	/* Pre-calculate the number of completed and in-flight operations */
 	slist_iter(
 		synapse, synapse_t, graph->synapses, lpc,
@@ -255,6 +304,19 @@ run_graph(crm_graph_t *graph)
 		} else if(synapse->executed) {
 		    crm_debug_2("Synapse %d: confirmation pending", synapse->id);
 		    graph->pending++;
+
+		    slist_iter(
+			action, crm_action_t, synapse->actions, lpc2,
+			const char *node = NULL;
+			if(action->type != action_type_rsc || action->confirmed) {
+			    continue;
+			}
+			node = crm_element_value(action->xml, XML_LRM_ATTR_TARGET);
+			if(node != NULL) {
+			    int active = GPOINTER_TO_INT(g_hash_table_lookup(in_flight, node));
+			    g_hash_table_insert(in_flight, (gpointer)node, GINT_TO_POINTER(active + 1));
+			}
+			);
 		}
 	    );
 
@@ -262,12 +324,7 @@ run_graph(crm_graph_t *graph)
 	slist_iter(
 		synapse, synapse_t, graph->synapses, lpc,
 
-		if(graph->batch_limit > 0 && graph->pending >= graph->batch_limit) {
-		    crm_debug("Throttling output: batch limit (%d) reached",
-			      graph->batch_limit);
-		    break;
-
-		} else if (synapse->confirmed || synapse->executed) {
+		if (synapse->confirmed || synapse->executed) {
 		    /* Already handled */
 		    continue;    
 		}
@@ -277,6 +334,59 @@ run_graph(crm_graph_t *graph)
 		    graph->skipped++;
 			
 		} else if(should_fire_synapse(synapse)) {
+		    ready = g_list_prepend(ready, synapse);
+		    
+		} else {
+		    crm_debug_2("Synapse %d cannot fire", synapse->id);
+		    graph->incomplete++;
+		}
+		);
+
+	/* g_list_sort() is stable, so equal synapses keep their graph order */
+	ready = g_list_sort(g_list_reverse(ready), sort_synapse_fire_order);
+
+	/*
+	 * Fire in rounds, at most one synapse per node per round, so that
+	 * one node isn't handed everything while the others sit idle
+	 */
+	while(ready != NULL) {
+	    GListPtr deferred = NULL;
+	    gboolean throttled = FALSE;
+	    GHashTable *this_round = g_hash_table_new(g_str_hash, g_str_equal);
+
+	    slist_iter(
+		synapse, synapse_t, ready, lpc,
+
+		const char *node = synapse_node(synapse);
+		int limit = node_action_limit(graph, node);
+		int active = 0;
+
+		if(node != NULL) {
+		    active = GPOINTER_TO_INT(g_hash_table_lookup(in_flight, node));
+		}
+		
+		if(graph->batch_limit > 0 && graph->pending >= graph->batch_limit) {
+		    crm_debug("Throttling output: batch limit (%d) reached",
+			      graph->batch_limit);
+		    /* This and everything after it waits for a later pass */
+		    graph->incomplete += g_list_length(ready) - lpc;
+		    throttled = TRUE;
+		    break;
+
+		} else if(synapse->priority < graph->abort_priority) {
+		    crm_debug_2("Skipping synapse %d: aborting", synapse->id);
+		    graph->skipped++;
+
+		} else if(node != NULL && g_hash_table_lookup(this_round, node)) {
+		    /* try again in the next round */
+		    deferred = g_list_prepend(deferred, synapse);
+		    
+		} else if(limit > 0 && active >= limit) {
+		    crm_debug_2("Throttling synapse %d: %d actions already in flight on %s",
+				synapse->id, active, node);
+		    graph->incomplete++;
+
+		} else {
 		    crm_debug_2("Synapse %d fired", synapse->id);
 		    graph->fired++;
 		    CRM_CHECK(fire_synapse(graph, synapse),
@@ -288,14 +398,25 @@ run_graph(crm_graph_t *graph)
 		    if (synapse->confirmed == FALSE) {
 			graph->pending++;
 		    }
-		    
-		} else {
-		    crm_debug_2("Synapse %d cannot fire", synapse->id);
-		    graph->incomplete++;
+
+		    if(node != NULL) {
+			g_hash_table_insert(this_round, (gpointer)node, (gpointer)node);
+			g_hash_table_insert(in_flight, (gpointer)node, GINT_TO_POINTER(active + 1));
+		    }
 		}
-		
 		);
 
+	    g_hash_table_destroy(this_round);
+	    g_list_free(ready);
+	    ready = g_list_reverse(deferred);
+	    if(throttled) {
+		graph->incomplete += g_list_length(ready);
+		g_list_free(ready);
+		ready = NULL;
+	    }
+	}
+	g_hash_table_destroy(in_flight);
+
 	if(graph->pending == 0 && graph->fired == 0) {
 		graph->complete = TRUE;
 		stat_log_level = LOG_NOTICE;
@@ -160,6 +160,68 @@ unpack_synapse(crm_graph_t *new_graph, xmlNode *xml_synapse)
 	return new_synapse;
 }
 
+static int
+synapse_depth(synapse_t *synapse, GHashTable *waiting)
+{
+	int depth = 1;
+	
+	if(synapse->depth != 0) {
+		/* already known, or -1 if we're in a loop */
+		return synapse->depth;
+	}
+	
+	synapse->depth = -1;
+	slist_iter(
+		next, synapse_t, g_hash_table_lookup(waiting, synapse), lpc,
+		int next_depth = synapse_depth(next, waiting);
+		if(next_depth + 1 > depth) {
+			depth = next_depth + 1;
+		}
+		);
+	synapse->depth = depth;
+	return depth;
+}
+
+/* So that run_graph() can start the longest chains first */
+static void
+calculate_synapse_depth(crm_graph_t *graph)
+{
+	GHashTable *producers = g_hash_table_new(g_direct_hash, g_direct_equal);
+	GHashTable *waiting = g_hash_table_new_full(
+		g_direct_hash, g_direct_equal, NULL, (GDestroyNotify)g_list_free);
+
+	slist_iter(
+		synapse, synapse_t, graph->synapses, lpc,
+		slist_iter(
+			action, crm_action_t, synapse->actions, lpc2,
+			g_hash_table_insert(producers, GINT_TO_POINTER(action->id), synapse);
+			);
+		);
+
+	slist_iter(
+		synapse, synapse_t, graph->synapses, lpc,
+		slist_iter(
+			input, crm_action_t, synapse->inputs, lpc2,
+
+			synapse_t *producer = g_hash_table_lookup(
+				producers, GINT_TO_POINTER(input->id));
+			if(producer != NULL) {
+				GListPtr list = g_hash_table_lookup(waiting, producer);
+				g_hash_table_steal(waiting, producer);
+				g_hash_table_insert(waiting, producer, g_list_prepend(list, synapse));
+			}
+			);
+		);
+
+	slist_iter(
+		synapse, synapse_t, graph->synapses, lpc,
+		synapse_depth(synapse, waiting);
+		);
+
+	g_hash_table_destroy(producers);
+	g_hash_table_destroy(waiting);
+}
+
 crm_graph_t *
 unpack_graph(xmlNode *xml_graph, const char *reference)
 {
@@ -210,7 +272,27 @@ unpack_graph(xmlNode *xml_graph, const char *reference)
 		
 		t_id = crm_element_value(xml_graph, "batch-limit");
 		new_graph->batch_limit = crm_parse_int(t_id, "0");
+
+		t_id = crm_element_value(xml_graph, "node-action-limit");
+		new_graph->node_limit = crm_parse_int(t_id, "0");
 	}
+
+	xml_child_iter_filter(
+		xml_graph, limit, "node_limit",
+
+		const char *uname = crm_element_value(limit, XML_ATTR_UNAME);
+		int value = crm_parse_int(crm_element_value(limit, "limit"), "0");
+
+		if(uname == NULL || value <= 0) {
+			continue;
+		}
+		if(new_graph->node_limits == NULL) {
+			new_graph->node_limits = g_hash_table_new_full(
+				g_str_hash, g_str_equal, g_hash_destroy_str, NULL);
+		}
+		g_hash_table_insert(new_graph->node_limits, crm_strdup(uname),
+				    GINT_TO_POINTER(value));
+		);
 	
 	xml_child_iter_filter(
 		xml_graph, synapse, "synapse",
@@ -222,6 +304,8 @@ unpack_graph(xmlNode *xml_graph, const char *reference)
 		}
 		);
 
+	calculate_synapse_depth(new_graph);
+
 	crm_info("Unpacked transition %d: %d actions in %d synapses",
 		 new_graph->id, new_graph->num_actions,new_graph->num_synapses);
 
@@ -270,6 +354,9 @@ destroy_graph(crm_graph_t *graph)
 		graph->synapses = g_list_remove(graph->synapses, synapse);
 		destroy_synapse(synapse);
 	}
+	if(graph->node_limits) {
+		g_hash_table_destroy(graph->node_limits);
+	}
 	crm_free(graph->source);
 	crm_free(graph);
 }
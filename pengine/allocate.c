@@ -860,14 +860,279 @@ stage4(pe_working_set_t *data_set)
 	return TRUE;
 }
 
-gboolean
-stage5(pe_working_set_t *data_set)
+/*
+ * Allocating resources on several threads
+ *
+ * Resources with no colocation path between them only affect each other
+ * through node->details->num_resources, which sort_node_weight() uses to
+ * spread resources across the cluster.  So each top-level resource gets
+ * a turn, in the order of data_set->resources, and runs on a worker while
+ * it only touches its own colocation component (which is where merging
+ * colocation scores spends its time).  The first time a turn needs
+ * anything shared (see pe_serialize()) it waits for every earlier turn to
+ * finish and then runs alone until it is done.  A turn is only started
+ * once the previous turn of its component has finished.
+ *
+ * The placement, and the scores printed for "ptest -s", are therefore the
+ * same as when the resources are allocated one after another.
+ */
+typedef struct alloc_turn_s 
 {
-	/* Take (next) highest resource, assign it and create its actions */
+	int turn;
+	int after; /* previous turn in the same component, or -1 */
+	resource_t *rsc;
+} alloc_turn_t;
+
+typedef struct alloc_pool_s 
+{
+	pe_working_set_t *data_set;
+	GMutex *lock;
+	GCond *finished;
+	int next; /* the only turn allowed to touch shared state */
+	GHashTable *op_keys;
+
+	gboolean config_error;
+	gboolean config_warning;
+	gboolean processing_error;
+	gboolean processing_warning;
+
+	/* per-thread, so handed on to each worker */
+	int score_red;
+	int score_green;
+	int score_yellow;
+} alloc_pool_t;
+
+static CRM_THREAD_LOCAL alloc_pool_t *alloc_pool = NULL;
+static CRM_THREAD_LOCAL alloc_turn_t *alloc_turn = NULL;
+static CRM_THREAD_LOCAL gboolean alloc_exclusive = FALSE;
+
+static void
+alloc_serialize(void)
+{
+	alloc_pool_t *pool = alloc_pool;
+	
+	if(alloc_exclusive) {
+		return;
+	}
+
+	g_mutex_lock(pool->lock);
+	while(pool->next != alloc_turn->turn) {
+		g_cond_wait(pool->finished, pool->lock);
+	}
+	g_mutex_unlock(pool->lock);
+
+	alloc_exclusive = TRUE;
+	swap_op_keys(pool->op_keys);
+	crm_debug_3("Turn %d (%s) is now running alone",
+		    alloc_turn->turn, alloc_turn->rsc->id);
+}
+
+static void
+alloc_worker(gpointer data, gpointer user_data)
+{
+	alloc_turn_t *turn = data;
+	alloc_pool_t *pool = user_data;
+	GString *scores = g_string_new(NULL);
+
+	pe_dataset = pool->data_set;
+	crm_config_error = FALSE;
+	crm_config_warning = FALSE;
+	was_processing_error = FALSE;
+	was_processing_warning = FALSE;
+	node_score_red = pool->score_red;
+	node_score_green = pool->score_green;
+	node_score_yellow = pool->score_yellow;
+
+	alloc_pool = pool;
+	alloc_turn = turn;
+	alloc_exclusive = FALSE;
+	pe_serialize_fn = alloc_serialize;
+	pe_score_buffer = scores;
+	
+	turn->rsc->cmds->color(turn->rsc, pool->data_set);
+
+	/* finish in turn order */
+	alloc_serialize();
+	pe_serialize_fn = NULL;
+	pe_score_buffer = NULL;
+
+	fputs(scores->str, stdout);
+	g_string_free(scores, TRUE);
+
+	pool->config_error |= crm_config_error;
+	pool->config_warning |= crm_config_warning;
+	pool->processing_error |= was_processing_error;
+	pool->processing_warning |= was_processing_warning;
+	pool->op_keys = swap_op_keys(NULL);
+	
+	alloc_exclusive = FALSE;
+	alloc_turn = NULL;
+	alloc_pool = NULL;
+	pe_dataset = NULL;
+
+	g_mutex_lock(pool->lock);
+	pool->next++;
+	g_cond_broadcast(pool->finished);
+	g_mutex_unlock(pool->lock);
+}
+
+static int
+alloc_component(int *component, int lpc) 
+{
+	while(component[lpc] != lpc) {
+		component[lpc] = component[component[lpc]];
+		lpc = component[lpc];
+	}
+	return lpc;
+}
+
+static alloc_turn_t *
+alloc_turns(pe_working_set_t *data_set, int max) 
+{
+	int lpc = 0;
+	int *last = NULL;
+	int *component = NULL;
+	alloc_turn_t *turns = NULL;
+	GHashTable *turn_of = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	crm_malloc0(turns, max * sizeof(alloc_turn_t));
+	crm_malloc0(component, max * sizeof(int));
+	crm_malloc0(last, max * sizeof(int));
+	
+	slist_iter(
+		rsc, resource_t, data_set->resources, lpc,
+		turns[lpc].turn = lpc;
+		turns[lpc].rsc = rsc;
+		component[lpc] = lpc;
+		last[lpc] = -1;
+		g_hash_table_insert(turn_of, rsc, GINT_TO_POINTER(lpc+1));
+		);
+
+	slist_iter(
+		constraint, rsc_colocation_t, data_set->colocation_constraints, lpc,
+		int lh = GPOINTER_TO_INT(g_hash_table_lookup(
+						 turn_of, uber_parent(constraint->rsc_lh))) - 1;
+		int rh = GPOINTER_TO_INT(g_hash_table_lookup(
+						 turn_of, uber_parent(constraint->rsc_rh))) - 1;
+		CRM_CHECK(lh >= 0 && rh >= 0, continue);
+
+		lh = alloc_component(component, lh);
+		rh = alloc_component(component, rh);
+		if(lh < rh) {
+			component[rh] = lh;
+		} else {
+			component[lh] = rh;
+		}
+
+		/* Workers read the attribute indexes without locking, so
+		 * every one they can ask for must exist before they start
+		 */
+		if(constraint->node_attribute != NULL) {
+			node_attr_index(constraint->node_attribute);
+		}
+		);
+	/* the defaults used by colocation and node_list_update() */
+	node_attr_index("#id");
+	node_attr_index("#"XML_ATTR_UNAME);
+
+	for(lpc = 0; lpc < max; lpc++) {
+		int root = alloc_component(component, lpc);
+		turns[lpc].after = last[root];
+		last[root] = lpc;
+	}
+	
+	g_hash_table_destroy(turn_of);
+	crm_free(component);
+	crm_free(last);
+	return turns;
+}
+
+static void
+allocate_resources(pe_working_set_t *data_set)
+{
+#if HAVE_GTHREAD
+	int max = g_list_length(data_set->resources);
+	int threads = alloc_threads;
+
+	if(threads <= 0) {
+		threads = crm_parse_int(
+			pe_pref(data_set->config_hash, "pe-alloc-threads"), "1");
+	}
+
+	if(threads > 1 && max > 1 && g_thread_supported()) {
+		int lpc = 0;
+		alloc_pool_t pool;
+		GThreadPool *workers = NULL;
+		alloc_turn_t *turns = alloc_turns(data_set, max);
+
+#  if GLIB_CHECK_VERSION(2,32,0)
+		GMutex lock;
+		GCond finished;
+#  endif
+
+		memset(&pool, 0, sizeof(alloc_pool_t));
+		pool.data_set = data_set;
+#  if GLIB_CHECK_VERSION(2,32,0)
+		g_mutex_init(&lock);
+		g_cond_init(&finished);
+		pool.lock = &lock;
+		pool.finished = &finished;
+#  else
+		pool.lock = g_mutex_new();
+		pool.finished = g_cond_new();
+#  endif
+		pool.op_keys = swap_op_keys(NULL);
+		pool.score_red = node_score_red;
+		pool.score_green = node_score_green;
+		pool.score_yellow = node_score_yellow;
+
+		crm_debug("Allocating %d resources with %d threads", max, threads);
+		workers = g_thread_pool_new(
+			alloc_worker, &pool, threads, TRUE, NULL);
+
+		/* Turns are queued in order so the one everyone else may be
+		 * waiting for has always been started
+		 */
+		for(lpc = 0; lpc < max; lpc++) {
+			if(turns[lpc].after >= 0) {
+				g_mutex_lock(pool.lock);
+				while(pool.next <= turns[lpc].after) {
+					g_cond_wait(pool.finished, pool.lock);
+				}
+				g_mutex_unlock(pool.lock);
+			}
+			g_thread_pool_push(workers, &turns[lpc], NULL);
+		}
+		g_thread_pool_free(workers, FALSE, TRUE);
+
+		swap_op_keys(pool.op_keys);
+		crm_config_error |= pool.config_error;
+		crm_config_warning |= pool.config_warning;
+		was_processing_error |= pool.processing_error;
+		was_processing_warning |= pool.processing_warning;
+		
+#  if GLIB_CHECK_VERSION(2,32,0)
+		g_mutex_clear(&lock);
+		g_cond_clear(&finished);
+#  else
+		g_mutex_free(pool.lock);
+		g_cond_free(pool.finished);
+#  endif
+		crm_free(turns);
+		return;
+	}
+#endif
 	slist_iter(
 		rsc, resource_t, data_set->resources, lpc,
 		rsc->cmds->color(rsc, data_set);
 		);
+}
+
+gboolean
+stage5(pe_working_set_t *data_set)
+{
+	/* Take (next) highest resource, assign it and create its actions */
+	allocate_resources(data_set);
 
 	probe_resources(data_set);
 	
@@ -912,9 +1177,12 @@ static gboolean any_managed_resouces(pe_working_set_t *data_set)
 gboolean
 stage6(pe_working_set_t *data_set)
 {
+	int chain = 0;
+	int max_chains = 1;
+	int num_fenced = 0;
 	action_t *dc_down = NULL;
 	action_t *stonith_op = NULL;
-	action_t *last_stonith = NULL;
+	action_t **last_stonith = NULL;
 	gboolean integrity_lost = FALSE;
 	action_t *ready = get_pseudo_op(STONITH_UP, data_set);
 	action_t *all_stopped = get_pseudo_op(ALL_STOPPED, data_set);
@@ -934,6 +1202,18 @@ stage6(pe_working_set_t *data_set)
 	    crm_info("Delaying fencing operations until there are resources to manage");
 	    need_stonith = FALSE;
 	}
+
+	/* Fencing operations are spread over this many independent
+	 * chains, each of which is executed one operation at a time
+	 */
+	max_chains = crm_parse_int(pe_pref(data_set->config_hash, "stonith-concurrency"), "1");
+	if(max_chains <= 0 || max_chains > (int)g_list_length(data_set->nodes)) {
+	    max_chains = g_list_length(data_set->nodes);
+	}
+	if(max_chains <= 0) {
+	    max_chains = 1;
+	}
+	crm_malloc0(last_stonith, max_chains * sizeof(action_t*));
 	
 	slist_iter(
 		node, node_t, data_set->nodes, lpc,
@@ -967,10 +1247,11 @@ stage6(pe_working_set_t *data_set)
 				dc_down = stonith_op;
 
 			} else {
-				if(last_stonith) {
-					order_actions(last_stonith, stonith_op, pe_order_implies_left);
+				chain = num_fenced++ % max_chains;
+				if(last_stonith[chain]) {
+					order_actions(last_stonith[chain], stonith_op, pe_order_implies_left);
 				}
-				last_stonith = stonith_op;			
+				last_stonith[chain] = stonith_op;			
 			}
 
 		} else if(node->details->online && node->details->shutdown) {			
@@ -1027,16 +1308,21 @@ stage6(pe_working_set_t *data_set)
 			order_actions(node_stop, dc_down, pe_order_implies_left);
 			);
 
-		if(last_stonith && dc_down != last_stonith) {
-			order_actions(last_stonith, dc_down, pe_order_implies_left);
+		for(chain = 0; chain < max_chains; chain++) {
+			if(last_stonith[chain] && dc_down != last_stonith[chain]) {
+				order_actions(last_stonith[chain], dc_down, pe_order_implies_left);
+			}
 		}
 		g_list_free(shutdown_matches);
 	}
 
-	if(last_stonith) {
-	    order_actions(last_stonith, done, pe_order_implies_right);
+	for(chain = 0; chain < max_chains; chain++) {
+	    if(last_stonith[chain]) {
+		order_actions(last_stonith[chain], done, pe_order_implies_right);
+	    }
 	}
 	order_actions(ready, done, pe_order_optional);
+	crm_free(last_stonith);
 	return TRUE;
 }
 
@@ -1076,7 +1362,7 @@ stage7(pe_working_set_t *data_set)
 		}
 		);
 
-	update_action_states(data_set->actions);
+	data_set->action_visits = update_action_states(data_set->actions);
 
 	slist_iter(
 		rsc, resource_t, data_set->resources, lpc,
@@ -1618,7 +1904,7 @@ void free_notification_data(notify_data_t *n_data)
     crm_free(n_data);
 }
 
-int transition_id = -1;
+CRM_THREAD_LOCAL int transition_id = -1;
 /*
  * Create a dependency graph to send to the transitioner (via the CRMd)
  */
@@ -1649,6 +1935,22 @@ stage8(pe_working_set_t *data_set)
 	value = pe_pref(data_set->config_hash, "batch-limit");
 	crm_xml_add(data_set->graph, "batch-limit", value);
 
+	value = pe_pref(data_set->config_hash, "node-action-limit");
+	if(crm_parse_int(value, "0") > 0) {
+	    crm_xml_add(data_set->graph, "node-action-limit", value);
+	}
+
+	slist_iter(
+		node, node_t, data_set->nodes, lpc,
+
+		value = g_hash_table_lookup(node->details->attrs, "node-action-limit");
+		if(value != NULL && crm_parse_int(value, "0") > 0) {
+		    xmlNode *limit = create_xml_node(data_set->graph, "node_limit");
+		    crm_xml_add(limit, XML_ATTR_UNAME, node->details->uname);
+		    crm_xml_add(limit, "limit", value);
+		}
+		);
+
 	crm_xml_add_int(data_set->graph, "transition_id", transition_id);
 	
 /* errors...
@@ -1697,7 +1999,7 @@ cleanup_alloc_calculations(pe_working_set_t *data_set)
 	data_set->placement_constraints = NULL;
 
 	crm_debug_3("deleting inter-resource cons: %p", data_set->colocation_constraints);
-  	pe_free_shallow(data_set->colocation_constraints);
+  	pe_free_shallow_adv(data_set->colocation_constraints, FALSE);
 	data_set->colocation_constraints = NULL;
 	
 	cleanup_calculations(data_set);
@@ -0,0 +1,125 @@
+#!/bin/bash
+
+ # Copyright (C) 2004 Andrew Beekhof <andrew@beekhof.net>
+ #
+ # This program is free software; you can redistribute it and/or
+ # modify it under the terms of the GNU General Public
+ # License as published by the Free Software Foundation; either
+ # version 2.1 of the License, or (at your option) any later version.
+ #
+ # This software is distributed in the hope that it will be useful,
+ # but WITHOUT ANY WARRANTY; without even the implied warranty of
+ # MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ # General Public License for more details.
+ #
+ # You should have received a copy of the GNU General Public
+ # License along with this library; if not, write to the Free Software
+ # Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ #
+
+# Run ptest over synthetic clusters of increasing size and record the
+# runtime and peak RSS of each.
+#
+# BENCH_NODES		node counts to try
+# BENCH_RESOURCES	resource counts to try
+# BENCH_MAX		skip sizes where nodes * resources exceeds this
+# BENCH_DIR		where the inputs, profiles and summary are kept
+# BENCH_BASELINE	a previous summary to compare against
+# BENCH_TOLERANCE	allowed slowdown against the baseline, in percent
+
+srcdir=`dirname $0`
+nodes_list=${BENCH_NODES:-"16 32 64 128 256"}
+resources_list=${BENCH_RESOURCES:-"100 1000 10000"}
+max_size=${BENCH_MAX:-640000}
+bench_dir=${BENCH_DIR:-bench-results}
+tolerance=${BENCH_TOLERANCE:-20}
+python=${PYTHON:-python3}
+
+summary=$bench_dir/summary.txt
+
+if [ -x ./ptest ]; then
+    ptest_cmd=./ptest
+else
+    echo No ptest executable in current directory using installed version
+    ptest_cmd=`which ptest`
+fi
+
+time_cmd=""
+if /usr/bin/time -f "%e %M" -o /dev/null true >/dev/null 2>&1; then
+    time_cmd="/usr/bin/time"
+else
+    echo "GNU time not found, peak RSS will not be recorded"
+fi
+
+mkdir -p $bench_dir
+printf "%-6s %-9s %-10s %-10s %s\n" nodes resources seconds rss_kb result > $summary
+
+function do_bench {
+    nodes=$1
+    resources=$2
+    base=$bench_dir/bench-$nodes-$resources
+
+    # 60% primitives, 30% in groups of three, the rest clones and masters
+    groups=`expr $resources / 10`
+    clones=`expr $resources / 100`
+    masters=`expr $resources / 200`
+    primitives=`expr $resources - $groups \* 3 - $clones - $masters`
+
+    $python $srcdir/ptest-gen.py --nodes $nodes --primitives $primitives \
+	--groups $groups --clones $clones --masters $masters -o $base.xml
+    if [ $? != 0 ]; then
+	printf "%-6s %-9s %-10s %-10s %s\n" $nodes $resources - - "generate failed" >> $summary
+	return
+    fi
+
+    if [ -n "$time_cmd" ]; then
+	$time_cmd -f "%e %M" -o $base.time \
+	    $ptest_cmd -x $base.xml --save-profile $base.profile > /dev/null 2>&1
+	rc=$?
+	# non-zero exit codes are reported on a line of their own
+	read seconds rss <<< "`tail -n 1 $base.time`"
+    else
+	start=`date +%s.%N`
+	$ptest_cmd -x $base.xml --save-profile $base.profile > /dev/null 2>&1
+	rc=$?
+	seconds=`awk -v start=$start -v end=$(date +%s.%N) 'BEGIN { printf("%.2f", end - start); }'`
+	rss=-
+    fi
+
+    result=ok
+    if [ $rc != 0 ]; then
+	result="ptest rc=$rc"
+    fi
+    printf "%-6s %-9s %-10s %-10s %s\n" $nodes $resources $seconds $rss "$result" >> $summary
+    rm -f $base.xml $base.time
+}
+
+for nodes in $nodes_list; do
+    for resources in $resources_list; do
+	if [ `expr $nodes \* $resources` -gt $max_size ]; then
+	    printf "%-6s %-9s %-10s %-10s %s\n" $nodes $resources - - skipped >> $summary
+	    continue
+	fi
+	echo "Benchmarking $nodes nodes with $resources resources"
+	do_bench $nodes $resources
+    done
+done
+
+echo ""
+cat $summary
+
+if [ -n "$BENCH_BASELINE" ]; then
+    echo ""
+    echo "Comparing against $BENCH_BASELINE (tolerance ${tolerance}%)"
+    awk -v tolerance=$tolerance '
+	NR == FNR { if(FNR > 1) { base[$1" "$2] = $3; } next; }
+	FNR > 1 && $3 != "-" && base[$1" "$2] > 0 {
+	    limit = base[$1" "$2] * (100 + tolerance) / 100;
+	    if($3 > limit) {
+		printf("Regression: %s nodes, %s resources: %ss vs. %ss\n", $1, $2, $3, base[$1" "$2]);
+		failed++;
+	    }
+	}
+	END { exit failed > 0; }' $BENCH_BASELINE $summary
+    exit $?
+fi
@@ -36,10 +36,14 @@
 #include <crm/pengine/rules.h>
 #include <lib/pengine/utils.h>
 
+static void sort_colocation_lists(pe_working_set_t *data_set);
+
 gboolean 
 unpack_constraints(xmlNode * xml_constraints, pe_working_set_t *data_set)
 {
 	xmlNode *lifetime = NULL;
+
+	set_bit_inplace(data_set->flags, pe_flag_unpacking_constraints);
 	xml_child_iter(
 		xml_constraints, xml_obj, 
 
@@ -81,6 +85,8 @@ unpack_constraints(xmlNode * xml_constraints, pe_working_set_t *data_set)
 		}
 		);
 
+	clear_bit_inplace(data_set->flags, pe_flag_unpacking_constraints);
+	sort_colocation_lists(data_set);
 	return TRUE;
 }
 
@@ -501,6 +507,44 @@ static gint sort_cons_priority_rh(gconstpointer a, gconstpointer b)
 	return strcmp(rsc_constraint1->rsc_rh->id, rsc_constraint2->rsc_rh->id);
 }
 
+/*
+ * Sorting each resource's colocation lists once, rather than keeping
+ * them sorted one insertion at a time, avoids quadratic behaviour for
+ * resources with many colocations.
+ *
+ * g_list_insert_sorted() puts new entries ahead of equal ones, so
+ * prepending followed by a (stable) g_list_sort() gives the same order.
+ */
+static void
+sort_colocation_lists(pe_working_set_t *data_set)
+{
+	GHashTable *sorted = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	slist_iter(
+		cons, rsc_colocation_t, data_set->colocation_constraints, lpc,
+
+		resource_t *rsc_lh = cons->rsc_lh;
+		resource_t *rsc_rh = cons->rsc_rh;
+
+		if(g_hash_table_lookup(sorted, rsc_lh) == NULL) {
+			rsc_lh->rsc_cons = g_list_sort(
+				rsc_lh->rsc_cons, sort_cons_priority_rh);
+			rsc_lh->rsc_cons_lhs = g_list_sort(
+				rsc_lh->rsc_cons_lhs, sort_cons_priority_lh);
+			g_hash_table_insert(sorted, rsc_lh, rsc_lh);
+		}
+		if(g_hash_table_lookup(sorted, rsc_rh) == NULL) {
+			rsc_rh->rsc_cons = g_list_sort(
+				rsc_rh->rsc_cons, sort_cons_priority_rh);
+			rsc_rh->rsc_cons_lhs = g_list_sort(
+				rsc_rh->rsc_cons_lhs, sort_cons_priority_lh);
+			g_hash_table_insert(sorted, rsc_rh, rsc_rh);
+		}
+		);
+
+	g_hash_table_destroy(sorted);
+}
+
 gboolean
 rsc_colocation_new(const char *id, const char *node_attr, int score,
 		   resource_t *rsc_lh, resource_t *rsc_rh,
@@ -517,7 +561,7 @@ rsc_colocation_new(const char *id, const char *node_attr, int score,
 		return FALSE;
 	}
 
-	crm_malloc0(new_con, sizeof(rsc_colocation_t));
+	new_con = pe_region_alloc(data_set, sizeof(rsc_colocation_t));
 	if(new_con == NULL) {
 		return FALSE;
 	}
@@ -545,12 +589,19 @@ rsc_colocation_new(const char *id, const char *node_attr, int score,
 	}
 	
 	crm_debug_3("%s ==> %s (%s %d)", rsc_lh->id, rsc_rh->id, node_attr, score);
-	
-	rsc_lh->rsc_cons = g_list_insert_sorted(
+
+	if(is_set(data_set->flags, pe_flag_unpacking_constraints)) {
+	    /* sorted once they're all in, see sort_colocation_lists() */
+	    rsc_lh->rsc_cons = g_list_prepend(rsc_lh->rsc_cons, new_con);
+	    rsc_rh->rsc_cons_lhs = g_list_prepend(rsc_rh->rsc_cons_lhs, new_con);
+
+	} else {
+	    rsc_lh->rsc_cons = g_list_insert_sorted(
 		rsc_lh->rsc_cons, new_con, sort_cons_priority_rh);
 
-	rsc_rh->rsc_cons_lhs = g_list_insert_sorted(
+	    rsc_rh->rsc_cons_lhs = g_list_insert_sorted(
 		rsc_rh->rsc_cons_lhs, new_con, sort_cons_priority_lh);
+	}
 
 	data_set->colocation_constraints = g_list_append(
 		data_set->colocation_constraints, new_con);
@@ -603,7 +654,7 @@ custom_action_order(
 		return -1;
 	}
 	
-	crm_malloc0(order, sizeof(order_constraint_t));
+	order = pe_region_alloc(data_set, sizeof(order_constraint_t));
 
 	crm_debug_3("Creating ordering constraint %d",
 		    data_set->order_id);
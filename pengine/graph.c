@@ -31,19 +31,92 @@
 #include <lib/pengine/utils.h>
 #include <utils.h>
 
-gboolean update_action(action_t *action);
+static void update_action(action_t *action, GQueue *worklist);
 
-gboolean
+static void
+enqueue_action(action_t *action, GQueue *worklist)
+{
+	if(action->queued == FALSE) {
+		action->queued = TRUE;
+		g_queue_push_tail(worklist, action);
+	}
+}
+
+/*
+ * Some checks look at the resource rather than a single action
+ * (any_possible() and pe_rsc_shutdown), so queue everything ordered
+ * after any action of the resource or of the collections containing it
+ */
+static void
+resource_changed(resource_t *rsc, GQueue *worklist)
+{
+	for(; rsc != NULL; rsc = rsc->parent) {
+		slist_iter(
+			action, action_t, rsc->actions, lpc,
+			slist_iter(
+				other, action_wrapper_t, action->actions_after, lpc2,
+				enqueue_action(other->action, worklist);
+				);
+			);
+	}
+}
+
+static void
+action_changed(action_t *action, GQueue *worklist)
+{
+	enqueue_action(action, worklist);
+	if(action->rsc != NULL
+	   && action->runnable == FALSE
+	   && safe_str_eq(action->task, RSC_START)) {
+		do_crm_log_unlikely(LOG_DEBUG_3, "%s changed, queueing dependents of %s",
+				    action->uuid, action->rsc->id);
+		resource_changed(action->rsc, worklist);
+	}
+	slist_iter(
+		other, action_wrapper_t, action->actions_after, lpc,
+		do_crm_log_unlikely(LOG_DEBUG_3, "%s changed, queueing %s",
+				    action->uuid, other->action->uuid);
+		enqueue_action(other->action, worklist);
+		);
+	slist_iter(
+		other, action_wrapper_t, action->actions_before, lpc,
+		do_crm_log_unlikely(LOG_DEBUG_3, "%s changed, queueing %s",
+				    action->uuid, other->action->uuid);
+		enqueue_action(other->action, worklist);
+		);
+}
+
+/*
+ * Propagate optional/runnable/print_always until nothing changes.
+ *
+ * Every action is checked once against the actions ordered before it.
+ * Whenever that changes an action, the action and its neighbours are
+ * queued for another pass; an action is never in the queue twice.
+ * Returns the total number of actions processed.
+ */
+int
 update_action_states(GListPtr actions)
 {
+	int visits = 0;
+	GQueue *worklist = g_queue_new();
+
 	crm_debug_2("Updating %d actions", g_list_length(actions));
 	slist_iter(
 		action, action_t, actions, lpc,
 
-		update_action(action);
+		enqueue_action(action, worklist);
 		);
 
-	return TRUE;
+	while(g_queue_is_empty(worklist) == FALSE) {
+		action_t *action = g_queue_pop_head(worklist);
+		action->queued = FALSE;
+		update_action(action, worklist);
+		visits++;
+	}
+
+	g_queue_free(worklist);
+	crm_debug_2("Updated %d actions in %d visits", g_list_length(actions), visits);
+	return visits;
 }
 
 static gboolean any_possible(resource_t *rsc, const char *task) {
@@ -91,8 +164,8 @@ static action_t *first_required(resource_t *rsc, const char *task) {
     return NULL;
 }
 
-gboolean
-update_action(action_t *action)
+static void
+update_action(action_t *action, GQueue *worklist)
 {
 	int local_type = 0;
 	int default_log_level = LOG_DEBUG_3;
@@ -175,7 +248,7 @@ update_action(action_t *action)
 				first->uuid, other->action->uuid);
 			    action->runnable = FALSE;
 			    first->runnable = FALSE;
-			    update_action(first);
+			    action_changed(first, worklist);
 			    changed = TRUE;
 			}
 		    }
@@ -215,8 +288,9 @@ update_action(action_t *action)
 				   "   * Marking action %s manditory because %s is unrunnable",
 				   other->action->uuid, action->uuid);
 			other->action->optional = FALSE;
-			if(other_rsc) {
+			if(other_rsc && is_not_set(other_rsc->flags, pe_rsc_shutdown)) {
 			    set_bit(other_rsc->flags, pe_rsc_shutdown);
+			    resource_changed(other_rsc, worklist);
 			}
 			other_changed = TRUE;
 		    } 
@@ -329,39 +403,14 @@ update_action(action_t *action)
 		}
 
 		if(other_changed) {
-			do_crm_log_unlikely(log_level, "%s changed, processing after list", other->action->uuid);
-			update_action(other->action);
-			slist_iter(
-				before_other, action_wrapper_t, other->action->actions_after, lpc2,
-				do_crm_log_unlikely(log_level, "%s changed, processing %s", other->action->uuid, before_other->action->uuid);
-				update_action(before_other->action);
-				);
-			slist_iter(
-				before_other, action_wrapper_t, other->action->actions_before, lpc2,
-				do_crm_log_unlikely(log_level, "%s changed, processing %s", other->action->uuid, before_other->action->uuid);
-				update_action(before_other->action);
-				);
+			action_changed(other->action, worklist);
 		}
 		
 		);
 
 	if(changed) {
-		update_action(action);
-		do_crm_log_unlikely(log_level, "%s changed, processing after list", action->uuid);
-		slist_iter(
-			other, action_wrapper_t, action->actions_after, lpc,
-			do_crm_log_unlikely(log_level, "%s changed, processing %s", action->uuid, other->action->uuid);
-			update_action(other->action);
-			);
-		do_crm_log_unlikely(log_level, "%s changed, processing before list", action->uuid);
-		slist_iter(
-			other, action_wrapper_t, action->actions_before, lpc,
-			do_crm_log_unlikely(log_level, "%s changed, processing %s", action->uuid, other->action->uuid);
-			update_action(other->action);
-			);
+		action_changed(action, worklist);
 	}
-	
-	return FALSE;
 }
 
 
@@ -102,6 +102,15 @@ main(int argc, char ** argv)
 	gboolean allow_cores = TRUE;
 	IPC_Channel *old_instance = NULL;
 
+#if HAVE_GTHREAD
+#  if !GLIB_CHECK_VERSION(2,32,0)
+	/* Needed before any other glib call for pe-alloc-threads */
+	if(g_thread_supported() == FALSE) {
+		g_thread_init(NULL);
+	}
+#  endif
+#endif
+
 	crm_system_name = CRM_SYSTEM_PENGINE;
  	mainloop_add_signal(SIGTERM, pengine_shutdown);
 
@@ -599,8 +599,8 @@ master_color(resource_t *rsc, pe_working_set_t *data_set)
 
 		chosen = child_rsc->fns->location(child_rsc, NULL, FALSE);
 		if(show_scores) {
-		    fprintf(stdout, "%s promotion score on %s: %d\n",
-			    child_rsc->id, chosen?chosen->details->uname:"none", child_rsc->sort_index);
+		    pe_score_printf("%s promotion score on %s: %d\n",
+				    child_rsc->id, chosen?chosen->details->uname:"none", child_rsc->sort_index);
 		    
 		} else {
 		    do_crm_log_unlikely(scores_log_level, "%s promotion score on %s: %d",
@@ -176,15 +176,50 @@ static void
 node_list_update(GListPtr list1, GListPtr list2, const char *attr, int factor)
 {
     int score = 0;
+    GHashTable *best = NULL;
+    node_attr_index_t *index = NULL;
+
     if(attr == NULL) {
 	attr = "#"XML_ATTR_UNAME;
     }
+
+    /* The same as node_list_attr_score() for each node in list1,
+     * but with one pass over list2 for all of them
+     */
+    index = node_attr_index(attr);
+    best = g_hash_table_new(g_direct_hash, g_direct_equal);
+    slist_iter(
+	node, node_t, list2, lpc,
+
+	gpointer current = NULL;
+	gpointer class = GINT_TO_POINTER(node_attr_class(index, node));
+	int weight = node->weight;
+
+	if(can_run_resources(node) == FALSE) {
+	    weight = -INFINITY;
+	}
+	if(g_hash_table_lookup_extended(best, class, NULL, &current) == FALSE
+	   || weight > GPOINTER_TO_INT(current)) {
+	    g_hash_table_insert(best, class, GINT_TO_POINTER(weight));
+	}
+	);
     
     slist_iter(
 	node, node_t, list1, lpc,
 	
+	gpointer known = NULL;
 	CRM_CHECK(node != NULL, continue);
-	score = node_list_attr_score(list2, attr, g_hash_table_lookup(node->details->attrs, attr));
+
+	score = -INFINITY;
+	if(g_hash_table_lookup_extended(
+	       best, GINT_TO_POINTER(node_attr_class(index, node)), NULL, &known)) {
+	    score = GPOINTER_TO_INT(known);
+	}
+
+	if(safe_str_neq(attr, "#"XML_ATTR_UNAME)) {
+	    crm_info("Best score for %s=%s was %d", attr,
+		     crm_str(g_hash_table_lookup(node->details->attrs, attr)), score);
+	}
 	
 	if(factor < 0 && score < 0) {
 	    /* Negative preference for a node with a negative score
@@ -199,6 +234,8 @@ node_list_update(GListPtr list1, GListPtr list2, const char *attr, int factor)
 		    node->details->uname, node->weight, factor, score);
 	node->weight = merge_weights(factor*score, node->weight);
 	);
+
+    g_hash_table_destroy(best);
 }
 
 GListPtr
@@ -752,20 +789,20 @@ static void
 colocation_match(
 	resource_t *rsc_lh, resource_t *rsc_rh, rsc_colocation_t *constraint) 
 {
-	const char *tmp = NULL;
-	const char *value = NULL;
+	int value = 0;
 	const char *attribute = "#id";
 
 	GListPtr work = NULL;
 	gboolean do_check = FALSE;
+	node_attr_index_t *index = NULL;
 
 	if(constraint->node_attribute != NULL) {
 		attribute = constraint->node_attribute;
 	}
 
+	index = node_attr_index(attribute);
 	if(rsc_rh->allocated_to) {
-		value = g_hash_table_lookup(
-			rsc_rh->allocated_to->details->attrs, attribute);
+		value = node_attr_class(index, rsc_rh->allocated_to);
 		do_check = TRUE;
 
 	} else if(constraint->score < 0) {
@@ -779,8 +816,7 @@ colocation_match(
 	
 	slist_iter(
 		node, node_t, work, lpc,
-		tmp = g_hash_table_lookup(node->details->attrs, attribute);
-		if(do_check && safe_str_eq(tmp, value)) {
+		if(do_check && node_attr_class(index, node) == value) {
 		    if(constraint->score < INFINITY) {
 			crm_debug_2("%s: %s.%s += %d", constraint->id, rsc_lh->id,
 				  node->details->uname, constraint->score);
@@ -2052,6 +2088,7 @@ complex_migrate_reload(resource_t *rsc, pe_working_set_t *data_set)
 		crm_free(stop->task);
 		stop->task = crm_strdup(RSC_MIGRATE);
 		stop->uuid = generate_op_key(rsc->id, stop->task, 0);
+		stop->op_key = intern_op_key(stop->uuid);
 		add_hash_param(stop->meta, "migrate_source",
 			       stop->node->details->uname);
 		add_hash_param(stop->meta, "migrate_target",
@@ -2112,6 +2149,7 @@ complex_migrate_reload(resource_t *rsc, pe_working_set_t *data_set)
 		crm_free(start->task);
 		start->task = crm_strdup(RSC_MIGRATED);
 		start->uuid = generate_op_key(rsc->id, start->task, 0);
+		start->op_key = intern_op_key(start->uuid);
 		add_hash_param(start->meta, "migrate_source_uuid", stop->node->details->id);
 		add_hash_param(start->meta, "migrate_source", stop->node->details->uname);
 		add_hash_param(start->meta, "migrate_target", start->node->details->uname);
@@ -2201,6 +2239,7 @@ complex_migrate_reload(resource_t *rsc, pe_working_set_t *data_set)
 		crm_free(rewrite->task);
 		rewrite->task = crm_strdup("reload");
 		rewrite->uuid = generate_op_key(rsc->id, rewrite->task, 0);
+		rewrite->op_key = intern_op_key(rewrite->uuid);
 		
 	} else {
 		do_crm_log_unlikely(level+1, "%s nothing to do", rsc->id);
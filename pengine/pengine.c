@@ -19,6 +19,8 @@
 #include <crm_internal.h>
 
 #include <sys/param.h>
+#include <sys/time.h>
+#include <time.h>
 
 #include <crm/crm.h>
 #include <crm/cib.h>
@@ -39,7 +41,8 @@ xmlNode * do_calculations(
 
 gboolean show_scores = FALSE;
 int scores_log_level = LOG_DEBUG_2;
-extern int transition_id;
+int alloc_threads = 0; /* 0: use pe-alloc-threads */
+extern CRM_THREAD_LOCAL int transition_id;
 
 #define get_series() 	was_processing_error?1:was_processing_warning?2:3
 
@@ -150,6 +153,10 @@ process_pe_message(xmlNode *msg, xmlNode *xml_data, IPC_Channel *sender)
 		crm_xml_add_int(reply, "graph-warnings", was_processing_warning);
 		crm_xml_add_int(reply, "config-errors", crm_config_error);
 		crm_xml_add_int(reply, "config-warnings", crm_config_warning);
+		if(process) {
+		    xmlNode *profile = pe_profile_xml();
+		    add_node_nocopy(reply, NULL, profile);
+		}
 
 		if(send_ipc_message(sender, reply) == FALSE) {
 		    if(sender && sender->ops->get_chan_status(sender) == IPC_CONNECT) {
@@ -224,6 +231,176 @@ process_pe_message(xmlNode *msg, xmlNode *xml_data, IPC_Channel *sender)
 
 #define MEMCHECK_STAGE_0 0
 
+/*
+ * Stage profiling
+ *
+ * Each stage records the time it took, the working set objects it
+ * allocated and the size of the working set when it finished.
+ */
+enum pe_stage_e 
+{
+	pe_stage_unpack,
+	pe_stage_placement,
+	pe_stage_internal,
+	pe_stage_check,
+	pe_stage_allocate,
+	pe_stage_fencing,
+	pe_stage_ordering,
+	pe_stage_graph,
+	pe_stage_max
+};
+
+typedef struct pe_stage_profile_s 
+{
+	const char *name;
+	unsigned long long usec;
+	unsigned long allocs;
+	unsigned long bytes;
+	int resources;
+	int actions;
+	int orderings;
+	int synapses;
+	int visits;
+} pe_stage_profile_t;
+
+static CRM_THREAD_LOCAL pe_stage_profile_t pe_profile[pe_stage_max] = {
+	{ "unpack" },
+	{ "placement" },
+	{ "internal" },
+	{ "check" },
+	{ "allocate" },
+	{ "fencing" },
+	{ "ordering" },
+	{ "graph" },
+};
+
+static CRM_THREAD_LOCAL unsigned long long profile_mark = 0;
+static CRM_THREAD_LOCAL unsigned long profile_allocs = 0;
+static CRM_THREAD_LOCAL unsigned long profile_bytes = 0;
+
+static unsigned long long
+pe_profile_now(void)
+{
+#ifdef CLOCK_MONOTONIC
+	struct timespec ts;
+	if(clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+		return (ts.tv_sec * 1000000ULL) + (ts.tv_nsec / 1000);
+	}
+#endif
+	{
+		struct timeval tv;
+		gettimeofday(&tv, NULL);
+		return (tv.tv_sec * 1000000ULL) + tv.tv_usec;
+	}
+}
+
+static void
+pe_profile_start(pe_working_set_t *data_set)
+{
+	int lpc = 0;
+	for(lpc = 0; lpc < pe_stage_max; lpc++) {
+		const char *name = pe_profile[lpc].name;
+		memset(&pe_profile[lpc], 0, sizeof(pe_stage_profile_t));
+		pe_profile[lpc].name = name;
+	}
+	pe_region_stats(data_set, &profile_allocs, &profile_bytes);
+	profile_mark = pe_profile_now();
+}
+
+static void
+pe_profile_stage(enum pe_stage_e stage, pe_working_set_t *data_set)
+{
+	unsigned long allocs = 0;
+	unsigned long bytes = 0;
+	unsigned long long now = pe_profile_now();
+	pe_stage_profile_t *profile = &pe_profile[stage];
+
+	pe_region_stats(data_set, &allocs, &bytes);
+
+	profile->usec = now - profile_mark;
+	profile->allocs = allocs - profile_allocs;
+	profile->bytes = bytes - profile_bytes;
+	profile->resources = g_list_length(data_set->resources);
+	profile->actions = g_list_length(data_set->actions);
+	profile->orderings = g_list_length(data_set->ordering_constraints);
+	profile->synapses = data_set->num_synapse;
+	profile->visits = data_set->action_visits;
+
+	crm_debug("Stage %s: %lluus, %lu allocations (%lu bytes),"
+		  " %d resources, %d actions, %d orderings, %d synapses,"
+		  " %d action visits",
+		  profile->name, profile->usec, profile->allocs, profile->bytes,
+		  profile->resources, profile->actions, profile->orderings,
+		  profile->synapses, profile->visits);
+
+	profile_allocs = allocs;
+	profile_bytes = bytes;
+	/* exclude our own overhead from the next stage */
+	profile_mark = pe_profile_now();
+}
+
+static void
+pe_profile_log(int log_level)
+{
+	int lpc = 0;
+	int offset = 0;
+	char buffer[512];
+	unsigned long long total = 0;
+
+	buffer[0] = 0;
+	for(lpc = 0; lpc < pe_stage_max; lpc++) {
+		total += pe_profile[lpc].usec;
+		if(offset < sizeof(buffer)) {
+			offset += snprintf(buffer + offset, sizeof(buffer) - offset,
+					   " %s=%llu", pe_profile[lpc].name,
+					   pe_profile[lpc].usec / 1000);
+		}
+	}
+	do_crm_log(log_level, "Calculated transition in %llums (stages:%s),"
+		   " %lu allocations, %d actions (%d visits), %d synapses",
+		   total / 1000, buffer, profile_allocs,
+		   pe_profile[pe_stage_graph].actions,
+		   pe_profile[pe_stage_graph].visits,
+		   pe_profile[pe_stage_graph].synapses);
+}
+
+xmlNode *
+pe_profile_xml(void)
+{
+	int lpc = 0;
+	unsigned long long total = 0;
+	xmlNode *xml = create_xml_node(NULL, XML_TAG_PE_PROFILE);
+
+	for(lpc = 0; lpc < pe_stage_max; lpc++) {
+		char buffer[64];
+		pe_stage_profile_t *profile = &pe_profile[lpc];
+		xmlNode *stage = create_xml_node(xml, "stage");
+
+		crm_xml_add(stage, XML_ATTR_ID, profile->name);
+
+		snprintf(buffer, sizeof(buffer), "%llu", profile->usec);
+		crm_xml_add(stage, "usec", buffer);
+		snprintf(buffer, sizeof(buffer), "%lu", profile->allocs);
+		crm_xml_add(stage, "allocs", buffer);
+		snprintf(buffer, sizeof(buffer), "%lu", profile->bytes);
+		crm_xml_add(stage, "bytes", buffer);
+
+		crm_xml_add_int(stage, "resources", profile->resources);
+		crm_xml_add_int(stage, "actions", profile->actions);
+		crm_xml_add_int(stage, "orderings", profile->orderings);
+		crm_xml_add_int(stage, "synapses", profile->synapses);
+		crm_xml_add_int(stage, "visits", profile->visits);
+		total += profile->usec;
+	}
+
+	{
+		char buffer[64];
+		snprintf(buffer, sizeof(buffer), "%llu", total);
+		crm_xml_add(xml, "usec", buffer);
+	}
+	return xml;
+}
+
 #define check_and_exit(stage) 	cleanup_calculations(data_set);		\
 	crm_mem_stats(NULL);						\
 	crm_err("Exiting: stage %d", stage);				\
@@ -245,6 +422,8 @@ do_calculations(pe_working_set_t *data_set, xmlNode *xml_input, ha_time_t *now)
 	check_and_exit(-1);
 #endif
 	
+	pe_profile_start(data_set);
+	
 	crm_debug_5("unpack constraints");		  
 	stage0(data_set);
 	
@@ -259,7 +438,7 @@ do_calculations(pe_working_set_t *data_set, xmlNode *xml_input, ha_time_t *now)
 		   }
 		   rsc->fns->print(rsc, NULL, pe_print_log, &rsc_log_level);
 		);
-
+	pe_profile_stage(pe_stage_unpack, data_set);
 	
 #if MEMCHECK_STAGE_1
 	check_and_exit(1);
@@ -267,6 +446,7 @@ do_calculations(pe_working_set_t *data_set, xmlNode *xml_input, ha_time_t *now)
 
 	crm_debug_5("color resources");
 	stage2(data_set);
+	pe_profile_stage(pe_stage_placement, data_set);
 
 #if MEMCHECK_STAGE_2
 	check_and_exit(2);
@@ -274,6 +454,7 @@ do_calculations(pe_working_set_t *data_set, xmlNode *xml_input, ha_time_t *now)
 
 	/* unused */
 	stage3(data_set);
+	pe_profile_stage(pe_stage_internal, data_set);
 
 #if MEMCHECK_STAGE_3
 	check_and_exit(3);
@@ -281,6 +462,7 @@ do_calculations(pe_working_set_t *data_set, xmlNode *xml_input, ha_time_t *now)
 	
 	crm_debug_5("assign nodes to colors");
 	stage4(data_set);	
+	pe_profile_stage(pe_stage_check, data_set);
 	
 #if MEMCHECK_STAGE_4
 	check_and_exit(4);
@@ -288,6 +470,7 @@ do_calculations(pe_working_set_t *data_set, xmlNode *xml_input, ha_time_t *now)
 
 	crm_debug_5("creating actions and internal ording constraints");
 	stage5(data_set);
+	pe_profile_stage(pe_stage_allocate, data_set);
 
 #if MEMCHECK_STAGE_5
 	check_and_exit(5);
@@ -295,6 +478,7 @@ do_calculations(pe_working_set_t *data_set, xmlNode *xml_input, ha_time_t *now)
 	
 	crm_debug_5("processing fencing and shutdown cases");
 	stage6(data_set);
+	pe_profile_stage(pe_stage_fencing, data_set);
 	
 #if MEMCHECK_STAGE_6
 	check_and_exit(6);
@@ -302,6 +486,7 @@ do_calculations(pe_working_set_t *data_set, xmlNode *xml_input, ha_time_t *now)
 
 	crm_debug_5("applying ordering constraints");
 	stage7(data_set);
+	pe_profile_stage(pe_stage_ordering, data_set);
 
 #if MEMCHECK_STAGE_7
 	check_and_exit(7);
@@ -309,6 +494,8 @@ do_calculations(pe_working_set_t *data_set, xmlNode *xml_input, ha_time_t *now)
 
 	crm_debug_5("creating transition graph");
 	stage8(data_set);
+	pe_profile_stage(pe_stage_graph, data_set);
+	pe_profile_log(LOG_INFO);
 
 #if MEMCHECK_STAGE_8
 	check_and_exit(8);
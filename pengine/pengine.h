@@ -140,7 +140,7 @@ extern gboolean process_pe_message(
 extern gboolean unpack_constraints(
 	xmlNode *xml_constraints, pe_working_set_t *data_set);
 
-extern gboolean update_action_states(GListPtr actions);
+extern int update_action_states(GListPtr actions);
 
 extern gboolean shutdown_constraints(
 	node_t *node, action_t *shutdown_op, pe_working_set_t *data_set);
@@ -165,8 +165,12 @@ extern int new_rsc_order(resource_t *lh_rsc, const char *lh_task,
 extern void graph_element_from_action(
 	action_t *action, pe_working_set_t *data_set);
 
+/* Per-stage profile of the last do_calculations() run */
+extern xmlNode *pe_profile_xml(void);
+
 extern gboolean show_scores;
 extern int scores_log_level;
+extern int alloc_threads;
 extern const char* transition_idle_timeout;
 
 #endif
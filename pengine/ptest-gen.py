@@ -0,0 +1,283 @@
+#!/usr/bin/env python3
+
+ # Copyright (C) 2004 Andrew Beekhof <andrew@beekhof.net>
+ #
+ # This program is free software; you can redistribute it and/or
+ # modify it under the terms of the GNU General Public
+ # License as published by the Free Software Foundation; either
+ # version 2.1 of the License, or (at your option) any later version.
+ #
+ # This software is distributed in the hope that it will be useful,
+ # but WITHOUT ANY WARRANTY; without even the implied warranty of
+ # MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ # General Public License for more details.
+ #
+ # You should have received a copy of the GNU General Public
+ # License along with this library; if not, write to the Free Software
+ # Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ #
+
+'''ptest-gen.py, generate a synthetic cluster for benchmarking the PE
+
+   The configuration and status sections describe a settled cluster:
+   every resource has been probed everywhere and is running where it
+   was placed, with matching operation digests, so ptest only has the
+   cost of reaching that conclusion.  Use --no-probes or --history 0
+   to generate a cluster that still has everything to do.
+'''
+
+import sys
+import random
+import optparse
+
+try:
+    from hashlib import md5
+except ImportError:
+    from md5 import md5
+
+FEATURE_SET = "3.0.1"
+UUID = "2668bbeb-06d5-40f9-936d-24cb7f87006a"
+
+MONITOR_TIMEOUT = 20000
+BASE_INTERVAL = 10000
+
+def op_digest(interval):
+    '''The PE's digest of an operation on a resource without parameters'''
+    if interval > 0:
+        params = ' <parameters CRM_meta_timeout="%d"/>\n' % MONITOR_TIMEOUT
+    else:
+        params = ' <parameters/>\n'
+    return md5(params.encode("ascii")).hexdigest()
+
+class Status:
+    '''Operation history and transient attributes, per node'''
+    def __init__(self, nodes):
+        self.nodes = nodes
+        self.attrs = {}
+        self.history = {}
+        self.order = {}
+        self.call_id = {}
+        self.action = 0
+        for node in nodes:
+            self.attrs[node] = [("probe_complete", "true")]
+            self.history[node] = {}
+            self.order[node] = []
+            self.call_id[node] = 0
+
+    def op(self, node, rsc, task, interval, rc):
+        self.action += 1
+        self.call_id[node] += 1
+        key = "%d:1:%d:%s" % (self.action, rc, UUID)
+        if rsc.id not in self.history[node]:
+            self.history[node][rsc.id] = []
+            self.order[node].append(rsc)
+        self.history[node][rsc.id].append(
+            '<lrm_rsc_op id="%s_%s_%d" operation="%s" crm-debug-origin="ptest-gen"'
+            ' crm_feature_set="%s" transition-key="%s" transition-magic="0:%d;%s"'
+            ' call-id="%d" rc-code="%d" op-status="0" interval="%d"'
+            ' last-run="1262304000" last-rc-change="1262304000" exec-time="10"'
+            ' queue-time="0" op-digest="%s"/>'
+            % (rsc.id, task, interval, task, FEATURE_SET, key, rc, key,
+               self.call_id[node], rc, interval, op_digest(interval)))
+
+class Primitive:
+    def __init__(self, id, type="Dummy", provider="heartbeat"):
+        self.id = id
+        self.type = type
+        self.provider = provider
+
+    def xml(self, monitors, stateful=False):
+        ops = []
+        for lpc in range(monitors):
+            interval = BASE_INTERVAL * (lpc + 1)
+            if stateful and lpc == 0:
+                ops.append('<op id="%s-monitor-%d" name="monitor" interval="%dms"'
+                           ' timeout="%dms" role="Master"/>'
+                           % (self.id, interval - 1000, interval - 1000, MONITOR_TIMEOUT))
+            ops.append('<op id="%s-monitor-%d" name="monitor" interval="%dms" timeout="%dms"/>'
+                       % (self.id, interval, interval, MONITOR_TIMEOUT))
+        return ('<primitive id="%s" class="ocf" provider="%s" type="%s">'
+                '<operations>%s</operations></primitive>'
+                % (self.id, self.provider, self.type, "".join(ops)))
+
+    def history(self, status, node, instance, depth, probes, role="Started"):
+        '''Record a probe on every node and depth operations where it runs'''
+        rsc = self
+        if instance is not None:
+            rsc = Primitive("%s:%d" % (self.id, instance), self.type, self.provider)
+
+        if probes:
+            for other in status.nodes:
+                if other != node:
+                    status.op(other, rsc, "monitor", 0, 7)
+        if node is None or depth == 0:
+            return
+
+        status.op(node, rsc, "monitor", 0, 7)
+        status.op(node, rsc, "start", 0, 0)
+        if role == "Master":
+            status.op(node, rsc, "promote", 0, 0)
+        for lpc in range(depth - 1):
+            interval = BASE_INTERVAL * (lpc + 1)
+            if role == "Master" and lpc == 0:
+                status.op(node, rsc, "monitor", interval - 1000, 8)
+            else:
+                status.op(node, rsc, "monitor", interval, 0)
+
+def main():
+    parser = optparse.OptionParser(
+        usage="%prog [options]",
+        description="Generate a synthetic cluster (CIB and status) for ptest")
+    parser.add_option("-n", "--nodes", type="int", default=16,
+                      help="Number of cluster nodes [%default]")
+    parser.add_option("-p", "--primitives", type="int", default=100,
+                      help="Number of ungrouped primitives [%default]")
+    parser.add_option("-g", "--groups", type="int", default=0,
+                      help="Number of groups [%default]")
+    parser.add_option("--group-size", type="int", default=3,
+                      help="Members of each group [%default]")
+    parser.add_option("-c", "--clones", type="int", default=0,
+                      help="Number of anonymous clones, one instance per node [%default]")
+    parser.add_option("-m", "--masters", type="int", default=0,
+                      help="Number of master/slave resources with two instances [%default]")
+    parser.add_option("-d", "--constraint-density", type="float", default=0.5,
+                      help="Fraction of primitives and groups given a location,"
+                      " colocation and ordering constraint [%default]")
+    parser.add_option("-H", "--history", type="int", default=2,
+                      help="Operations recorded for each active resource: the probe and start,"
+                      " then one recurring monitor for each level above one [%default]")
+    parser.add_option("--no-probes", action="store_false", dest="probes", default=True,
+                      help="Leave out probe results from the nodes a resource is not running on")
+    parser.add_option("-s", "--seed", type="int", default=1,
+                      help="Random seed [%default]")
+    parser.add_option("-o", "--output", default="-",
+                      help="Write the CIB to this file [stdout]")
+    (options, args) = parser.parse_args()
+
+    if options.nodes < 1:
+        parser.error("at least one node is required")
+
+    random.seed(options.seed)
+    monitors = max(options.history - 1, 0)
+    nodes = ["node%d" % (lpc + 1) for lpc in range(options.nodes)]
+    status = Status(nodes)
+
+    resources = []
+    constraints = []
+    placed = []
+
+    def place(id):
+        '''Pick a node for id, following a colocation with an earlier resource'''
+        if placed and random.random() < options.constraint_density:
+            (with_id, node) = random.choice(placed)
+            constraints.append('<rsc_colocation id="col-%s-%s" rsc="%s" with-rsc="%s" score="INFINITY"/>'
+                               % (id, with_id, id, with_id))
+            constraints.append('<rsc_order id="ord-%s-%s" first="%s" then="%s" score="INFINITY"/>'
+                               % (with_id, id, with_id, id))
+        else:
+            node = random.choice(nodes)
+            if random.random() < options.constraint_density:
+                constraints.append('<rsc_location id="loc-%s" rsc="%s" node="%s" score="100"/>'
+                                   % (id, id, node))
+        placed.append((id, node))
+        return node
+
+    for lpc in range(options.primitives):
+        rsc = Primitive("rsc%d" % lpc)
+        node = place(rsc.id)
+        rsc.history(status, node, None, options.history, options.probes)
+        resources.append(rsc.xml(monitors))
+
+    for lpc in range(options.groups):
+        id = "group%d" % lpc
+        node = place(id)
+        members = []
+        for child in range(options.group_size):
+            rsc = Primitive("%s-rsc%d" % (id, child))
+            rsc.history(status, node, None, options.history, options.probes)
+            members.append(rsc.xml(monitors))
+        resources.append('<group id="%s">%s</group>' % (id, "".join(members)))
+
+    for lpc in range(options.clones):
+        rsc = Primitive("clone%d-rsc" % lpc)
+        for instance in range(len(nodes)):
+            # an anonymous clone's probe is recorded against the local instance
+            rsc.history(status, nodes[instance], instance, options.history, False)
+        resources.append('<clone id="clone%d"><meta_attributes id="clone%d-meta">'
+                         '<nvpair id="clone%d-unique" name="globally-unique" value="false"/>'
+                         '</meta_attributes>%s</clone>' % (lpc, lpc, lpc, rsc.xml(monitors)))
+
+    for lpc in range(options.masters):
+        rsc = Primitive("ms%d-rsc" % lpc, "Stateful", "pacemaker")
+        first = random.randrange(len(nodes))
+        active = [nodes[(first + instance) % len(nodes)] for instance in range(min(2, len(nodes)))]
+        if options.probes:
+            probe = Primitive("%s:0" % rsc.id, rsc.type, rsc.provider)
+            for node in nodes:
+                if node not in active:
+                    status.op(node, probe, "monitor", 0, 7)
+        for instance in range(len(active)):
+            node = active[instance]
+            role = "Started"
+            score = "5"
+            if instance == 0:
+                role = "Master"
+                score = "10"
+            rsc.history(status, node, instance, options.history, False, role)
+            status.attrs[node].append(("master-%s:%d" % (rsc.id, instance), score))
+        resources.append('<master id="ms%d"><meta_attributes id="ms%d-meta">'
+                         '<nvpair id="ms%d-unique" name="globally-unique" value="false"/>'
+                         '<nvpair id="ms%d-max" name="clone-max" value="2"/>'
+                         '<nvpair id="ms%d-node-max" name="clone-node-max" value="1"/>'
+                         '<nvpair id="ms%d-master-max" name="master-max" value="1"/>'
+                         '</meta_attributes>%s</master>'
+                         % (lpc, lpc, lpc, lpc, lpc, lpc, rsc.xml(monitors, True)))
+
+    out = sys.stdout
+    if options.output != "-":
+        out = open(options.output, "w")
+
+    out.write('<cib validate-with="pacemaker-1.0" crm_feature_set="%s" have-quorum="1"'
+              ' dc-uuid="%s" admin_epoch="0" epoch="1" num_updates="1">\n'
+              % (FEATURE_SET, nodes[0]))
+    out.write('  <configuration>\n    <crm_config><cluster_property_set id="cib-bootstrap-options">'
+              '<nvpair id="opt-stonith-enabled" name="stonith-enabled" value="false"/>'
+              '<nvpair id="opt-no-quorum-policy" name="no-quorum-policy" value="ignore"/>'
+              '</cluster_property_set></crm_config>\n')
+    out.write('    <nodes>\n')
+    for node in nodes:
+        out.write('      <node id="%s" uname="%s" type="normal"/>\n' % (node, node))
+    out.write('    </nodes>\n    <resources>\n')
+    for rsc in resources:
+        out.write('      %s\n' % rsc)
+    out.write('    </resources>\n    <constraints>\n')
+    for cons in constraints:
+        out.write('      %s\n' % cons)
+    out.write('    </constraints>\n')
+    out.write('    <rsc_defaults><meta_attributes id="rsc-options">'
+              '<nvpair id="rsc-options-stickiness" name="resource-stickiness" value="100"/>'
+              '</meta_attributes></rsc_defaults>\n')
+    out.write('  </configuration>\n  <status>\n')
+    for node in nodes:
+        out.write('    <node_state id="%s" uname="%s" ha="active" in_ccm="true" crmd="online"'
+                  ' join="member" expected="member" shutdown="0" crm-debug-origin="ptest-gen">\n'
+                  % (node, node))
+        out.write('      <transient_attributes id="%s"><instance_attributes id="status-%s">'
+                  % (node, node))
+        for (name, value) in status.attrs[node]:
+            out.write('<nvpair id="status-%s-%s" name="%s" value="%s"/>'
+                      % (node, name, name, value))
+        out.write('</instance_attributes></transient_attributes>\n')
+        out.write('      <lrm id="%s"><lrm_resources>\n' % node)
+        for rsc in status.order[node]:
+            out.write('        <lrm_resource id="%s" class="ocf" provider="%s" type="%s">%s</lrm_resource>\n'
+                      % (rsc.id, rsc.provider, rsc.type, "".join(status.history[node][rsc.id])))
+        out.write('      </lrm_resources></lrm>\n    </node_state>\n')
+    out.write('  </status>\n</cib>\n')
+
+    if out != sys.stdout:
+        out.close()
+    return 0
+
+if __name__ == "__main__":
+    sys.exit(main())
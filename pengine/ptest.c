@@ -27,6 +27,9 @@
 #include <stdlib.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <glob.h>
+#include <sys/stat.h>
+#include <sys/time.h>
 
 #include <crm/transition.h>
 #include <crm/common/xml.h>
@@ -47,9 +50,11 @@ gboolean use_stdin = FALSE;
 gboolean do_simulation = FALSE;
 gboolean inhibit_exit = FALSE;
 gboolean all_actions = FALSE;
+gboolean show_profile = FALSE;
 extern xmlNode * do_calculations(
 	pe_working_set_t *data_set, xmlNode *xml_input, ha_time_t *now);
 extern void cleanup_calculations(pe_working_set_t *data_set);
+extern CRM_THREAD_LOCAL int transition_id;
 char *use_date = NULL;
 
 FILE *dot_strm = NULL;
@@ -115,6 +120,273 @@ create_action_name(action_t *action)
 	return action_name;
 }
 
+static void
+print_profile(xmlNode *profile)
+{
+	const char *total = crm_element_value(profile, "usec");
+	
+	fprintf(stdout, "%-10s %10s %10s %12s %9s %8s %9s %8s\n",
+		"Stage", "usec", "allocs", "bytes",
+		"resources", "actions", "orderings", "synapses");
+	
+	xml_child_iter(
+		profile, stage,
+		fprintf(stdout, "%-10s %10s %10s %12s %9s %8s %9s %8s\n",
+			crm_element_value(stage, XML_ATTR_ID),
+			crm_element_value(stage, "usec"),
+			crm_element_value(stage, "allocs"),
+			crm_element_value(stage, "bytes"),
+			crm_element_value(stage, "resources"),
+			crm_element_value(stage, "actions"),
+			crm_element_value(stage, "orderings"),
+			crm_element_value(stage, "synapses"));
+		);
+	fprintf(stdout, "%-10s %10s\n", "Total", total);
+}
+
+/*
+ * Batch replay
+ *
+ * Each input is read, upgraded, validated and calculated on one worker
+ * thread.  The PE keeps its state per-thread, so resetting it before
+ * each input gives the same graph as "ptest -x" of that file.
+ */
+typedef struct batch_input_s 
+{
+	char *filename;
+	int rc;
+	gboolean errors;
+	gboolean warnings;
+	int synapses;
+	unsigned long long parse_usec;
+	unsigned long long calc_usec;
+	char *digest;
+} batch_input_t;
+
+static unsigned long long
+batch_now(void)
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return (tv.tv_sec * 1000000ULL) + tv.tv_usec;
+}
+
+static void
+batch_calculate(gpointer data, gpointer user_data)
+{
+	batch_input_t *input = data;
+	pe_working_set_t data_set;
+	ha_time_t *a_date = NULL;
+	xmlNode *cib_object = NULL;
+	unsigned long long start = batch_now();
+
+	cib_object = filename2xml(input->filename);
+	if(cib_object == NULL) {
+		input->rc = 4;
+		return;
+
+	} else if(cli_config_update(&cib_object, NULL, FALSE) == FALSE) {
+		free_xml(cib_object);
+		input->rc = cib_STALE;
+		return;
+
+	} else if(validate_xml(cib_object, NULL, FALSE) != TRUE) {
+		free_xml(cib_object);
+		input->rc = cib_dtd_validation;
+		return;
+	}
+	input->parse_usec = batch_now() - start;
+
+	if(use_date != NULL) {
+		char *date_text = crm_strdup(use_date);
+		char *date_iter = date_text;
+		a_date = parse_date(&date_iter);
+		crm_free(date_text);
+	}
+
+	transition_id = -1;
+	crm_config_error = FALSE;
+	crm_config_warning = FALSE;	
+	was_processing_error = FALSE;
+	was_processing_warning = FALSE;
+
+	start = batch_now();
+	do_calculations(&data_set, cib_object, a_date);
+	input->calc_usec = batch_now() - start;
+
+	input->errors = was_processing_error;
+	input->warnings = was_processing_warning;
+	input->synapses = data_set.num_synapse;
+	input->digest = calculate_xml_digest(data_set.graph, FALSE, FALSE);
+
+	cleanup_alloc_calculations(&data_set);
+}
+
+static GListPtr
+batch_inputs(const char *source)
+{
+	int lpc = 0;
+	glob_t matches;
+	struct stat buf;
+	GListPtr inputs = NULL;
+
+	memset(&matches, 0, sizeof(glob_t));
+	if(stat(source, &buf) == 0 && S_ISDIR(buf.st_mode)) {
+		char *pattern = NULL;
+		int len = strlen(source) + 8;
+
+		crm_malloc0(pattern, len);
+		snprintf(pattern, len, "%s/*.xml", source);
+		glob(pattern, 0, NULL, &matches);
+
+		snprintf(pattern, len, "%s/*.bz2", source);
+		glob(pattern, GLOB_APPEND, NULL, &matches);
+		crm_free(pattern);
+
+	} else {
+		glob(source, 0, NULL, &matches);
+	}
+
+	for(lpc = 0; lpc < matches.gl_pathc; lpc++) {
+		batch_input_t *input = NULL;
+		crm_malloc0(input, sizeof(batch_input_t));
+		input->filename = crm_strdup(matches.gl_pathv[lpc]);
+		inputs = g_list_append(inputs, input);
+	}
+
+	globfree(&matches);
+	return inputs;
+}
+
+static int
+run_batch(const char *source, int threads)
+{
+	int rc = 0;
+	int failed = 0;
+	unsigned long long start = batch_now();
+	GListPtr inputs = batch_inputs(source);
+
+	if(inputs == NULL) {
+		fprintf(stderr, "No inputs found in: %s\n", source);
+		return 4;
+	}
+
+	if(threads <= 0) {
+		threads = sysconf(_SC_NPROCESSORS_ONLN);
+	}
+	if(threads <= 0) {
+		threads = 1;
+	}
+#if !HAVE_GTHREAD
+	threads = 1;
+#endif
+
+#if HAVE_GTHREAD
+	if(threads > 1) {
+		GThreadPool *pool = NULL;
+#  if !GLIB_CHECK_VERSION(2,32,0)
+		if(g_thread_supported() == FALSE) {
+			g_thread_init(NULL);
+		}
+#  endif
+		/* libxml2 initializes itself lazily, which isn't thread-safe */
+		xmlInitParser();
+		pool = g_thread_pool_new(batch_calculate, NULL, threads, TRUE, NULL);
+		slist_iter(input, batch_input_t, inputs, lpc,
+			   g_thread_pool_push(pool, input, NULL));
+
+		/* waits for every input to be processed */
+		g_thread_pool_free(pool, FALSE, TRUE);
+	} else
+#endif
+	{
+		slist_iter(input, batch_input_t, inputs, lpc,
+			   batch_calculate(input, NULL));
+	}
+
+	fprintf(stdout, "%-40s %4s %10s %10s %8s %s\n",
+		"Input", "rc", "parse_us", "calc_us", "synapses", "digest");
+	slist_iter(
+		input, batch_input_t, inputs, lpc,
+		const char *status = input->digest;
+
+		if(input->rc != 0) {
+			status = "failed";
+			failed++;
+		}
+		fprintf(stdout, "%-40s %4d %10llu %10llu %8d %s%s%s\n",
+			input->filename, input->rc,
+			input->parse_usec, input->calc_usec, input->synapses,
+			status?status:"<none>",
+			input->errors?" (errors)":"",
+			input->warnings?" (warnings)":"");
+
+		crm_free(input->filename);
+		crm_free(input->digest);
+		crm_free(input);
+		);
+	fprintf(stdout, "Processed %d inputs (%d failed) with %d threads in %llums\n",
+		g_list_length(inputs), failed, threads, (batch_now() - start) / 1000);
+
+	if(failed) {
+		rc = 5;
+	}
+	g_list_free(inputs);
+	return rc;
+}
+
+/*
+ * With --save-simulation, resource and cluster actions stay in flight
+ * until the end of the pass that fired them, as they would with a real
+ * TE, and the order they were fired in is written out.  That makes the
+ * per-node action limits and the synapse fire order testable.
+ */
+FILE *sim_strm = NULL;
+static int sim_pass = 0;
+static GListPtr sim_in_flight = NULL;
+
+static gboolean
+sim_pseudo_action(crm_graph_t *graph, crm_action_t *action) 
+{
+	action->confirmed = TRUE;
+	update_graph(graph, action);
+	return TRUE;
+}
+
+static gboolean
+sim_action(crm_graph_t *graph, crm_action_t *action) 
+{
+	const char *node = crm_element_value(action->xml, XML_LRM_ATTR_TARGET);
+	const char *task = crm_element_value(action->xml, XML_LRM_ATTR_TASK_KEY);
+
+	if(task == NULL) {
+		task = crm_element_value(action->xml, XML_LRM_ATTR_TASK);
+	}
+	
+	fprintf(sim_strm, "Pass %d: %s %s\n", sim_pass, crm_str(task), crm_str(node));
+	sim_in_flight = g_list_append(sim_in_flight, action);
+	return TRUE;
+}
+
+static crm_graph_functions_t sim_fns = {
+	sim_pseudo_action,
+	sim_action,
+	sim_action,
+	sim_action
+};
+
+static void
+sim_complete_pass(crm_graph_t *graph) 
+{
+	slist_iter(
+		action, crm_action_t, sim_in_flight, lpc,
+		action->confirmed = TRUE;
+		update_graph(graph, action);
+		);
+	g_list_free(sim_in_flight);
+	sim_in_flight = NULL;
+}
+
 gboolean USE_LIVE_CIB = FALSE;
 static struct crm_option long_options[] = {
     /* Top-level Options */
@@ -125,15 +397,21 @@ static struct crm_option long_options[] = {
     {"simulate",    0, 0, 'S', "Simulate the transition's execution to find invalid graphs\n"},
     {"show-scores", 0, 0, 's', "Display resource allocation scores"},
     {"all-actions", 0, 0, 'a', "Display all possible actions - even ones not part of the transition graph"},
+    {"profile",     0, 0, 'P', "Display the time, allocations and objects of each calculation stage"},
 
     {"live-check",  0, 0, 'L', "Connect to the CIB and use the current contents as input"},
     {"xml-text",    1, 0, 'X', "Retrieve XML from the supplied string"},
     {"xml-file",    1, 0, 'x', "Retrieve XML from the named file"},
+    {"batch",       1, 0, 'b', "Replay every input in the named directory (or matching the glob) and display per-file timings and graph digests"},
+    {"threads",     1, 0, 'j', "\tNumber of worker threads for --batch (default: one per CPU)"},
+    {"alloc-threads",1, 0, 't', "Allocate resources that aren't colocated with each other on this many threads (default: pe-alloc-threads)"},
     /* {"xml-pipe",    0, 0, 'p', "Retrieve XML from stdin\n"}, */
     
     {"save-input",  1, 0, 'I', "\tSave the input to the named file"},
     {"save-graph",  1, 0, 'G', "\tSave the transition graph (XML format) to the named file"},
-    {"save-dotfile",1, 0, 'D', "Save the transition graph (DOT format) to the named file\n"},
+    {"save-dotfile",1, 0, 'D', "Save the transition graph (DOT format) to the named file"},
+    {"save-profile",1, 0, 'F', "Save the calculation profile (XML format) to the named file"},
+    {"save-simulation",1, 0, 'e', "Simulate the transition and save the order its actions were fired in to the named file\n"},
     
     {0, 0, 0, 0}
 };
@@ -161,6 +439,10 @@ main(int argc, char **argv)
 	const char *dot_file = NULL;
 	const char *graph_file = NULL;
 	const char *input_file = NULL;
+	const char *profile_file = NULL;
+	const char *sim_file = NULL;
+	const char *batch_source = NULL;
+	int batch_threads = 0;
 
 	/* disable glib's fancy allocators that can't be free'd */ 
 	GMemVTable vtable;
@@ -175,7 +457,7 @@ main(int argc, char **argv)
         g_mem_set_vtable(&vtable);
 
 	crm_log_init("ptest", LOG_CRIT, FALSE, FALSE, 0, NULL);
-	crm_set_options("V?$XD:G:I:Lwx:d:aSs", "[-?Vv] -[Xxp] {other options}", long_options,
+	crm_set_options("V?$XD:G:I:F:Lwx:d:aSsPb:j:t:e:", "[-?Vv] -[Xxp] {other options}", long_options,
 			"Calculate the cluster's response to the supplied cluster state\n");
 	
 	while (1) {
@@ -200,9 +482,28 @@ main(int argc, char **argv)
 			case 's':
 				show_scores = TRUE;
 				break;
+			case 'P':
+				show_profile = TRUE;
+				break;
+			case 'F':
+				profile_file = optarg;
+				break;
+			case 'e':
+				sim_file = optarg;
+				do_simulation = TRUE;
+				break;
 			case 'x':
 				xml_file = optarg;
 				break;
+			case 'b':
+				batch_source = optarg;
+				break;
+			case 'j':
+				batch_threads = crm_parse_int(optarg, "0");
+				break;
+			case 't':
+				alloc_threads = crm_parse_int(optarg, "1");
+				break;
 			case 'd':
 				use_date = optarg;
 				break;
@@ -249,7 +550,22 @@ main(int argc, char **argv)
 		crm_err("%d errors in option parsing", argerr);
 		crm_help('?', 1);
 	}
+
+#if HAVE_GTHREAD
+#  if !GLIB_CHECK_VERSION(2,32,0)
+	if(g_thread_supported() == FALSE) {
+		g_thread_init(NULL);
+	}
+#  endif
+#endif
   
+	if(batch_source != NULL) {
+		int rc = run_batch(batch_source, batch_threads);
+		xmlCleanupParser();
+		crm_log_deinit();
+		return rc;
+	}
+	
 	if(USE_LIVE_CIB) {
 		int rc = cib_ok;
 		source = "live cib";
@@ -326,6 +642,23 @@ main(int argc, char **argv)
 		fprintf(stdout, "Allocation scores:\n");
 	    }
 	    do_calculations(&data_set, cib_object, a_date);
+
+	    if(show_profile || profile_file != NULL) {
+		xmlNode *profile = pe_profile_xml();
+		if(show_profile) {
+		    print_profile(profile);
+		}
+		if(safe_str_eq(profile_file, "-")) {
+		    msg_buffer = dump_xml_formatted(profile);
+		    fprintf(stdout, "%s\n", msg_buffer);
+		    crm_free(msg_buffer);
+		    
+		} else if(profile_file != NULL
+			  && write_xml_file(profile, profile_file, FALSE) < 0) {
+		    crm_err("Could not save the profile to %s", profile_file);
+		}
+		free_xml(profile);
+	    }
 	}
 	
 	msg_buffer = dump_xml_formatted(data_set.graph);
@@ -447,14 +780,34 @@ main(int argc, char **argv)
 	    goto cleanup;
 	}
 	
+	if(sim_file != NULL) {
+		sim_strm = fopen(sim_file, "w");
+		if(sim_strm == NULL) {
+			crm_perror(LOG_ERR,"Could not open %s for writing", sim_file);
+		} else {
+			set_graph_functions(&sim_fns);
+		}
+	}
+	
 	transition = unpack_graph(data_set.graph, "ptest");
 	print_graph(LOG_DEBUG, transition);
 
 	do {
+		sim_pass++;
 		graph_rc = run_graph(transition);
+		if(sim_in_flight != NULL) {
+			sim_complete_pass(transition);
+			graph_rc = transition_active;
+		}
 		
 	} while(graph_rc == transition_active);
 
+	if(sim_strm != NULL) {
+		fflush(sim_strm);
+		fclose(sim_strm);
+		sim_strm = NULL;
+	}
+
 	if(graph_rc != transition_complete) {
 		crm_crit("Transition failed: %s", transition_status(graph_rc));
 		print_graph(LOG_ERR, transition);
@@ -464,6 +817,7 @@ main(int argc, char **argv)
 
   cleanup:
 	cleanup_alloc_calculations(&data_set);
+	xmlCleanupParser();
 	crm_log_deinit();
 
 	/* required for MallocDebug.app */
@@ -21,6 +21,12 @@ verbose=$1
 io_dir=test10
 diff_opts="--ignore-all-space -u -N"
 failed=.regression.failed.diff
+ptest_args=""
+if [ "x$PE_ALLOC_THREADS" != "x" ]; then
+    # Same inputs and expected outputs, resources allocated in parallel
+    ptest_args="--alloc-threads $PE_ALLOC_THREADS"
+    failed=.regression.threads.failed.diff
+fi
 # zero out the error log
 > $failed
 
@@ -56,6 +62,8 @@ function do_test {
     dot_png=$io_dir/${base}.png
     scores=$io_dir/${base}.scores
     score_output=$io_dir/${base}.pe.scores
+    sim=$io_dir/${base}.sim
+    sim_output=$io_dir/${base}.pe.sim
 
     if [ "x$1" = "x--rc" ]; then
 	expected_rc=$2
@@ -74,8 +82,14 @@ function do_test {
 #	return;
     fi
 
+    sim_args=""
+    if [ -f $sim ]; then
+	# Record the order the simulated transition fires its actions in
+	sim_args="-e $sim_output"
+    fi
+
 #    ../admin/crm_verify -X $input
-    ptest -x $input -D $dot_output -G $output -S -s $* > $score_output
+    ptest -x $input -D $dot_output -G $output -S -s $ptest_args $sim_args $* > $score_output
     rc=$?
     if [ $rc != $expected_rc ]; then
 	echo "	* Failed (PE : rc=$rc)";
@@ -122,6 +136,9 @@ function do_test {
 	cp "$output" "$expected"
 	cp "$dot_output" "$dot_expected"
 	cp "$score_output" "$scores"
+	if [ -f $sim ]; then
+	    cp "$sim_output" "$sim"
+	fi
 	echo "	Created expected output (PE)" 
     fi
 
@@ -158,6 +175,19 @@ function do_test {
 	rm $score_output
     fi
 
+    if [ -f $sim ]; then
+	diff $diff_opts $sim $sim_output >/dev/null
+	rc=$?
+	if [ $rc != 0 ]; then
+	    echo "	* Failed (PE : simulation)";
+	    diff $diff_opts $sim $sim_output 2>/dev/null >> $failed
+	    echo "" >> $failed
+	    num_failed=`expr $num_failed + 1`
+	else 
+	    rm $sim_output
+	fi
+    fi
+
     rm -f $output
 }
 
@@ -44,6 +44,8 @@ do_test simple7 "Shutdown    "
 do_test simple11 "Priority (ne)"
 do_test simple12 "Priority (eq)"
 do_test simple8 "Stickiness"
+do_test node-action-limit "Limit the actions in flight on each node"
+do_test fire-order-depth "Fire the synapses with the longest chain first"
 
 echo ""
 do_test params-0 "Params: No change"
@@ -215,6 +217,7 @@ echo ""
 do_test clone-anon-probe-1 "Probe the correct (anonymous) clone instance for each node"
 do_test clone-anon-probe-2 "Avoid needless re-probing of anonymous clones"
 do_test clone-anon-failcount "Merge failcounts for anonymous clones"
+do_test clone-anon-failcount-nested "Merge failcounts for nested anonymous clone instances"
 do_test inc0 "Incarnation start" 
 do_test inc1 "Incarnation start order" 
 do_test inc2 "Incarnation silent restart, stop, move"
@@ -312,6 +315,7 @@ do_test stonith-0 "Stonith loop - 1"
 do_test stonith-1 "Stonith loop - 2"
 do_test stonith-2 "Stonith loop - 3"
 do_test stonith-3 "Stonith startup"
+do_test stonith-4 "Stonith concurrency"
 do_test bug-1572-1 "Recovery of groups depending on master/slave"
 do_test bug-1572-2 "Recovery of groups depending on master/slave when the master is never re-promoted"
 do_test bug-1685 "Depends-on-master ordering"
@@ -344,4 +348,10 @@ do_test systemhealthp3 "System Health (Progessive)     #3"
 
 echo ""
 
+if [ "x$PE_ALLOC_THREADS" = "x" ]; then
+    echo "Repeating the tests with resources allocated on 4 threads..."
+    PE_ALLOC_THREADS=4 bash $0 $verbose
+    num_failed=`expr $num_failed + $?`
+fi
+
 test_results
@@ -82,7 +82,6 @@ pe_free_ordering(GListPtr constraints)
 
 		crm_free(order->lh_action_task);
 		crm_free(order->rh_action_task);
-		crm_free(order);
 	}
 	if(constraints != NULL) {
 		g_list_free(constraints);
@@ -99,7 +98,6 @@ pe_free_rsc_to_node(GListPtr constraints)
 		iterator = iterator->next;
 
 		pe_free_shallow(cons->node_list_rh);
-		crm_free(cons);
 	}
 	if(constraints != NULL) {
 		g_list_free(constraints);
@@ -121,7 +119,7 @@ rsc2node_new(const char *id, resource_t *rsc,
 		CRM_CHECK(node_weight == 0, return NULL);
 	}
 	
-	crm_malloc0(new_con, sizeof(rsc_to_node_t));
+	new_con = pe_region_alloc(data_set, sizeof(rsc_to_node_t));
 	if(new_con != NULL) {
 		new_con->id           = id;
 		new_con->rsc_lh       = rsc;
@@ -209,6 +207,9 @@ gint sort_node_weight(gconstpointer a, gconstpointer b)
 	
 	if(a == NULL) { return 1; }
 	if(b == NULL) { return -1; }
+
+	/* num_resources depends on everything allocated so far */
+	pe_serialize();
 	
 	node1_weight = node1->weight;
 	node2_weight = node2->weight;
@@ -263,6 +264,7 @@ gboolean
 native_assign_node(resource_t *rsc, GListPtr nodes, node_t *chosen, gboolean force)
 {
 	CRM_ASSERT(rsc->variant == pe_native);
+	pe_serialize();
 
 	clear_bit(rsc->flags, pe_rsc_provisional);
 	
@@ -422,7 +424,7 @@ order_actions(
 	log_action(LOG_DEBUG_4, "RH (order_actions)", rh_action, FALSE);
 
 	
-	crm_malloc0(wrapper, sizeof(action_wrapper_t));
+	wrapper = pe_region_alloc(pe_dataset, sizeof(action_wrapper_t));
 	wrapper->action = rh_action;
 	wrapper->type = order;
 	
@@ -435,7 +437,7 @@ order_actions(
 /* 	order |= pe_order_implies_right; */
 /* 	order ^= pe_order_implies_right; */
 	
-	crm_malloc0(wrapper, sizeof(action_wrapper_t));
+	wrapper = pe_region_alloc(pe_dataset, sizeof(action_wrapper_t));
 	wrapper->action = lh_action;
 	wrapper->type = order;
 	list = rh_action->actions_before;
@@ -566,6 +568,117 @@ gboolean can_run_any(GListPtr nodes)
 	return FALSE;
 }
 
+/*
+ * Nodes grouped by their value for a node attribute
+ *
+ * Node attributes don't change once the status section has been
+ * unpacked, so colocation only needs to work out which nodes share a
+ * value once per attribute.  Values are compared like safe_str_eq()
+ * does (ignoring case) and nodes without the attribute share class 0.
+ *
+ * The tables are read without any locking.  When allocating with
+ * several threads, alloc_turns() builds an index for every attribute
+ * a colocation can ask for (and every node is added to each of them)
+ * before the first worker starts.  pe_serialize() only waits for
+ * earlier turns, later ones keep reading, so nothing may be added
+ * once the workers are running.
+ */
+struct node_attr_index_s 
+{
+	const char *attr;
+	int classes;
+	GHashTable *values; /* folded value -> class */
+	GHashTable *nodes;  /* node details -> class + 1 */
+};
+
+static void
+free_node_attr_index(gpointer data)
+{
+	node_attr_index_t *index = data;
+	g_hash_table_destroy(index->values);
+	g_hash_table_destroy(index->nodes);
+	crm_free(index);
+}
+
+static int
+node_attr_index_add(node_attr_index_t *index, const node_t *node) 
+{
+	int class = 0;
+	const char *value = g_hash_table_lookup(node->details->attrs, index->attr);
+
+	if(value != NULL) {
+		char *folded = g_ascii_strdown(value, -1);
+		gpointer known = NULL;
+
+		if(g_hash_table_lookup_extended(index->values, folded, NULL, &known)) {
+			class = GPOINTER_TO_INT(known);
+			g_free(folded);
+
+		} else {
+			class = ++index->classes;
+			g_hash_table_insert(index->values, folded, GINT_TO_POINTER(class));
+		}
+	}
+
+	g_hash_table_insert(index->nodes, node->details, GINT_TO_POINTER(class + 1));
+	return class;
+}
+
+node_attr_index_t *
+node_attr_index(const char *attr)
+{
+	node_attr_index_t *index = NULL;
+	pe_working_set_t *data_set = pe_dataset;
+
+	CRM_CHECK(attr != NULL, attr = "#"XML_ATTR_UNAME);
+	CRM_CHECK(data_set != NULL, return NULL);
+
+	if(data_set->attr_index == NULL) {
+		data_set->attr_index = g_hash_table_new_full(
+			g_str_hash, g_str_equal, NULL, free_node_attr_index);
+
+	} else {
+		index = g_hash_table_lookup(data_set->attr_index, attr);
+		if(index != NULL) {
+			return index;
+		}
+	}
+
+	if(pe_serialize_fn != NULL) {
+		crm_err("No index for %s was built before allocation started", attr);
+	}
+	pe_serialize();
+	crm_malloc0(index, sizeof(node_attr_index_t));
+	index->attr = attr;
+	index->values = g_hash_table_new_full(g_str_hash, g_str_equal, g_free, NULL);
+	index->nodes = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+	slist_iter(node, node_t, data_set->nodes, lpc,
+		   node_attr_index_add(index, node);
+		);
+
+	crm_debug_2("Indexed %d values of %s for %d nodes",
+		    index->classes, attr, g_list_length(data_set->nodes));
+	g_hash_table_insert(data_set->attr_index, (gpointer)attr, index);
+	return index;
+}
+
+/* Nodes with the same class have the same value for the attribute */
+int
+node_attr_class(node_attr_index_t *index, const node_t *node)
+{
+	int class = GPOINTER_TO_INT(g_hash_table_lookup(index->nodes, node->details));
+	if(class > 0) {
+		return class - 1;
+	}
+	if(pe_serialize_fn != NULL) {
+		crm_err("Node %s was not in the %s index before allocation started",
+			node->details->uname, index->attr);
+	}
+	pe_serialize();
+	return node_attr_index_add(index, node);
+}
+
 enum rsc_role_e
 minimum_resource_state(resource_t *rsc, gboolean current)
 {
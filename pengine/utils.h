@@ -60,6 +60,10 @@ extern void log_action(unsigned int log_level, const char *pre_text,
 
 extern action_t *get_pseudo_op(const char *name, pe_working_set_t *data_set);
 extern gboolean can_run_any(GListPtr nodes);
+
+typedef struct node_attr_index_s node_attr_index_t;
+extern node_attr_index_t *node_attr_index(const char *attr);
+extern int node_attr_class(node_attr_index_t *index, const node_t *node);
 extern resource_t *find_compatible_child(
     resource_t *local_child, resource_t *rsc, enum rsc_role_e filter, gboolean current);
 
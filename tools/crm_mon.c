@@ -89,6 +89,24 @@ gboolean log_updates = FALSE;
 long last_refresh = 0;
 crm_trigger_t *refresh_trigger = NULL;
 
+/* What the next refresh has to redo.  Any change is unpacked in full,
+ * the difference is whether the configuration is upgraded again.
+ */
+enum mon_refresh_e {
+    mon_refresh_none,	/* only the version numbers changed: redraw as-is */
+    mon_refresh_status,	/* the status section (or DC/quorum) changed */
+    mon_refresh_config,	/* anything else: upgrade and unpack from scratch */
+};
+
+static enum mon_refresh_e mon_pending = mon_refresh_config;
+static gboolean mon_data_valid = FALSE;
+static pe_working_set_t mon_data_set;
+
+/* The upgraded configuration (everything but the status section) that
+ * status-only updates are unpacked against
+ */
+static xmlNode *mon_config = NULL;
+
 /*
  * 1.3.6.1.4.1.32723 has been assigned to the project by IANA
  * http://www.iana.org/assignments/enterprise-numbers
@@ -226,7 +244,9 @@ int cib_connect(gboolean full)
 	    return rc;
 	}
 
+	free_xml(current_cib);
 	current_cib = get_cib_copy(cib);
+	mon_pending = mon_refresh_config;
 	mon_refresh_display(NULL);
 	
 	if(full) {
@@ -1686,6 +1706,62 @@ static void handle_rsc_op(xmlNode *rsc_op)
     crm_free(task);
 }
 
+static enum mon_refresh_e
+mon_diff_scope(xmlNode *diff)
+{
+    int lpc = 0;
+    xmlAttrPtr prop = NULL;
+    int add_admin_epoch = 0, add_epoch = 0, add_updates = 0;
+    int del_admin_epoch = 0, del_epoch = 0, del_updates = 0;
+    const char *sections[] = { XML_TAG_DIFF_REMOVED, XML_TAG_DIFF_ADDED };
+    enum mon_refresh_e scope = mon_refresh_none;
+
+    if(diff == NULL) {
+	return mon_refresh_config;
+    }
+
+    /* The CIB bumps the epoch for every configuration change */
+    cib_diff_version_details(
+	diff, &add_admin_epoch, &add_epoch, &add_updates,
+	&del_admin_epoch, &del_epoch, &del_updates);
+
+    if(add_admin_epoch != del_admin_epoch || add_epoch != del_epoch) {
+	return mon_refresh_config;
+    }
+
+    for(lpc = 0; lpc < DIMOF(sections); lpc++) {
+	xmlNode *change = find_xml_node(diff, sections[lpc], FALSE);
+	xml_child_iter(
+	    change, top,
+
+	    for(prop = top->properties; prop != NULL; prop = prop->next) {
+		const char *name = (const char *)prop->name;
+		if(safe_str_eq(name, XML_ATTR_VALIDATION)
+		   || safe_str_eq(name, XML_ATTR_CRM_VERSION)) {
+		    return mon_refresh_config;
+
+		} else if(safe_str_eq(name, XML_ATTR_GENERATION_ADMIN)
+			  || safe_str_eq(name, XML_ATTR_GENERATION)
+			  || safe_str_eq(name, XML_ATTR_NUMUPDATES)
+			  || safe_str_eq(name, XML_CIB_ATTR_WRITTEN)
+			  || safe_str_eq(name, XML_DIFF_MARKER)) {
+		    continue;
+		}
+		scope = mon_refresh_status;
+	    }
+
+	    xml_child_iter(
+		top, section,
+		if(safe_str_neq(crm_element_name(section), XML_CIB_TAG_STATUS)) {
+		    return mon_refresh_config;
+		}
+		scope = mon_refresh_status;
+		);
+	    );
+    }
+    return scope;
+}
+
 void
 crm_diff_update(const char *event, xmlNode *msg)
 {
@@ -1693,6 +1769,7 @@ crm_diff_update(const char *event, xmlNode *msg)
     long now = time(NULL);
     const char *op = NULL;
     unsigned int log_level = LOG_INFO;
+    enum mon_refresh_e scope = mon_refresh_none;
 
     xmlNode *diff = NULL;
     xmlNode *cib_last = NULL;
@@ -1716,6 +1793,7 @@ crm_diff_update(const char *event, xmlNode *msg)
 	return;	
     } 
 
+    scope = mon_diff_scope(diff);
     if(current_cib != NULL) {
 	cib_last = current_cib; current_cib = NULL;
 	rc = cib_process_diff(op, cib_force_diff, NULL, NULL, diff, cib_last, &current_cib, NULL);
@@ -1729,8 +1807,13 @@ crm_diff_update(const char *event, xmlNode *msg)
     
     if(current_cib == NULL) {
 	current_cib = get_cib_copy(cib);
+	scope = mon_refresh_config;
     }
 
+    if(scope > mon_pending) {
+	mon_pending = scope;
+    }
+    
     if(log_diffs && diff) {
 	log_cib_diff(LOG_DEBUG, diff, op);
     }
@@ -1755,7 +1838,11 @@ crm_diff_update(const char *event, xmlNode *msg)
 	}
     }
 
-    if((now - last_refresh) > (reconnect_msec/1000)) {
+    if(mon_pending == mon_refresh_none) {
+	/* Nothing we display has changed */
+	crm_debug_2("Skipping refresh for %s", op);
+
+    } else if((now - last_refresh) > (reconnect_msec/1000)) {
 	/* Force a refresh */
 	mon_refresh_display(NULL);
 	
@@ -1765,30 +1852,94 @@ crm_diff_update(const char *event, xmlNode *msg)
     free_xml(cib_last);
 }
 
+/*
+ * Build the input for the next unpack.
+ *
+ * Configuration changes go through cli_config_update() as before and
+ * the upgraded configuration is remembered.  Status updates re-use it
+ * so that the (potentially expensive) schema upgrade and validation
+ * only happen when the configuration actually changes.  Either way the
+ * result is a fresh copy that cluster_status() unpacks in full.
+ */
+static xmlNode *
+mon_build_input(void)
+{
+    xmlNode *input = NULL;
+    xmlNode *status = NULL;
+    const char *validation = NULL;
+    
+    if(mon_pending == mon_refresh_status && mon_config != NULL) {
+	status = get_object_root(XML_CIB_TAG_STATUS, current_cib);
+	input = copy_xml(mon_config);
+
+	/* Keep the upgraded schema name, take everything else (DC,
+	 * quorum, versions) from the live copy
+	 */
+	validation = crm_element_value(mon_config, XML_ATTR_VALIDATION);
+	copy_in_properties(input, current_cib);
+	crm_xml_add(input, XML_ATTR_VALIDATION, validation);
+
+	if(status != NULL) {
+	    add_node_copy(input, status);
+	}
+	crm_debug_2("Re-using the upgraded configuration");
+	return input;
+    }
+
+    input = copy_xml(current_cib);
+    if(cli_config_update(&input, NULL, FALSE) == FALSE) {
+	free_xml(input);
+	return NULL;
+    }
+
+    free_xml(mon_config);
+    mon_config = copy_xml(input);
+    status = find_xml_node(mon_config, XML_CIB_TAG_STATUS, FALSE);
+    if(status != NULL) {
+	free_xml_from_parent(mon_config, status);
+    }
+    return input;
+}
+
 gboolean
 mon_refresh_display(gpointer user_data) 
 {
-    xmlNode *cib_copy = copy_xml(current_cib);
-    pe_working_set_t data_set;
-
     last_refresh = time(NULL);
-    
-    if(cli_config_update(&cib_copy, NULL, FALSE) == FALSE) {
-	if(cib) {
-	    cib->cmds->signoff(cib);
+
+    if(mon_data_valid == FALSE || mon_pending != mon_refresh_none) {
+	xmlNode *input = mon_build_input();
+
+	if(input == NULL) {
+	    if(cib) {
+		cib->cmds->signoff(cib);
+	    }
+	    print_as("Upgrade failed: %s", cib_error2string(cib_dtd_validation));
+	    if(as_console) { sleep(2); }
+	    clean_up(LSB_EXIT_GENERIC);
+	    return FALSE;
+	}
+	
+	if(mon_data_valid) {
+	    cleanup_calculations(&mon_data_set);
 	}
-	print_as("Upgrade failed: %s", cib_error2string(cib_dtd_validation));
-	if(as_console) { sleep(2); }
-	clean_up(LSB_EXIT_GENERIC);
-	return FALSE;
-    }
 
-    set_working_set_defaults(&data_set);
-    data_set.input = cib_copy;
-    cluster_status(&data_set);	
+	/* TODO: apply node_state and lrm_rsc_op changes to the rows they
+	 * affect instead of unpacking everything again.  That needs a way
+	 * to reset one node's contribution to each resource's state in
+	 * libpe_status (running_on, role, failure flags and which instance
+	 * of an anonymous clone a node's history belongs to), which it
+	 * doesn't have yet.
+	 */
+	set_working_set_defaults(&mon_data_set);
+	mon_data_set.input = input;
+	cluster_status(&mon_data_set);
+	
+	mon_data_valid = TRUE;
+	mon_pending = mon_refresh_none;
+    }
 
     if(as_html_file || web_cgi) {
-	if (print_html_status(&data_set, as_html_file, web_cgi) != 0) {
+	if (print_html_status(&mon_data_set, as_html_file, web_cgi) != 0) {
 	    fprintf(stderr, "Critical: Unable to output html file\n");
 	    clean_up(LSB_EXIT_GENERIC);
 	}
@@ -1797,16 +1948,15 @@ mon_refresh_display(gpointer user_data)
 	/* do nothing */
 
     } else if (simple_status) {
-	print_simple_status(&data_set);
+	print_simple_status(&mon_data_set);
 	if (has_warnings) {
 	    clean_up(LSB_EXIT_GENERIC);
 	}
 	
     } else {
-	print_status(&data_set);
+	print_status(&mon_data_set);
     }
     
-    cleanup_calculations(&data_set);
     return TRUE;
 }
 
@@ -1838,6 +1988,13 @@ void clean_up(int rc)
 	cib = NULL;
     }
 
+    if(mon_data_valid) {
+	mon_data_valid = FALSE;
+	cleanup_calculations(&mon_data_set);
+    }
+    free_xml(mon_config);
+    mon_config = NULL;
+
     crm_free(as_html_file);
     crm_free(xml_file);
     crm_free(pid_file);
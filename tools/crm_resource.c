@@ -96,6 +96,8 @@ start_mainloop(void)
     g_main_run(mainloop);
 }
 
+static void cleanup_replied(xmlNode *msg);
+
 static gboolean
 resource_ipc_callback(IPC_Channel * server, void *private_data)
 {
@@ -116,6 +118,7 @@ resource_ipc_callback(IPC_Channel * server, void *private_data)
 	lpc++;
 	fprintf(stderr, ".");
 	crm_log_xml(LOG_DEBUG_2, "[inbound]", msg);
+	cleanup_replied(msg);
 
 	crmd_replies_needed--;
 	if(crmd_replies_needed == 0) {
@@ -594,39 +597,44 @@ dump_resource_prop(
 	return cib_NOTEXISTS;
 }
 
+static xmlNode *
+create_lrm_rsc_data(void) 
+{
+	char *key = crm_concat("0:0:crm-resource", our_pid, '-');
+	xmlNode *msg_data = create_xml_node(NULL, XML_GRAPH_TAG_RSC_OP);
+	xmlNode *params = NULL;
+
+	crm_xml_add(msg_data, XML_ATTR_TRANSITION_KEY, key);
+	crm_free(key);
+	
+	params = create_xml_node(msg_data, XML_TAG_ATTRS);
+	crm_xml_add(params, XML_ATTR_CRM_VERSION, CRM_FEATURE_SET);
+
+	key = crm_meta_name(XML_LRM_ATTR_INTERVAL);
+	crm_xml_add(params, key, "60000"); /* 1 minute */
+	crm_free(key);
+
+	return msg_data;
+}
+
 static int
-send_lrm_rsc_op(IPC_Channel *crmd_channel, const char *op,
-		const char *host_uname, const char *rsc_id,
-		gboolean only_failed, pe_working_set_t *data_set)
+add_lrm_rsc_xml(xmlNode *msg_data, resource_t *rsc)
 {
-	char *key = NULL;
-	int rc = cib_send_failed;
-	xmlNode *cmd = NULL;
-	xmlNode *xml_rsc = NULL;
 	const char *value = NULL;
-	xmlNode *params = NULL;
-	xmlNode *msg_data = NULL;
-	resource_t *rsc = pe_find_resource(data_set->resources, rsc_id);
+	xmlNode *xml_rsc = NULL;
 
-	if(rsc == NULL) {
-		CMD_ERR("Resource %s not found\n", rsc_id);
+	value = crm_element_value(rsc->xml, XML_ATTR_TYPE);
+	if(value == NULL) {
+		CMD_ERR("%s has no type!  Aborting...\n", rsc->id);
 		return cib_NOTEXISTS;
+	}
 
-	} else if(rsc->variant != pe_native) {
-		CMD_ERR("We can only process primitive resources, not %s\n", rsc_id);
-		return cib_invalid_argument;
-
-	} else if(host_uname == NULL) {
-		CMD_ERR("Please supply a hostname with -H\n");
-		return cib_invalid_argument;
+	value = crm_element_value(rsc->xml, XML_AGENT_ATTR_CLASS);
+	if(value == NULL) {
+		CMD_ERR("%s has no class!  Aborting...\n", rsc->id);
+		return cib_NOTEXISTS;
 	}
-	
-	key = crm_concat("0:0:crm-resource", our_pid, '-');
-	
-	msg_data = create_xml_node(NULL, XML_GRAPH_TAG_RSC_OP);
-	crm_xml_add(msg_data, XML_ATTR_TRANSITION_KEY, key);
-	crm_free(key);
-	
+
 	xml_rsc = create_xml_node(msg_data, XML_CIB_TAG_RESOURCE);
 	if(rsc->clone_name) {
 	    crm_xml_add(xml_rsc, XML_ATTR_ID, rsc->clone_name);
@@ -637,36 +645,22 @@ send_lrm_rsc_op(IPC_Channel *crmd_channel, const char *op,
 	    crm_xml_add(xml_rsc, XML_ATTR_ID_LONG, rsc->long_name);
 	}
 	
-	value = crm_element_value(rsc->xml, XML_ATTR_TYPE);
-	crm_xml_add(xml_rsc, XML_ATTR_TYPE, value);
-	if(value == NULL) {
-		CMD_ERR("%s has no type!  Aborting...\n", rsc_id);
-		return cib_NOTEXISTS;
-	}
-
-	value = crm_element_value(rsc->xml, XML_AGENT_ATTR_CLASS);
+	crm_xml_add(xml_rsc, XML_ATTR_TYPE, crm_element_value(rsc->xml, XML_ATTR_TYPE));
 	crm_xml_add(xml_rsc, XML_AGENT_ATTR_CLASS, value);
-	if(value == NULL) {
-		CMD_ERR("%s has no class!  Aborting...\n", rsc_id);
-		return cib_NOTEXISTS;
-	}
-
-	value = crm_element_value(rsc->xml, XML_AGENT_ATTR_PROVIDER);
-	crm_xml_add(xml_rsc, XML_AGENT_ATTR_PROVIDER, value);
-
-	params = create_xml_node(msg_data, XML_TAG_ATTRS);
-	crm_xml_add(params, XML_ATTR_CRM_VERSION, CRM_FEATURE_SET);
-
-	key = crm_meta_name(XML_LRM_ATTR_INTERVAL);
-	crm_xml_add(params, key, "60000"); /* 1 minute */
-	crm_free(key);
-	
-	cmd = create_request(op, msg_data, host_uname,
-			     CRM_SYSTEM_CRMD, crm_system_name, our_pid);
+	crm_xml_add(xml_rsc, XML_AGENT_ATTR_PROVIDER,
+		    crm_element_value(rsc->xml, XML_AGENT_ATTR_PROVIDER));
+	return cib_ok;
+}
 
-/* 	crm_log_xml_warn(cmd, "send_lrm_rsc_op"); */	
-	free_xml(msg_data);
+static int
+send_lrm_request(IPC_Channel *crmd_channel, const char *op,
+		 const char *host_uname, xmlNode *msg_data) 
+{
+	int rc = cib_send_failed;
+	xmlNode *cmd = create_request(op, msg_data, host_uname,
+				      CRM_SYSTEM_CRMD, crm_system_name, our_pid);
 
+/* 	crm_log_xml_warn(cmd, "send_lrm_request"); */	
 	if(send_ipc_message(crmd_channel, cmd)) {
 	    rc = 0;
 	    
@@ -675,48 +669,186 @@ send_lrm_rsc_op(IPC_Channel *crmd_channel, const char *op,
 	}
 	
 	free_xml(cmd);
+	return rc;
+}
+
+static int
+send_lrm_rsc_op(IPC_Channel *crmd_channel, const char *op,
+		const char *host_uname, const char *rsc_id,
+		gboolean only_failed, pe_working_set_t *data_set)
+{
+	int rc = cib_ok;
+	xmlNode *msg_data = NULL;
+	resource_t *rsc = pe_find_resource(data_set->resources, rsc_id);
+
+	if(rsc == NULL) {
+		CMD_ERR("Resource %s not found\n", rsc_id);
+		return cib_NOTEXISTS;
+
+	} else if(rsc->variant != pe_native) {
+		CMD_ERR("We can only process primitive resources, not %s\n", rsc_id);
+		return cib_invalid_argument;
+
+	} else if(host_uname == NULL) {
+		CMD_ERR("Please supply a hostname with -H\n");
+		return cib_invalid_argument;
+	}
+	
+	msg_data = create_lrm_rsc_data();
+	rc = add_lrm_rsc_xml(msg_data, rsc);
+	if(rc == cib_ok) {
+	    rc = send_lrm_request(crmd_channel, op, host_uname, msg_data);
+	}
 
+	free_xml(msg_data);
 	return rc;
 }
 
+/*
+ * Cleanups are collected per node and sent as a single
+ * CRM_OP_LRM_BULK_DELETE request, which the crmd turns into one LRM
+ * pass and one CIB update no matter how many resources are involved.
+ *
+ * Older crmds ignore that request without replying.  Nodes that haven't
+ * answered within bulk_timeout_ms are sent the old CRM_OP_LRM_DELETE
+ * request for each resource instead.
+ */
+#define bulk_timeout_ms 15*1000
+
+/* host -> the resources sent to it, until it replies */
+static GHashTable *bulk_cleanups = NULL;
+
+static void
+free_lrm_cleanup(gpointer data)
+{
+    xmlNode *msg_data = data;
+    free_xml(msg_data);
+}
+
+static void
+cleanup_replied(xmlNode *msg)
+{
+    const char *host_uname = crm_element_value(msg, F_CRM_HOST_FROM);
+    
+    if(bulk_cleanups != NULL && host_uname != NULL
+       && safe_str_eq(crm_element_value(msg, F_CRM_TASK), CRM_OP_INVOKE_LRM)) {
+	g_hash_table_remove(bulk_cleanups, host_uname);
+    }
+}
+
+static gboolean
+send_lrm_deletes(gpointer key, gpointer value, gpointer user_data)
+{
+    const char *host_uname = key;
+    xmlNode *bulk_data = value;
+    IPC_Channel *crmd_channel = user_data;
+
+    CMD_ERR("\nNo reply from %s to the bulk cleanup, cleaning up one resource at a time\n",
+	    host_uname);
+
+    /* The bulk request was expected to produce a single reply */
+    crmd_replies_needed--;
+    xml_child_iter_filter(
+	bulk_data, xml_rsc, XML_CIB_TAG_RESOURCE,
+
+	xmlNode *msg_data = create_lrm_rsc_data();
+	add_node_copy(msg_data, xml_rsc);
+	if(send_lrm_request(crmd_channel, CRM_OP_LRM_DELETE, host_uname, msg_data) == cib_ok) {
+	    crmd_replies_needed++;
+	}
+	free_xml(msg_data);
+	);
+    return TRUE;
+}
+
+static gboolean
+bulk_cleanup_timeout(gpointer data)
+{
+    g_hash_table_foreach_remove(bulk_cleanups, send_lrm_deletes, data);
+    if(crmd_replies_needed <= 0) {
+	CMD_ERR("\nCould not send any of the individual cleanup requests\n");
+	exit(1);
+    }
+    return FALSE;
+}
+
 static int
-delete_lrm_rsc(IPC_Channel *crmd_channel, const char *host_uname,
-	       resource_t *rsc, pe_working_set_t *data_set)
+collect_lrm_rsc(GHashTable *cleanups, const char *host_uname,
+		resource_t *rsc, pe_working_set_t *data_set)
 {
-    int rc = cib_ok;
+    xmlNode *msg_data = NULL;
     
     if(rsc == NULL) {
 	return cib_NOTEXISTS;
 
     } else if(rsc->children) {
 	slist_iter(child, resource_t, rsc->children, lpc,
-		   delete_lrm_rsc(crmd_channel, host_uname, child, data_set));
+		   collect_lrm_rsc(cleanups, host_uname, child, data_set));
 	return cib_ok;
 
     } else if(host_uname == NULL) {
 	slist_iter(node, node_t, data_set->nodes, lpc,
 		   if(node->details->online) {
-		       delete_lrm_rsc(crmd_channel, node->details->uname, rsc, data_set);
+		       collect_lrm_rsc(cleanups, node->details->uname, rsc, data_set);
 		   }
 	    );
 	return cib_ok;	
     }
 
+    msg_data = g_hash_table_lookup(cleanups, host_uname);
+    if(msg_data == NULL) {
+	msg_data = create_lrm_rsc_data();
+	g_hash_table_insert(cleanups, (gpointer)host_uname, msg_data);
+    }
+
     printf("Cleaning up %s on %s\n", rsc->id, host_uname);
-    rc = send_lrm_rsc_op(crmd_channel, CRM_OP_LRM_DELETE, host_uname, rsc->id, TRUE, data_set);
-    if(rc == cib_ok) {
-	char *attr_name = NULL;
-	const char *id = rsc->id;
+    return add_lrm_rsc_xml(msg_data, rsc);
+}
 
-	crmd_replies_needed++;
-	if(rsc->clone_name) {
-	    id = rsc->clone_name;
-	}
-	
-	attr_name = crm_concat("fail-count", id, '-');
+static void
+send_lrm_cleanup(gpointer key, gpointer value, gpointer user_data)
+{
+    const char *host_uname = key;
+    xmlNode *msg_data = value;
+    IPC_Channel *crmd_channel = user_data;
+
+    if(find_xml_node(msg_data, XML_CIB_TAG_RESOURCE, FALSE) == NULL) {
+	return;
+
+    } else if(send_lrm_request(crmd_channel, CRM_OP_LRM_BULK_DELETE, host_uname, msg_data) != cib_ok) {
+	return;
+    }
+
+    crmd_replies_needed++;
+    if(bulk_cleanups == NULL) {
+	bulk_cleanups = g_hash_table_new_full(
+	    g_str_hash, g_str_equal, g_hash_destroy_str, free_lrm_cleanup);
+	g_timeout_add(bulk_timeout_ms, bulk_cleanup_timeout, crmd_channel);
+    }
+    g_hash_table_insert(bulk_cleanups, crm_strdup(host_uname), copy_xml(msg_data));
+
+    xml_child_iter_filter(
+	msg_data, xml_rsc, XML_CIB_TAG_RESOURCE,
+	char *attr_name = crm_concat("fail-count", ID(xml_rsc), '-');
 	attrd_lazy_update('D', host_uname, attr_name, NULL, XML_CIB_TAG_STATUS, NULL, NULL);
 	crm_free(attr_name);
+	);
+}
+
+static int
+delete_lrm_rsc(IPC_Channel *crmd_channel, const char *host_uname,
+	       resource_t *rsc, pe_working_set_t *data_set)
+{
+    int rc = cib_ok;
+    GHashTable *cleanups = g_hash_table_new_full(
+	g_str_hash, g_str_equal, NULL, free_lrm_cleanup);
+
+    rc = collect_lrm_rsc(cleanups, host_uname, rsc, data_set);
+    if(rc == cib_ok) {
+	g_hash_table_foreach(cleanups, send_lrm_cleanup, crmd_channel);
     }
+
+    g_hash_table_destroy(cleanups);
     return rc;
 }
 
@@ -60,7 +60,8 @@ gboolean is_node_online(xmlNode *node_state);
 enum debug {
 	debug_none,
 	debug_dec,
-	debug_inc
+	debug_inc,
+	debug_dump
 };
 
 gboolean BE_VERBOSE = FALSE;
@@ -68,6 +69,7 @@ int expected_responses = 1;
 
 gboolean BASH_EXPORT      = FALSE;
 gboolean DO_HEALTH        = FALSE;
+gboolean DO_FSA_STATS     = FALSE;
 gboolean DO_RESET         = FALSE;
 gboolean DO_RESOURCE      = FALSE;
 gboolean DO_ELECT_DC      = FALSE;
@@ -102,8 +104,11 @@ static struct crm_option long_options[] = {
     /* daemon options */
     {"debug_inc", 1, 0, 'i', "Increase the crmd's debug level on the specified host"},
     {"debug_dec", 1, 0, 'd', "Decrease the crmd's debug level on the specified host"},
+    {"blackbox",  1, 0, 'b', "Have the crmd on the specified host write its recent log history (including debug messages) to "CRM_STATE_DIR". The crmd must have been started with PCMK_blackbox=yes"},
     {"status",    1, 0, 'S', "Display the status of the specified node." },
     {"-spacer-",  1, 0, '-', "\n\tResult is the node's internal FSM state which can be useful for debugging\n"},
+    {"fsa_stats", 1, 0, 'T', "Display how long the crmd on the specified node spends queueing and handling each FSA input and action."},
+    {"-spacer-",  1, 0, '-', "\n\tTimes are in microseconds and accumulate from when the crmd started\n"},
     {"dc_lookup", 0, 0, 'D', "Display the uname of the node co-ordinating the cluster."},
     {"-spacer-",  1, 0, '-', "\n\tThis is an internal detail and is rarely useful to administrators except when deciding on which node to examine the logs.\n"},
     {"nodes",     0, 0, 'N', "\tDisplay the uname of all member nodes"},
@@ -129,7 +134,7 @@ main(int argc, char **argv)
 	int flag;
 
 	crm_log_init(basename(argv[0]), LOG_ERR, FALSE, TRUE, argc, argv);
-	crm_set_options("V?$K:S:HE:Dd:i:Nqt:B", "command [options]", long_options,
+	crm_set_options("V?$K:S:T:HE:Dd:i:b:Nqt:B", "command [options]", long_options,
 			"Development tool for performing some crmd-specific commands."
 			"\n  Likely to be replaced by crm_node in the future" );
 	if(argc < 2) {
@@ -184,11 +189,21 @@ main(int argc, char **argv)
 				crm_debug_2("Option %c => %s", flag, optarg);
 				dest_node = crm_strdup(optarg);
 				break;
+			case 'b':
+				DO_DEBUG = debug_dump;
+				crm_debug_2("Option %c => %s", flag, optarg);
+				dest_node = crm_strdup(optarg);
+				break;
 			case 'S':
 				DO_HEALTH = TRUE;
 				crm_debug_2("Option %c => %s", flag, optarg);
 				dest_node = crm_strdup(optarg);
 				break;
+			case 'T':
+				DO_FSA_STATS = TRUE;
+				crm_debug_2("Option %c => %s", flag, optarg);
+				dest_node = crm_strdup(optarg);
+				break;
 			case 'E':
 				DO_ELECT_DC = TRUE;
 				break;
@@ -283,6 +298,11 @@ do_work(void)
 			all_is_good = FALSE;
 		}		
 		
+	} else if(DO_FSA_STATS) {
+		sys_to = CRM_SYSTEM_CRMD;
+		crmd_operation = CRM_OP_FSA_STATS;
+		crm_xml_add(msg_options, XML_ATTR_TIMEOUT, "0");
+
 	} else if(DO_ELECT_DC) {
 		/* tell the local node to initiate an election */
 
@@ -355,6 +375,13 @@ do_work(void)
 		
 		ret = 0; /* no return message */
 		
+	} else if(DO_DEBUG == debug_dump) {
+		/* tell dest_node to dump its blackbox to disk */
+		sys_to = CRM_SYSTEM_CRMD;
+		crmd_operation = CRM_OP_BLACKBOX;
+		
+		ret = 0; /* no return message */
+		
 	} else {
 		crm_err("Unknown options");
 		all_is_good = FALSE;
@@ -432,6 +459,43 @@ do_init(void)
 	return FALSE;
 }
 
+static void
+print_fsa_timing(xmlNode *timing)
+{
+	unsigned long long count = 0;
+	unsigned long long wait_total = 0;
+	unsigned long long run_total = 0;
+	const char *value = NULL;
+
+	value = crm_element_value(timing, "run_count");
+	if(value != NULL) {
+		count = crm_int_helper(value, NULL);
+	}
+	if(count == 0) {
+		return;
+	}
+	
+	value = crm_element_value(timing, "wait_total");
+	if(value != NULL) {
+		wait_total = crm_int_helper(value, NULL);
+	}
+	value = crm_element_value(timing, "run_total");
+	if(value != NULL) {
+		run_total = crm_int_helper(value, NULL);
+	}
+
+	if(safe_str_eq(crm_element_name(timing), "fsa_input")) {
+		printf("%-26s %10llu %12llu %12s %12llu %12s\n",
+		       ID(timing), count, wait_total / count,
+		       crm_element_value(timing, "wait_max"),
+		       run_total / count, crm_element_value(timing, "run_max"));
+	} else {
+		printf("%-26s %10llu %12s %12s %12llu %12s\n",
+		       ID(timing), count, "-", "-",
+		       run_total / count, crm_element_value(timing, "run_max"));
+	}
+}
+
 gboolean
 admin_msg_callback(IPC_Channel * server, void *private_data)
 {
@@ -498,6 +562,18 @@ admin_msg_callback(IPC_Channel * server, void *private_data)
 				fprintf(stderr, "%s\n", state);
 			}
 			
+		} else if(DO_FSA_STATS) {
+			xmlNode *data = get_message_xml(xml, F_CRM_DATA);
+
+			printf("FSA timings for %s (usec):\n",
+			       crm_element_value(xml, F_CRM_HOST_FROM));
+			printf("%-26s %10s %12s %12s %12s %12s\n", "Input/Action",
+			       "Count", "Avg wait", "Max wait", "Avg run", "Max run");
+			xml_child_iter(
+				data, child,
+				print_fsa_timing(child);
+				);
+			
 		} else if(DO_WHOIS_DC) {
 			const char *dc = crm_element_value(xml, F_CRM_HOST_FROM);
 			
@@ -92,31 +92,58 @@ int re_ping_interval = 1000; /* 1s */
 
 int ident;		/* our pid */
 
-unsigned char cmsgbuf[4096];
-int cmsglen = 0;
+/* One raw socket per address family, shared by all ping nodes */
+int ping_fd4 = -1;
+int ping_fd6 = -1;
 
 typedef struct ping_node_s {
         int    			fd;		/* ping socket */
 	uint16_t		iseq;		/* sequence number */
 	gboolean		type;
-	gboolean		extra_filters;
+	gboolean		pending;	/* waiting for a reply this round */
+	gboolean		alive;		/* result of the last round */
+	int			attempts;	/* echo requests sent this round */
+	int			slot;		/* timer wheel slot (-1 = none) */
+	int			laps;		/* wheel revolutions left */
 	union {
 		struct sockaddr     raw;
 		struct sockaddr_in  v4;   	/* ipv4 ping addr */
 		struct sockaddr_in6 v6;   	/* ipv6 ping addr */
 	} addr;
+	union {
+		struct cmsghdr      hdr;
+		unsigned char       buf[64];	/* IP(V6)_PKTINFO for host%iface */
+	} ctl;
+	int			ctl_len;
 	char			dest[256];
 	char			*host;
 } ping_node;
 
+/*
+ * Echo requests for a round are sent to every host at once and timed
+ * out by a hashed timer wheel: each outstanding host sits in the slot
+ * its current attempt expires in.  Retries are spread across
+ * ping_timeout so that a whole round completes within it.
+ */
+#define WHEEL_SLOTS	64
+#define WHEEL_TICK_MS	100
+
+static GListPtr ping_wheel[WHEEL_SLOTS];
+static int wheel_now = 0;
+static guint wheel_timer = 0;
+
+static GHashTable *ping_pending = NULL;	/* sequence number -> ping_node */
+static uint16_t ping_seq = 0;
+static gboolean round_in_progress = FALSE;
+static int round_outstanding = 0;
+static int round_active = 0;
+
 void pingd_nstatus_callback(
 	const char *node, const char *status, void *private_data);
 void pingd_lstatus_callback(
 	const char *node, const char *link, const char *status,
 	void *private_data);
 void send_update(int active);
-int process_icmp6_error(ping_node *node, struct sockaddr_in6 *whereto);
-int process_icmp4_error(ping_node *node, struct sockaddr_in *whereto);
 
 /*
  * in_cksum --
@@ -328,9 +355,21 @@ static const char *ping_desc(gboolean family, uint8_t type, uint8_t code)
 	}
 }
 
+static ping_node *
+ping_find(uint16_t seq)
+{
+    if(ping_pending == NULL) {
+	return NULL;
+    }
+    return g_hash_table_lookup(ping_pending, GINT_TO_POINTER((int)seq));
+}
+
 #ifdef ON_LINUX
 #  define MAX_HOST 1024
-int process_icmp6_error(ping_node *node, struct sockaddr_in6 *whereto)
+/* Process one entry from the socket's error queue
+ * Returns FALSE once the queue is empty
+ */
+static gboolean process_icmp6_error(int fd)
 {
     int rc = 0;
     char buf[512];
@@ -340,6 +379,7 @@ int process_icmp6_error(ping_node *node, struct sockaddr_in6 *whereto)
     struct sockaddr_in6 target;
     struct cmsghdr *cmsg = NULL;
     struct sock_extended_err *s_err = NULL;
+    ping_node *node = NULL;
 
     iov.iov_base = &icmph;
     iov.iov_len = sizeof(icmph);
@@ -351,10 +391,10 @@ int process_icmp6_error(ping_node *node, struct sockaddr_in6 *whereto)
     msg.msg_control = buf;
     msg.msg_controllen = sizeof(buf);
 
-    rc = recvmsg(node->fd, &msg, MSG_ERRQUEUE|MSG_DONTWAIT);
+    rc = recvmsg(fd, &msg, MSG_ERRQUEUE|MSG_DONTWAIT);
     if (rc < 0 || rc < sizeof(icmph)) {
-	crm_perror(LOG_DEBUG, "No error message: %d", rc);
-	return 0;
+	crm_debug_3("No error message: %d", rc);
+	return FALSE;
     }
 
     for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
@@ -363,7 +403,7 @@ int process_icmp6_error(ping_node *node, struct sockaddr_in6 *whereto)
 	}
     }
 
-    CRM_ASSERT(s_err != NULL);
+    CRM_CHECK(s_err != NULL, return TRUE);
 
     if (s_err->ee_origin == SO_EE_ORIGIN_LOCAL) {
 	if (s_err->ee_errno == EMSGSIZE) {
@@ -371,42 +411,43 @@ int process_icmp6_error(ping_node *node, struct sockaddr_in6 *whereto)
 	} else {
 	    crm_info("local error: %s", strerror(s_err->ee_errno));
 	}
-	return 0;
 
     } else if (s_err->ee_origin == SO_EE_ORIGIN_ICMP6) {
 	struct sockaddr_in6 *sin = (struct sockaddr_in6*)(s_err+1);	
-	const char *ping_result = ping_desc(node->type, s_err->ee_type, s_err->ee_code);
-	static char target_s[64], whereto_s[64], ping_host_s[64];
+	const char *ping_result = ping_desc(AF_INET6, s_err->ee_type, s_err->ee_code);
+	static char target_s[64], ping_host_s[64];
 	inet_ntop(AF_INET6, (struct in6_addr *)&(target.sin6_addr), target_s, sizeof(target_s));
-	inet_ntop(AF_INET6, (struct in6_addr *)&(whereto->sin6_addr), whereto_s, sizeof(whereto_s));
 
 	if (ntohs(icmph.icmp6_id) != ident) {
 	    /* Result was not for us */
 	    crm_debug("Not our error (ident): %d %d", ntohs(icmph.icmp6_id), ident);
-	    return -1;
+	    return TRUE;
+	}
 
-	} else if (memcmp(&target.sin6_addr, &whereto->sin6_addr, 16)) {
+	node = ping_find(ntohs(icmph.icmp6_seq));
+	if (node == NULL || memcmp(&target.sin6_addr, &node->addr.v6.sin6_addr, 16)) {
 	    /* Result was not for us */
-	    crm_debug("Not our error (addr): %s %s", target_s, whereto_s);
-	    return -1;
+	    crm_debug("Not our error (addr): %s", target_s);
+	    return TRUE;
 
 	} else if (icmph.icmp6_type != ICMP6_ECHO_REQUEST) {
 	    /* Not an error */
 	    crm_info("Not an error: %d", icmph.icmp6_type);
-	    return -1;
+	    return TRUE;
 	}
 
 	inet_ntop(AF_INET6, (struct in6_addr *)&(sin->sin6_addr), ping_host_s, sizeof(ping_host_s));
-	crm_debug("From %s icmp_seq=%u %s", ping_host_s, ntohs(icmph.icmp6_seq), ping_result);
+	crm_debug("From %s icmp_seq=%u %s (pinging %s)",
+		  ping_host_s, ntohs(icmph.icmp6_seq), ping_result, node->host);
 
     } else {
 	crm_debug("else: %d", s_err->ee_origin);
     }
 
-    return 0;
+    return TRUE;
 }
 
-int process_icmp4_error(ping_node *node, struct sockaddr_in *whereto)
+static gboolean process_icmp4_error(int fd)
 {
     int rc = 0;
     char buf[512];
@@ -416,6 +457,8 @@ int process_icmp4_error(ping_node *node, struct sockaddr_in *whereto)
     struct sockaddr_in target;
     struct cmsghdr *cmsg = NULL;
     struct sock_extended_err *s_err = NULL;
+    ping_node *node = NULL;
+    static gboolean extra_filters = FALSE;
 
     iov.iov_base = &icmph;
     iov.iov_len = sizeof(icmph);
@@ -427,10 +470,10 @@ int process_icmp4_error(ping_node *node, struct sockaddr_in *whereto)
     msg.msg_control = buf;
     msg.msg_controllen = sizeof(buf);
     
-    rc = recvmsg(node->fd, &msg, MSG_ERRQUEUE|MSG_DONTWAIT);
+    rc = recvmsg(fd, &msg, MSG_ERRQUEUE|MSG_DONTWAIT);
     if (rc < 0 || rc < sizeof(icmph)) {
-	crm_perror(LOG_DEBUG, "No error message: %d", rc);
-	return 0;
+	crm_debug_3("No error message: %d", rc);
+	return FALSE;
     }
 	
     for (cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
@@ -439,7 +482,7 @@ int process_icmp4_error(ping_node *node, struct sockaddr_in *whereto)
 	}
     }
 
-    CRM_ASSERT(s_err != NULL);
+    CRM_CHECK(s_err != NULL, return TRUE);
     
     if (s_err->ee_origin == SO_EE_ORIGIN_LOCAL) {
 	if (s_err->ee_errno == EMSGSIZE) {
@@ -447,67 +490,67 @@ int process_icmp4_error(ping_node *node, struct sockaddr_in *whereto)
 	} else {
 	    crm_info("local error: %s", strerror(s_err->ee_errno));
 	}
-	return 0;
 	
     } else if (s_err->ee_origin == SO_EE_ORIGIN_ICMP) {
 	char ping_host[MAX_HOST];
 	struct sockaddr_in *sin = (struct sockaddr_in*)(s_err+1);	
-	const char *ping_result = ping_desc(node->type, s_err->ee_type, s_err->ee_code);
+	const char *ping_result = ping_desc(AF_INET, s_err->ee_type, s_err->ee_code);
 	char *target_s = inet_ntoa(*(struct in_addr *)&(target.sin_addr.s_addr));
-	char *whereto_s = inet_ntoa(*(struct in_addr *)&(whereto->sin_addr.s_addr));
 	
 	if (ntohs(icmph.un.echo.id) != ident) {
 	    /* Result was not for us */
 	    crm_debug("Not our error (ident): %d %d", ntohs(icmph.un.echo.id), ident);
-	    return -1;
+	    return TRUE;
+	}
 
-	} else if (safe_str_neq(target_s, whereto_s)) {
+	node = ping_find(ntohs(icmph.un.echo.sequence));
+	if (node == NULL || target.sin_addr.s_addr != node->addr.v4.sin_addr.s_addr) {
 	    /* Result was not for us */
-	    crm_debug("Not our error (addr): %s %s", target_s, whereto_s);
-	    return -1;
+	    crm_debug("Not our error (addr): %s", target_s);
+	    return TRUE;
 
 	} else if (icmph.type != ICMP_ECHO) {
 	    /* Not an error */
 	    crm_info("Not an error: %d", icmph.type);
-	    return -1;
+	    return TRUE;
 	}
 	
-	/* snprintf(ping_host, MAX_HOST, "%s", inet_ntoa(*(struct in_addr *)&(sin->sin_addr.s_addr))); */
 	snprintf(ping_host, MAX_HOST, "%s", inet_ntoa(sin->sin_addr));
 	
-	if (node->extra_filters == FALSE) {
+	if (extra_filters == FALSE) {
 	    /* Now that we got some sort of reply, add extra filters to
 	     * ensure we keep getting the _right_ replies for dead hosts
 	     */
 	    struct icmp_filter filt;
 	    crm_debug("Installing additional ICMP filters");
-	    node->extra_filters = TRUE; /* only try once */
+	    extra_filters = TRUE; /* only try once */
 	    
 	    filt.data = ~((1<<ICMP_SOURCE_QUENCH) | (1<<ICMP_REDIRECT) | (1<<ICMP_ECHOREPLY));
-	    if (setsockopt(node->fd, SOL_RAW, ICMP_FILTER, (char*)&filt, sizeof(filt)) == -1) {
+	    if (setsockopt(fd, SOL_RAW, ICMP_FILTER, (char*)&filt, sizeof(filt)) == -1) {
 		crm_perror(LOG_WARNING, "setsockopt failed: Cannot install ICMP filters for %s", ping_host);
 	    }
 	}
 	
-	crm_debug("From %s icmp_seq=%u %s", ping_host, ntohs(icmph.un.echo.sequence), ping_result);
+	crm_debug("From %s icmp_seq=%u %s (pinging %s)",
+		  ping_host, ntohs(icmph.un.echo.sequence), ping_result, node->host);
 
     } else {
 	crm_debug("else: %d", s_err->ee_origin);
     }
     
-    return 0;
+    return TRUE;
 }
 #else
-int process_icmp6_error(ping_node *node, struct sockaddr_in6 *whereto) 
+static gboolean process_icmp6_error(int fd) 
 {
     /* dummy function */
-    return 0;
+    return FALSE;
 }
 
-int process_icmp4_error(ping_node *node, struct sockaddr_in *whereto) 
+static gboolean process_icmp4_error(int fd) 
 {
     /* dummy function */
-    return 0;
+    return FALSE;
 }
 #endif
 
@@ -523,12 +566,92 @@ static ping_node *ping_new(const char *host)
 	node->type = AF_INET;
     }
     
+    node->fd = -1;
+    node->slot = -1;
     node->host = crm_strdup(host);
     
     return node;
 }
 
-static gboolean ping_open(ping_node *node) 
+static gboolean ping_dispatch(int fd, gpointer user_data);
+
+static int ping_socket(int family)
+{
+    int flags = 0;
+    int *fd = &ping_fd4;
+    const char *name = "ICMP";
+
+    if(family == AF_INET6) {
+	fd = &ping_fd6;
+	name = "ICMPv6";
+    }
+
+    if(*fd >= 0) {
+	return *fd;
+    }
+
+    if(family == AF_INET6) {
+	*fd = socket(family, SOCK_RAW, IPPROTO_ICMPV6);
+    } else {
+	*fd = socket(family, SOCK_RAW, IPPROTO_ICMP);
+    }
+
+    if(*fd < 0) {
+	crm_perror(LOG_WARNING, "Can't open %s socket", name);
+	return -1;
+    }
+
+    flags = fcntl(*fd, F_GETFL);
+    if(flags < 0 || fcntl(*fd, F_SETFL, flags|O_NONBLOCK) < 0) {
+	crm_perror(LOG_WARNING, "Can't make the %s socket non-blocking", name);
+    }
+    
+    if(family == AF_INET6) {
+	/* set recv buf for broadcast pings */
+	int sockopt = 48 * 1024;
+	setsockopt(*fd, SOL_SOCKET, SO_RCVBUF, (char *) &sockopt, sizeof(sockopt));
+    }
+
+#ifdef ON_LINUX
+    {
+	int dummy = 1;
+
+	if(family == AF_INET6) {
+	    struct icmp6_filter filt;
+
+	    ICMP6_FILTER_SETBLOCKALL(&filt);
+	    ICMP6_FILTER_SETPASS(ICMP6_ECHO_REPLY, &filt);
+
+	    if (setsockopt(*fd, IPPROTO_ICMPV6, ICMP6_FILTER, (char*)&filt, sizeof(filt)) == -1) {
+		crm_perror(LOG_WARNING, "setsockopt failed: Cannot install ICMP6 filters");
+	    }
+	    setsockopt(*fd, SOL_IPV6, IPV6_RECVERR, (char *)&dummy, sizeof(dummy));
+
+	} else {
+	    struct icmp_filter filt;
+	    filt.data = ~((1<<ICMP_SOURCE_QUENCH)|
+			  (1<<ICMP_DEST_UNREACH)|
+			  (1<<ICMP_TIME_EXCEEDED)|
+			  (1<<ICMP_PARAMETERPROB)|
+			  (1<<ICMP_REDIRECT)|
+			  (1<<ICMP_ECHOREPLY));
+
+	    if (setsockopt(*fd, SOL_RAW, ICMP_FILTER, (char*)&filt, sizeof(filt)) == -1) {
+		crm_perror(LOG_WARNING, "setsockopt failed: Cannot install ICMP filters");
+	    }
+	    setsockopt(*fd, SOL_IP, IP_RECVERR, (char *)&dummy, sizeof(dummy));
+	}
+    }
+#endif    
+
+    G_main_add_fd(G_PRIORITY_HIGH, *fd, FALSE, ping_dispatch,
+		  GINT_TO_POINTER(family), NULL);
+
+    crm_debug_2("Opened %s socket", name);
+    return *fd;
+}
+
+static gboolean ping_resolve(ping_node *node) 
 {
     int ret_ga = 0;
     char *hostname = NULL;
@@ -575,121 +698,61 @@ static gboolean ping_open(ping_node *node)
     }
 	
     memcpy(&(node->addr.raw), res->ai_addr, res->ai_addrlen);
-    node->fd = socket(hints.ai_family, hints.ai_socktype, hints.ai_protocol);
-    /* node->fd = socket(res->ai_family, res->ai_socktype, res->ai_protocol); */
+    node->fd = ping_socket(node->type);
 
     if(node->fd < 0) {
-	crm_perror(LOG_WARNING, "Can't open socket to %s", hostname);
+	crm_warn("Can't ping %s: no socket", hostname);
 	goto bail;
     }
 
     if(node->type == AF_INET6) {
-	int sockopt;
-
 	inet_ntop(node->type, &node->addr.v6.sin6_addr, node->dest, sizeof(node->dest));
-	
-	/* set recv buf for broadcast pings */
-	sockopt = 48 * 1024;
-	setsockopt(node->fd, SOL_SOCKET, SO_RCVBUF, (char *) &sockopt, sizeof(sockopt));
-
     } else {
 	inet_ntop(node->type, &node->addr.v4.sin_addr, node->dest, sizeof(node->dest));
     }
 
-    if(ping_timeout > 0) {
-	struct timeval timeout_opt;
-
-	timeout_opt.tv_sec = ping_timeout;
-	timeout_opt.tv_usec = 0;
-	
-	setsockopt(node->fd, SOL_SOCKET, SO_RCVTIMEO, (char *) &timeout_opt, sizeof(timeout_opt));
-    }
+    node->ctl_len = 0;
+    memset(&node->ctl, 0, sizeof(node->ctl));
 
 #ifdef ON_LINUX
-    {
-	int dummy = 1;
+    if ((cp = strchr(node->host, '%'))) {
+	struct ifreq ifr;
+	struct cmsghdr *cmsg = &node->ctl.hdr;
 
-	memset(&cmsgbuf, 0, sizeof(cmsgbuf));
-	cmsglen = 0;
+	memset(&ifr, 0, sizeof(ifr));
+	cp++;
+	crm_debug("set interface: [%s]", cp);
+	strncpy(ifr.ifr_name, cp, IFNAMSIZ-1);
 
-	if(node->type == AF_INET6) {
-	    struct icmp6_filter filt;
+	if (ioctl(node->fd, SIOCGIFINDEX, &ifr) < 0) {
+	    crm_warn("unknown interface %s specified", cp);
 
-	    ICMP6_FILTER_SETBLOCKALL(&filt);
-	    ICMP6_FILTER_SETPASS(ICMP6_ECHO_REPLY, &filt);
+	} else if(node->type == AF_INET6) {
+	    struct in6_pktinfo *ipi;
+
+	    node->ctl_len = CMSG_SPACE(sizeof(*ipi));
+	    cmsg->cmsg_len = CMSG_LEN(sizeof(*ipi));
+	    cmsg->cmsg_level = SOL_IPV6;
+	    cmsg->cmsg_type = IPV6_PKTINFO;
+
+	    ipi = (struct in6_pktinfo*)CMSG_DATA(cmsg);
+	    ipi->ipi6_ifindex = ifr.ifr_ifindex;
 
-	    if (setsockopt(node->fd, IPPROTO_ICMPV6, ICMP6_FILTER, (char*)&filt, sizeof(filt)) == -1) {
-		crm_perror(LOG_WARNING, "setsockopt failed: Cannot install ICMP6 filters for %s", node->dest);
-	    }
-	    setsockopt(node->fd, SOL_IPV6, IPV6_RECVERR, (char *)&dummy, sizeof(dummy));
-
-	    if ((cp = strchr(node->host, '%'))) {
-		struct ifreq ifr;
-		struct cmsghdr *cmsg;
-		struct in6_pktinfo *ipi;
-
-		memset(&ifr, 0, sizeof(ifr));
-		cp++;
-		crm_debug("set interface: [%s]", cp);
-		strncpy(ifr.ifr_name, cp, IFNAMSIZ-1);
-
-		if (ioctl(node->fd, SIOCGIFINDEX, &ifr) >= 0) {
-		    cmsg = (struct cmsghdr*)cmsgbuf;
-		    cmsglen = CMSG_SPACE(sizeof(*ipi));
-		    cmsg->cmsg_len = CMSG_LEN(sizeof(*ipi));
-		    cmsg->cmsg_level = SOL_IPV6;
-		    cmsg->cmsg_type = IPV6_PKTINFO;
-
-		    ipi = (struct in6_pktinfo*)CMSG_DATA(cmsg);
-		    memset(ipi, 0, sizeof(*ipi));
-		    ipi->ipi6_ifindex = ifr.ifr_ifindex;
-		} else {
-		    crm_warn("unknown interface %s specified", cp);
-		}
-	    }
 	} else {
-	    struct icmp_filter filt;
-	    filt.data = ~((1<<ICMP_SOURCE_QUENCH)|
-			  (1<<ICMP_DEST_UNREACH)|
-			  (1<<ICMP_TIME_EXCEEDED)|
-			  (1<<ICMP_PARAMETERPROB)|
-			  (1<<ICMP_REDIRECT)|
-			  (1<<ICMP_ECHOREPLY));
+	    struct in_pktinfo *ipi;
 
-	    if (setsockopt(node->fd, SOL_RAW, ICMP_FILTER, (char*)&filt, sizeof(filt)) == -1) {
-		crm_perror(LOG_WARNING, "setsockopt failed: Cannot install ICMP filters for %s", node->dest);
-	    }
-	    setsockopt(node->fd, SOL_IP, IP_RECVERR, (char *)&dummy, sizeof(dummy));
-
-	    if ((cp = strchr(node->host, '%'))) {
-		struct ifreq ifr;
-		struct cmsghdr *cmsg;
-		struct in_pktinfo *ipi;
-
-		memset(&ifr, 0, sizeof(ifr));
-		cp++;
-		crm_debug("set interface: [%s]", cp);
-		strncpy(ifr.ifr_name, cp, IFNAMSIZ-1);
-
-		if (ioctl(node->fd, SIOCGIFINDEX, &ifr) >= 0) {
-		    cmsg = (struct cmsghdr*)cmsgbuf;
-		    cmsglen = CMSG_SPACE(sizeof(*ipi));
-		    cmsg->cmsg_len = CMSG_LEN(sizeof(*ipi));
-		    cmsg->cmsg_level = SOL_IP;
-		    cmsg->cmsg_type = IP_PKTINFO;
-
-		    ipi = (struct in_pktinfo*)CMSG_DATA(cmsg);
-		    memset(ipi, 0, sizeof(*ipi));
-		    ipi->ipi_ifindex = ifr.ifr_ifindex;
-		} else {
-		    crm_warn("unknown interface %s specified", cp);
-		}
-	    }
+	    node->ctl_len = CMSG_SPACE(sizeof(*ipi));
+	    cmsg->cmsg_len = CMSG_LEN(sizeof(*ipi));
+	    cmsg->cmsg_level = SOL_IP;
+	    cmsg->cmsg_type = IP_PKTINFO;
+
+	    ipi = (struct in_pktinfo*)CMSG_DATA(cmsg);
+	    ipi->ipi_ifindex = ifr.ifr_ifindex;
 	}
     }
 #endif    
     
-    crm_debug_2("Opened connection to %s", node->dest);
+    crm_debug_2("Resolved %s to %s", node->host, node->dest);
     freeaddrinfo(res);
     return TRUE;
 
@@ -700,43 +763,26 @@ static gboolean ping_open(ping_node *node)
     return FALSE;
 }
 
-static gboolean ping_close(ping_node *node)
-{
-    int tmp_fd = node->fd;
-    node->fd = -1;
-	
-    if (tmp_fd >= 0) {
-	if(close(tmp_fd) < 0) {
-	    crm_perror(LOG_ERR,"Could not close ping socket");
-	} else {
-	    tmp_fd = -1;
-	    crm_debug_2("Closed connection to %s", node->dest);
-	}
-    }
-    return (tmp_fd == -1);
-}
-
-#define MAXPACKETLEN	131072
 #define ICMP6ECHOLEN	8	/* icmp echo header len excluding time */
 #define ICMP6ECHOTMLEN  20
 #define	DEFDATALEN	ICMP6ECHOTMLEN
 #define	EXTRA		256	/* for AH and various other headers. weird. */
 #define	IP6LEN		40
 
-static int
-dump_v6_echo(ping_node *node, u_char *buf, int bytes, struct msghdr *hdr)
+static ping_node *
+dump_v6_echo(u_char *buf, int bytes, struct msghdr *hdr)
 {
-	int rc = -1; /* Try again */
 	int fromlen;
 	char from_host[1024];
 	
+	ping_node *node = NULL;
 	struct icmp6_hdr *icp;
 	struct sockaddr *from;
 
 	if (!hdr || !hdr->msg_name || hdr->msg_namelen != sizeof(struct sockaddr_in6)
 	    || ((struct sockaddr *)hdr->msg_name)->sa_family != AF_INET6) {
 	    crm_warn("Invalid echo peer");
-	    return rc;
+	    return NULL;
 	}
 
 	fromlen = hdr->msg_namelen;
@@ -745,46 +791,40 @@ dump_v6_echo(ping_node *node, u_char *buf, int bytes, struct msghdr *hdr)
 	
 	if (bytes < (int)sizeof(struct icmp6_hdr)) {
 	    crm_warn("Invalid echo packet (too short: %d bytes) from %s", bytes, from_host);
-	    return rc;
+	    return NULL;
 	}
 	icp = (struct icmp6_hdr *)buf;
 
-	if (icp->icmp6_type == ICMP6_ECHO_REPLY) {
-	    if (ident == ntohs(icp->icmp6_id)
-		&& node->iseq == ntohs(icp->icmp6_seq)) {
-		rc = 1; /* Alive */
-	    }
-
-	} else if(icp->icmp6_type != ICMP6_ECHO_REQUEST) {
-	    rc = process_icmp6_error(node, (struct sockaddr_in6*)&(node->addr));
+	if (icp->icmp6_type == ICMP6_ECHO_REPLY && ident == ntohs(icp->icmp6_id)) {
+	    node = ping_find(ntohs(icp->icmp6_seq));
 	}
 	
 	do_crm_log(LOG_DEBUG_2,
-		   "Echo from %s (exp=%d, seq=%d, id=%d, dest=%s, data=%s): %s",
-		   from_host, node->iseq, ntohs(icp->icmp6_seq),
-		   ntohs(icp->icmp6_id), node->dest, (char*)(buf + ICMP6ECHOLEN),
-		   ping_desc(node->type, icp->icmp6_type, icp->icmp6_code));
+		   "Echo from %s (seq=%d, id=%d, dest=%s, data=%s): %s",
+		   from_host, ntohs(icp->icmp6_seq), ntohs(icp->icmp6_id),
+		   node?node->dest:"-", (char*)(buf + ICMP6ECHOLEN),
+		   ping_desc(AF_INET6, icp->icmp6_type, icp->icmp6_code));
 	
-	return rc;
+	return node;
 }
 
-static int
-dump_v4_echo(ping_node *node, u_char *buf, int bytes, struct msghdr *hdr)
+static ping_node *
+dump_v4_echo(u_char *buf, int bytes, struct msghdr *hdr)
 {
-	int rc = -1; /* Try again */
 	int iplen, fromlen;
 	char from_host[1024];
 
 	struct ip *ip;
 	struct icmp *icp;
 	struct sockaddr *from;
+	ping_node *node = NULL;
 
 	if (hdr == NULL
 	    || !hdr->msg_name
 	    || hdr->msg_namelen != sizeof(struct sockaddr_in)
 	    || ((struct sockaddr *)hdr->msg_name)->sa_family != AF_INET) {
 	    crm_warn("Invalid echo peer");
-	    return rc;
+	    return NULL;
 	}
 
 	fromlen = hdr->msg_namelen;
@@ -796,116 +836,144 @@ dump_v4_echo(ping_node *node, u_char *buf, int bytes, struct msghdr *hdr)
 	
 	if (bytes < (iplen + sizeof(struct icmp))) {
 	    crm_warn("Invalid echo packet (too short: %d bytes) from %s", bytes, from_host);
-	    return rc;
+	    return NULL;
 	}
 
 	/* Check the IP header */
 	icp = (struct icmp*)(buf + iplen);
 
-	if (icp->icmp_type == ICMP_ECHOREPLY) {
-	    if (ident == ntohs(icp->icmp_id)
-		&& node->iseq == ntohs(icp->icmp_seq)) {
-		rc = 1; /* Alive */
-	    }
-
-	} else if(icp->icmp_type != ICMP_ECHO) {
-	    rc = process_icmp4_error(node, (struct sockaddr_in*)from);
+	if (icp->icmp_type == ICMP_ECHOREPLY && ident == ntohs(icp->icmp_id)) {
+	    node = ping_find(ntohs(icp->icmp_seq));
 	}
 
-	/* TODO: Stop logging icmp_id once we're sure everything works */
 	do_crm_log(LOG_DEBUG_2,
-		   "Echo from %s (exp=%d, seq=%d, id=%d, dest=%s, data=%s): %s",
-		   from_host, node->iseq, ntohs(icp->icmp_seq),
-		   ntohs(icp->icmp_id), node->dest, icp->icmp_data,
-		   ping_desc(node->type, icp->icmp_type, icp->icmp_code));
+		   "Echo from %s (seq=%d, id=%d, dest=%s, data=%s): %s",
+		   from_host, ntohs(icp->icmp_seq), ntohs(icp->icmp_id),
+		   node?node->dest:"-", icp->icmp_data,
+		   ping_desc(AF_INET, icp->icmp_type, icp->icmp_code));
 	
-	return rc;
+	return node;
 }
 
-static int
-ping_read(ping_node *node, int *lenp)
+static void
+ping_wheel_add(ping_node *node, int timeout_ms)
 {
-    int bytes;
+	int ticks = (timeout_ms + WHEEL_TICK_MS - 1) / WHEEL_TICK_MS;
+	if(ticks < 1) {
+	    ticks = 1;
+	}
+	
+	node->slot = (wheel_now + ticks) % WHEEL_SLOTS;
+	node->laps = (ticks - 1) / WHEEL_SLOTS;
+	ping_wheel[node->slot] = g_list_prepend(ping_wheel[node->slot], node);
+}
+
+static void
+ping_wheel_del(ping_node *node)
+{
+	if(node->slot >= 0) {
+	    ping_wheel[node->slot] = g_list_remove(ping_wheel[node->slot], node);
+	    node->slot = -1;
+	}
+}
+
+static void
+ping_result(ping_node *node, gboolean alive)
+{
+	ping_wheel_del(node);
+	node->pending = FALSE;
+	node->alive = alive;
+
+	if(alive) {
+	    round_active++;
+	}
+
+	round_outstanding--;
+	if(round_outstanding == 0) {
+	    crm_debug_2("Connectivity check complete: %d of %d hosts alive",
+			round_active, g_list_length(ping_list));
+	    round_in_progress = FALSE;
+	    send_update(round_active);
+	}
+}
+
+static gboolean
+ping_dispatch(int fd, gpointer user_data)
+{
+    int family = GPOINTER_TO_INT(user_data);
     char fromaddr[128];
     struct msghdr m;
-    struct cmsghdr *cm;
     u_char buf[1024];
-    struct iovec iov[2];
-    int saved_errno = 0;
-
-    struct timeval recv_start_time;
-    struct timeval recv_time;
-    int packlen;
-    u_char *packet;
-
-    gettimeofday(&recv_start_time, NULL);
-    packlen = DEFDATALEN + IP6LEN + ICMP6ECHOLEN + EXTRA;
-
-    crm_malloc0(packet, packlen);
-
-  retry:
-    m.msg_name = &fromaddr;
-    m.msg_namelen = sizeof(fromaddr);
-    memset(&iov, 0, sizeof(iov));
-    iov[0].iov_base = (caddr_t)packet;
-    iov[0].iov_len = packlen;
-    m.msg_iov = iov;
-    m.msg_iovlen = 1;
-    cm = (struct cmsghdr *)buf;
-    m.msg_control = (caddr_t)buf;
-    m.msg_controllen = sizeof(buf);
-
-
-    bytes = recvmsg(node->fd, &m, 0);
-    saved_errno = errno;
-    crm_debug_2("Got %d bytes", bytes);
-    
-    if(bytes < 0) {
-	crm_perror(LOG_DEBUG, "Read failed");
-	if (saved_errno != EAGAIN && saved_errno != EINTR) {
-	    int rc = 0;
-	    if(node->type == AF_INET6) {
-		rc = process_icmp6_error(node, (struct sockaddr_in6*)&(node->addr));
+    struct iovec iov;
+    u_char packet[DEFDATALEN + IP6LEN + ICMP6ECHOLEN + EXTRA];
+
+    while(TRUE) {
+	int bytes = 0;
+	ping_node *node = NULL;
+
+	memset(&m, 0, sizeof(m));
+	memset(&iov, 0, sizeof(iov));
+	m.msg_name = &fromaddr;
+	m.msg_namelen = sizeof(fromaddr);
+	iov.iov_base = (caddr_t)packet;
+	iov.iov_len = sizeof(packet);
+	m.msg_iov = &iov;
+	m.msg_iovlen = 1;
+	m.msg_control = (caddr_t)buf;
+	m.msg_controllen = sizeof(buf);
+
+	bytes = recvmsg(fd, &m, MSG_DONTWAIT);
+	crm_debug_3("Got %d bytes", bytes);
+
+	if(bytes < 0) {
+	    gboolean had_error = FALSE;
+	    if (errno == EINTR) {
+		continue;
+
+	    } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+		break;
+	    }
+
+	    /* Most likely an ICMP error for something we sent */
+	    if(family == AF_INET6) {
+		had_error = process_icmp6_error(fd);
 	    } else {
-		rc = process_icmp4_error(node, (struct sockaddr_in*)&fromaddr);
+		had_error = process_icmp4_error(fd);
 	    }
 
-	    if(rc < 0) {
-		crm_info("Retrying...");
-		goto retry;
+	    if(had_error == FALSE) {
+		crm_perror(LOG_DEBUG, "Read failed");
+		break;
 	    }
+	    continue;
+
+	} else if(bytes == 0) {
+	    crm_err("Unexpected reply");
+	    break;
 	}
 
-    } else if (bytes > 0) {
-	int rc = 0;
-	if(node->type == AF_INET6) {
-	    rc = dump_v6_echo(node, packet, bytes, &m);
+	if(family == AF_INET6) {
+	    node = dump_v6_echo(packet, bytes, &m);
 	} else {
-	    rc = dump_v4_echo(node, packet, bytes, &m);
+	    node = dump_v4_echo(packet, bytes, &m);
 	}
-
-	gettimeofday(&recv_time, NULL);
-	if ((recv_start_time.tv_sec + ping_timeout) < recv_time.tv_sec) {
-		crm_warn("failed to receive for timeout.");
-		crm_free(packet);
-		return FALSE;
+	
+	if(node != NULL && node->pending) {
+	    crm_debug("Node %s is alive", node->host);
+	    ping_result(node, TRUE);
 	}
+    }
 
-	if(rc < 0) {
-	    crm_info("Retrying...");
-	    goto retry;
-	    
-	} else if(rc > 0) {
-	    crm_free(packet);
-	    return TRUE;
-	}	
-	
+    /* Don't leave anything on the error queue or we'll be called again */
+    if(family == AF_INET6) {
+	while(process_icmp6_error(fd)) {
+	}
     } else {
-	crm_err("Unexpected reply");
+	while(process_icmp4_error(fd)) {
+	}
     }
-
-    crm_free(packet);
-    return FALSE;
+    
+    return TRUE;
 }
 
 static int
@@ -915,10 +983,8 @@ ping_write(ping_node *node, const char *data, size_t size)
 	int rc, bytes, namelen;
 	/* static int ntransmitted = 9; */
 	struct msghdr smsghdr;
-	u_char outpack[MAXPACKETLEN];
-	memset(outpack, 0, MAXPACKETLEN);
-
-	node->iseq++;
+	u_char outpack[ICMP6ECHOLEN + DEFDATALEN + EXTRA];
+	memset(outpack, 0, sizeof(outpack));
 
 	if(node->type == AF_INET6) {
 	    struct icmp6_hdr *icp;
@@ -973,10 +1039,12 @@ ping_write(ping_node *node, const char *data, size_t size)
 	iov.iov_len = bytes;
 	smsghdr.msg_iov = &iov;
 	smsghdr.msg_iovlen = 1;
-	smsghdr.msg_control = cmsgbuf;
-	smsghdr.msg_controllen = cmsglen;
+	if(node->ctl_len > 0) {
+	    smsghdr.msg_control = node->ctl.buf;
+	    smsghdr.msg_controllen = node->ctl_len;
+	}
 
-	rc = sendmsg(node->fd, &smsghdr, 0);
+	rc = sendmsg(node->fd, &smsghdr, MSG_DONTWAIT);
 
 	if (rc < 0 || rc != bytes) {
 	    crm_perror(LOG_WARNING, "Wrote %d of %d chars", rc, bytes);
@@ -1146,37 +1214,98 @@ do_node_walk(ll_cluster_t *hb_cluster)
 }
 #endif
 
+static void
+ping_send(ping_node *node)
+{
+    node->attempts++;
+    node->iseq = ++ping_seq;
+    g_hash_table_insert(ping_pending, GINT_TO_POINTER((int)node->iseq), node);
+
+    if(ping_write(node, "test", 4) == FALSE) {
+	crm_info("Node %s is unreachable (write)", node->host);
+    }
+
+    /* Spread the attempts across ping_timeout */
+    ping_wheel_add(node, (ping_timeout * 1000) / pings_per_host);
+}
+
+static gboolean ping_wheel_tick(gpointer data)
+{
+    GListPtr expired = NULL;
+
+    wheel_now = (wheel_now + 1) % WHEEL_SLOTS;
+    expired = ping_wheel[wheel_now];
+    ping_wheel[wheel_now] = NULL;
+
+    slist_iter(
+	ping, ping_node, expired, lpc,
+
+	ping->slot = -1;
+	if(ping->laps > 0) {
+	    ping->laps--;
+	    ping->slot = wheel_now;
+	    ping_wheel[wheel_now] = g_list_prepend(ping_wheel[wheel_now], ping);
+
+	} else if(ping->attempts < pings_per_host) {
+	    crm_debug_2("Retrying %s", ping->host);
+	    ping_send(ping);
+
+	} else {
+	    crm_info("Node %s is unreachable (read)", ping->host);
+	    ping_result(ping, FALSE);
+	}
+	);
+    g_list_free(expired);
+
+    if(round_in_progress == FALSE) {
+	wheel_timer = 0;
+	return FALSE;
+    }
+    return TRUE;
+}
+
 static gboolean stand_alone_ping(gpointer data)
 {
-    int num_active = 0;
-    
+    if(round_in_progress) {
+	crm_debug("Previous check still in progress (%d hosts outstanding)",
+		  round_outstanding);
+	return TRUE;
+    }
+
     crm_debug_2("Checking connectivity");
+
+    /* Late replies from previous rounds no longer match anything */
+    if(ping_pending != NULL) {
+	g_hash_table_destroy(ping_pending);
+    }
+    ping_pending = g_hash_table_new(g_direct_hash, g_direct_equal);
+
+    round_active = 0;
+    round_outstanding = 0;
+
     slist_iter(
 	ping, ping_node, ping_list, num, 
-	
-	if(ping_open(ping)) {
-	    int lpc = 0;
-	    for(;lpc < pings_per_host; lpc++) {
-		int len = 0;
-		if(ping_write(ping, "test", 4) == FALSE) {
-		    crm_info("Node %s is unreachable (write)", ping->host);
-
-		} else if(ping_read(ping, &len)) {
-		    crm_debug("Node %s is alive", ping->host);
-		    num_active++;
-		    break;
-		} else {
-		    crm_info("Node %s is unreachable (read)", ping->host);
-		}
-		sleep(1);
-	    }
+
+	ping->attempts = 0;
+	if(ping->alive == FALSE && ping_resolve(ping) == FALSE) {
+	    /* Look it up again next time */
+	    continue;
 	}
-	
-	ping_close(ping);
+
+	ping->pending = TRUE;
+	round_outstanding++;
+	ping_send(ping);
 	);
 
-    send_update(num_active);
+    if(round_outstanding == 0) {
+	send_update(0);
+	return TRUE;
+    }
 
+    round_in_progress = TRUE;
+    if(wheel_timer == 0) {
+	wheel_timer = g_timeout_add(WHEEL_TICK_MS, ping_wheel_tick, NULL);
+    }
     return TRUE;
 }
 
@@ -1194,7 +1323,7 @@ static struct crm_option long_options[] = {
     {"attr-set",        1, 0, 's', "\t(Advanced) Name of the set in which to put the attribute\n"},
     {"ping-interval",   1, 0, 'i', "How often, in seconds, to check for node liveliness (default=1)"},
     {"ping-attempts",   1, 0, 'n', "Number of ping attempts, per host, before declaring it dead (default=2)"},
-    {"ping-timeout",    1, 0, 't', "How long, in seconds, to wait before declaring a ping lost (default=2)"},
+    {"ping-timeout",    1, 0, 't', "How long, in seconds, to wait for all ping attempts to a host before declaring it dead (default=2)"},
     {"ping-multiplier", 1, 0, 'm', "For every connected node, add <integer> to the value set in the CIB"},
     {"no-updates",      0, 0, 'U', NULL, 1},
     
@@ -1304,6 +1433,13 @@ main(int argc, char **argv)
 	    crm_help(flag, LSB_EXIT_GENERIC);
 	}
 
+	if(pings_per_host < 1) {
+	    pings_per_host = 1;
+	}
+	if(ping_timeout < 1) {
+	    ping_timeout = 1;
+	}
+	
 	crm_make_daemon(crm_system_name, daemonize, pid_file);
 	ident = getpid();
 